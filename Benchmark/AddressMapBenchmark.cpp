@@ -0,0 +1,195 @@
+/**
+ * @file
+ * @brief Benchmark of address keys.
+ * The compact Address in one map is compared with the polymorphic AddressIP4 and AddressIP6 in a map per address
+ * type, which the storage used before. Keys are created from raw addresses like in the collector.
+ */
+
+#include <algorithm>
+#include <cstdio>
+
+#include "Benchmark.hpp"
+#include "Address.hpp"
+#include "StableHashMap.hpp"
+
+static const unsigned int RUNS = 3;
+
+struct RawAddress
+{
+	bool isIP6;
+	Address::RawAddr address;
+};
+
+class PerTypeMaps
+{
+	StableHashMap<AddressIP4, uint32_t> m_ip4Map;
+	StableHashMap<AddressIP6, uint32_t> m_ip6Map;
+
+public:
+	void insert(const RawAddress & raw, uint32_t value)
+	{
+		if (raw.isIP6)
+		{
+			m_ip6Map.emplace(AddressIP6(raw.address), value);
+		}
+		else
+		{
+			m_ip4Map.emplace(AddressIP4(raw.address[0]), value);
+		}
+	}
+
+	const uint32_t *find(const RawAddress & raw)
+	{
+		if (raw.isIP6)
+		{
+			auto pEntry = m_ip6Map.find(AddressIP6(raw.address));
+			return (pEntry) ? &pEntry->second : nullptr;
+		}
+		else
+		{
+			auto pEntry = m_ip4Map.find(AddressIP4(raw.address[0]));
+			return (pEntry) ? &pEntry->second : nullptr;
+		}
+	}
+
+	size_t getMemoryUsage() const
+	{
+		return m_ip4Map.getMemoryUsage() + m_ip6Map.getMemoryUsage();
+	}
+};
+
+class CompactMap
+{
+	StableHashMap<Address, uint32_t> m_map;
+
+	static Address CreateKey(const RawAddress & raw)
+	{
+		return (raw.isIP6) ? Address::CreateIP6(raw.address) : Address::CreateIP4(raw.address[0]);
+	}
+
+public:
+	void insert(const RawAddress & raw, uint32_t value)
+	{
+		m_map.emplace(CreateKey(raw), value);
+	}
+
+	const uint32_t *find(const RawAddress & raw)
+	{
+		auto pEntry = m_map.find(CreateKey(raw));
+		return (pEntry) ? &pEntry->second : nullptr;
+	}
+
+	size_t getMemoryUsage() const
+	{
+		return m_map.getMemoryUsage();
+	}
+};
+
+static std::vector<RawAddress> GenerateAddresses(size_t count, unsigned int ip6Percent)
+{
+	std::mt19937_64 & random = Benchmark::GetRandom();
+
+	std::vector<RawAddress> addresses(count);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		RawAddress & raw = addresses[i];
+		raw.isIP6 = random() % 100 < ip6Percent;
+
+		if (raw.isIP6)
+		{
+			// global unicast, never in the IPv4-mapped range
+			raw.address[0] = 0x20010db8 ^ (random() & 0x0FFFFFFF);
+			raw.address[1] = random();
+			raw.address[2] = random();
+			raw.address[3] = random();
+		}
+		else
+		{
+			// unique IPv4 addresses
+			raw.address[0] = static_cast<uint32_t>(i * 2654435761u);
+			raw.address[1] = 0;
+			raw.address[2] = 0;
+			raw.address[3] = 0;
+		}
+	}
+
+	return addresses;
+}
+
+template<class Map>
+static void RunMap(const char *name, const std::vector<RawAddress> & addresses,
+                   const std::vector<RawAddress> & shuffledAddresses)
+{
+	const size_t count = addresses.size();
+
+	double insertTime = 0;
+	double lookupTime = 0;
+	size_t memoryUsage = 0;
+	uint64_t checksum = 0;
+
+	for (unsigned int run = 0; run < RUNS; run++)
+	{
+		Map map;
+
+		const double runInsertTime = Benchmark::Measure([&]()
+		{
+			for (size_t i = 0; i < count; i++)
+			{
+				map.insert(addresses[i], i);
+			}
+		});
+
+		const double runLookupTime = Benchmark::Measure([&]()
+		{
+			for (const RawAddress & raw : shuffledAddresses)
+			{
+				const uint32_t *pValue = map.find(raw);
+				if (pValue)
+				{
+					checksum += *pValue + 1;
+				}
+			}
+		});
+
+		insertTime = (run == 0) ? runInsertTime : std::min(insertTime, runInsertTime);
+		lookupTime = (run == 0) ? runLookupTime : std::min(lookupTime, runLookupTime);
+		memoryUsage = map.getMemoryUsage();
+	}
+
+	std::printf("%-40s %10.1f B/entry\n", name, static_cast<double>(memoryUsage) / count);
+
+	Benchmark::Report("  insert", insertTime, count);
+	Benchmark::Report("  lookup", lookupTime, count);
+
+	if (checksum == 0)
+	{
+		std::printf("no entries found\n");
+	}
+}
+
+static void RunBenchmark()
+{
+	const size_t count = Benchmark::GetCount(1000000);
+
+	std::printf("key size: AddressIP4 %zu B, AddressIP6 %zu B, Address %zu B\n",
+	            sizeof (AddressIP4), sizeof (AddressIP6), sizeof (Address));
+
+	for (unsigned int ip6Percent : { 0, 20 })
+	{
+		const std::vector<RawAddress> addresses = GenerateAddresses(count, ip6Percent);
+
+		std::vector<RawAddress> shuffledAddresses = addresses;
+		std::shuffle(shuffledAddresses.begin(), shuffledAddresses.end(), Benchmark::GetRandom());
+
+		std::printf("\n%zu addresses, %u%% IPv6\n", count, ip6Percent);
+
+		RunMap<PerTypeMaps>("AddressIP4 and AddressIP6 maps", addresses, shuffledAddresses);
+		RunMap<CompactMap>("Address map", addresses, shuffledAddresses);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	return Benchmark::Run(argc, argv, RunBenchmark);
+}
@@ -0,0 +1,137 @@
+/**
+ * @file
+ * @brief Implementation of common code of benchmarks.
+ */
+
+#include <unistd.h>
+#include <cstdio>
+#include <memory>
+
+#include "Benchmark.hpp"
+#include "CmdLine.hpp"
+#include "Log.hpp"
+#include "Exception.hpp"
+#include "Thread.hpp"
+#include "Util.hpp"
+
+static Log::EVerbosity GetVerbosity()
+{
+	CmdLineArg *verbosityArg = gCmdLine->getArg("verbose");
+	if (!verbosityArg)
+	{
+		return Log::VERBOSITY_LOW;
+	}
+
+	switch (verbosityArg->getCount())
+	{
+		case 0:  return Log::VERBOSITY_LOW;
+		case 1:  return Log::VERBOSITY_NORMAL;
+		case 2:  return Log::VERBOSITY_HIGH;
+	}
+
+	return Log::VERBOSITY_DEBUG;
+}
+
+int Benchmark::Run(int argc, char *argv[], Function function)
+{
+	Thread::SetCurrentThreadName("Main");
+
+	std::unique_ptr<CmdLine> pCmdLine;
+	std::unique_ptr<Log> pLog;
+
+	try
+	{
+		pCmdLine = std::make_unique<CmdLine>(argc, argv);
+	}
+	catch (const CmdLineParseException & e)
+	{
+		std::fprintf(stderr, "%s\n", e.getString().c_str());
+		return 2;
+	}
+
+	gCmdLine = pCmdLine.get();
+
+	int status = 0;
+
+	try
+	{
+		pLog = std::make_unique<Log>(GetVerbosity(), Log::COLORIZE_NEVER, Log::STYLE_SIMPLE);
+		gLog = pLog.get();
+
+		function();
+	}
+	catch (const Exception & e)
+	{
+		if (!e.wasLogAvailable())
+		{
+			std::fprintf(stderr, "ERROR: %s\n", e.what());
+		}
+		status = 1;
+	}
+	catch (const std::exception & e)
+	{
+		std::fprintf(stderr, "ERROR: %s\n", e.what());
+		status = 1;
+	}
+
+	gLog = nullptr;
+	gCmdLine = nullptr;
+
+	return status;
+}
+
+unsigned long Benchmark::GetCount(unsigned long defaultValue)
+{
+	const std::vector<KString> & args = gCmdLine->getNonOptionArgs();
+	if (args.empty())
+	{
+		return defaultValue;
+	}
+
+	unsigned long count;
+	if (!Util::StringToUInt(args[0], count) || count == 0)
+	{
+		std::string errMsg = "Invalid count '";
+		errMsg += args[0];
+		errMsg += "'";
+		throw Exception(std::move(errMsg), "Benchmark");
+	}
+
+	return count;
+}
+
+std::mt19937_64 & Benchmark::GetRandom()
+{
+	static std::mt19937_64 random(42);
+
+	return random;
+}
+
+size_t Benchmark::GetResidentMemory()
+{
+	unsigned long size = 0;
+	unsigned long resident = 0;
+
+	FILE *file = std::fopen("/proc/self/statm", "r");
+	if (file)
+	{
+		if (std::fscanf(file, "%lu %lu", &size, &resident) != 2)
+		{
+			resident = 0;
+		}
+
+		std::fclose(file);
+	}
+
+	return resident * sysconf(_SC_PAGESIZE);
+}
+
+void Benchmark::Report(const KString & name, double milliseconds, unsigned long count)
+{
+	const double nanosecondsPerItem = (count > 0) ? milliseconds * 1e6 / count : 0;
+	const double itemsPerSecond = (milliseconds > 0) ? count / (milliseconds / 1000) : 0;
+
+	std::printf("%-40s %10.3f ms %10.1f ns/item %14.0f items/s\n", name.c_str(), milliseconds, nanosecondsPerItem,
+	            itemsPerSecond);
+	std::fflush(stdout);
+}
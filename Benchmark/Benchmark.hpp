@@ -0,0 +1,92 @@
+/**
+ * @file
+ * @brief Common code of benchmarks.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <chrono>
+#include <random>
+
+#include "KString.hpp"
+
+namespace Benchmark
+{
+	using Function = void (*)();
+
+	/**
+	 * @brief Creates global environment and runs a benchmark.
+	 * Usual command line options of the application are accepted, so for example -vvv enables debug log messages
+	 * of the measured code. Errors are printed and turned into exit code.
+	 * @return Exit code of the benchmark.
+	 */
+	int Run(int argc, char *argv[], Function function);
+
+	/**
+	 * @brief Returns the first non-option argument as a number.
+	 * @param defaultValue Value used if there is no such argument.
+	 */
+	unsigned long GetCount(unsigned long defaultValue);
+
+	/**
+	 * @brief Returns random number generator seeded by a fixed value, so each run uses the same data.
+	 */
+	std::mt19937_64 & GetRandom();
+
+	/**
+	 * @brief Returns resident memory of the process.
+	 * @return Number of bytes or zero if it is unknown.
+	 */
+	size_t GetResidentMemory();
+
+	/**
+	 * @brief Measures one run of a function.
+	 * @return Duration in milliseconds.
+	 */
+	template<class Function>
+	double Measure(Function function)
+	{
+		const auto startTime = std::chrono::steady_clock::now();
+
+		function();
+
+		const std::chrono::duration<double, std::milli> duration = std::chrono::steady_clock::now() - startTime;
+
+		return duration.count();
+	}
+
+	/**
+	 * @brief Measures a function.
+	 * @param runs Number of runs.
+	 * @param function The function. It is called once before the measured runs.
+	 * @return The shortest run in milliseconds.
+	 */
+	template<class Function>
+	double MeasureBest(unsigned int runs, Function function)
+	{
+		function();  // warm-up
+
+		double best = 0;
+
+		for (unsigned int i = 0; i < runs; i++)
+		{
+			const double duration = Measure(function);
+
+			if (i == 0 || duration < best)
+			{
+				best = duration;
+			}
+		}
+
+		return best;
+	}
+
+	/**
+	 * @brief Prints result of one measurement.
+	 * @param name Name of the measurement.
+	 * @param milliseconds Duration of the measurement.
+	 * @param count Number of processed items.
+	 */
+	void Report(const KString & name, double milliseconds, unsigned long count);
+}
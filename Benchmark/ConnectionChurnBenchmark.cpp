@@ -0,0 +1,135 @@
+/**
+ * @file
+ * @brief Soak benchmark of connection storage under churn.
+ * Short-lived UDP connections of a NAT gateway are added and removed in real time, each of them with a new remote
+ * address. Unused address and port data must be reclaimed after the grace period, which is set by the usual
+ * --data-grace-period option, so the storage stays flat. The benchmark fails if it does not.
+ */
+
+#include <arpa/inet.h>
+#include <algorithm>
+#include <cstdio>
+#include <deque>
+#include <thread>
+
+#include "Benchmark.hpp"
+#include "ConnectionStorage.hpp"
+#include "Exception.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+//! Number of new connections per second.
+static const size_t RATE = 50000;
+//! Number of live connections. The oldest connection is removed when a new one is added.
+static const size_t LIVE_COUNT = 20000;
+static const size_t LOCAL_ADDRESS_COUNT = 256;
+static const auto TICK = std::chrono::milliseconds(100);
+static const auto REPORT_INTERVAL = std::chrono::seconds(1);
+
+static double ToSeconds(Clock::duration duration)
+{
+	return std::chrono::duration<double>(duration).count();
+}
+
+static void RunBenchmark()
+{
+	ConnectionStorage storage;
+
+	const size_t count = Benchmark::GetCount(RATE * 20);
+	const double gracePeriod = ToSeconds(storage.getGracePeriod());
+	const double duration = static_cast<double>(count) / RATE;
+
+	// the remote addresses released during the grace period, one tick of delay and the live connections
+	const size_t maxAddressCount = LOCAL_ADDRESS_COUNT + LIVE_COUNT + RATE * (gracePeriod + 2 * ToSeconds(TICK));
+
+	std::printf("%zu connections, %zu per second, %zu live, grace period %.0f s\n", count, RATE, LIVE_COUNT,
+	            gracePeriod);
+
+	if (duration < gracePeriod + 2)
+	{
+		std::printf("The run is shorter than the grace period, use --data-grace-period=2 to check reclamation\n");
+	}
+
+	std::vector<AddressData*> localAddresses;
+	for (uint32_t i = 0; i < LOCAL_ADDRESS_COUNT; i++)
+	{
+		localAddresses.push_back(storage.addAddress(Address::CreateIP4(htonl(0x0A000000 | i))).first);
+	}
+
+	std::deque<Connection> liveConnections;
+
+	const size_t residentBefore = Benchmark::GetResidentMemory();
+	const Clock::time_point beginTime = Clock::now();
+	Clock::time_point tickTime = beginTime;
+	Clock::time_point reportTime = beginTime + REPORT_INTERVAL;
+
+	size_t addedCount = 0;
+	size_t maxCheckedAddressCount = 0;
+
+	while (addedCount < count)
+	{
+		const size_t tickCount = std::min<size_t>(RATE * ToSeconds(TICK), count - addedCount);
+
+		for (size_t i = 0; i < tickCount; i++, addedCount++)
+		{
+			// each connection has a new remote address, local addresses use all ephemeral ports in turn
+			const AddressData *pSrcAddress = localAddresses[addedCount % LOCAL_ADDRESS_COUNT];
+			const PortData *pSrcPort = storage.addPort(Port(EPortType::UDP, 1024 + addedCount % 64512)).first;
+			const Address dstAddress = Address::CreateIP4(htonl(0x01000000 + addedCount));
+			const AddressData *pDstAddress = storage.addAddress(dstAddress).first;
+			const PortData *pDstPort = storage.addPort(Port(EPortType::UDP, 53)).first;
+
+			const Connection connection(*pSrcAddress, *pSrcPort, *pDstAddress, *pDstPort);
+			liveConnections.push_back(storage.addConnection(connection, ConnectionTraffic()).first->getConnection());
+
+			if (liveConnections.size() > LIVE_COUNT)
+			{
+				storage.removeConnection(liveConnections.front());
+				liveConnections.pop_front();
+			}
+		}
+
+		tickTime += TICK;
+		std::this_thread::sleep_until(tickTime);
+
+		const Clock::time_point now = Clock::now();
+
+		if (now >= reportTime || addedCount == count)
+		{
+			const double elapsed = ToSeconds(now - beginTime);
+			const size_t addressCount = storage.getAddressCount();
+			const size_t residentGrowth = Benchmark::GetResidentMemory() - residentBefore;
+
+			std::printf("%6.1f s %10zu connections %10zu addresses %10zu ports %10.1f MiB resident growth\n",
+			            elapsed, storage.getConnectionCount(), addressCount, storage.getPortCount(),
+			            static_cast<double>(residentGrowth) / 1048576);
+			std::fflush(stdout);
+
+			if (elapsed > gracePeriod + 1)
+			{
+				maxCheckedAddressCount = std::max(maxCheckedAddressCount, addressCount);
+			}
+
+			reportTime += REPORT_INTERVAL;
+		}
+	}
+
+	const double rate = addedCount / ToSeconds(Clock::now() - beginTime);
+
+	std::printf("%.0f connections per second\n", rate);
+
+	if (maxCheckedAddressCount > maxAddressCount)
+	{
+		std::string errMsg = "Storage has ";
+		errMsg += std::to_string(maxCheckedAddressCount);
+		errMsg += " addresses, at most ";
+		errMsg += std::to_string(maxAddressCount);
+		errMsg += " are expected";
+		throw Exception(std::move(errMsg), "Benchmark");
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	return Benchmark::Run(argc, argv, RunBenchmark);
+}
@@ -0,0 +1,68 @@
+/**
+ * @file
+ * @brief Implementation of ConnectionGenerator class.
+ */
+
+#include <arpa/inet.h>
+
+#include "ConnectionGenerator.hpp"
+#include "Benchmark.hpp"
+
+//! Number of local addresses. Each of them uses all ephemeral ports before the next one is used.
+static const uint32_t LOCAL_ADDRESS_COUNT = 4096;
+//! Number of remote addresses.
+static const uint32_t REMOTE_ADDRESS_COUNT = 65536;
+
+ConnectionGenerator::ConnectionGenerator(ConnectionStorage & storage, size_t count)
+: m_connections()
+{
+	std::mt19937_64 & random = Benchmark::GetRandom();
+
+	std::vector<AddressData*> localAddresses;
+	std::vector<AddressData*> remoteAddresses;
+
+	for (uint32_t i = 0; i < LOCAL_ADDRESS_COUNT; i++)
+	{
+		localAddresses.push_back(storage.addAddress(Address::CreateIP4(htonl(0x0A000000 | i))).first);
+	}
+
+	for (uint32_t i = 0; i < REMOTE_ADDRESS_COUNT; i++)
+	{
+		remoteAddresses.push_back(storage.addAddress(Address::CreateIP4(random())).first);
+	}
+
+	m_connections.reserve(count);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		const EPortType portType = (random() % 5 == 0) ? EPortType::UDP : EPortType::TCP;
+
+		// the pair of local address and port is unique
+		const AddressData *pSrcAddress = localAddresses[i % LOCAL_ADDRESS_COUNT];
+		const PortData *pSrcPort = storage.addPort(Port(portType, 1024 + i / LOCAL_ADDRESS_COUNT)).first;
+		const AddressData *pDstAddress = remoteAddresses[random() % REMOTE_ADDRESS_COUNT];
+		const PortData *pDstPort = storage.addPort(Port(portType, (random() % 2) ? 443 : 80)).first;
+
+		m_connections.emplace_back(*pSrcAddress, *pSrcPort, *pDstAddress, *pDstPort);
+	}
+}
+
+void ConnectionGenerator::fill(ConnectionStorage & storage) const
+{
+	std::mt19937_64 & random = Benchmark::GetRandom();
+
+	storage.reserveConnections(m_connections.size());
+
+	for (const Connection & connection : m_connections)
+	{
+		ConnectionTraffic traffic;
+		traffic.rxPackets = random() % 100000;
+		traffic.txPackets = random() % 100000;
+		traffic.rxBytes = traffic.rxPackets * 1000;
+		traffic.txBytes = traffic.txPackets * 100;
+		traffic.rxSpeed = random() % 1000000;
+		traffic.txSpeed = random() % 100000;
+
+		storage.addConnection(connection, traffic);
+	}
+}
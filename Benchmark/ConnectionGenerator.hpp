@@ -0,0 +1,37 @@
+/**
+ * @file
+ * @brief ConnectionGenerator class.
+ */
+
+#pragma once
+
+#include <vector>
+
+#include "ConnectionStorage.hpp"
+
+/**
+ * @brief Generates unique connections with random addresses and ports.
+ * Addresses and ports are shared by connections like on a busy NAT gateway, and their data are owned by
+ * the storage. The connections themselves are not added to the storage.
+ */
+class ConnectionGenerator
+{
+	std::vector<Connection> m_connections;
+
+public:
+	/**
+	 * @param storage Storage of address and port data.
+	 * @param count Number of connections.
+	 */
+	ConnectionGenerator(ConnectionStorage & storage, size_t count);
+
+	/**
+	 * @brief Adds all connections to storage with random traffic.
+	 */
+	void fill(ConnectionStorage & storage) const;
+
+	const std::vector<Connection> & getConnections() const
+	{
+		return m_connections;
+	}
+};
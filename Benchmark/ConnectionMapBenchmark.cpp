@@ -0,0 +1,145 @@
+/**
+ * @file
+ * @brief Benchmark of connection map of the storage.
+ * StableHashMap is compared with std::unordered_map using the same keys and values as ConnectionStorage.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <unordered_map>
+
+#include "Benchmark.hpp"
+#include "ConnectionGenerator.hpp"
+#include "Exception.hpp"
+#include "StableHashMap.hpp"
+
+static const unsigned int RUNS = 5;
+
+struct MapResult
+{
+	double insertTime = 0;
+	double lookupTime = 0;
+	double iterationTime = 0;
+	double eraseTime = 0;
+
+	void update(const MapResult & run, bool isFirst)
+	{
+		insertTime = (isFirst) ? run.insertTime : std::min(insertTime, run.insertTime);
+		lookupTime = (isFirst) ? run.lookupTime : std::min(lookupTime, run.lookupTime);
+		iterationTime = (isFirst) ? run.iterationTime : std::min(iterationTime, run.iterationTime);
+		eraseTime = (isFirst) ? run.eraseTime : std::min(eraseTime, run.eraseTime);
+	}
+};
+
+static ConnectionData *Find(StableHashMap<Connection, ConnectionData> & map, const Connection & connection)
+{
+	auto pEntry = map.find(connection);
+	return (pEntry) ? &pEntry->second : nullptr;
+}
+
+static ConnectionData *Find(std::unordered_map<Connection, ConnectionData> & map, const Connection & connection)
+{
+	auto it = map.find(connection);
+	return (it != map.end()) ? &it->second : nullptr;
+}
+
+/**
+ * @brief Inserts all connections, looks them up in random order, iterates over all of them and erases them.
+ * The map is empty before and after each run.
+ */
+template<class Map>
+static MapResult RunMap(Map & map, const std::vector<Connection> & connections,
+                        const std::vector<Connection> & shuffledConnections)
+{
+	MapResult result;
+	uint64_t checksum = 0;
+
+	result.insertTime = Benchmark::Measure([&]()
+	{
+		for (const Connection & connection : connections)
+		{
+			map.emplace(connection, connection);
+		}
+	});
+
+	result.lookupTime = Benchmark::Measure([&]()
+	{
+		for (const Connection & connection : shuffledConnections)
+		{
+			const ConnectionData *pData = Find(map, connection);
+			if (pData)
+			{
+				checksum += pData->getTraffic().rxBytes + 1;
+			}
+		}
+	});
+
+	result.iterationTime = Benchmark::Measure([&]()
+	{
+		for (const auto & entry : map)
+		{
+			checksum += entry.second.getTraffic().rxSpeed + 1;
+		}
+	});
+
+	result.eraseTime = Benchmark::Measure([&]()
+	{
+		for (const Connection & connection : shuffledConnections)
+		{
+			map.erase(connection);
+		}
+	});
+
+	if (checksum != 2 * connections.size() || map.size() != 0)
+	{
+		throw Exception("Map lost some connections", "Benchmark");
+	}
+
+	return result;
+}
+
+template<class Map>
+static void RunBenchmark(const char *name, const std::vector<Connection> & connections,
+                         const std::vector<Connection> & shuffledConnections)
+{
+	Map map;
+	MapResult result;
+
+	RunMap(map, connections, shuffledConnections);  // warm-up
+
+	for (unsigned int i = 0; i < RUNS; i++)
+	{
+		result.update(RunMap(map, connections, shuffledConnections), i == 0);
+	}
+
+	const size_t count = connections.size();
+
+	std::string prefix = name;
+	prefix += ' ';
+
+	Benchmark::Report(prefix + "insert", result.insertTime, count);
+	Benchmark::Report(prefix + "lookup", result.lookupTime, count);
+	Benchmark::Report(prefix + "iteration", result.iterationTime, count);
+	Benchmark::Report(prefix + "erase", result.eraseTime, count);
+}
+
+static void RunBenchmark()
+{
+	ConnectionStorage storage;
+
+	const ConnectionGenerator gen(storage, Benchmark::GetCount(1000000));
+	const std::vector<Connection> & connections = gen.getConnections();
+
+	std::vector<Connection> shuffledConnections = connections;
+	std::shuffle(shuffledConnections.begin(), shuffledConnections.end(), Benchmark::GetRandom());
+
+	std::printf("%zu connections\n", connections.size());
+
+	RunBenchmark<StableHashMap<Connection, ConnectionData>>("StableHashMap", connections, shuffledConnections);
+	RunBenchmark<std::unordered_map<Connection, ConnectionData>>("unordered_map", connections, shuffledConnections);
+}
+
+int main(int argc, char *argv[])
+{
+	return Benchmark::Run(argc, argv, RunBenchmark);
+}
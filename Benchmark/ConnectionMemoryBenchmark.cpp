@@ -0,0 +1,85 @@
+/**
+ * @file
+ * @brief Memory used by each connection and iteration over all connections.
+ * Memory is reported as computed by the storage, which includes all hash map overhead, and as measured growth of
+ * resident memory of the process, which also includes overhead of the allocator. The memory budget of each connection
+ * is checked by connection_memory_test.
+ */
+
+#include <cstdio>
+
+#include "Benchmark.hpp"
+#include "ConnectionGenerator.hpp"
+
+#ifndef CONNTOP_DEDICATED
+#include "ConnectionIndex.hpp"
+#include "ConnectionList.hpp"
+#endif
+
+static const unsigned int RUNS = 5;
+
+static void ReportMemory(const char *name, size_t bytes, size_t count)
+{
+	std::printf("%-40s %10.1f MiB %10.1f B/connection\n", name, bytes / 1048576.0, static_cast<double>(bytes) / count);
+}
+
+static void RunBenchmark()
+{
+	ConnectionStorage storage;
+
+	const ConnectionGenerator gen(storage, Benchmark::GetCount(1000000));
+	const size_t count = gen.getConnections().size();
+
+	const size_t residentBefore = Benchmark::GetResidentMemory();
+
+	gen.fill(storage);
+
+	const size_t residentAfter = Benchmark::GetResidentMemory();
+
+	std::printf("%zu connections, %zu addresses, %zu ports\n", count, storage.getAddressCount(),
+	            storage.getPortCount());
+
+	ReportMemory("storage", storage.getConnectionMemoryUsage(), count);
+	ReportMemory("storage, resident memory growth", residentAfter - residentBefore, count);
+
+#ifndef CONNTOP_DEDICATED
+	std::vector<const ConnectionData*> connections;
+	connections.reserve(count);
+
+	for (auto it = storage.begin(); it != storage.end(); ++it)
+	{
+		connections.push_back(&it->second);
+	}
+
+	ConnectionIndex index(ConnectionList::GetSortOrder(EConnectionSortMode::RX_SPEED, false));
+	index.assign(connections, index.getOrder());
+
+	ReportMemory("sorted index", index.getMemoryUsage(), count);
+#endif
+
+	// the same data as connection list needs to refresh its rows
+	uint64_t checksum = 0;
+
+	const double time = Benchmark::MeasureBest(RUNS, [&storage, &checksum]()
+	{
+		for (const auto & entry : storage)
+		{
+			const ConnectionData & data = entry.second;
+
+			checksum += data.getTraffic().rxSpeed + data.getTraffic().txSpeed + data.getState();
+			checksum += data.getConnection().hasPorts() + static_cast<int>(data.getType());
+		}
+	});
+
+	Benchmark::Report("iteration", time, count);
+
+	if (checksum == 0)
+	{
+		std::printf("no traffic\n");
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	return Benchmark::Run(argc, argv, RunBenchmark);
+}
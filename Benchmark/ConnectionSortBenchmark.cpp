@@ -0,0 +1,98 @@
+/**
+ * @file
+ * @brief Benchmark of sorting all connections when sort mode of connection list changes.
+ * The whole index is rebuilt with different number of threads and each result is checked against the result of
+ * a single thread, so ties must keep the same order too.
+ */
+
+#include <cstdio>
+#include <thread>
+
+#include "Benchmark.hpp"
+#include "ConnectionGenerator.hpp"
+#include "ConnectionIndex.hpp"
+#include "ConnectionList.hpp"
+#include "Exception.hpp"
+
+static const unsigned int RUNS = 3;
+
+struct SortMode
+{
+	const char *name;
+	EConnectionSortMode mode;
+};
+
+static const SortMode SORT_MODES[] = {
+	{ "RX speed", EConnectionSortMode::RX_SPEED },
+	{ "destination address", EConnectionSortMode::DST_ADDRESS },
+	{ "destination port", EConnectionSortMode::DST_PORT },
+};
+
+static std::vector<const ConnectionData*> GetOrder(const ConnectionIndex & index)
+{
+	std::vector<const ConnectionData*> result;
+	result.reserve(index.size());
+
+	index.forEach(0, index.size(), [&result](const ConnectionData *pConnection)
+	{
+		result.push_back(pConnection);
+	});
+
+	return result;
+}
+
+static void RunBenchmark()
+{
+	ConnectionStorage storage;
+
+	const ConnectionGenerator gen(storage, Benchmark::GetCount(1000000));
+	gen.fill(storage);
+
+	std::vector<const ConnectionData*> connections;
+	connections.reserve(storage.getConnectionCount());
+
+	for (auto it = storage.begin(); it != storage.end(); ++it)
+	{
+		connections.push_back(&it->second);
+	}
+
+	std::printf("%zu connections, %u hardware threads\n", connections.size(), std::thread::hardware_concurrency());
+
+	for (const SortMode & sortMode : SORT_MODES)
+	{
+		const ConnectionIndex::Order order = ConnectionList::GetSortOrder(sortMode.mode, false);
+
+		ConnectionIndex index(order);
+		std::vector<const ConnectionData*> expectedOrder;
+
+		// zero is the automatic number of threads used by connection list
+		for (unsigned int threadCount : { 1, 2, 4, 8, 0 })
+		{
+			const double time = Benchmark::MeasureBest(RUNS, [&]()
+			{
+				index.assign(connections, order, threadCount);
+			});
+
+			std::string name = sortMode.name;
+			name += ", ";
+			name += (threadCount > 0) ? std::to_string(threadCount) : "auto";
+			name += (threadCount == 1) ? " thread" : " threads";
+
+			Benchmark::Report(name, time, connections.size());
+
+			if (threadCount == 1)
+			{
+				expectedOrder = GetOrder(index);
+			}
+			else if (GetOrder(index) != expectedOrder)
+			{
+				throw Exception("Order differs from the order of a single thread", "Benchmark");
+			}
+		}
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	return Benchmark::Run(argc, argv, RunBenchmark);
+}
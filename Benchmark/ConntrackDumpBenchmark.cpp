@@ -0,0 +1,130 @@
+/**
+ * @file
+ * @brief Benchmark of serial and parallel conntrack table dumps.
+ * Each dump does the same work as the Netfilter collector after the kernel sends the entries - parses messages,
+ * stores counters to the table copy, computes changes and creates the batch. Receiving from the socket is not
+ * included, so only the userspace part that is split between threads is measured.
+ */
+
+#include <sys/socket.h>
+#include <cstdio>
+#include <thread>
+
+#include "Benchmark.hpp"
+#include "ConntrackDumpGenerator.hpp"
+#include "Collector_Common/ConntrackTable.hpp"
+#include "Collector_Netfilter/ConntrackBatch.hpp"
+#include "Collector_Netfilter/ConntrackNetlink.hpp"
+#include "Thread.hpp"
+
+static const unsigned int RUNS = 5;
+
+/**
+ * @brief Table of one address family with two dumps that differ in all counters.
+ * Dumps are used alternately, so each run finds changes in all entries like a busy system would.
+ */
+struct FamilyDump
+{
+	ConntrackDumpGenerator generator;
+	std::vector<std::string> dumps[2];
+	ConntrackTable table;
+	ConntrackBatch batch;
+	unsigned int runCount;
+
+	FamilyDump(size_t count, int addressFamily)
+	: generator(count, addressFamily),
+	  dumps(),
+	  table(),
+	  batch(),
+	  runCount(0)
+	{
+		dumps[0] = generator.createDump(true);
+		generator.advance(100);
+		dumps[1] = generator.createDump(true);
+
+		table.reserve(count);
+
+		for (const ConntrackRecord & record : generator.getRecords())
+		{
+			table.add(record.tuple, ConnectionTraffic(), 0);
+		}
+	}
+};
+
+static void RunDump(FamilyDump & dump)
+{
+	ConntrackTable & table = dump.table;
+
+	dump.batch.clear();
+	table.beginGeneration();
+
+	const std::vector<std::string> & messages = dump.dumps[dump.runCount % 2];
+	dump.runCount++;
+
+	ConntrackDumpGenerator::ForEachEntry(messages, [&table](const nlmsghdr *nlh, unsigned long)
+	{
+		ConntrackRecord record;
+		ConntrackDumpSocket::ParseEntry(nlh, record);
+
+		const uint32_t row = table.find(record.tuple);
+		if (row == ConntrackTable::NO_ROW)
+		{
+			return;
+		}
+
+		table.mark(row);
+		table.setDumpedCounters(row, record.rxPackets, record.txPackets, record.rxBytes, record.txBytes);
+	});
+
+	table.commitCounters(1, [&dump](uint32_t row, int updateFlags) -> void
+	{
+		dump.batch.addUpdate(dump.table.getTuple(row), dump.table.getTraffic(row), dump.table.getState(row),
+		                     updateFlags);
+	});
+}
+
+static void RunBenchmark()
+{
+	const unsigned long count = Benchmark::GetCount(1000000);
+
+	FamilyDump ip4Dump(count / 2, AF_INET);
+	FamilyDump ip6Dump(count - count / 2, AF_INET6);
+	ConntrackBatch batch;
+
+	std::printf("%lu entries (%lu IPv4, %lu IPv6), %u hardware threads\n", count, count / 2, count - count / 2,
+	            std::thread::hardware_concurrency());
+
+	const double serialTime = Benchmark::MeasureBest(RUNS, [&]()
+	{
+		RunDump(ip4Dump);
+		RunDump(ip6Dump);
+
+		batch.clear();
+		batch.append(ip4Dump.batch);
+		batch.append(ip6Dump.batch);
+	});
+
+	Benchmark::Report("serial dump", serialTime, count);
+
+	const double parallelTime = Benchmark::MeasureBest(RUNS, [&]()
+	{
+		Thread worker("Dump IPv6", [&ip6Dump]() { RunDump(ip6Dump); });
+
+		RunDump(ip4Dump);
+
+		worker.join();
+
+		batch.clear();
+		batch.append(ip4Dump.batch);
+		batch.append(ip6Dump.batch);
+	});
+
+	Benchmark::Report("parallel dump", parallelTime, count);
+
+	std::printf("speed-up %.2fx, %zu changed entries\n", serialTime / parallelTime, batch.getSize());
+}
+
+int main(int argc, char *argv[])
+{
+	return Benchmark::Run(argc, argv, RunBenchmark);
+}
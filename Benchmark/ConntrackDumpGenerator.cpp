@@ -0,0 +1,255 @@
+/**
+ * @file
+ * @brief Implementation of ConntrackDumpGenerator class.
+ */
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <endian.h>
+#include <linux/netlink.h>
+#include <linux/netfilter/nfnetlink.h>
+#include <linux/netfilter/nfnetlink_conntrack.h>
+#include <linux/netfilter/nf_conntrack_tcp.h>
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+
+#include "ConntrackDumpGenerator.hpp"
+#include "Benchmark.hpp"
+
+//! Size of receive buffer of the ctnetlink parser.
+static const size_t BUFFER_SIZE = 65536;
+
+static void AppendAttr(std::string & buffer, uint16_t type, const void *data, size_t length)
+{
+	nlattr attr = {};
+	attr.nla_len = NLA_HDRLEN + length;
+	attr.nla_type = type;
+
+	buffer.append(reinterpret_cast<const char*>(&attr), NLA_HDRLEN);
+	buffer.append(static_cast<const char*>(data), length);
+	buffer.append(NLA_ALIGN(length) - length, '\0');
+}
+
+template<class T>
+static void AppendAttr(std::string & buffer, uint16_t type, T value)
+{
+	AppendAttr(buffer, type, &value, sizeof value);
+}
+
+/**
+ * @return Position of the nested attribute, which is passed to EndNested.
+ */
+static size_t BeginNested(std::string & buffer, uint16_t type)
+{
+	const size_t pos = buffer.length();
+
+	AppendAttr(buffer, type | NLA_F_NESTED, nullptr, 0);
+
+	return pos;
+}
+
+static void EndNested(std::string & buffer, size_t pos)
+{
+	const uint16_t length = buffer.length() - pos;
+
+	std::memcpy(&buffer[pos], &length, sizeof length);
+}
+
+static void AppendTuple(std::string & buffer, uint16_t type, const ConntrackTuple & tuple, bool isReply)
+{
+	const uint32_t *srcAddr = (isReply) ? tuple.dstAddr : tuple.srcAddr;
+	const uint32_t *dstAddr = (isReply) ? tuple.srcAddr : tuple.dstAddr;
+	const uint16_t srcPort = (isReply) ? tuple.dstPort : tuple.srcPort;
+	const uint16_t dstPort = (isReply) ? tuple.srcPort : tuple.dstPort;
+
+	const size_t tuplePos = BeginNested(buffer, type);
+
+	const size_t ipPos = BeginNested(buffer, CTA_TUPLE_IP);
+	if (tuple.l3proto == AF_INET6)
+	{
+		AppendAttr(buffer, CTA_IP_V6_SRC, srcAddr, 16);
+		AppendAttr(buffer, CTA_IP_V6_DST, dstAddr, 16);
+	}
+	else
+	{
+		AppendAttr(buffer, CTA_IP_V4_SRC, srcAddr, 4);
+		AppendAttr(buffer, CTA_IP_V4_DST, dstAddr, 4);
+	}
+	EndNested(buffer, ipPos);
+
+	const size_t protoPos = BeginNested(buffer, CTA_TUPLE_PROTO);
+	AppendAttr<uint8_t>(buffer, CTA_PROTO_NUM, tuple.l4proto);
+	AppendAttr<uint16_t>(buffer, CTA_PROTO_SRC_PORT, htons(srcPort));
+	AppendAttr<uint16_t>(buffer, CTA_PROTO_DST_PORT, htons(dstPort));
+	EndNested(buffer, protoPos);
+
+	EndNested(buffer, tuplePos);
+}
+
+static void AppendCounters(std::string & buffer, uint16_t type, uint64_t packets, uint64_t bytes)
+{
+	const size_t pos = BeginNested(buffer, type);
+	AppendAttr<uint64_t>(buffer, CTA_COUNTERS_PACKETS, htobe64(packets));
+	AppendAttr<uint64_t>(buffer, CTA_COUNTERS_BYTES, htobe64(bytes));
+	EndNested(buffer, pos);
+}
+
+/**
+ * @brief Appends one entry with the same attributes as kernel puts into dump messages.
+ */
+static void AppendEntry(std::string & buffer, const ConntrackRecord & record, uint32_t id)
+{
+	const size_t messagePos = buffer.length();
+
+	nlmsghdr nlh = {};
+	nlh.nlmsg_type = (NFNL_SUBSYS_CTNETLINK << 8) | IPCTNL_MSG_CT_NEW;
+	nlh.nlmsg_flags = NLM_F_MULTI;
+	nlh.nlmsg_seq = 1;
+
+	nfgenmsg nfmsg = {};
+	nfmsg.nfgen_family = record.tuple.l3proto;
+	nfmsg.version = NFNETLINK_V0;
+
+	buffer.append(reinterpret_cast<const char*>(&nlh), NLMSG_HDRLEN);
+	buffer.append(reinterpret_cast<const char*>(&nfmsg), sizeof nfmsg);
+	buffer.append(NLMSG_ALIGN(sizeof nfmsg) - sizeof nfmsg, '\0');
+
+	AppendTuple(buffer, CTA_TUPLE_ORIG, record.tuple, false);
+	AppendTuple(buffer, CTA_TUPLE_REPLY, record.tuple, true);
+	AppendAttr<uint32_t>(buffer, CTA_STATUS, htonl(0x18E));  // confirmed, assured, seen reply
+	AppendAttr<uint32_t>(buffer, CTA_TIMEOUT, htonl(431999));
+
+	if (record.hasTCPState)
+	{
+		const uint8_t flags[2] = { 0x0A, 0x0A };
+
+		const size_t protoInfoPos = BeginNested(buffer, CTA_PROTOINFO);
+		const size_t tcpPos = BeginNested(buffer, CTA_PROTOINFO_TCP);
+		AppendAttr<uint8_t>(buffer, CTA_PROTOINFO_TCP_STATE, record.tcpState);
+		AppendAttr<uint8_t>(buffer, CTA_PROTOINFO_TCP_WSCALE_ORIGINAL, 7);
+		AppendAttr<uint8_t>(buffer, CTA_PROTOINFO_TCP_WSCALE_REPLY, 7);
+		AppendAttr(buffer, CTA_PROTOINFO_TCP_FLAGS_ORIGINAL, flags, sizeof flags);
+		AppendAttr(buffer, CTA_PROTOINFO_TCP_FLAGS_REPLY, flags, sizeof flags);
+		EndNested(buffer, tcpPos);
+		EndNested(buffer, protoInfoPos);
+	}
+
+	AppendCounters(buffer, CTA_COUNTERS_ORIG, record.txPackets, record.txBytes);
+	AppendCounters(buffer, CTA_COUNTERS_REPLY, record.rxPackets, record.rxBytes);
+	AppendAttr<uint32_t>(buffer, CTA_MARK, htonl(record.mark));
+	AppendAttr<uint32_t>(buffer, CTA_ID, htonl(id));
+	AppendAttr<uint32_t>(buffer, CTA_USE, htonl(1));
+
+	const uint32_t messageLength = buffer.length() - messagePos;
+
+	std::memcpy(&buffer[messagePos], &messageLength, sizeof messageLength);
+}
+
+static void AppendDone(std::string & buffer)
+{
+	nlmsghdr nlh = {};
+	nlh.nlmsg_len = NLMSG_LENGTH(sizeof (int));
+	nlh.nlmsg_type = NLMSG_DONE;
+	nlh.nlmsg_flags = NLM_F_MULTI;
+	nlh.nlmsg_seq = 1;
+
+	const int status = 0;
+
+	buffer.append(reinterpret_cast<const char*>(&nlh), NLMSG_HDRLEN);
+	buffer.append(reinterpret_cast<const char*>(&status), sizeof status);
+}
+
+ConntrackDumpGenerator::ConntrackDumpGenerator(size_t count, int addressFamily)
+: m_records(count)
+{
+	std::mt19937_64 & random = Benchmark::GetRandom();
+
+	for (ConntrackRecord & record : m_records)
+	{
+		record = ConntrackRecord();
+
+		ConntrackTuple & tuple = record.tuple;
+		tuple.l3proto = addressFamily;
+		tuple.l4proto = (random() % 5 == 0) ? IPPROTO_UDP : IPPROTO_TCP;
+
+		if (addressFamily == AF_INET6)
+		{
+			for (int i = 0; i < 4; i++)
+			{
+				tuple.srcAddr[i] = random();
+				tuple.dstAddr[i] = random();
+			}
+		}
+		else
+		{
+			tuple.srcAddr[0] = htonl(0x0A000000 | (random() & 0xFFFFFF));  // 10.0.0.0/8
+			tuple.dstAddr[0] = random();
+		}
+
+		tuple.srcPort = 1024 + random() % 64512;
+		tuple.dstPort = (random() % 2) ? 443 : random() % 65536;
+
+		record.rxPackets = random() % 100000;
+		record.txPackets = random() % 100000;
+		record.rxBytes = record.rxPackets * 1000;
+		record.txBytes = record.txPackets * 100;
+
+		if (tuple.l4proto == IPPROTO_TCP)
+		{
+			record.tcpState = TCP_CONNTRACK_ESTABLISHED;
+			record.hasTCPState = true;
+		}
+	}
+}
+
+void ConntrackDumpGenerator::advance(unsigned int changedPercent)
+{
+	std::mt19937_64 & random = Benchmark::GetRandom();
+
+	for (ConntrackRecord & record : m_records)
+	{
+		if (random() % 100 < changedPercent)
+		{
+			const uint64_t rxPackets = 1 + random() % 100;
+			const uint64_t txPackets = 1 + random() % 100;
+
+			record.rxPackets += rxPackets;
+			record.txPackets += txPackets;
+			record.rxBytes += rxPackets * 1000;
+			record.txBytes += txPackets * 100;
+		}
+	}
+}
+
+std::vector<std::string> ConntrackDumpGenerator::createDump(bool shuffle) const
+{
+	std::vector<size_t> order(m_records.size());
+	std::iota(order.begin(), order.end(), 0);
+
+	if (shuffle)
+	{
+		std::shuffle(order.begin(), order.end(), Benchmark::GetRandom());
+	}
+
+	std::vector<std::string> buffers(1);
+	std::string entry;
+
+	for (size_t i : order)
+	{
+		entry.clear();
+		AppendEntry(entry, m_records[i], i);
+
+		if (buffers.back().length() + entry.length() > BUFFER_SIZE)
+		{
+			buffers.emplace_back();
+		}
+
+		buffers.back() += entry;
+	}
+
+	AppendDone(buffers.back());
+
+	return buffers;
+}
@@ -0,0 +1,72 @@
+/**
+ * @file
+ * @brief ConntrackDumpGenerator class.
+ */
+
+#pragma once
+
+#include <linux/netlink.h>
+#include <string>
+#include <vector>
+
+#include "Collector_Common/ConntrackRecord.hpp"
+
+/**
+ * @brief Generates conntrack table dumps in the same ctnetlink format as kernel.
+ * Entries have random addresses and ports, so they are spread over the whole hash table like real ones.
+ */
+class ConntrackDumpGenerator
+{
+	std::vector<ConntrackRecord> m_records;
+
+public:
+	/**
+	 * @param count Number of entries.
+	 * @param addressFamily AF_INET or AF_INET6.
+	 */
+	ConntrackDumpGenerator(size_t count, int addressFamily);
+
+	/**
+	 * @brief Increases traffic counters of some entries, so the next dump has changes.
+	 * @param changedPercent Percent of entries that are changed.
+	 */
+	void advance(unsigned int changedPercent);
+
+	/**
+	 * @brief Creates dump messages.
+	 * Messages are split into buffers of the same size as receive buffer of the ctnetlink parser, so each buffer is
+	 * what one receive call would return.
+	 * @param shuffle Entries are dumped in random order if true, otherwise in order of creation.
+	 */
+	std::vector<std::string> createDump(bool shuffle = false) const;
+
+	const std::vector<ConntrackRecord> & getRecords() const
+	{
+		return m_records;
+	}
+
+	/**
+	 * @brief Calls callback with each entry message of a dump and its index.
+	 * @return Number of entries.
+	 */
+	template<class Callback>
+	static unsigned long ForEachEntry(const std::vector<std::string> & dump, Callback callback)
+	{
+		unsigned long count = 0;
+
+		for (const std::string & buffer : dump)
+		{
+			int length = buffer.length();
+
+			for (const nlmsghdr *nlh = reinterpret_cast<const nlmsghdr*>(buffer.data());
+			     NLMSG_OK(nlh, length) && nlh->nlmsg_type != NLMSG_DONE;
+			     nlh = NLMSG_NEXT(nlh, length))
+			{
+				callback(nlh, count);
+				count++;
+			}
+		}
+
+		return count;
+	}
+};
@@ -0,0 +1,138 @@
+/**
+ * @file
+ * @brief Benchmark of ctnetlink message parsers.
+ * The same conntrack table dump is parsed by raw parser of the Netfilter collector and by libnetfilter_conntrack.
+ */
+
+#include <cstdio>
+
+#include "Benchmark.hpp"
+#include "ConntrackDumpGenerator.hpp"
+#include "Collector_Netfilter/Conntrack.hpp"
+#include "Collector_Netfilter/ConntrackNetlink.hpp"
+#include "Exception.hpp"
+
+static const unsigned int RUNS = 5;
+
+static bool IsEqual(const ConntrackRecord & a, const ConntrackRecord & b)
+{
+	return a.tuple == b.tuple
+	    && a.rxPackets == b.rxPackets
+	    && a.txPackets == b.txPackets
+	    && a.rxBytes == b.rxBytes
+	    && a.txBytes == b.txBytes
+	    && a.mark == b.mark
+	    && a.zone == b.zone
+	    && a.hasTCPState == b.hasTCPState
+	    && a.tcpState == b.tcpState;
+}
+
+static void ParseRaw(const std::vector<std::string> & dump, std::vector<ConntrackRecord> & records)
+{
+	ConntrackDumpGenerator::ForEachEntry(dump, [&records](const nlmsghdr *nlh, unsigned long index)
+	{
+		ConntrackDumpSocket::ParseEntry(nlh, records[index]);
+	});
+}
+
+static void ParseLibrary(const std::vector<std::string> & dump, std::vector<ConntrackRecord> & records)
+{
+	// the collector used a new object for each entry, just like libnetfilter_conntrack callback API does
+	ConntrackDumpGenerator::ForEachEntry(dump, [&records](const nlmsghdr *nlh, unsigned long index)
+	{
+		nf_conntrack *ct = nfct_new();
+		if (!ct)
+		{
+			throw Exception("Unable to create conntrack object", "Benchmark");
+		}
+
+		if (nfct_parse_conntrack(NFCT_T_ALL, nlh, ct) < 0)
+		{
+			nfct_destroy(ct);
+			throw Exception("Unable to parse conntrack entry with libnetfilter_conntrack", "Benchmark");
+		}
+
+		records[index] = ConntrackRecord();
+		Conntrack::FillRecord(records[index], ct);
+
+		nfct_destroy(ct);
+	});
+}
+
+static unsigned long CountMismatches(const std::vector<ConntrackRecord> & records, const ConntrackDumpGenerator & gen)
+{
+	unsigned long count = 0;
+
+	for (size_t i = 0; i < records.size(); i++)
+	{
+		if (!IsEqual(records[i], gen.getRecords()[i]))
+		{
+			count++;
+		}
+	}
+
+	return count;
+}
+
+static void RunFamily(unsigned long count, int addressFamily, const char *familyName)
+{
+	const ConntrackDumpGenerator gen(count, addressFamily);
+	const std::vector<std::string> dump = gen.createDump();
+
+	size_t dumpSize = 0;
+	for (const std::string & buffer : dump)
+	{
+		dumpSize += buffer.length();
+	}
+
+	std::printf("%s: %lu entries, %zu buffers, %zu bytes\n", familyName, count, dump.size(), dumpSize);
+
+	std::vector<ConntrackRecord> records(count);
+
+	std::string name = familyName;
+	name += " raw parser";
+
+	double time = Benchmark::MeasureBest(RUNS, [&]() { ParseRaw(dump, records); });
+	Benchmark::Report(name, time, count);
+
+	if (const unsigned long mismatchCount = CountMismatches(records, gen))
+	{
+		std::string errMsg = "Raw parser result differs in ";
+		errMsg += std::to_string(mismatchCount);
+		errMsg += " entries";
+		throw Exception(std::move(errMsg), "Benchmark");
+	}
+
+	name = familyName;
+	name += " libnetfilter_conntrack";
+
+	try
+	{
+		time = Benchmark::MeasureBest(RUNS, [&]() { ParseLibrary(dump, records); });
+	}
+	catch (const Exception & e)
+	{
+		std::printf("%-40s failed: %s\n", name.c_str(), e.what());
+		return;
+	}
+
+	Benchmark::Report(name, time, count);
+
+	if (const unsigned long mismatchCount = CountMismatches(records, gen))
+	{
+		std::printf("WARNING: libnetfilter_conntrack result differs in %lu entries\n", mismatchCount);
+	}
+}
+
+static void RunBenchmark()
+{
+	const unsigned long count = Benchmark::GetCount(100000);
+
+	RunFamily(count, AF_INET, "IPv4");
+	RunFamily(count, AF_INET6, "IPv6");
+}
+
+int main(int argc, char *argv[])
+{
+	return Benchmark::Run(argc, argv, RunBenchmark);
+}
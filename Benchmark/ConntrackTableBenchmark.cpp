@@ -0,0 +1,270 @@
+/**
+ * @file
+ * @brief Benchmark of applying a dump to conntrack table copy of the collector.
+ * Columnar ConntrackTable, which computes changes of all entries at once after the dump, is compared with
+ * the previous per-entry computation done during the dump. The per-entry path is measured with both std::unordered_map
+ * it used before and StableHashMap, so the gain of the columnar layout alone can be seen.
+ */
+
+#include <sys/socket.h>
+#include <algorithm>
+#include <cstdio>
+#include <numeric>
+#include <unordered_map>
+
+#include "Benchmark.hpp"
+#include "ConntrackDumpGenerator.hpp"
+#include "Collector_Common/ConntrackTable.hpp"
+#include "Collector_Netfilter/ConntrackBatch.hpp"
+#include "Exception.hpp"
+#include "StableHashMap.hpp"
+
+static const unsigned int RUNS = 5;
+
+//! Time between dumps in seconds.
+static const double SECONDS = 1;
+
+/**
+ * @brief Copy of conntrack table with changes computed during the dump entry by entry.
+ */
+template<template<class...> class Map>
+class PerEntryTable
+{
+	struct Entry
+	{
+		ConnectionTraffic traffic;
+		int state;
+		unsigned int generation;
+
+		Entry(const ConnectionTraffic & entryTraffic, int entryState, unsigned int entryGeneration)
+		: traffic(entryTraffic),
+		  state(entryState),
+		  generation(entryGeneration)
+		{
+		}
+	};
+
+	Map<ConntrackTuple, Entry> m_entries;
+	unsigned int m_generation;
+
+	static Entry *Find(StableHashMap<ConntrackTuple, Entry> & map, const ConntrackTuple & tuple)
+	{
+		auto pEntry = map.find(tuple);
+		return (pEntry) ? &pEntry->second : nullptr;
+	}
+
+	static Entry *Find(std::unordered_map<ConntrackTuple, Entry> & map, const ConntrackTuple & tuple)
+	{
+		auto it = map.find(tuple);
+		return (it != map.end()) ? &it->second : nullptr;
+	}
+
+public:
+	PerEntryTable()
+	: m_entries(),
+	  m_generation(0)
+	{
+	}
+
+	void add(const ConntrackTuple & tuple)
+	{
+		m_entries.emplace(tuple, Entry(ConnectionTraffic(), 0, m_generation));
+	}
+
+	void beginGeneration()
+	{
+		m_generation++;
+	}
+
+	/**
+	 * @brief The same computation as the collector did for each dumped entry.
+	 */
+	void handleEntry(const ConntrackRecord & record, ConntrackBatch & batch)
+	{
+		Entry *pEntry = Find(m_entries, record.tuple);
+		if (!pEntry)
+		{
+			return;
+		}
+
+		pEntry->generation = m_generation;
+
+		int updateFlags = 0;
+		uint64_t speed;
+
+		ConnectionTraffic & traffic = pEntry->traffic;
+
+		if (traffic.rxPackets != record.rxPackets)
+		{
+			traffic.rxPackets = record.rxPackets;
+			updateFlags |= EConnectionUpdateFlags::RX_PACKETS;
+		}
+
+		if (traffic.txPackets != record.txPackets)
+		{
+			traffic.txPackets = record.txPackets;
+			updateFlags |= EConnectionUpdateFlags::TX_PACKETS;
+		}
+
+		speed = static_cast<uint64_t>((record.rxBytes - traffic.rxBytes) / SECONDS);
+		if (traffic.rxBytes != record.rxBytes)
+		{
+			traffic.rxBytes = record.rxBytes;
+			updateFlags |= EConnectionUpdateFlags::RX_BYTES;
+			if (speed != traffic.rxSpeed)
+			{
+				traffic.rxSpeed = speed;
+				updateFlags |= EConnectionUpdateFlags::RX_SPEED;
+			}
+		}
+		else if (traffic.rxSpeed != 0)
+		{
+			traffic.rxSpeed = 0;
+			updateFlags |= EConnectionUpdateFlags::RX_SPEED;
+		}
+
+		speed = static_cast<uint64_t>((record.txBytes - traffic.txBytes) / SECONDS);
+		if (traffic.txBytes != record.txBytes)
+		{
+			traffic.txBytes = record.txBytes;
+			updateFlags |= EConnectionUpdateFlags::TX_BYTES;
+			if (speed != traffic.txSpeed)
+			{
+				traffic.txSpeed = speed;
+				updateFlags |= EConnectionUpdateFlags::TX_SPEED;
+			}
+		}
+		else if (traffic.txSpeed != 0)
+		{
+			traffic.txSpeed = 0;
+			updateFlags |= EConnectionUpdateFlags::TX_SPEED;
+		}
+
+		if (updateFlags)
+		{
+			batch.addUpdate(record.tuple, traffic, pEntry->state, updateFlags);
+		}
+	}
+};
+
+template<template<class...> class Map>
+static void ApplyDump(PerEntryTable<Map> & table, const std::vector<ConntrackRecord> & records,
+                      const std::vector<size_t> & order, ConntrackBatch & batch)
+{
+	table.beginGeneration();
+
+	for (size_t i : order)
+	{
+		table.handleEntry(records[i], batch);
+	}
+}
+
+static void ApplyDump(ConntrackTable & table, const std::vector<ConntrackRecord> & records,
+                      const std::vector<size_t> & order, ConntrackBatch & batch)
+{
+	table.beginGeneration();
+
+	for (size_t i : order)
+	{
+		const ConntrackRecord & record = records[i];
+
+		const uint32_t row = table.find(record.tuple);
+		if (row == ConntrackTable::NO_ROW)
+		{
+			continue;
+		}
+
+		table.mark(row);
+		table.setDumpedCounters(row, record.rxPackets, record.txPackets, record.rxBytes, record.txBytes);
+	}
+
+	table.commitCounters(SECONDS, [&table, &batch](uint32_t row, int updateFlags) -> void
+	{
+		batch.addUpdate(table.getTuple(row), table.getTraffic(row), table.getState(row), updateFlags);
+	});
+}
+
+/**
+ * @brief Measures time to apply dumps with some entries changed.
+ * Counters of the changed entries are increased before each dump.
+ */
+template<class Table>
+static void RunTable(const char *name, unsigned long count, unsigned int changedPercent)
+{
+	ConntrackDumpGenerator gen(count, AF_INET);
+	const std::vector<ConntrackRecord> & records = gen.getRecords();
+
+	// kernel dumps entries in order of its hash table, which is random for us
+	std::vector<size_t> order(count);
+	std::iota(order.begin(), order.end(), 0);
+	std::shuffle(order.begin(), order.end(), Benchmark::GetRandom());
+
+	Table table;
+	for (const ConntrackRecord & record : records)
+	{
+		table.add(record.tuple);
+	}
+
+	ConntrackBatch batch;
+	ApplyDump(table, records, order, batch);  // warm-up
+
+	double best = 0;
+	size_t changedCount = 0;
+
+	for (unsigned int i = 0; i < RUNS; i++)
+	{
+		gen.advance(changedPercent);
+		batch.clear();
+
+		const double duration = Benchmark::Measure([&]() { ApplyDump(table, records, order, batch); });
+
+		if (i == 0 || duration < best)
+		{
+			best = duration;
+		}
+
+		changedCount = batch.getSize();
+	}
+
+	std::string reportName = name;
+	reportName += ' ';
+	reportName += std::to_string(changedPercent);
+	reportName += "% changed";
+
+	Benchmark::Report(reportName, best, count);
+
+	if (changedCount < count * changedPercent / 200)
+	{
+		throw Exception("Too few changed entries", "Benchmark");
+	}
+}
+
+/**
+ * @brief ConntrackTable with the same interface as PerEntryTable for RunTable.
+ */
+struct ColumnTable : ConntrackTable
+{
+	void add(const ConntrackTuple & tuple)
+	{
+		ConntrackTable::add(tuple, ConnectionTraffic(), 0);
+	}
+};
+
+static void RunBenchmark()
+{
+	const unsigned long count = Benchmark::GetCount(1000000);
+
+	std::printf("%lu IPv4 entries in random order\n", count);
+
+	for (unsigned int changedPercent : { 5, 50, 100 })
+	{
+		RunTable<ColumnTable>("ConntrackTable", count, changedPercent);
+		RunTable<PerEntryTable<StableHashMap>>("per-entry StableHashMap", count, changedPercent);
+		RunTable<PerEntryTable<std::unordered_map>>("per-entry unordered_map", count, changedPercent);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	return Benchmark::Run(argc, argv, RunBenchmark);
+}
@@ -0,0 +1,250 @@
+/**
+ * @file
+ * @brief Implementation of platform-independent functions from network address classes.
+ */
+
+#include <array>
+#include <stdexcept>  // std::invalid_argument
+
+#include "Address.hpp"
+
+/**
+ * @brief Decimal form of one IPv4 address byte followed by a dot.
+ * Whole entry is always copied, so no branches are needed for different number of digits.
+ */
+struct DecimalOctet
+{
+	char text[4];
+	uint8_t length;
+};
+
+static constexpr std::array<DecimalOctet, 256> CreateDecimalOctets()
+{
+	std::array<DecimalOctet, 256> table{};
+
+	for (unsigned int i = 0; i < table.size(); i++)
+	{
+		DecimalOctet & octet = table[i];
+		uint8_t length = 0;
+
+		if (i >= 100)
+		{
+			octet.text[length++] = '0' + i / 100;
+		}
+		if (i >= 10)
+		{
+			octet.text[length++] = '0' + (i / 10) % 10;
+		}
+		octet.text[length++] = '0' + i % 10;
+		octet.text[length] = '.';
+
+		octet.length = length;
+	}
+
+	return table;
+}
+
+static constexpr std::array<DecimalOctet, 256> DECIMAL_OCTETS = CreateDecimalOctets();
+
+static constexpr char HEX_DIGITS[] = "0123456789abcdef";
+
+/**
+ * @brief Formats IPv4 address.
+ * The buffer must have at least 16 bytes.
+ * @param buffer The buffer that receives null-terminated address string.
+ * @param bytes Raw IPv4 address in network byte order.
+ * @return Length of the string.
+ */
+size_t AddressString::FormatIP4(char *buffer, const uint8_t *bytes)
+{
+	size_t length = 0;
+
+	for (unsigned int i = 0; i < 4; i++)
+	{
+		const DecimalOctet & octet = DECIMAL_OCTETS[bytes[i]];
+		std::memcpy(buffer + length, octet.text, sizeof octet.text);
+		length += octet.length + 1;
+	}
+
+	// drop the last dot
+	length--;
+	buffer[length] = '\0';
+
+	return length;
+}
+
+/**
+ * @brief Formats IPv6 address in the same way as inet_ntop.
+ * The buffer must have at least MAX_LENGTH + 1 bytes.
+ * @param buffer The buffer that receives null-terminated address string.
+ * @param bytes Raw IPv6 address in network byte order.
+ * @return Length of the string.
+ */
+size_t AddressString::FormatIP6(char *buffer, const uint8_t *bytes)
+{
+	unsigned int words[8];
+	for (unsigned int i = 0; i < 8; i++)
+	{
+		words[i] = (bytes[i * 2] << 8) | bytes[i * 2 + 1];
+	}
+
+	// the longest run of at least 2 zero words is replaced with "::"
+	int bestBase = -1;
+	int bestLength = 0;
+	for (int i = 0; i < 8;)
+	{
+		if (words[i] != 0)
+		{
+			i++;
+			continue;
+		}
+
+		int runLength = 1;
+		while (i + runLength < 8 && words[i + runLength] == 0)
+		{
+			runLength++;
+		}
+
+		if (runLength >= 2 && runLength > bestLength)
+		{
+			bestBase = i;
+			bestLength = runLength;
+		}
+
+		i += runLength;
+	}
+
+	char *p = buffer;
+
+	for (int i = 0; i < 8; i++)
+	{
+		if (bestBase >= 0 && i >= bestBase && i < bestBase + bestLength)
+		{
+			if (i == bestBase)
+			{
+				*p++ = ':';
+			}
+			continue;
+		}
+
+		if (i != 0)
+		{
+			*p++ = ':';
+		}
+
+		// IPv4-compatible and IPv4-mapped addresses
+		if (i == 6 && bestBase == 0 && (bestLength == 6 || (bestLength == 5 && words[5] == 0xFFFF)))
+		{
+			p += FormatIP4(p, bytes + 12);
+			return p - buffer;
+		}
+
+		const unsigned int word = words[i];
+		const char digits[4] = {
+			HEX_DIGITS[word >> 12],
+			HEX_DIGITS[(word >> 8) & 0xF],
+			HEX_DIGITS[(word >> 4) & 0xF],
+			HEX_DIGITS[word & 0xF]
+		};
+		const unsigned int digitCount = (word >= 0x1000) ? 4 : (word >= 0x100) ? 3 : (word >= 0x10) ? 2 : 1;
+
+		std::memcpy(p, digits + (4 - digitCount), digitCount);
+		p += digitCount;
+	}
+
+	if (bestBase >= 0 && bestBase + bestLength == 8)
+	{
+		*p++ = ':';
+	}
+
+	*p = '\0';
+
+	return p - buffer;
+}
+
+AddressString::AddressString(const AddressIP4 & address)
+{
+	const uint32_t raw = address.getRawAddr();
+	uint8_t bytes[4];
+	std::memcpy(bytes, &raw, 4);
+
+	m_length = FormatIP4(m_buffer, bytes);
+}
+
+AddressString::AddressString(const AddressIP6 & address)
+{
+	uint8_t bytes[16];
+	std::memcpy(bytes, address.getRawAddr(), 16);
+
+	m_length = FormatIP6(m_buffer, bytes);
+}
+
+AddressString::AddressString(const Address & address)
+{
+	uint8_t bytes[16];
+	std::memcpy(bytes, address.getRawAddr(), 16);
+
+	if (address.isIP4())
+	{
+		m_length = FormatIP4(m_buffer, bytes + 12);
+	}
+	else
+	{
+		m_length = FormatIP6(m_buffer, bytes);
+	}
+}
+
+std::string AddressIP4::toString() const
+{
+	return AddressString(*this).toString();
+}
+
+std::string AddressIP6::toString() const
+{
+	return AddressString(*this).toString();
+}
+
+AddressIP4 AddressIP4::CreateFromString(const KString & string)
+{
+	const size_t length = string.length();
+	size_t pos = 0;
+
+	uint8_t bytes[4];
+	for (unsigned int i = 0; i < 4; i++)
+	{
+		if (i > 0)
+		{
+			if (pos >= length || string[pos] != '.')
+			{
+				throw std::invalid_argument("Invalid IPv4 address string");
+			}
+			pos++;
+		}
+
+		const size_t begin = pos;
+		unsigned int value = 0;
+		while (pos < length && pos - begin < 3 && string[pos] >= '0' && string[pos] <= '9')
+		{
+			value = value * 10 + (string[pos] - '0');
+			pos++;
+		}
+
+		const size_t digitCount = pos - begin;
+		if (digitCount == 0 || value > 255 || (digitCount > 1 && string[begin] == '0'))
+		{
+			throw std::invalid_argument("Invalid IPv4 address string");
+		}
+
+		bytes[i] = value;
+	}
+
+	if (pos != length)
+	{
+		throw std::invalid_argument("Invalid IPv4 address string");
+	}
+
+	uint32_t address;
+	std::memcpy(&address, bytes, 4);
+
+	return AddressIP4(address);
+}
@@ -110,7 +110,7 @@ public:
 
 	/**
 	 * @brief Converts IPv4 address to string.
-	 * No lookups are performed. Implementation is platform-specific.
+	 * No lookups are performed.
 	 * @return IPv4 address string.
 	 */
 	std::string toString() const override;
@@ -136,7 +136,7 @@ public:
 
 	/**
 	 * @brief Creates IPv4 address from string.
-	 * Implementation is platform-specific.
+	 * Only the dotted-decimal notation with exactly 4 parts and without leading zeros is accepted.
 	 * @param string IPv4 address string.
 	 * @return IPv4 address.
 	 * @throws std::invalid_argument If the string does not contain valid IPv4 address.
@@ -186,7 +186,7 @@ public:
 
 	/**
 	 * @brief Converts IPv6 address to string.
-	 * No lookups are performed. Implementation is platform-specific.
+	 * No lookups are performed.
 	 * @return IPv6 address string.
 	 */
 	std::string toString() const override;
@@ -220,6 +220,282 @@ public:
 	static AddressIP6 CreateFromString(const KString & string);
 };
 
+/**
+ * @brief Compact network address of any type.
+ * Unlike AddressIP4 and AddressIP6, it is not polymorphic and always has 16 bytes. IPv4 addresses are stored as
+ * IPv4-mapped IPv6 addresses (::ffff:a.b.c.d), so both types share one hash table and comparison needs no branches.
+ * It is used as a key in hot paths, while IAddress remains at API boundaries such as sockets and hostname resolving.
+ * Note that real IPv6 address in the IPv4-mapped range is indistinguishable from the IPv4 address.
+ */
+class Address
+{
+public:
+	using RawAddr = uint32_t[4];
+
+private:
+	//! IPv6 address or IPv4-mapped IPv6 address in network byte order divided into 4 blocks.
+	alignas(8) RawAddr m_address;
+
+	static uint32_t GetIP4MappedPrefix()
+	{
+		const uint8_t prefix[4] = { 0x00, 0x00, 0xFF, 0xFF };
+		uint32_t result;
+		std::memcpy(&result, prefix, 4);
+		return result;
+	}
+
+	void getHalves(uint64_t *halves) const
+	{
+		std::memcpy(halves, m_address, 16);
+	}
+
+	void setHalves(const uint64_t *halves)
+	{
+		std::memcpy(m_address, halves, 16);
+	}
+
+public:
+	/**
+	 * @brief Constructor of the unspecified IPv6 address.
+	 */
+	Address()
+	: m_address{}
+	{
+	}
+
+	/**
+	 * @brief Constructor.
+	 * @param address IPv4 address.
+	 */
+	Address(const AddressIP4 & address)
+	: Address(CreateIP4(address.getRawAddr()))
+	{
+	}
+
+	/**
+	 * @brief Constructor.
+	 * @param address IPv6 address.
+	 */
+	Address(const AddressIP6 & address)
+	: Address(CreateIP6(address.getRawAddr()))
+	{
+	}
+
+	/**
+	 * @brief Constructor.
+	 * @param address Address of any type.
+	 */
+	explicit Address(const IAddress & address)
+	: m_address{}
+	{
+		switch (address.getType())
+		{
+			case EAddressType::IP4:
+			{
+				(*this) = Address(static_cast<const AddressIP4&>(address));
+				break;
+			}
+			case EAddressType::IP6:
+			{
+				(*this) = Address(static_cast<const AddressIP6&>(address));
+				break;
+			}
+		}
+	}
+
+	/**
+	 * @brief Creates IPv4 address without any temporary object.
+	 * @param address Raw IPv4 address in network byte order.
+	 * @return The address.
+	 */
+	static Address CreateIP4(uint32_t address)
+	{
+		// the address is written as two 64-bit halves, so hashing and comparing it right after it was created
+		// does not stall on store forwarding
+		const uint32_t mapped[2] = { GetIP4MappedPrefix(), address };
+		uint64_t halves[2] = { 0, 0 };
+		std::memcpy(&halves[1], mapped, 8);
+
+		Address result;
+		result.setHalves(halves);
+		return result;
+	}
+
+	/**
+	 * @brief Creates IPv6 address without any temporary object.
+	 * @param address Raw IPv6 address in network byte order.
+	 * @return The address.
+	 */
+	static Address CreateIP6(const RawAddr & address)
+	{
+		Address result;
+		std::memcpy(result.m_address, address, 16);
+		return result;
+	}
+
+	/**
+	 * @brief Checks if this is IPv4 address.
+	 * @return True, if this is IPv4 address, otherwise false.
+	 */
+	bool isIP4() const
+	{
+		return m_address[0] == 0 && m_address[1] == 0 && m_address[2] == GetIP4MappedPrefix();
+	}
+
+	/**
+	 * @brief Returns address type.
+	 * @return Address type.
+	 */
+	EAddressType getType() const
+	{
+		return (isIP4()) ? EAddressType::IP4 : EAddressType::IP6;
+	}
+
+	/**
+	 * @brief Returns name of address type.
+	 * @return Address type name.
+	 */
+	KString getTypeName() const
+	{
+		return (isIP4()) ? "IPv4" : "IPv6";
+	}
+
+	/**
+	 * @brief Converts address to string.
+	 * @return Address string.
+	 */
+	std::string toString() const
+	{
+		return (isIP4()) ? toIP4().toString() : toIP6().toString();
+	}
+
+	/**
+	 * @brief Copies raw address to some buffer.
+	 * Size of the buffer must be at least 4 bytes for IPv4 address and 16 bytes for IPv6 address.
+	 * @param buffer The buffer.
+	 */
+	void copyRawTo(void *buffer) const
+	{
+		if (isIP4())
+		{
+			std::memcpy(buffer, &m_address[3], 4);
+		}
+		else
+		{
+			std::memcpy(buffer, m_address, 16);
+		}
+	}
+
+	/**
+	 * @brief Returns raw address.
+	 * @return IPv6 address or IPv4-mapped IPv6 address in network byte order.
+	 */
+	const RawAddr & getRawAddr() const
+	{
+		return m_address;
+	}
+
+	/**
+	 * @brief Converts the address to IPv4 address.
+	 * The address must be IPv4 address.
+	 * @return IPv4 address.
+	 */
+	AddressIP4 toIP4() const
+	{
+		return AddressIP4(m_address[3]);
+	}
+
+	/**
+	 * @brief Converts the address to IPv6 address.
+	 * @return IPv6 address.
+	 */
+	AddressIP6 toIP6() const
+	{
+		return AddressIP6(m_address);
+	}
+
+	/**
+	 * @brief Compares two addresses.
+	 * @param other The other address.
+	 * @return True, if both addresses are equal, otherwise false.
+	 */
+	bool isEqual(const Address & other) const
+	{
+		uint64_t a[2];
+		uint64_t b[2];
+		getHalves(a);
+		other.getHalves(b);
+
+		return ((a[0] ^ b[0]) | (a[1] ^ b[1])) == 0;
+	}
+
+	/**
+	 * @brief Computes hash of the address.
+	 * @return The hash.
+	 */
+	size_t computeHash() const
+	{
+		uint64_t halves[2];
+		getHalves(halves);
+
+		// the last 4 bytes (IPv4 address or IPv6 host part) carry the most entropy, so mix them into the low half
+		uint64_t h = halves[0] ^ (halves[1] * 0x9E3779B97F4A7C15);
+		h ^= h >> 32;
+
+		return static_cast<size_t>(h);
+	}
+};
+
+static_assert(sizeof (Address) == 16, "Address must be compact");
+
+/**
+ * @brief Address string in fixed-size buffer.
+ * The string is formatted without any heap allocation. The output is the same as from inet_ntop, so IPv6 addresses
+ * are in the compressed form and IPv4-mapped addresses use the dotted-decimal notation for the last 4 bytes.
+ */
+class AddressString
+{
+public:
+	//! Maximum length of address string without the terminating null character.
+	static constexpr size_t MAX_LENGTH = 45;
+
+private:
+	char m_buffer[MAX_LENGTH + 1];
+	uint8_t m_length;
+
+	static size_t FormatIP4(char *buffer, const uint8_t *bytes);
+	static size_t FormatIP6(char *buffer, const uint8_t *bytes);
+
+public:
+	/**
+	 * @brief Constructor of empty string.
+	 */
+	AddressString()
+	: m_length(0)
+	{
+		m_buffer[0] = '\0';
+	}
+
+	explicit AddressString(const AddressIP4 & address);
+	explicit AddressString(const AddressIP6 & address);
+	explicit AddressString(const Address & address);
+
+	bool isEmpty() const
+	{
+		return m_length == 0;
+	}
+
+	KString get() const
+	{
+		return KString(m_buffer, m_length);
+	}
+
+	std::string toString() const
+	{
+		return std::string(m_buffer, m_length);
+	}
+};
+
 /**
  * @brief Container for multiple network addresses of different type.
  */
@@ -277,7 +553,7 @@ public:
 class AddressData
 {
 	//! Data belongs to this address.
-	const IAddress *m_pAddress;
+	const Address *m_pAddress;
 
 #ifndef CONNTOP_DEDICATED
 	//! True if address hostname has been resolved, otherwise false.
@@ -303,8 +579,12 @@ class AddressData
 	std::vector<WhoisData> m_whois;
 #endif
 
-	//! Cached address string.
-	std::string m_numericString;
+	//! Address string. It is formatted when it is needed for the first time.
+	mutable AddressString m_numericString;
+	//! Number of connections and pending requests using the data.
+	unsigned int m_refCount;
+	//! Number of times the data became unused.
+	unsigned int m_releaseCount;
 
 public:
 	/**
@@ -312,7 +592,7 @@ public:
 	 * The address must be stored somewhere else because this class holds only a pointer to it.
 	 * @param address The address.
 	 */
-	AddressData(const IAddress & address)
+	AddressData(const Address & address)
 	: m_pAddress(&address),
 #ifndef CONNTOP_DEDICATED
 	  m_isHostnameResolved(false),
@@ -326,7 +606,9 @@ public:
 	  m_country(),
 	  m_whois(),
 #endif
-	  m_numericString(address.toString())
+	  m_numericString(),
+	  m_refCount(0),
+	  m_releaseCount(0)
 	{
 	}
 
@@ -461,7 +743,7 @@ public:
 	 * @brief Returns address to which the data belongs.
 	 * @return The address.
 	 */
-	const IAddress & getAddress() const
+	const Address & getAddress() const
 	{
 		return *m_pAddress;
 	}
@@ -486,11 +768,17 @@ public:
 
 	/**
 	 * @brief Returns address as numeric string.
+	 * The string is cached, so this function must not be called from other threads.
 	 * @return Address string.
 	 */
-	const std::string & getNumericString() const
+	KString getNumericString() const
 	{
-		return m_numericString;
+		if (m_numericString.isEmpty())
+		{
+			m_numericString = AddressString(*m_pAddress);
+		}
+
+		return m_numericString.get();
 	}
 
 #ifndef CONNTOP_DEDICATED
@@ -508,10 +796,10 @@ public:
 	 * @brief Returns address string.
 	 * @return Hostname or numeric string if the address has no hostname.
 	 */
-	const std::string & getString() const
+	KString getString() const
 	{
 	#ifndef CONNTOP_DEDICATED
-		return (isHostnameAvailable()) ? getHostnameString() : getNumericString();
+		return (isHostnameAvailable()) ? KString(getHostnameString()) : getNumericString();
 	#else
 		return getNumericString();
 	#endif
@@ -657,12 +945,56 @@ public:
 	}
 #endif
 
+	/**
+	 * @brief Returns number of connections and pending requests using the data.
+	 * Unused data are reclaimed by ConnectionStorage after a grace period.
+	 * @return Reference count.
+	 */
+	unsigned int getRefCount() const
+	{
+		return m_refCount;
+	}
+
+	/**
+	 * @brief Returns number of times the data became unused.
+	 * It allows ConnectionStorage to detect that the data were used again during the grace period.
+	 * @return Release count.
+	 */
+	unsigned int getReleaseCount() const
+	{
+		return m_releaseCount;
+	}
+
+	/**
+	 * @brief Increments reference count.
+	 * This function should be used only in ConnectionStorage class.
+	 */
+	void addRef()
+	{
+		m_refCount++;
+	}
+
+	/**
+	 * @brief Decrements reference count.
+	 * This function should be used only in ConnectionStorage class.
+	 * @return New reference count.
+	 */
+	unsigned int releaseRef()
+	{
+		if (--m_refCount == 0)
+		{
+			m_releaseCount++;
+		}
+
+		return m_refCount;
+	}
+
 	/**
 	 * @brief Sets address to which the data belongs.
 	 * This function should be used only in ConnectionStorage class.
 	 * @param address The address.
 	 */
-	void setAddress(const IAddress & address)
+	void setAddress(const Address & address)
 	{
 		m_pAddress = &address;
 	}
@@ -693,6 +1025,16 @@ inline bool operator!=(const AddressIP6 & a, const AddressIP6 & b)
 	return !(a == b);
 }
 
+inline bool operator==(const Address & a, const Address & b)
+{
+	return a.isEqual(b);
+}
+
+inline bool operator!=(const Address & a, const Address & b)
+{
+	return !(a == b);
+}
+
 namespace std
 {
 	template<>
@@ -724,4 +1066,16 @@ namespace std
 			return h;
 		}
 	};
+
+	template<>
+	struct hash<Address>
+	{
+		using argument_type = Address;
+		using result_type = size_t;
+
+		result_type operator()(const argument_type & v) const
+		{
+			return v.computeHash();
+		}
+	};
 }
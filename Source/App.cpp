@@ -10,6 +10,7 @@
 #include "Server.hpp"
 #include "ICollector.hpp"
 #include "Exception.hpp"
+#include "Platform.hpp"
 
 #ifndef CONNTOP_DEDICATED
 #include "ConnectionList.hpp"
@@ -23,6 +24,9 @@
 #include "Collector_Netfilter/CCollector.hpp"
 #endif
 
+#include "Collector_Synthetic/CCollector.hpp"
+#include "Collector_Replay/CCollector.hpp"
+
 #ifdef CONNTOP_UI_CURSES
 #include "UI_Curses/CUI.hpp"
 #endif
@@ -164,10 +168,37 @@ struct UpdateEventCallback : public IEventCallback<UpdateEvent>
 				gApp->getUI()->refreshConnectionList();
 			}
 		}
+
+		if (gApp->hasResolver())
+		{
+			gApp->getResolver()->onUpdate();
+		}
 	#endif
+
+		// allow the next update
+		gPlatform->finishUpdate();
 	}
 };
 
+static std::unique_ptr<ICollector> CreateCollector()
+{
+	if (gCmdLine->hasArg("synthetic"))
+	{
+		return std::make_unique<CCollector_Synthetic>();
+	}
+
+	if (gCmdLine->hasArg("replay"))
+	{
+		return std::make_unique<CCollector_Replay>();
+	}
+
+#ifdef CONNTOP_COLLECTOR_NETFILTER
+	return std::make_unique<CCollector>();
+#else
+	throw Exception("No collector of real connections available, use '--synthetic' or '--replay'", "App");
+#endif
+}
+
 App::App()
 : m_pEventSystem(),
   m_pPollSystem(),
@@ -196,7 +227,7 @@ void App::launch()
 #ifndef CONNTOP_DEDICATED
 	if (gCmdLine->hasArg("server"))
 	{
-		m_pCollector = std::make_unique<CCollector>();
+		m_pCollector = CreateCollector();
 		m_pServer = std::make_unique<Server>();
 	}
 	else
@@ -215,13 +246,13 @@ void App::launch()
 		}
 		else
 		{
-			m_pCollector = std::make_unique<CCollector>();
+			m_pCollector = CreateCollector();
 		}
 
 		m_pUI = std::make_unique<CUI>();
 	}
 #else
-	m_pCollector = std::make_unique<CCollector>();
+	m_pCollector = CreateCollector();
 	m_pServer = std::make_unique<Server>();
 #endif
 
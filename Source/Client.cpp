@@ -422,9 +422,15 @@ void Client::onSessionData(ClientSession*, int type, bool isUpdate, rapidjson::V
 		}
 
 		// deserialize
-		for (auto it = data.Begin(); it != data.End(); ++it)
 		{
-			ConnectionData::Deserialize(*it, gApp->getConnectionList());
+			ConnectionUpdateBatch updateBatch(gApp->getConnectionList());
+
+			for (auto it = data.Begin(); it != data.End(); ++it)
+			{
+				ConnectionData::Deserialize(*it, gApp->getConnectionList());
+			}
+
+			updateBatch.commit();
 		}
 
 		if (gApp->hasUI())
@@ -28,6 +28,24 @@ const std::map<KString, CmdLineArgConfig> CmdLine::OPTIONS = {
 			"Increase log verbosity - 1x normal, 2x high, 3x debug."
 		}
 	},
+	{
+		"interval",
+		{
+			"i",
+			"Update every N milliseconds (100-10000) instead of every second.",
+			ECmdLineArgValue::REQUIRED,
+			"N"
+		}
+	},
+	{
+		"data-grace-period",
+		{
+			"",
+			"Keep unused address and port data for N seconds (default 60).",
+			ECmdLineArgValue::REQUIRED,
+			"N"
+		}
+	},
 	{
 		"log-file",
 		{
@@ -91,6 +109,31 @@ const std::map<KString, CmdLineArgConfig> CmdLine::OPTIONS = {
 			"Disable GeoIP database."
 		}
 	},
+	{
+		"resolver-threads",
+		{
+			"",
+			"Resolve hostnames using N threads (default 4).",
+			ECmdLineArgValue::REQUIRED,
+			"N"
+		}
+	},
+	{
+		"resolver-cache",
+		{
+			"",
+			"Keep resolved addresses in FILE instead of the default cache file.",
+			ECmdLineArgValue::REQUIRED,
+			"FILE"
+		}
+	},
+	{
+		"no-resolver-cache",
+		{
+			"",
+			"Do not keep resolved addresses between runs."
+		}
+	},
 	{
 		"connect",
 		{
@@ -141,5 +184,84 @@ const std::map<KString, CmdLineArgConfig> CmdLine::OPTIONS = {
 			"",
 			"Bind server port to 0.0.0.0 and [::]."
 		}
-	}
+	},
+	{
+		"replay",
+		{
+			"",
+			"Replay conntrack capture FILE instead of collecting real connections.",
+			ECmdLineArgValue::REQUIRED,
+			"FILE"
+		}
+	},
+	{
+		"replay-speed",
+		{
+			"",
+			"Replay the capture N times faster or at maximum speed (max).",
+			ECmdLineArgValue::REQUIRED,
+			"N"
+		}
+	},
+	{
+		"synthetic",
+		{
+			"",
+			"Generate artificial connections instead of collecting real ones.",
+			ECmdLineArgValue::REQUIRED,
+			"OPTIONS"
+		}
+	},
+#ifdef CONNTOP_COLLECTOR_NETFILTER
+	{
+		"adaptive-interval",
+		{
+			"",
+			"Make update interval longer when conntrack dumps take more than PERCENT of it (default 20).",
+			ECmdLineArgValue::OPTIONAL,
+			"PERCENT"
+		}
+	},
+	{
+		"dump-interval",
+		{
+			"",
+			"Dump and reconcile conntrack table only every N updates and use events in between.",
+			ECmdLineArgValue::REQUIRED,
+			"N"
+		}
+	},
+	{
+		"filter",
+		{
+			"",
+			"Collect only connections matching comma-separated RULES.",
+			ECmdLineArgValue::REQUIRED,
+			"RULES"
+		}
+	},
+	{
+		"raw-dump",
+		{
+			"",
+			"Parse conntrack table dumps directly instead of using libnetfilter_conntrack."
+		}
+	},
+	{
+		"record",
+		{
+			"",
+			"Record conntrack table dumps and events to capture FILE.",
+			ECmdLineArgValue::REQUIRED,
+			"FILE"
+		}
+	},
+	{
+		"parallel-dump",
+		{
+			"",
+			"Dump IPv4 and IPv6 conntrack tables in parallel."
+		}
+	},
+#endif
 };
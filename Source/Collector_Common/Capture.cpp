@@ -0,0 +1,378 @@
+/**
+ * @file
+ * @brief Implementation of conntrack capture file format.
+ */
+
+#include <sys/socket.h>
+#include <cerrno>
+#include <cstring>
+
+#include "Capture.hpp"
+#include "Exception.hpp"
+#include "Log.hpp"
+#include "Util.hpp"
+
+static const char CAPTURE_MAGIC[8] = { 'C', 'O', 'N', 'N', 'T', 'O', 'P', 'C' };
+static const uint8_t CAPTURE_VERSION = 2;
+
+// values of AF_INET6 differ between systems, so capture files have their own ones
+static const uint8_t CAPTURE_FAMILY_IP4 = 4;
+static const uint8_t CAPTURE_FAMILY_IP6 = 6;
+
+//! The file ends inside a record, which is normal if the writer was killed.
+struct IncompleteRecord
+{
+};
+
+static void AppendVarint(std::string & buffer, uint64_t value)
+{
+	while (value >= 0x80)
+	{
+		buffer += static_cast<char>((value & 0x7F) | 0x80);
+		value >>= 7;
+	}
+
+	buffer += static_cast<char>(value);
+}
+
+static void AppendConnection(std::string & buffer, const CaptureEntry & entry)
+{
+	const ConntrackTuple & tuple = entry.tuple;
+	const bool isIP6 = (tuple.l3proto == AF_INET6);
+	const size_t addressLength = (isIP6) ? 16 : 4;
+
+	buffer += static_cast<char>((isIP6) ? CAPTURE_FAMILY_IP6 : CAPTURE_FAMILY_IP4);
+	buffer += static_cast<char>(tuple.l4proto);
+	buffer += static_cast<char>(static_cast<int8_t>(entry.state));
+	buffer.append(reinterpret_cast<const char*>(tuple.srcAddr), addressLength);
+	buffer.append(reinterpret_cast<const char*>(tuple.dstAddr), addressLength);
+	buffer += static_cast<char>(tuple.srcPort >> 8);
+	buffer += static_cast<char>(tuple.srcPort);
+	buffer += static_cast<char>(tuple.dstPort >> 8);
+	buffer += static_cast<char>(tuple.dstPort);
+
+	AppendVarint(buffer, entry.rxPackets);
+	AppendVarint(buffer, entry.txPackets);
+	AppendVarint(buffer, entry.rxBytes);
+	AppendVarint(buffer, entry.txBytes);
+}
+
+CaptureWriter::CaptureWriter(const KString & fileName)
+: m_file(),
+  m_fileName(fileName),
+  m_startTime(std::chrono::steady_clock::now()),
+  m_buffer()
+{
+	m_file = std::fopen(m_fileName.c_str(), "wb");
+	if (!m_file)
+	{
+		std::string errMsg = "Unable to open capture file '";
+		errMsg += m_fileName;
+		errMsg += "': ";
+		errMsg += Util::ErrnoToString();
+		throw Exception(std::move(errMsg), "Capture");
+	}
+
+	std::string header(CAPTURE_MAGIC, sizeof CAPTURE_MAGIC);
+	header += static_cast<char>(CAPTURE_VERSION);
+
+	write(header);
+}
+
+CaptureWriter::~CaptureWriter()
+{
+	std::fclose(m_file);
+}
+
+void CaptureWriter::write(const std::string & data)
+{
+	if (std::fwrite(data.data(), 1, data.length(), m_file) != data.length())
+	{
+		std::string errMsg = "Unable to write capture file '";
+		errMsg += m_fileName;
+		errMsg += "': ";
+		errMsg += Util::ErrnoToString();
+		throw Exception(std::move(errMsg), "Capture");
+	}
+}
+
+/**
+ * @return Number of milliseconds since start of the capture.
+ */
+uint64_t CaptureWriter::getTimestamp() const
+{
+	const auto duration = std::chrono::steady_clock::now() - m_startTime;
+
+	return std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
+}
+
+void CaptureWriter::writeDumpBegin()
+{
+	m_buffer.clear();
+	m_buffer += static_cast<char>(CaptureEntry::DUMP_BEGIN);
+	AppendVarint(m_buffer, getTimestamp());
+
+	write(m_buffer);
+}
+
+/**
+ * @brief Writes dump entries created by EncodeDumpEntry.
+ */
+void CaptureWriter::writeDumpEntries(const std::string & entries)
+{
+	write(entries);
+}
+
+void CaptureWriter::writeDumpEnd()
+{
+	m_buffer.clear();
+	m_buffer += static_cast<char>(CaptureEntry::DUMP_END);
+
+	write(m_buffer);
+
+	// the capture should be usable even if the application is killed
+	std::fflush(m_file);
+}
+
+void CaptureWriter::writeEvent(const CaptureEntry & entry)
+{
+	m_buffer.clear();
+	m_buffer += static_cast<char>(entry.type);
+	AppendVarint(m_buffer, getTimestamp());
+	AppendConnection(m_buffer, entry);
+
+	write(m_buffer);
+}
+
+/**
+ * @brief Encodes dump entry without writing it.
+ * This function is thread-safe, so parallel dumps can encode their entries at the same time.
+ */
+void CaptureWriter::EncodeDumpEntry(std::string & buffer, const CaptureEntry & entry)
+{
+	buffer += static_cast<char>(CaptureEntry::DUMP_ENTRY);
+	AppendConnection(buffer, entry);
+}
+
+CaptureReader::CaptureReader(const KString & fileName)
+: m_file(),
+  m_fileName(fileName),
+  m_buffer(std::make_unique<uint8_t[]>(BUFFER_SIZE)),
+  m_bufferPos(0),
+  m_bufferLength(0),
+  m_dumpTimestamp(0)
+{
+	m_file = std::fopen(m_fileName.c_str(), "rb");
+	if (!m_file)
+	{
+		std::string errMsg = "Unable to open capture file '";
+		errMsg += m_fileName;
+		errMsg += "': ";
+		errMsg += Util::ErrnoToString();
+		throw Exception(std::move(errMsg), "Capture");
+	}
+
+	uint8_t header[sizeof CAPTURE_MAGIC + 1] = {};
+	for (uint8_t & byte : header)
+	{
+		if (!readByte(byte))
+		{
+			break;
+		}
+	}
+
+	if (std::memcmp(header, CAPTURE_MAGIC, sizeof CAPTURE_MAGIC) != 0 || header[sizeof CAPTURE_MAGIC] != CAPTURE_VERSION)
+	{
+		std::fclose(m_file);
+
+		std::string errMsg = "File '";
+		errMsg += m_fileName;
+		errMsg += "' is not a supported capture file";
+		throw Exception(std::move(errMsg), "Capture");
+	}
+}
+
+CaptureReader::~CaptureReader()
+{
+	std::fclose(m_file);
+}
+
+void CaptureReader::throwCorrupted() const
+{
+	std::string errMsg = "Capture file '";
+	errMsg += m_fileName;
+	errMsg += "' is corrupted";
+	throw Exception(std::move(errMsg), "Capture");
+}
+
+bool CaptureReader::readByte(uint8_t & result)
+{
+	if (m_bufferPos >= m_bufferLength)
+	{
+		m_bufferLength = std::fread(m_buffer.get(), 1, BUFFER_SIZE, m_file);
+		m_bufferPos = 0;
+
+		if (m_bufferLength == 0)
+		{
+			if (std::ferror(m_file))
+			{
+				std::string errMsg = "Unable to read capture file '";
+				errMsg += m_fileName;
+				errMsg += "': ";
+				errMsg += Util::ErrnoToString();
+				throw Exception(std::move(errMsg), "Capture");
+			}
+
+			return false;
+		}
+	}
+
+	result = m_buffer[m_bufferPos++];
+
+	return true;
+}
+
+uint8_t CaptureReader::readByteRequired()
+{
+	uint8_t result = 0;
+	if (!readByte(result))
+	{
+		throw IncompleteRecord();
+	}
+
+	return result;
+}
+
+uint64_t CaptureReader::readVarint()
+{
+	uint64_t result = 0;
+
+	for (unsigned int shift = 0; shift < 64; shift += 7)
+	{
+		const uint8_t byte = readByteRequired();
+		result |= static_cast<uint64_t>(byte & 0x7F) << shift;
+
+		if ((byte & 0x80) == 0)
+		{
+			return result;
+		}
+	}
+
+	throwCorrupted();
+
+	return result;
+}
+
+void CaptureReader::readConnection(CaptureEntry & entry)
+{
+	ConntrackTuple & tuple = entry.tuple;
+	tuple = ConntrackTuple();
+
+	const uint8_t family = readByteRequired();
+	tuple.l4proto = readByteRequired();
+	entry.state = static_cast<int8_t>(readByteRequired());
+
+	switch (family)
+	{
+		case CAPTURE_FAMILY_IP4:
+		{
+			tuple.l3proto = AF_INET;
+			break;
+		}
+		case CAPTURE_FAMILY_IP6:
+		{
+			tuple.l3proto = AF_INET6;
+			break;
+		}
+		default:
+		{
+			throwCorrupted();
+		}
+	}
+
+	const size_t addressLength = (family == CAPTURE_FAMILY_IP6) ? 16 : 4;
+
+	for (uint32_t *address : { tuple.srcAddr, tuple.dstAddr })
+	{
+		uint8_t *bytes = reinterpret_cast<uint8_t*>(address);
+		for (size_t i = 0; i < addressLength; i++)
+		{
+			bytes[i] = readByteRequired();
+		}
+	}
+
+	tuple.srcPort = readByteRequired() << 8;
+	tuple.srcPort |= readByteRequired();
+	tuple.dstPort = readByteRequired() << 8;
+	tuple.dstPort |= readByteRequired();
+
+	entry.rxPackets = readVarint();
+	entry.txPackets = readVarint();
+	entry.rxBytes = readVarint();
+	entry.txBytes = readVarint();
+}
+
+/**
+ * @brief Reads the next record.
+ * Incomplete last record is treated as the end of the file.
+ * @param entry Receives the record.
+ * @return False if the end of the file was reached, otherwise true.
+ */
+bool CaptureReader::read(CaptureEntry & entry)
+{
+	try
+	{
+		return readRecord(entry);
+	}
+	catch (const IncompleteRecord &)
+	{
+		gLog->warning("[Capture] Capture file '%s' ends with incomplete record", m_fileName.c_str());
+		return false;
+	}
+}
+
+bool CaptureReader::readRecord(CaptureEntry & entry)
+{
+	uint8_t type;
+	if (!readByte(type))
+	{
+		return false;
+	}
+
+	entry.type = static_cast<CaptureEntry::EType>(type);
+
+	switch (entry.type)
+	{
+		case CaptureEntry::DUMP_BEGIN:
+		{
+			m_dumpTimestamp = readVarint();
+			entry.timestamp = m_dumpTimestamp;
+			break;
+		}
+		case CaptureEntry::DUMP_ENTRY:
+		{
+			entry.timestamp = m_dumpTimestamp;
+			readConnection(entry);
+			break;
+		}
+		case CaptureEntry::DUMP_END:
+		{
+			entry.timestamp = m_dumpTimestamp;
+			break;
+		}
+		case CaptureEntry::EVENT_NEW:
+		case CaptureEntry::EVENT_UPDATE:
+		case CaptureEntry::EVENT_DESTROY:
+		{
+			entry.timestamp = readVarint();
+			readConnection(entry);
+			break;
+		}
+		default:
+		{
+			throwCorrupted();
+		}
+	}
+
+	return true;
+}
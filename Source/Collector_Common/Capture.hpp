@@ -0,0 +1,126 @@
+/**
+ * @file
+ * @brief Conntrack capture file format.
+ *
+ * Capture file consists of a header and a sequence of records. Each record begins with its type. Timestamps are in
+ * milliseconds since start of the capture and all numbers except addresses and ports are stored as LEB128 varints.
+ *
+ * Header:
+ *   8 bytes   magic "CONNTOPC"
+ *   1 byte    format version
+ *
+ * DUMP_BEGIN:   type, timestamp
+ * DUMP_ENTRY:   type, connection
+ * DUMP_END:     type
+ * EVENT_*:      type, timestamp, connection
+ *
+ * Connection:
+ *   1 byte    address family (4 for IPv4 or 6 for IPv6)
+ *   1 byte    protocol (IPPROTO_TCP or IPPROTO_UDP)
+ *   1 byte    connection state (signed)
+ *   4/16 B    source address in network byte order
+ *   4/16 B    destination address in network byte order
+ *   2 bytes   source port in network byte order
+ *   2 bytes   destination port in network byte order
+ *   varint    received packets
+ *   varint    sent packets
+ *   varint    received bytes
+ *   varint    sent bytes
+ */
+
+#pragma once
+
+#include <cstdio>
+#include <chrono>
+#include <memory>
+#include <string>
+
+#include "ConntrackRecord.hpp"
+#include "KString.hpp"
+
+struct CaptureEntry
+{
+	enum EType : uint8_t
+	{
+		DUMP_BEGIN = 1,
+		DUMP_ENTRY,
+		DUMP_END,
+		EVENT_NEW,
+		EVENT_UPDATE,
+		EVENT_DESTROY
+	};
+
+	EType type;
+	uint64_t timestamp;
+	ConntrackTuple tuple;
+	uint64_t rxPackets;
+	uint64_t txPackets;
+	uint64_t rxBytes;
+	uint64_t txBytes;
+	int state;
+};
+
+/**
+ * @brief Appends records to a capture file.
+ */
+class CaptureWriter
+{
+	std::FILE *m_file;
+	std::string m_fileName;
+	std::chrono::steady_clock::time_point m_startTime;
+	std::string m_buffer;
+
+	void write(const std::string & data);
+
+public:
+	explicit CaptureWriter(const KString & fileName);
+	~CaptureWriter();
+
+	// no copy
+	CaptureWriter(const CaptureWriter &) = delete;
+	CaptureWriter & operator=(const CaptureWriter &) = delete;
+
+	uint64_t getTimestamp() const;
+
+	void writeDumpBegin();
+	void writeDumpEntries(const std::string & entries);
+	void writeDumpEnd();
+	void writeEvent(const CaptureEntry & entry);
+
+	static void EncodeDumpEntry(std::string & buffer, const CaptureEntry & entry);
+};
+
+/**
+ * @brief Reads records from a capture file.
+ * Dump entries get timestamp of their dump. Capture of a killed application can end inside a record, which is
+ * skipped, while invalid content of the file is reported as an exception.
+ */
+class CaptureReader
+{
+	static constexpr size_t BUFFER_SIZE = 65536;
+
+	std::FILE *m_file;
+	std::string m_fileName;
+	std::unique_ptr<uint8_t[]> m_buffer;
+	size_t m_bufferPos;
+	size_t m_bufferLength;
+	uint64_t m_dumpTimestamp;
+
+	bool readByte(uint8_t & result);
+	uint8_t readByteRequired();
+	uint64_t readVarint();
+	void readConnection(CaptureEntry & entry);
+	bool readRecord(CaptureEntry & entry);
+
+	void throwCorrupted() const;
+
+public:
+	explicit CaptureReader(const KString & fileName);
+	~CaptureReader();
+
+	// no copy
+	CaptureReader(const CaptureReader &) = delete;
+	CaptureReader & operator=(const CaptureReader &) = delete;
+
+	bool read(CaptureEntry & entry);
+};
@@ -0,0 +1,79 @@
+/**
+ * @file
+ * @brief Implementation of functions working with conntrack records.
+ */
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "ConntrackRecord.hpp"
+#include "Connection.hpp"
+#include "Address.hpp"
+#include "Port.hpp"
+
+bool ExtractAddressPort(AddressData **pSrcAddress, PortData **pSrcPort,
+                        AddressData **pDstAddress, PortData **pDstPort,
+                        const ConntrackTuple & tuple, IConnectionUpdateCallback *callback, bool add)
+{
+	EPortType portType;
+	switch (tuple.l4proto)
+	{
+		case IPPROTO_UDP:
+		{
+			portType = EPortType::UDP;
+			break;
+		}
+		case IPPROTO_TCP:
+		{
+			portType = EPortType::TCP;
+			break;
+		}
+		default:
+		{
+			return false;
+		}
+	}
+
+	AddressData *srcAddress = nullptr;
+	AddressData *dstAddress = nullptr;
+
+	switch (tuple.l3proto)
+	{
+		case AF_INET:
+		{
+			srcAddress = callback->getAddress(Address::CreateIP4(tuple.srcAddr[0]), add);
+			dstAddress = callback->getAddress(Address::CreateIP4(tuple.dstAddr[0]), add);
+			break;
+		}
+		case AF_INET6:
+		{
+			srcAddress = callback->getAddress(Address::CreateIP6(tuple.srcAddr), add);
+			dstAddress = callback->getAddress(Address::CreateIP6(tuple.dstAddr), add);
+			break;
+		}
+		default:
+		{
+			return false;
+		}
+	}
+
+	if (!srcAddress || !dstAddress)
+	{
+		return false;
+	}
+
+	PortData *srcPort = callback->getPort(Port(portType, tuple.srcPort), add);
+	PortData *dstPort = callback->getPort(Port(portType, tuple.dstPort), add);
+
+	if (!srcPort || !dstPort)
+	{
+		return false;
+	}
+
+	(*pSrcAddress) = srcAddress;
+	(*pDstAddress) = dstAddress;
+	(*pSrcPort) = srcPort;
+	(*pDstPort) = dstPort;
+
+	return true;
+}
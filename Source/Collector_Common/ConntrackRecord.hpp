@@ -0,0 +1,98 @@
+/**
+ * @file
+ * @brief ConntrackTuple and ConntrackRecord structs.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include "Hash.hpp"
+
+class AddressData;
+class PortData;
+struct IConnectionUpdateCallback;
+
+/**
+ * @brief Original direction tuple of conntrack entry.
+ * Addresses are in network byte order and ports are in host byte order.
+ * IPv4 addresses use only the first element and the rest is zero.
+ */
+struct ConntrackTuple
+{
+	uint32_t srcAddr[4];
+	uint32_t dstAddr[4];
+	uint16_t srcPort;
+	uint16_t dstPort;
+	uint8_t l3proto;
+	uint8_t l4proto;
+};
+
+inline bool operator==(const ConntrackTuple & a, const ConntrackTuple & b)
+{
+	return a.srcPort == b.srcPort
+	    && a.dstPort == b.dstPort
+	    && a.l3proto == b.l3proto
+	    && a.l4proto == b.l4proto
+	    && std::memcmp(a.srcAddr, b.srcAddr, sizeof a.srcAddr) == 0
+	    && std::memcmp(a.dstAddr, b.dstAddr, sizeof a.dstAddr) == 0;
+}
+
+inline bool operator!=(const ConntrackTuple & a, const ConntrackTuple & b)
+{
+	return !(a == b);
+}
+
+/**
+ * @brief Flat copy of conntrack entry attributes used by the collector.
+ * It is filled either from libnetfilter_conntrack object or directly from ctnetlink message.
+ */
+struct ConntrackRecord
+{
+	ConntrackTuple tuple;
+	uint64_t rxPackets;
+	uint64_t txPackets;
+	uint64_t rxBytes;
+	uint64_t txBytes;
+	uint32_t mark;
+	uint16_t zone;
+	uint8_t tcpState;
+	bool hasTCPState;
+};
+
+/**
+ * @brief Obtains address and port data of both sides of a connection.
+ * @param add True if missing data should be created, otherwise false.
+ * @return False if the tuple has unsupported protocol or some data are missing, otherwise true.
+ */
+bool ExtractAddressPort(AddressData **pSrcAddress, PortData **pSrcPort,
+                        AddressData **pDstAddress, PortData **pDstPort,
+                        const ConntrackTuple & tuple, IConnectionUpdateCallback *callback, bool add);
+
+namespace std
+{
+	template<>
+	struct hash<ConntrackTuple>
+	{
+		using argument_type = ConntrackTuple;
+		using result_type = size_t;
+
+		result_type operator()(const argument_type & v) const
+		{
+			result_type h = hash<uint32_t>()(v.srcAddr[0]);
+			for (int i = 1; i < 4; i++)
+			{
+				HashCombine(h, hash<uint32_t>()(v.srcAddr[i]));
+			}
+			for (int i = 0; i < 4; i++)
+			{
+				HashCombine(h, hash<uint32_t>()(v.dstAddr[i]));
+			}
+			HashCombine(h, hash<uint32_t>()((v.srcPort << 16) | v.dstPort));
+			HashCombine(h, hash<uint32_t>()((v.l3proto << 8) | v.l4proto));
+
+			return h;
+		}
+	};
+}
@@ -0,0 +1,405 @@
+/**
+ * @file
+ * @brief ConntrackTable class.
+ */
+
+#pragma once
+
+#include <vector>
+
+#include "Connection.hpp"
+#include "ConntrackRecord.hpp"
+#include "StableHashMap.hpp"
+
+/**
+ * @brief Copy of conntrack table owned by the collector thread.
+ * It keeps the last known traffic and state of each connection, so changes can be computed without
+ * access to the connection storage on the main thread.
+ * Each entry is tagged with generation of the last dump that has seen it, so entries that disappeared
+ * from the kernel table without a DESTROY event can be found and removed.
+ * Entries are stored in columns indexed by row. A dump only stores new counters of each entry, and changes of all
+ * entries are then computed at once by loops without branches, which the compiler can vectorize.
+ * Dump entries come in random order, so everything they access is kept together in one row state, and only
+ * one cache line is touched per entry.
+ */
+class ConntrackTable
+{
+public:
+	static constexpr uint32_t NO_ROW = UINT32_MAX;
+
+private:
+	//! Data of a row accessed by dump entries.
+	struct alignas(64) RowState
+	{
+		//! Counters from the current dump.
+		uint64_t newRxPackets;
+		uint64_t newTxPackets;
+		uint64_t newRxBytes;
+		uint64_t newTxBytes;
+		int state;
+		unsigned int generation;
+		//! Changes found by the current dump.
+		int updateFlags;
+		//! Non-zero if the row has counters from the current dump.
+		uint8_t isDumped;
+	};
+
+	StableHashMap<ConntrackTuple, uint32_t> m_rows;
+	std::vector<uint32_t> m_freeRows;
+
+	std::vector<ConntrackTuple> m_tuples;
+	std::vector<RowState> m_rowStates;
+	//! Last known traffic.
+	std::vector<uint64_t> m_rxPackets;
+	std::vector<uint64_t> m_txPackets;
+	std::vector<uint64_t> m_rxBytes;
+	std::vector<uint64_t> m_txBytes;
+	std::vector<uint64_t> m_rxSpeed;
+	std::vector<uint64_t> m_txSpeed;
+	//! Columns of the current dump copied from row states by commitCounters.
+	std::vector<uint64_t> m_newRxPackets;
+	std::vector<uint64_t> m_newTxPackets;
+	std::vector<uint64_t> m_newRxBytes;
+	std::vector<uint64_t> m_newTxBytes;
+	std::vector<uint8_t> m_isDumped;
+	std::vector<int> m_updateFlags;
+
+	unsigned int m_generation;
+
+	uint32_t allocateRow()
+	{
+		if (!m_freeRows.empty())
+		{
+			const uint32_t row = m_freeRows.back();
+			m_freeRows.pop_back();
+			return row;
+		}
+
+		const size_t rowCount = m_tuples.size() + 1;
+
+		m_tuples.resize(rowCount);
+		m_rowStates.resize(rowCount);
+		m_rxPackets.resize(rowCount);
+		m_txPackets.resize(rowCount);
+		m_rxBytes.resize(rowCount);
+		m_txBytes.resize(rowCount);
+		m_rxSpeed.resize(rowCount);
+		m_txSpeed.resize(rowCount);
+
+		return rowCount - 1;
+	}
+
+	void freeRow(uint32_t row)
+	{
+		m_rowStates[row].isDumped = 0;
+		m_rowStates[row].updateFlags = 0;
+
+		m_freeRows.push_back(row);
+	}
+
+	// the kernels below have no branches, so the compiler can vectorize them
+	// all values are loaded unconditionally and then selected
+	// each kernel processes only one column, so there are only a few pointers that might alias
+
+	/**
+	 * @brief Replaces values of dumped rows with the new ones.
+	 * @param newValues New values that are replaced with deltas, which are zero if a value went backwards.
+	 */
+	static void MergeColumn(size_t rowCount, const uint8_t *__restrict isDumped, uint64_t *__restrict values,
+	                        uint64_t *__restrict newValues, int *__restrict updateFlags, int flag)
+	{
+		for (size_t i = 0; i < rowCount; i++)
+		{
+			const uint64_t oldValue = values[i];
+			const uint64_t newValue = (isDumped[i]) ? newValues[i] : oldValue;
+
+			const int64_t delta = static_cast<int64_t>(newValue - oldValue);
+
+			values[i] = newValue;
+			newValues[i] = (delta > 0) ? delta : 0;
+			updateFlags[i] |= (newValue != oldValue) ? flag : 0;
+		}
+	}
+
+	/**
+	 * @brief Converts byte deltas to speed.
+	 * Vectorized conversion between 64-bit integers and doubles is available only on some CPUs, so this is
+	 * separated from merging of counters.
+	 */
+	static void ComputeSpeed(size_t rowCount, uint64_t *__restrict values, double speedFactor)
+	{
+		for (size_t i = 0; i < rowCount; i++)
+		{
+			values[i] = static_cast<int64_t>(static_cast<int64_t>(values[i]) * speedFactor);
+		}
+	}
+
+public:
+	ConntrackTable()
+	: m_rows(),
+	  m_freeRows(),
+	  m_tuples(),
+	  m_rowStates(),
+	  m_rxPackets(),
+	  m_txPackets(),
+	  m_rxBytes(),
+	  m_txBytes(),
+	  m_rxSpeed(),
+	  m_txSpeed(),
+	  m_newRxPackets(),
+	  m_newTxPackets(),
+	  m_newRxBytes(),
+	  m_newTxBytes(),
+	  m_isDumped(),
+	  m_updateFlags(),
+	  m_generation(0)
+	{
+	}
+
+	/**
+	 * @brief Finds row of an entry.
+	 * @return The row or NO_ROW if there is no such entry.
+	 */
+	uint32_t find(const ConntrackTuple & tuple) const
+	{
+		auto pEntry = m_rows.find(tuple);
+		return (pEntry) ? pEntry->second : NO_ROW;
+	}
+
+	std::pair<uint32_t, bool> add(const ConntrackTuple & tuple, const ConnectionTraffic & traffic, int state)
+	{
+		auto pEntry = m_rows.find(tuple);
+		if (pEntry)
+		{
+			return std::pair<uint32_t, bool>(pEntry->second, false);
+		}
+
+		const uint32_t row = allocateRow();
+
+		m_tuples[row] = tuple;
+		m_rowStates[row].state = state;
+		m_rowStates[row].generation = m_generation;
+		m_rxPackets[row] = traffic.rxPackets;
+		m_txPackets[row] = traffic.txPackets;
+		m_rxBytes[row] = traffic.rxBytes;
+		m_txBytes[row] = traffic.txBytes;
+		m_rxSpeed[row] = traffic.rxSpeed;
+		m_txSpeed[row] = traffic.txSpeed;
+
+		m_rows.emplace(tuple, row);
+
+		return std::pair<uint32_t, bool>(row, true);
+	}
+
+	bool remove(const ConntrackTuple & tuple)
+	{
+		const uint32_t row = find(tuple);
+		if (row == NO_ROW)
+		{
+			return false;
+		}
+
+		m_rows.erase(tuple);
+		freeRow(row);
+
+		return true;
+	}
+
+	void clear()
+	{
+		m_rows.clear();
+		m_freeRows.clear();
+		m_tuples.clear();
+		m_rowStates.clear();
+		m_rxPackets.clear();
+		m_txPackets.clear();
+		m_rxBytes.clear();
+		m_txBytes.clear();
+		m_rxSpeed.clear();
+		m_txSpeed.clear();
+		m_newRxPackets.clear();
+		m_newTxPackets.clear();
+		m_newRxBytes.clear();
+		m_newTxBytes.clear();
+		m_isDumped.clear();
+		m_updateFlags.clear();
+	}
+
+	/**
+	 * @brief Prepares the table for a number of entries, so they can be added without reallocation.
+	 */
+	void reserve(size_t count)
+	{
+		m_rows.reserve(count);
+		m_tuples.reserve(count);
+		m_rowStates.reserve(count);
+		m_rxPackets.reserve(count);
+		m_txPackets.reserve(count);
+		m_rxBytes.reserve(count);
+		m_txBytes.reserve(count);
+		m_rxSpeed.reserve(count);
+		m_txSpeed.reserve(count);
+		m_newRxPackets.reserve(count);
+		m_newTxPackets.reserve(count);
+		m_newRxBytes.reserve(count);
+		m_newTxBytes.reserve(count);
+		m_isDumped.reserve(count);
+		m_updateFlags.reserve(count);
+	}
+
+	/**
+	 * @brief Starts a new generation.
+	 * All existing entries become unmarked.
+	 */
+	void beginGeneration()
+	{
+		m_generation++;
+	}
+
+	/**
+	 * @brief Marks entry as seen in the current generation.
+	 */
+	void mark(uint32_t row)
+	{
+		m_rowStates[row].generation = m_generation;
+	}
+
+	const ConntrackTuple & getTuple(uint32_t row) const
+	{
+		return m_tuples[row];
+	}
+
+	int getState(uint32_t row) const
+	{
+		return m_rowStates[row].state;
+	}
+
+	void setState(uint32_t row, int state)
+	{
+		m_rowStates[row].state = state;
+	}
+
+	ConnectionTraffic getTraffic(uint32_t row) const
+	{
+		return ConnectionTraffic(m_rxPackets[row], m_txPackets[row], m_rxBytes[row], m_txBytes[row],
+		                         m_rxSpeed[row], m_txSpeed[row]);
+	}
+
+	/**
+	 * @brief Stores counters of an entry from the current dump.
+	 * They are compared with the last known traffic later by commitCounters.
+	 * @param updateFlags Changes already found by the caller, for example protocol state.
+	 */
+	void setDumpedCounters(uint32_t row, uint64_t rxPackets, uint64_t txPackets, uint64_t rxBytes, uint64_t txBytes,
+	                       int updateFlags = 0)
+	{
+		RowState & rowState = m_rowStates[row];
+		rowState.newRxPackets = rxPackets;
+		rowState.newTxPackets = txPackets;
+		rowState.newRxBytes = rxBytes;
+		rowState.newTxBytes = txBytes;
+		rowState.isDumped = 1;
+		rowState.updateFlags = updateFlags;
+	}
+
+	/**
+	 * @brief Applies counters of all entries from the current dump.
+	 * Entries that were not dumped are not changed.
+	 * @param seconds Time since the previous dump or zero if speed is unknown.
+	 * @param callback Function called with row and update flags of each changed entry.
+	 */
+	template<class Callback>
+	void commitCounters(double seconds, Callback callback)
+	{
+		const size_t rowCount = m_tuples.size();
+		const double speedFactor = (seconds > 0) ? 1 / seconds : 0;
+
+		m_newRxPackets.resize(rowCount);
+		m_newTxPackets.resize(rowCount);
+		m_newRxBytes.resize(rowCount);
+		m_newTxBytes.resize(rowCount);
+		m_isDumped.resize(rowCount);
+		m_updateFlags.resize(rowCount);
+
+		// one sequential pass moves the dump out of row states, so the kernels below can work on columns
+		for (size_t i = 0; i < rowCount; i++)
+		{
+			RowState & rowState = m_rowStates[i];
+
+			m_newRxPackets[i] = rowState.newRxPackets;
+			m_newTxPackets[i] = rowState.newTxPackets;
+			m_newRxBytes[i] = rowState.newRxBytes;
+			m_newTxBytes[i] = rowState.newTxBytes;
+			m_isDumped[i] = rowState.isDumped;
+			m_updateFlags[i] = rowState.updateFlags;
+
+			rowState.isDumped = 0;
+			rowState.updateFlags = 0;
+		}
+
+		const uint8_t *isDumped = m_isDumped.data();
+		int *updateFlags = m_updateFlags.data();
+
+		// the new counters are not needed after merging, so their columns receive the deltas
+		MergeColumn(rowCount, isDumped, m_rxPackets.data(), m_newRxPackets.data(), updateFlags,
+		            EConnectionUpdateFlags::RX_PACKETS);
+		MergeColumn(rowCount, isDumped, m_txPackets.data(), m_newTxPackets.data(), updateFlags,
+		            EConnectionUpdateFlags::TX_PACKETS);
+		MergeColumn(rowCount, isDumped, m_rxBytes.data(), m_newRxBytes.data(), updateFlags,
+		            EConnectionUpdateFlags::RX_BYTES);
+		MergeColumn(rowCount, isDumped, m_txBytes.data(), m_newTxBytes.data(), updateFlags,
+		            EConnectionUpdateFlags::TX_BYTES);
+
+		// speed is per second of real time since previous dump
+		ComputeSpeed(rowCount, m_newRxBytes.data(), speedFactor);
+		ComputeSpeed(rowCount, m_newTxBytes.data(), speedFactor);
+
+		MergeColumn(rowCount, isDumped, m_rxSpeed.data(), m_newRxBytes.data(), updateFlags,
+		            EConnectionUpdateFlags::RX_SPEED);
+		MergeColumn(rowCount, isDumped, m_txSpeed.data(), m_newTxBytes.data(), updateFlags,
+		            EConnectionUpdateFlags::TX_SPEED);
+
+		for (size_t i = 0; i < rowCount; i++)
+		{
+			if (updateFlags[i])
+			{
+				callback(static_cast<uint32_t>(i), updateFlags[i]);
+			}
+		}
+	}
+
+	/**
+	 * @brief Removes all entries not marked in the current generation.
+	 * @param callback Function called with tuple of each removed entry.
+	 * @return Number of removed entries.
+	 */
+	template<class Callback>
+	size_t sweep(Callback callback)
+	{
+		size_t count = 0;
+
+		std::vector<bool> isFree(m_tuples.size());
+		for (uint32_t row : m_freeRows)
+		{
+			isFree[row] = true;
+		}
+
+		for (uint32_t row = 0; row < m_tuples.size(); row++)
+		{
+			if (!isFree[row] && m_rowStates[row].generation != m_generation)
+			{
+				callback(m_tuples[row]);
+				m_rows.erase(m_tuples[row]);
+				freeRow(row);
+				count++;
+			}
+		}
+
+		return count;
+	}
+
+	size_t getSize() const
+	{
+		return m_rows.size();
+	}
+};
@@ -3,37 +3,324 @@
  * @brief Implementation of Netfilter collector.
  */
 
+#include <arpa/inet.h>
+
 #include "CCollector.hpp"
 #include "Conntrack.hpp"
+#include "Thread.hpp"
+#include "PollSystem.hpp"
+#include "Log.hpp"
+#include "Exception.hpp"
+#include "Platform.hpp"
+#include "CmdLine.hpp"
+#include "Util.hpp"
+#include "Platform/Unix/PollHandle.hpp"
+#include "Platform/Unix/SelfPipe.hpp"
+
+#include "readerwriterqueue/readerwriterqueue.h"
 
 class CCollector_Netfilter::Impl
 {
+	enum class ECommand
+	{
+		UPDATE,
+		PAUSE,
+		RESUME,
+		STOP
+	};
+
 	Conntrack m_conntrack;
+	moodycamel::ReaderWriterQueue<ECommand> m_commandQueue;
+	moodycamel::ReaderWriterQueue<ConntrackBatch> m_batchQueue;
+	SelfPipe m_pipe;
+	Thread m_collectorThread;
+	IConnectionUpdateCallback *m_callback;
+	unsigned int m_baseInterval;
+	unsigned int m_cpuBudget;  // percent of update interval, 0 if adaptive interval is disabled
+	bool m_isPaused;
+
+	static unsigned int GetCPUBudget()
+	{
+		CmdLineArg *adaptiveArg = gCmdLine->getArg("adaptive-interval");
+		if (!adaptiveArg)
+		{
+			return 0;
+		}
+
+		const KString value = adaptiveArg->getValue();
+		if (value.empty())
+		{
+			// value of --adaptive-interval is optional
+			return 20;
+		}
+
+		unsigned long budget;
+		if (!Util::StringToUInt(value, budget) || budget < 1 || budget > 100)
+		{
+			std::string errMsg = "Invalid value '";
+			errMsg += value;
+			errMsg += "' of '--adaptive-interval'";
+			throw Exception(std::move(errMsg), "Collector_Netfilter");
+		}
+
+		return budget;
+	}
+
+	/**
+	 * @brief Stretches update interval when dumps take too much time and shrinks it back when they become cheaper.
+	 */
+	void adjustUpdateInterval()
+	{
+		const uint64_t dumpDuration = m_conntrack.getLastDumpDuration();
+		if (dumpDuration == 0)
+		{
+			return;
+		}
+
+		// shortest interval with average dump cost per update within the budget
+		const uint64_t dumpCost = dumpDuration / m_conntrack.getDumpInterval();
+		uint64_t interval = dumpCost * 100 / m_cpuBudget / 1000;
+
+		// multiples of the minimum interval to avoid changing it after each dump
+		interval = (interval / Platform::MIN_UPDATE_INTERVAL + 1) * Platform::MIN_UPDATE_INTERVAL;
+
+		if (interval < m_baseInterval)
+		{
+			interval = m_baseInterval;
+		}
+		else if (interval > Platform::MAX_UPDATE_INTERVAL)
+		{
+			interval = Platform::MAX_UPDATE_INTERVAL;
+		}
+
+		const unsigned int currentInterval = gPlatform->getUpdateInterval();
+
+		// interval is shortened only when the difference is significant
+		if (interval > currentInterval || interval * 5 < currentInterval * 4)
+		{
+			gLog->info("[Collector_Netfilter] Dump takes %.1f ms, update interval changed from %u ms to %u ms",
+			           dumpDuration / 1000.0, currentInterval, static_cast<unsigned int>(interval));
+
+			gPlatform->setUpdateInterval(interval);
+		}
+	}
+
+	void collectorLoop()  // executed by collector thread
+	{
+		PollHandle pollHandle;
+
+		const int pipeFD = m_pipe.getReadFD();
+		const int eventFD = m_conntrack.getEventFD();
+		pollHandle.add(pipeFD, EPollFlags::INPUT);
+		pollHandle.add(eventFD, EPollFlags::INPUT);
+
+		unsigned int updateCount = 0;
+		bool isRunning = true;
+
+		while (isRunning)
+		{
+			pollHandle.wait();
+
+			bool checkCommandQueue = false;
+			PollEvent event = pollHandle.getNextEvent();
+			while (!event.isEmpty())
+			{
+				if (event.getDescriptor() == pipeFD)
+				{
+					m_pipe.clear();
+					pollHandle.reset(pipeFD, EPollFlags::INPUT);
+					checkCommandQueue = true;
+				}
+				else
+				{
+					if (event.hasError())
+					{
+						throw Exception("Conntrack event socket poll failed", "Collector_Netfilter");
+					}
+
+					m_conntrack.receiveEvents();
+					pollHandle.reset(eventFD, EPollFlags::INPUT);
+				}
+
+				event = pollHandle.getNextEvent();
+			}
+
+			if (!checkCommandQueue)
+			{
+				continue;
+			}
+
+			ECommand command;
+			while (m_commandQueue.try_dequeue(command))
+			{
+				switch (command)
+				{
+					case ECommand::UPDATE:
+					{
+						updateCount++;
+						break;
+					}
+					case ECommand::PAUSE:
+					{
+						m_conntrack.setPaused(true);
+						break;
+					}
+					case ECommand::RESUME:
+					{
+						m_conntrack.setPaused(false);
+						break;
+					}
+					case ECommand::STOP:
+					{
+						isRunning = false;
+						break;
+					}
+				}
+			}
+
+			// multiple pending updates are merged into one batch
+			if (updateCount > 0 && isRunning)
+			{
+				ConntrackBatch batch;
+				m_conntrack.update(updateCount, batch);
+				updateCount = 0;
+
+				if (!batch.isEmpty())
+				{
+					m_batchQueue.enqueue(std::move(batch));
+				}
+			}
+		}
+	}
+
+	void pushCommand(ECommand command)
+	{
+		m_commandQueue.enqueue(command);
+
+		const char *something = "A";
+		m_pipe.writeData(something, 1);  // wake collector thread
+	}
+
+	void applyBatch(const ConntrackBatch & batch)
+	{
+		if (batch.getCreateCount() > 0)
+		{
+			m_callback->reserve(batch.getCreateCount());
+		}
+
+		for (const ConntrackDelta & delta : batch)
+		{
+			const bool isNew = (delta.type == ConntrackDelta::CREATE);
+
+			AddressData *srcAddress, *dstAddress;
+			PortData *srcPort, *dstPort;
+			if (!ExtractAddressPort(&srcAddress, &srcPort, &dstAddress, &dstPort, delta.tuple, m_callback, isNew))
+			{
+				continue;
+			}
+
+			Connection connection(*srcAddress, *srcPort, *dstAddress, *dstPort);
+
+			switch (delta.type)
+			{
+				case ConntrackDelta::CREATE:
+				{
+					m_callback->add(connection, delta.traffic, delta.state);
+					break;
+				}
+				case ConntrackDelta::UPDATE:
+				{
+					ConnectionData *pData = m_callback->find(connection);
+					if (pData)
+					{
+						pData->getTraffic() = delta.traffic;
+						pData->setState(delta.state);
+						m_callback->update(*pData, delta.updateFlags);
+					}
+					break;
+				}
+				case ConntrackDelta::REMOVE:
+				{
+					m_callback->remove(connection);
+					break;
+				}
+			}
+		}
+	}
 
 public:
 	Impl()
-	: m_conntrack()
+	: m_conntrack(),
+	  m_commandQueue(),
+	  m_batchQueue(),
+	  m_pipe(),
+	  m_collectorThread(),
+	  m_callback(),
+	  m_baseInterval(gPlatform->getUpdateInterval()),
+	  m_cpuBudget(GetCPUBudget()),
+	  m_isPaused()
 	{
+		auto CollectorThreadFunction = [this]() -> void
+		{
+			collectorLoop();
+		};
+
+		// start collector thread
+		m_collectorThread = Thread("Collector", CollectorThreadFunction);
+	}
+
+	~Impl()
+	{
+		// stop collector thread
+		pushCommand(ECommand::STOP);
+		m_collectorThread.join();
 	}
 
 	void init(IConnectionUpdateCallback *callback)
 	{
-		m_conntrack.init(callback);
+		m_callback = callback;
 	}
 
 	void onUpdate()
 	{
-		m_conntrack.onUpdate();
+		if (!m_callback || m_isPaused)
+		{
+			return;
+		}
+
+		// apply changes produced by the collector thread since the previous update
+		{
+			ConnectionUpdateBatch updateBatch(m_callback);
+
+			ConntrackBatch batch;
+			while (m_batchQueue.try_dequeue(batch))
+			{
+				applyBatch(batch);
+			}
+
+			updateBatch.commit();
+		}
+
+		if (m_cpuBudget > 0)
+		{
+			adjustUpdateInterval();
+		}
+
+		pushCommand(ECommand::UPDATE);
 	}
 
 	bool isPaused() const
 	{
-		return m_conntrack.isPaused();
+		return m_isPaused;
 	}
 
 	void setPaused(bool paused)
 	{
-		m_conntrack.setPaused(paused);
+		if (m_isPaused != paused)
+		{
+			m_isPaused = paused;
+			pushCommand((paused) ? ECommand::PAUSE : ECommand::RESUME);
+		}
 	}
 };
 
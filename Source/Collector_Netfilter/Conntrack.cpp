@@ -7,13 +7,16 @@
 #include <fcntl.h>
 #include <arpa/inet.h>
 #include <cerrno>
+#include <cstring>
+#include <chrono>
+#include <fstream>
 #include <system_error>
 
 #include "Conntrack.hpp"
-#include "App.hpp"
 #include "Log.hpp"
 #include "Exception.hpp"
 #include "Util.hpp"
+#include "CmdLine.hpp"
 
 static int TCPStateToEnum(uint8_t rawState)
 {
@@ -114,95 +117,106 @@ static bool TCPStateIsEqual(int state, uint8_t rawState)
 	return false;
 }
 
-static bool ExtractAddressPort(AddressData **pSrcAddress, PortData **pSrcPort,
-                                AddressData **pDstAddress, PortData **pDstPort,
-                                nf_conntrack *ct, IConnectionUpdateCallback *callback, bool add)
+/**
+ * @brief Converts libnetfilter_conntrack object to record.
+ * @param record Zero-initialized record.
+ * @param ct The object.
+ */
+void Conntrack::FillRecord(ConntrackRecord & record, nf_conntrack *ct)
 {
-	EAddressType addressType;
-	switch (nfct_get_attr_u8(ct, ATTR_L3PROTO))
+	record.tuple.l3proto = nfct_get_attr_u8(ct, ATTR_L3PROTO);
+	record.tuple.l4proto = nfct_get_attr_u8(ct, ATTR_L4PROTO);
+
+	switch (record.tuple.l3proto)
 	{
 		case AF_INET:
 		{
-			addressType = EAddressType::IP4;
+			record.tuple.srcAddr[0] = nfct_get_attr_u32(ct, ATTR_IPV4_SRC);
+			record.tuple.dstAddr[0] = nfct_get_attr_u32(ct, ATTR_IPV4_DST);
 			break;
 		}
 		case AF_INET6:
 		{
-			addressType = EAddressType::IP6;
+			std::memcpy(record.tuple.srcAddr, nfct_get_attr(ct, ATTR_IPV6_SRC), sizeof record.tuple.srcAddr);
+			std::memcpy(record.tuple.dstAddr, nfct_get_attr(ct, ATTR_IPV6_DST), sizeof record.tuple.dstAddr);
 			break;
 		}
 		default:
 		{
-			return false;
+			return;
 		}
 	}
 
-	EPortType portType;
-	switch (nfct_get_attr_u8(ct, ATTR_L4PROTO))
+	record.tuple.srcPort = ntohs(nfct_get_attr_u16(ct, ATTR_PORT_SRC));
+	record.tuple.dstPort = ntohs(nfct_get_attr_u16(ct, ATTR_PORT_DST));
+
+	record.rxPackets = nfct_get_attr_u64(ct, ATTR_REPL_COUNTER_PACKETS);
+	record.txPackets = nfct_get_attr_u64(ct, ATTR_ORIG_COUNTER_PACKETS);
+	record.rxBytes = nfct_get_attr_u64(ct, ATTR_REPL_COUNTER_BYTES);
+	record.txBytes = nfct_get_attr_u64(ct, ATTR_ORIG_COUNTER_BYTES);
+
+	if (nfct_attr_is_set(ct, ATTR_MARK) > 0)
 	{
-		case IPPROTO_UDP:
-		{
-			portType = EPortType::UDP;
-			break;
-		}
-		case IPPROTO_TCP:
-		{
-			portType = EPortType::TCP;
-			break;
-		}
-		default:
-		{
-			return false;
-		}
+		record.mark = nfct_get_attr_u32(ct, ATTR_MARK);
 	}
 
-	AddressData *srcAddress = nullptr;
-	AddressData *dstAddress = nullptr;
+	if (nfct_attr_is_set(ct, ATTR_ZONE) > 0)
+	{
+		record.zone = nfct_get_attr_u16(ct, ATTR_ZONE);
+	}
 
-	switch (addressType)
+	record.hasTCPState = (nfct_attr_is_set(ct, ATTR_TCP_STATE) > 0);
+	if (record.hasTCPState)
 	{
-		case EAddressType::IP4:
-		{
-			uint32_t srcAddrRaw = nfct_get_attr_u32(ct, ATTR_IPV4_SRC);
-			uint32_t dstAddrRaw = nfct_get_attr_u32(ct, ATTR_IPV4_DST);
-			srcAddress = callback->getAddress(AddressIP4(srcAddrRaw), add);
-			dstAddress = callback->getAddress(AddressIP4(dstAddrRaw), add);
-			break;
-		}
-		case EAddressType::IP6:
-		{
-			const void *pSrcAddrRaw = nfct_get_attr(ct, ATTR_IPV6_SRC);
-			const void *pDstAddrRaw = nfct_get_attr(ct, ATTR_IPV6_DST);
-			const AddressIP6::RawAddr & srcAddrRaw = *static_cast<const AddressIP6::RawAddr*>(pSrcAddrRaw);
-			const AddressIP6::RawAddr & dstAddrRaw = *static_cast<const AddressIP6::RawAddr*>(pDstAddrRaw);
-			srcAddress = callback->getAddress(AddressIP6(srcAddrRaw), add);
-			dstAddress = callback->getAddress(AddressIP6(dstAddrRaw), add);
-			break;
-		}
+		record.tcpState = nfct_get_attr_u8(ct, ATTR_TCP_STATE);
 	}
+}
 
-	if (!srcAddress || !dstAddress)
+static bool IsSupported(const ConntrackTuple & tuple)
+{
+	if (tuple.l3proto != AF_INET && tuple.l3proto != AF_INET6)
 	{
 		return false;
 	}
 
-	const uint16_t srcPortNumber = ntohs(nfct_get_attr_u16(ct, ATTR_PORT_SRC));
-	const uint16_t dstPortNumber = ntohs(nfct_get_attr_u16(ct, ATTR_PORT_DST));
+	return tuple.l4proto == IPPROTO_TCP || tuple.l4proto == IPPROTO_UDP;
+}
+
+static int GetState(const ConntrackRecord & record)
+{
+	return (record.tuple.l4proto == IPPROTO_TCP) ? TCPStateToEnum(record.tcpState) : 0;
+}
+
+static CaptureEntry ToCaptureEntry(const ConntrackRecord & record, CaptureEntry::EType type)
+{
+	CaptureEntry entry;
+	entry.type = type;
+	entry.timestamp = 0;
+	entry.tuple = record.tuple;
+	entry.rxPackets = record.rxPackets;
+	entry.txPackets = record.txPackets;
+	entry.rxBytes = record.rxBytes;
+	entry.txBytes = record.txBytes;
+	entry.state = (record.hasTCPState) ? GetState(record) : 0;
+
+	return entry;
+}
 
-	PortData *srcPort = callback->getPort(Port(portType, srcPortNumber), add);
-	PortData *dstPort = callback->getPort(Port(portType, dstPortNumber), add);
+/**
+ * @brief Returns number of entries in the kernel conntrack table of all address families.
+ * @return The number or zero if it is not available.
+ */
+static size_t GetKernelEntryCount()
+{
+	size_t count = 0;
 
-	if (!srcPort || !dstPort)
+	std::ifstream countFile("/proc/sys/net/netfilter/nf_conntrack_count");
+	if (countFile.is_open())
 	{
-		return false;
+		countFile >> count;
 	}
 
-	(*pSrcAddress) = srcAddress;
-	(*pDstAddress) = dstAddress;
-	(*pSrcPort) = srcPort;
-	(*pDstPort) = dstPort;
-
-	return true;
+	return (countFile.fail()) ? 0 : count;
 }
 
 ConntrackSocket::ConntrackSocket(unsigned int events)
@@ -248,273 +262,495 @@ ConntrackSocket::~ConntrackSocket()
 	gLog->info("[Collector_Netfilter] Closed conntrack socket on %d", fd);
 }
 
-Conntrack::Conntrack()
-: m_eventQueue(),
-  m_querySocket(),
-  m_eventSocket(NF_NETLINK_CONNTRACK_NEW | NF_NETLINK_CONNTRACK_DESTROY),
-  m_callback(),
-  m_isInitialized(false),
-  m_isRefillRequired(true),
-  m_isPaused()
+ConntrackDumpWorker::ConntrackDumpWorker(ConntrackDump & dump, std::string threadName)
+: m_requestQueue(),
+  m_resultQueue(),
+  m_thread()
+{
+	auto WorkerThreadFunction = [this, &dump]() -> void
+	{
+		workerLoop(dump);
+	};
+
+	m_thread = Thread(std::move(threadName), WorkerThreadFunction);
+}
+
+ConntrackDumpWorker::~ConntrackDumpWorker()
+{
+	// stop worker thread
+	m_requestQueue.enqueue(false);
+	m_thread.join();
+}
+
+/**
+ * @brief Waits until the requested dump is done.
+ * Errors of the worker thread are propagated to the caller.
+ */
+void ConntrackDumpWorker::wait()
+{
+	std::string result;
+	m_resultQueue.wait_dequeue(result);
+
+	if (!result.empty())
+	{
+		// the error was already logged by the worker thread
+		throw Exception(std::move(result), "Collector_Netfilter", false);
+	}
+}
+
+void ConntrackDumpWorker::workerLoop(ConntrackDump & dump)
 {
-	if (nfct_callback_register(m_querySocket.get(), NFCT_T_ALL, QueryCallback, this) < 0)
+	bool isDumpRequested = false;
+	m_requestQueue.wait_dequeue(isDumpRequested);
+
+	while (isDumpRequested)
 	{
-		throw std::system_error(errno, std::system_category(), "Unable to register conntrack query callback");
+		std::string result;
+
+		try
+		{
+			Conntrack::RunDump(dump);
+		}
+		catch (const Exception & e)
+		{
+			result = e.getString();
+		}
+
+		m_resultQueue.enqueue(std::move(result));
+
+		m_requestQueue.wait_dequeue(isDumpRequested);
 	}
+}
 
+Conntrack::Conntrack()
+: m_tables(),
+  m_batch(),
+  m_filter(),
+  m_dumpInterval(GetDumpInterval()),
+  m_updatesSinceDump(0),
+  m_lastDumpTime(),
+  m_secondsSinceDump(0),
+  m_dumpDuration(0),
+  m_eventSocket(NF_NETLINK_CONNTRACK_NEW | NF_NETLINK_CONNTRACK_DESTROY
+                | ((m_dumpInterval > 1) ? NF_NETLINK_CONNTRACK_UPDATE : 0)),
+  m_dumps(),
+  m_dumpWorkers(),
+  m_pCaptureWriter(),
+  m_isReconcileRequired(true),
+  m_isReconciling(false),
+  m_isSpeedResetRequired(false),
+  m_isPaused()
+{
 	if (nfct_callback_register(m_eventSocket.get(), NFCT_T_ALL, EventCallback, this) < 0)
 	{
 		throw std::system_error(errno, std::system_category(), "Unable to register conntrack event callback");
 	}
 
-	gApp->getPollSystem()->add(m_eventSocket, EPollFlags::INPUT, EventPollHandler, this);
+	if (CmdLineArg *filterArg = gCmdLine->getArg("filter"))
+	{
+		for (const KString & value : filterArg->getAllValues())
+		{
+			m_filter.parse(value);
+		}
+	}
+
+	m_filter.attachToEventSocket(m_eventSocket.getFD());
+
+	const uint8_t addressFamily = m_filter.getAddressFamily();
+
+	// IPv4 and IPv6 parts of the conntrack table can be dumped at the same time using separate sockets
+	const bool isParallel = gCmdLine->hasArg("parallel-dump") && addressFamily == AF_UNSPEC;
+
+	if (isParallel)
+	{
+		m_dumps.emplace_back(std::make_unique<ConntrackDump>(this, AF_INET));
+		m_dumps.emplace_back(std::make_unique<ConntrackDump>(this, AF_INET6));
+	}
+	else
+	{
+		m_dumps.emplace_back(std::make_unique<ConntrackDump>(this, addressFamily));
+	}
+
+	const bool isRawDump = gCmdLine->hasArg("raw-dump");
+
+	for (std::unique_ptr<ConntrackDump> & pDump : m_dumps)
+	{
+		if (isRawDump)
+		{
+			pDump->pRawDumpSocket = std::make_unique<ConntrackDumpSocket>();
+			m_filter.applyToDumpSocket(*pDump->pRawDumpSocket);
+		}
+		else
+		{
+			pDump->pQuerySocket = std::make_unique<ConntrackSocket>();
+			pDump->pDumpFilter = m_filter.createDumpFilter(pDump->addressFamily);
+
+			if (nfct_callback_register(pDump->pQuerySocket->get(), NFCT_T_ALL, QueryCallback, pDump.get()) < 0)
+			{
+				throw std::system_error(errno, std::system_category(), "Unable to register conntrack query callback");
+			}
+		}
+	}
+
+	if (isParallel)
+	{
+		m_dumpWorkers.emplace_back(std::make_unique<ConntrackDumpWorker>(*m_dumps[0], "Dump IPv4"));
+		m_dumpWorkers.emplace_back(std::make_unique<ConntrackDumpWorker>(*m_dumps[1], "Dump IPv6"));
+
+		gLog->info("[Collector_Netfilter] IPv4 and IPv6 conntrack tables are dumped in parallel");
+	}
+
+	if (CmdLineArg *recordArg = gCmdLine->getArg("record"))
+	{
+		m_pCaptureWriter = std::make_unique<CaptureWriter>(recordArg->getValue());
+		gLog->info("[Collector_Netfilter] Recording conntrack table to '%s'", recordArg->getValue().c_str());
+	}
+
+	if (isEventDriven())
+	{
+		gLog->info("[Collector_Netfilter] Event-driven mode, conntrack table is reconciled every %u updates",
+		           m_dumpInterval);
+	}
 }
 
 Conntrack::~Conntrack()
 {
-	gApp->getPollSystem()->remove(m_eventSocket);
+	// workers have to be stopped before their dumps are destroyed
+	m_dumpWorkers.clear();
 }
 
-void Conntrack::init(IConnectionUpdateCallback *callback)
+/**
+ * @brief Receives all pending conntrack events.
+ * Changes are applied to the table immediately and stored in the current batch.
+ */
+void Conntrack::receiveEvents()
 {
-	if (!callback)
+	if (nfct_catch(m_eventSocket.get()) < 0)  // calls EventCallback
 	{
-		return;
+		if (errno == ENOBUFS)
+		{
+			gLog->warning("[Collector_Netfilter] Conntrack event socket buffer is full");
+			m_isReconcileRequired = true;
+		}
+		else if (errno == EAGAIN || errno == EWOULDBLOCK)
+		{
+			// all events were received from kernel
+		}
+		else
+		{
+			std::string errMsg = "Unable to receive conntrack events: ";
+			errMsg += Util::ErrnoToString();
+			throw Exception(std::move(errMsg), "Collector_Netfilter");
+		}
 	}
-
-	m_callback = callback;
-	m_isInitialized = true;
-	m_isRefillRequired = true;
-	m_isPaused = false;
 }
 
-void Conntrack::onUpdate()
+/**
+ * @brief Finishes the current batch.
+ * @param updateCount Number of updates since the previous call.
+ * @param batch Empty batch that receives all changes since the previous call.
+ */
+void Conntrack::update(unsigned int updateCount, ConntrackBatch & batch)
 {
-	if (!m_isInitialized || m_isPaused)
+	if (m_isPaused)
 	{
 		return;
 	}
 
-	if (m_isRefillRequired)
+	m_updatesSinceDump += updateCount;
+
+	if (m_isReconcileRequired)
 	{
-		m_callback->clear();
-		// connection list is now empty and it needs to be refilled
+		reconcile();
 	}
-	else
+	else if (m_updatesSinceDump >= m_dumpInterval)
 	{
-		// process conntrack events received from kernel since last update
-		for (const ConntrackEvent & event : m_eventQueue)
+		// traffic counters are available only in dumps, so the table is dumped at least every N updates
+		if (isEventDriven())
 		{
-			switch (event.getType())
-			{
-				case ConntrackEvent::NEW_CONNECTION:
-				{
-					m_callback->add(event.getConnection());
-					break;
-				}
-				case ConntrackEvent::REMOVED_CONNECTION:
-				{
-					m_callback->remove(event.getConnection());
-					break;
-				}
-			}
+			// the dump visits all entries anyway, so entries whose DESTROY events were missed are removed too
+			reconcile();
+		}
+		else
+		{
+			dump();
 		}
 	}
 
-	m_eventQueue.clear();
+	std::swap(batch, m_batch);
+}
+
+/**
+ * @brief Synchronizes the table with kernel using one full dump.
+ * Only new and vanished entries produce CREATE and REMOVE changes, so unchanged connections are kept.
+ */
+void Conntrack::reconcile()
+{
+	if (getTableSize() == 0)
+	{
+		reserveInitialLoad();
+	}
 
-	const uint32_t addressFamily = AF_UNSPEC;
-	// dump conntrack table to either refill connection list or update traffic and state of connections in the list
-	if (nfct_query(m_querySocket.get(), NFCT_Q_DUMP, &addressFamily) < 0)  // calls QueryCallback
+	for (ConntrackTable & table : m_tables)
 	{
-		std::string errMsg = "Unable to dump content of conntrack table: ";
-		errMsg += Util::ErrnoToString();
-		throw Exception(std::move(errMsg), "Collector_Netfilter");
+		table.beginGeneration();
 	}
 
-	if (m_isRefillRequired)
+	m_isReconcileRequired = false;
+	m_isReconciling = true;
+	dump();  // marks all dumped entries
+	m_isReconciling = false;
+
+	ConntrackBatch & batch = m_batch;
+	size_t removedCount = 0;
+
+	for (ConntrackTable & table : m_tables)
 	{
-		gLog->debug("[Collector_Netfilter] Refill done");
+		removedCount += table.sweep([&batch](const ConntrackTuple & tuple) -> void
+		{
+			batch.addRemove(tuple);
+		});
 	}
 
-	m_isRefillRequired = false;
+	gLog->debug("[Collector_Netfilter] Reconciliation done, %zu entries, %zu removed", getTableSize(), removedCount);
 }
 
-void Conntrack::handleQuery(nf_conntrack *ct)
+/**
+ * @brief Prepares the table and batches for loading the whole kernel table at once.
+ * The kernel does not count entries of each address family separately, so only one table is prepared. It is
+ * the IPv4 one if both families are dumped.
+ */
+void Conntrack::reserveInitialLoad()
 {
-	AddressData *srcAddress, *dstAddress;
-	PortData *srcPort, *dstPort;
-	if (!ExtractAddressPort(&srcAddress, &srcPort, &dstAddress, &dstPort, ct, m_callback, m_isRefillRequired))
+	const size_t count = GetKernelEntryCount();
+	if (count == 0)
 	{
 		return;
 	}
 
-	Connection connection(*srcAddress, *srcPort, *dstAddress, *dstPort);
+	getTable(m_filter.getAddressFamily()).reserve(count);
 
-	if (m_isRefillRequired)
+	// entries of parallel dumps are split between them in unknown ratio
+	if (m_dumps.size() == 1)
 	{
-		ConnectionTraffic traffic;
-		traffic.rxPackets = nfct_get_attr_u64(ct, ATTR_REPL_COUNTER_PACKETS);
-		traffic.txPackets = nfct_get_attr_u64(ct, ATTR_ORIG_COUNTER_PACKETS);
-		traffic.rxBytes = nfct_get_attr_u64(ct, ATTR_REPL_COUNTER_BYTES);
-		traffic.txBytes = nfct_get_attr_u64(ct, ATTR_ORIG_COUNTER_BYTES);
+		m_dumps[0]->batch.reserve(count);
+	}
 
-		int state = 0;
+	m_batch.reserve(m_batch.getSize() + count);
 
-		switch (connection.getType())
-		{
-			case EConnectionType::TCP4:
-			case EConnectionType::TCP6:
-			{
-				const uint8_t rawState = nfct_get_attr_u8(ct, ATTR_TCP_STATE);
-				state = TCPStateToEnum(rawState);
-				break;
-			}
-			default:
-			{
-				break;
-			}
-		}
+	gLog->debug("[Collector_Netfilter] Prepared for initial load of %zu entries", count);
+}
+
+void Conntrack::dump()
+{
+	const auto startTime = std::chrono::steady_clock::now();
 
-		m_callback->add(connection, traffic, state);
+	// speed is normalized by real time between dumps, so it does not depend on update interval and late updates
+	if (m_lastDumpTime != std::chrono::steady_clock::time_point())
+	{
+		const std::chrono::duration<double> timeSinceDump = startTime - m_lastDumpTime;
+		m_secondsSinceDump = timeSinceDump.count();
+	}
+
+	if (m_pCaptureWriter)
+	{
+		m_pCaptureWriter->writeDumpBegin();
+	}
+
+	// dump conntrack table to update traffic and state of connections in the table
+	if (m_dumpWorkers.empty())
+	{
+		RunDump(*m_dumps[0]);
 	}
 	else
 	{
-		ConnectionData *pData = m_callback->find(connection);
-		if (!pData)
+		for (std::unique_ptr<ConntrackDumpWorker> & pWorker : m_dumpWorkers)
 		{
-			return;
+			pWorker->start();
 		}
 
-		int updateFlags = 0;
-
-		switch (connection.getType())
+		for (std::unique_ptr<ConntrackDumpWorker> & pWorker : m_dumpWorkers)
 		{
-			case EConnectionType::TCP4:
-			case EConnectionType::TCP6:
-			{
-				const uint8_t rawState = nfct_get_attr_u8(ct, ATTR_TCP_STATE);
-				if (!TCPStateIsEqual(pData->getState(), rawState))
-				{
-					pData->setState(TCPStateToEnum(rawState));
-					updateFlags |= EConnectionUpdateFlags::PROTO_STATE;
-				}
-				break;
-			}
-			default:
-			{
-				break;
-			}
+			pWorker->wait();
 		}
+	}
 
-		uint64_t value;
-		uint64_t speed;
+	unsigned long entryCount = 0;
 
-		ConnectionTraffic & traffic = pData->getTraffic();
+	// changes are always merged in the same order to keep the result deterministic
+	for (std::unique_ptr<ConntrackDump> & pDump : m_dumps)
+	{
+		m_batch.append(pDump->batch);
+		pDump->batch.clear();
 
-		// number of received packets
-		value = nfct_get_attr_u64(ct, ATTR_REPL_COUNTER_PACKETS);
-		if (traffic.rxPackets != value)
+		if (m_pCaptureWriter)
 		{
-			traffic.rxPackets = value;
-			updateFlags |= EConnectionUpdateFlags::RX_PACKETS;
+			m_pCaptureWriter->writeDumpEntries(pDump->captureBuffer);
+			pDump->captureBuffer.clear();
 		}
 
-		// number of sent packets
-		value = nfct_get_attr_u64(ct, ATTR_ORIG_COUNTER_PACKETS);
-		if (traffic.txPackets != value)
-		{
-			traffic.txPackets = value;
-			updateFlags |= EConnectionUpdateFlags::TX_PACKETS;
-		}
+		entryCount += pDump->entryCount;
+	}
 
-		// number of received bytes and receive speed
-		value = nfct_get_attr_u64(ct, ATTR_REPL_COUNTER_BYTES);
-		speed = value - traffic.rxBytes;
-		if (speed != 0)
-		{
-			traffic.rxBytes = value;
-			updateFlags |= EConnectionUpdateFlags::RX_BYTES;
-			if (speed != traffic.rxSpeed)
-			{
-				traffic.rxSpeed = speed;
-				updateFlags |= EConnectionUpdateFlags::RX_SPEED;
-			}
-		}
-		else if (traffic.rxSpeed != 0)
-		{
-			traffic.rxSpeed = 0;
-			updateFlags |= EConnectionUpdateFlags::RX_SPEED;
-		}
+	if (m_pCaptureWriter)
+	{
+		m_pCaptureWriter->writeDumpEnd();
+	}
+
+	m_updatesSinceDump = 0;
+	m_isSpeedResetRequired = false;
+	m_lastDumpTime = startTime;
 
-		// number of sent bytes and send speed
-		value = nfct_get_attr_u64(ct, ATTR_ORIG_COUNTER_BYTES);
-		speed = value - traffic.txBytes;
-		if (speed != 0)
+	const std::chrono::duration<double> duration = std::chrono::steady_clock::now() - startTime;
+	m_dumpDuration = std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+
+	if (gLog->isMsgEnabled(Log::DEBUG))
+	{
+		const double entriesPerSecond = (duration.count() > 0) ? entryCount / duration.count() : 0;
+
+		gLog->debug("[Collector_Netfilter] Dumped %lu entries in %.3f ms (%.0f entries/s, %s%s)",
+		            entryCount, duration.count() * 1000, entriesPerSecond,
+		            (m_dumps[0]->pRawDumpSocket) ? "ctnetlink parser" : "libnetfilter_conntrack",
+		            (m_dumpWorkers.empty()) ? "" : ", parallel");
+	}
+}
+
+/**
+ * @brief Dumps conntrack table of one address family to the batch of the dump.
+ * Parallel dumps are executed by worker threads, so only the table of the dump family can be modified.
+ */
+void Conntrack::RunDump(ConntrackDump & dump)
+{
+	dump.entryCount = 0;
+
+	if (dump.pRawDumpSocket)
+	{
+		dump.entryCount = dump.pRawDumpSocket->dump(dump.addressFamily, RawDumpCallback, &dump);  // calls RawDumpCallback
+	}
+	else
+	{
+		int status;
+		if (dump.pDumpFilter)
 		{
-			traffic.txBytes = value;
-			updateFlags |= EConnectionUpdateFlags::TX_BYTES;
-			if (speed != traffic.txSpeed)
-			{
-				traffic.txSpeed = speed;
-				updateFlags |= EConnectionUpdateFlags::TX_SPEED;
-			}
+			status = nfct_query(dump.pQuerySocket->get(), NFCT_Q_DUMP_FILTER, dump.pDumpFilter);  // calls QueryCallback
 		}
-		else if (traffic.txSpeed != 0)
+		else
 		{
-			traffic.txSpeed = 0;
-			updateFlags |= EConnectionUpdateFlags::TX_SPEED;
+			const uint32_t addressFamily = dump.addressFamily;
+			status = nfct_query(dump.pQuerySocket->get(), NFCT_Q_DUMP, &addressFamily);  // calls QueryCallback
 		}
 
-		// update the connection if some value has changed
-		if (updateFlags)
+		if (status < 0)
 		{
-			m_callback->update(*pData, updateFlags);
+			std::string errMsg = "Unable to dump content of conntrack table: ";
+			errMsg += Util::ErrnoToString();
+			throw Exception(std::move(errMsg), "Collector_Netfilter");
 		}
 	}
+
+	Conntrack *self = dump.pConntrack;
+
+	if (dump.addressFamily != AF_INET6)
+	{
+		self->commitCounters(self->getTable(AF_INET), dump);
+	}
+
+	if (dump.addressFamily != AF_INET)
+	{
+		self->commitCounters(self->getTable(AF_INET6), dump);
+	}
 }
 
-void Conntrack::handleEvent(nf_conntrack *ct, ConntrackEvent::EType eventType)
+void Conntrack::handleQuery(const ConntrackRecord & record, ConntrackDump & dump)
 {
-	const bool isNew = (eventType == ConntrackEvent::NEW_CONNECTION);
+	if (!IsSupported(record.tuple) || !m_filter.matches(record))
+	{
+		return;
+	}
+
+	if (m_pCaptureWriter)
+	{
+		CaptureWriter::EncodeDumpEntry(dump.captureBuffer, ToCaptureEntry(record, CaptureEntry::DUMP_ENTRY));
+	}
+
+	ConntrackTable & table = getTable(record.tuple.l3proto);
+	const uint32_t row = table.find(record.tuple);
 
-	AddressData *srcAddress, *dstAddress;
-	PortData *srcPort, *dstPort;
-	if (!ExtractAddressPort(&srcAddress, &srcPort, &dstAddress, &dstPort, ct, m_callback, isNew))
+	if (row == ConntrackTable::NO_ROW)
 	{
+		// the dump also adds connections whose NEW events were not received
+		if (m_isReconciling || isEventDriven())
+		{
+			ConnectionTraffic traffic;
+			traffic.rxPackets = record.rxPackets;
+			traffic.txPackets = record.txPackets;
+			traffic.rxBytes = record.rxBytes;
+			traffic.txBytes = record.txBytes;
+
+			const int state = GetState(record);
+
+			table.add(record.tuple, traffic, state);
+			dump.batch.addCreate(record.tuple, traffic, state);
+		}
+
 		return;
 	}
 
-	Connection connection(*srcAddress, *srcPort, *dstAddress, *dstPort);
+	table.mark(row);
+
+	int updateFlags = 0;
 
-	m_eventQueue.emplace_back(eventType, connection);
+	if (record.tuple.l4proto == IPPROTO_TCP && !TCPStateIsEqual(table.getState(row), record.tcpState))
+	{
+		table.setState(row, TCPStateToEnum(record.tcpState));
+		updateFlags |= EConnectionUpdateFlags::PROTO_STATE;
+	}
+
+	// traffic changes of all dumped entries are computed at once after the dump
+	table.setDumpedCounters(row, record.rxPackets, record.txPackets, record.rxBytes, record.txBytes, updateFlags);
 }
 
-int Conntrack::QueryCallback(nf_conntrack_msg_type /* unused */, nf_conntrack *ct, void *param)
+/**
+ * @brief Computes traffic changes of all entries in the table from counters stored by the dump.
+ */
+void Conntrack::commitCounters(ConntrackTable & table, ConntrackDump & dump)
 {
-	Conntrack *self = static_cast<Conntrack*>(param);
+	// speed is unknown after pause, because the counters were not read for some time
+	const double seconds = (m_isSpeedResetRequired) ? 0 : m_secondsSinceDump;
 
-	self->handleQuery(ct);
-
-	return NFCT_CB_CONTINUE;
+	table.commitCounters(seconds, [&table, &dump](uint32_t row, int updateFlags) -> void
+	{
+		dump.batch.addUpdate(table.getTuple(row), table.getTraffic(row), table.getState(row), updateFlags);
+	});
 }
 
-int Conntrack::EventCallback(nf_conntrack_msg_type type, nf_conntrack *ct, void *param)
+void Conntrack::handleEvent(const ConntrackRecord & record, nf_conntrack_msg_type type)
 {
-	Conntrack *self = static_cast<Conntrack*>(param);
+	if (!IsSupported(record.tuple) || !m_filter.matches(record))
+	{
+		return;
+	}
 
-	if (!self->m_isRefillRequired)
+	if (m_pCaptureWriter)
 	{
 		switch (type)
 		{
 			case NFCT_T_NEW:
 			{
-				self->handleEvent(ct, ConntrackEvent::NEW_CONNECTION);
+				m_pCaptureWriter->writeEvent(ToCaptureEntry(record, CaptureEntry::EVENT_NEW));
+				break;
+			}
+			case NFCT_T_UPDATE:
+			{
+				if (record.hasTCPState)
+				{
+					m_pCaptureWriter->writeEvent(ToCaptureEntry(record, CaptureEntry::EVENT_UPDATE));
+				}
 				break;
 			}
 			case NFCT_T_DESTROY:
 			{
-				self->handleEvent(ct, ConntrackEvent::REMOVED_CONNECTION);
+				m_pCaptureWriter->writeEvent(ToCaptureEntry(record, CaptureEntry::EVENT_DESTROY));
 				break;
 			}
 			default:
@@ -524,39 +760,106 @@ int Conntrack::EventCallback(nf_conntrack_msg_type type, nf_conntrack *ct, void
 		}
 	}
 
-	return NFCT_CB_CONTINUE;
-}
+	ConntrackTable & table = getTable(record.tuple.l3proto);
 
-void Conntrack::EventPollHandler(int flags, void *param)
-{
-	Conntrack *self = static_cast<Conntrack*>(param);
-
-	if (flags & EPollFlags::INPUT)
+	switch (type)
 	{
-		if (nfct_catch(self->m_eventSocket.get()) < 0)  // calls EventCallback
+		case NFCT_T_NEW:
+		{
+			const int state = (record.hasTCPState) ? GetState(record) : 0;
+
+			if (table.add(record.tuple, ConnectionTraffic(), state).second)
+			{
+				m_batch.addCreate(record.tuple, ConnectionTraffic(), state);
+			}
+			break;
+		}
+		case NFCT_T_UPDATE:
 		{
-			if (errno == ENOBUFS)
+			// kernel includes protocol state in UPDATE events only when it has changed
+			if (!record.hasTCPState)
 			{
-				gLog->warning("[Collector_Netfilter] Conntrack event socket buffer is full");
-				self->m_isRefillRequired = true;
+				break;
 			}
-			else if (errno == EAGAIN || errno == EWOULDBLOCK)
+
+			const uint32_t row = table.find(record.tuple);
+			const int state = GetState(record);
+
+			if (row != ConntrackTable::NO_ROW && table.getState(row) != state)
 			{
-				// all events were received from kernel
+				table.setState(row, state);
+				m_batch.addUpdate(record.tuple, table.getTraffic(row), state, EConnectionUpdateFlags::PROTO_STATE);
 			}
-			else
+			break;
+		}
+		case NFCT_T_DESTROY:
+		{
+			if (table.remove(record.tuple))
 			{
-				std::string errMsg = "Unable to receive conntrack events: ";
-				errMsg += Util::ErrnoToString();
-				throw Exception(std::move(errMsg), "Collector_Netfilter");
+				m_batch.addRemove(record.tuple);
 			}
+			break;
 		}
+		default:
+		{
+			break;
+		}
+	}
+}
+
+int Conntrack::QueryCallback(nf_conntrack_msg_type /* unused */, nf_conntrack *ct, void *param)
+{
+	ConntrackDump *pDump = static_cast<ConntrackDump*>(param);
+
+	ConntrackRecord record = {};
+	FillRecord(record, ct);
+
+	pDump->pConntrack->handleQuery(record, *pDump);
+	pDump->entryCount++;
+
+	return NFCT_CB_CONTINUE;
+}
+
+int Conntrack::EventCallback(nf_conntrack_msg_type type, nf_conntrack *ct, void *param)
+{
+	Conntrack *self = static_cast<Conntrack*>(param);
+
+	if (!self->m_isPaused)
+	{
+		ConntrackRecord record = {};
+		FillRecord(record, ct);
+
+		self->handleEvent(record, type);
+	}
+
+	return NFCT_CB_CONTINUE;
+}
+
+void Conntrack::RawDumpCallback(const ConntrackRecord & record, void *param)
+{
+	ConntrackDump *pDump = static_cast<ConntrackDump*>(param);
+
+	pDump->pConntrack->handleQuery(record, *pDump);
+}
+
+unsigned int Conntrack::GetDumpInterval()
+{
+	CmdLineArg *intervalArg = gCmdLine->getArg("dump-interval");
+	if (!intervalArg)
+	{
+		return 1;
 	}
 
-	if (flags & EPollFlags::ERROR)
+	const KString value = intervalArg->getValue();
+
+	unsigned long interval;
+	if (!Util::StringToUInt(value, interval) || interval < 1 || interval > 3600)
 	{
-		throw Exception("Conntrack event socket poll failed", "Collector_Netfilter");
+		std::string errMsg = "Invalid value '";
+		errMsg += value;
+		errMsg += "' of '--dump-interval'";
+		throw Exception(std::move(errMsg), "Collector_Netfilter");
 	}
 
-	gApp->getPollSystem()->reset(self->m_eventSocket, EPollFlags::INPUT);
+	return interval;
 }
@@ -7,84 +7,187 @@
 
 #include <libnetfilter_conntrack/libnetfilter_conntrack.h>
 #include <libnetfilter_conntrack/libnetfilter_conntrack_tcp.h>
-#include <deque>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Collector_Common/ConntrackRecord.hpp"
+#include "Collector_Common/ConntrackTable.hpp"
+#include "ConntrackBatch.hpp"
+#include "ConntrackFilter.hpp"
+#include "ConntrackNetlink.hpp"
+#include "Thread.hpp"
+#include "Collector_Common/Capture.hpp"
+
+#include "readerwriterqueue/readerwriterqueue.h"
 
-#include "Connection.hpp"
-
-class ConntrackEvent
+class ConntrackSocket
 {
+	nfct_handle *m_socket;
+
 public:
-	enum EType
-	{
-		NEW_CONNECTION,
-		REMOVED_CONNECTION
-	};
+	ConntrackSocket(unsigned int events = 0);
+	~ConntrackSocket();
 
-private:
-	EType m_type;
-	Connection m_connection;
+	nfct_handle *get()
+	{
+		return m_socket;
+	}
 
-public:
-	ConntrackEvent(EType type, const Connection & connection)
-	: m_type(type),
-	  m_connection(connection)
+	int getFD()
 	{
+		return nfct_fd(m_socket);
 	}
+};
 
-	EType getType() const
+class Conntrack;
+
+/**
+ * @brief Dump of conntrack table for one address family or for all of them.
+ */
+struct ConntrackDump
+{
+	Conntrack *pConntrack;
+	std::unique_ptr<ConntrackSocket> pQuerySocket;
+	std::unique_ptr<ConntrackDumpSocket> pRawDumpSocket;
+	nfct_filter_dump *pDumpFilter;
+	ConntrackBatch batch;
+	std::string captureBuffer;
+	unsigned long entryCount;
+	uint8_t addressFamily;
+
+	ConntrackDump(Conntrack *conntrack, uint8_t family)
+	: pConntrack(conntrack),
+	  pQuerySocket(),
+	  pRawDumpSocket(),
+	  pDumpFilter(nullptr),
+	  batch(),
+	  captureBuffer(),
+	  entryCount(0),
+	  addressFamily(family)
 	{
-		return m_type;
 	}
 
-	const Connection & getConnection() const
+	~ConntrackDump()
 	{
-		return m_connection;
+		if (pDumpFilter)
+		{
+			nfct_filter_dump_destroy(pDumpFilter);
+		}
 	}
+
+	// no copy
+	ConntrackDump(const ConntrackDump &) = delete;
+	ConntrackDump & operator=(const ConntrackDump &) = delete;
 };
 
-class ConntrackSocket
+/**
+ * @brief Thread that performs one conntrack dump on request.
+ */
+class ConntrackDumpWorker
 {
-	nfct_handle *m_socket;
+	moodycamel::BlockingReaderWriterQueue<bool> m_requestQueue;
+	moodycamel::BlockingReaderWriterQueue<std::string> m_resultQueue;
+	Thread m_thread;
+
+	void workerLoop(ConntrackDump & dump);  // executed by worker thread
 
 public:
-	ConntrackSocket(unsigned int events = 0);
-	~ConntrackSocket();
+	ConntrackDumpWorker(ConntrackDump & dump, std::string threadName);
+	~ConntrackDumpWorker();
 
-	nfct_handle *get()
+	void start()
 	{
-		return m_socket;
+		m_requestQueue.enqueue(true);
 	}
 
-	int getFD()
-	{
-		return nfct_fd(m_socket);
-	}
+	void wait();
 };
 
+/**
+ * @brief Conntrack table reader.
+ * Everything except constructor and destructor is executed by the collector thread.
+ */
 class Conntrack
 {
-	std::deque<ConntrackEvent> m_eventQueue;
-	ConntrackSocket m_querySocket;
+	ConntrackTable m_tables[2];  // IPv4 and IPv6
+	ConntrackBatch m_batch;
+	ConntrackFilter m_filter;
+	unsigned int m_dumpInterval;
+	unsigned int m_updatesSinceDump;
+	std::chrono::steady_clock::time_point m_lastDumpTime;
+	double m_secondsSinceDump;
+	std::atomic<uint64_t> m_dumpDuration;  // microseconds
 	ConntrackSocket m_eventSocket;
-	IConnectionUpdateCallback *m_callback;
-	bool m_isInitialized;
-	bool m_isRefillRequired;
+	std::vector<std::unique_ptr<ConntrackDump>> m_dumps;
+	std::vector<std::unique_ptr<ConntrackDumpWorker>> m_dumpWorkers;
+	std::unique_ptr<CaptureWriter> m_pCaptureWriter;
+	bool m_isReconcileRequired;
+	bool m_isReconciling;
+	bool m_isSpeedResetRequired;
 	bool m_isPaused;
 
-	void handleQuery(nf_conntrack *ct);
-	void handleEvent(nf_conntrack *ct, ConntrackEvent::EType eventType);
+	void dump();
+	void reconcile();
+	void reserveInitialLoad();
+	void handleQuery(const ConntrackRecord & record, ConntrackDump & dump);
+	void commitCounters(ConntrackTable & table, ConntrackDump & dump);
+	void handleEvent(const ConntrackRecord & record, nf_conntrack_msg_type type);
+
+	ConntrackTable & getTable(uint8_t addressFamily)
+	{
+		return m_tables[(addressFamily == AF_INET6) ? 1 : 0];
+	}
+
+	size_t getTableSize() const
+	{
+		return m_tables[0].getSize() + m_tables[1].getSize();
+	}
+
+	bool isEventDriven() const
+	{
+		return m_dumpInterval > 1;
+	}
+
+	static unsigned int GetDumpInterval();
+	static void RunDump(ConntrackDump & dump);
 
 	static int QueryCallback(nf_conntrack_msg_type type, nf_conntrack *ct, void *param);
 	static int EventCallback(nf_conntrack_msg_type type, nf_conntrack *ct, void *param);
-	static void EventPollHandler(int flags, void *param);
+	static void RawDumpCallback(const ConntrackRecord & record, void *param);
+
+	friend class ConntrackDumpWorker;
 
 public:
 	Conntrack();
 	~Conntrack();
 
-	void init(IConnectionUpdateCallback *callback);
+	static void FillRecord(ConntrackRecord & record, nf_conntrack *ct);
+
+	void receiveEvents();
+
+	void update(unsigned int updateCount, ConntrackBatch & batch);
+
+	int getEventFD()
+	{
+		return m_eventSocket.getFD();
+	}
+
+	unsigned int getDumpInterval() const
+	{
+		return m_dumpInterval;
+	}
 
-	void onUpdate();
+	/**
+	 * @brief Returns how long the last dump took in microseconds.
+	 * This function can be called from any thread.
+	 */
+	uint64_t getLastDumpDuration() const
+	{
+		return m_dumpDuration;
+	}
 
 	bool isPaused() const
 	{
@@ -96,7 +199,13 @@ public:
 		if (m_isPaused != paused)
 		{
 			m_isPaused = paused;
-			m_isRefillRequired = true;
+
+			if (!paused)
+			{
+				// events received during pause were dropped and counters grew for unknown time
+				m_isReconcileRequired = true;
+				m_isSpeedResetRequired = true;
+			}
 		}
 	}
 };
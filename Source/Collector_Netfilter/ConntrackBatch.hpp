@@ -0,0 +1,114 @@
+/**
+ * @file
+ * @brief ConntrackBatch class.
+ */
+
+#pragma once
+
+#include <vector>
+
+#include "Connection.hpp"
+#include "Collector_Common/ConntrackRecord.hpp"
+
+struct ConntrackDelta
+{
+	enum EType
+	{
+		CREATE,
+		UPDATE,
+		REMOVE
+	};
+
+	EType type;
+	ConntrackTuple tuple;
+	ConnectionTraffic traffic;
+	int state;
+	int updateFlags;
+
+	ConntrackDelta(EType deltaType, const ConntrackTuple & deltaTuple,
+	               const ConnectionTraffic & deltaTraffic = ConnectionTraffic(), int deltaState = 0,
+	               int deltaUpdateFlags = 0)
+	: type(deltaType),
+	  tuple(deltaTuple),
+	  traffic(deltaTraffic),
+	  state(deltaState),
+	  updateFlags(deltaUpdateFlags)
+	{
+	}
+};
+
+/**
+ * @brief Changes in conntrack table produced by the collector thread in one update.
+ * The main thread applies the whole batch at once.
+ */
+class ConntrackBatch
+{
+	std::vector<ConntrackDelta> m_deltas;
+	size_t m_createCount;
+
+public:
+	ConntrackBatch()
+	: m_deltas(),
+	  m_createCount(0)
+	{
+	}
+
+	void addCreate(const ConntrackTuple & tuple, const ConnectionTraffic & traffic, int state)
+	{
+		m_deltas.emplace_back(ConntrackDelta::CREATE, tuple, traffic, state);
+		m_createCount++;
+	}
+
+	void addUpdate(const ConntrackTuple & tuple, const ConnectionTraffic & traffic, int state, int updateFlags)
+	{
+		m_deltas.emplace_back(ConntrackDelta::UPDATE, tuple, traffic, state, updateFlags);
+	}
+
+	void addRemove(const ConntrackTuple & tuple)
+	{
+		m_deltas.emplace_back(ConntrackDelta::REMOVE, tuple);
+	}
+
+	void append(const ConntrackBatch & other)
+	{
+		m_deltas.insert(m_deltas.end(), other.m_deltas.begin(), other.m_deltas.end());
+		m_createCount += other.m_createCount;
+	}
+
+	void reserve(size_t count)
+	{
+		m_deltas.reserve(count);
+	}
+
+	void clear()
+	{
+		m_deltas.clear();
+		m_createCount = 0;
+	}
+
+	bool isEmpty() const
+	{
+		return m_deltas.empty();
+	}
+
+	size_t getSize() const
+	{
+		return m_deltas.size();
+	}
+
+	//! Number of new connections in the batch.
+	size_t getCreateCount() const
+	{
+		return m_createCount;
+	}
+
+	std::vector<ConntrackDelta>::const_iterator begin() const
+	{
+		return m_deltas.begin();
+	}
+
+	std::vector<ConntrackDelta>::const_iterator end() const
+	{
+		return m_deltas.end();
+	}
+};
@@ -0,0 +1,535 @@
+/**
+ * @file
+ * @brief Implementation of ConntrackFilter class.
+ */
+
+#include <arpa/inet.h>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include "ConntrackFilter.hpp"
+#include "ConntrackNetlink.hpp"
+#include "Log.hpp"
+#include "Exception.hpp"
+#include "Util.hpp"
+
+static bool ParseNumber(const std::string & value, unsigned long maxValue, unsigned long & result)
+{
+	// strtoul would skip whitespace and accept sign
+	if (value.empty() || value[0] < '0' || value[0] > '9')
+	{
+		return false;
+	}
+
+	// decimal or hexadecimal with 0x prefix, leading zeros do not mean octal
+	const bool isHex = value.length() > 2 && value[0] == '0' && (value[1] == 'x' || value[1] == 'X');
+	const char *begin = value.c_str() + ((isHex) ? 2 : 0);
+
+	if (isHex && !std::isxdigit(static_cast<unsigned char>(*begin)))
+	{
+		return false;
+	}
+
+	errno = 0;
+	char *end = nullptr;
+	const unsigned long number = std::strtoul(begin, &end, (isHex) ? 16 : 10);
+	if (errno != 0 || end == begin || *end != '\0' || number > maxValue)
+	{
+		return false;
+	}
+
+	result = number;
+
+	return true;
+}
+
+static void ThrowInvalidTerm(const std::string & term)
+{
+	std::string errMsg = "Invalid filter '";
+	errMsg += term;
+	errMsg += "' in '--filter'";
+	throw Exception(std::move(errMsg), "Collector_Netfilter");
+}
+
+bool ConntrackFilter::AddressRule::matches(const ConntrackTuple & tuple) const
+{
+	if (tuple.l3proto != l3proto)
+	{
+		return false;
+	}
+
+	auto AddressMatches = [this](const uint32_t *address) -> bool
+	{
+		for (int i = 0; i < 4; i++)
+		{
+			if ((address[i] & mask[i]) != addr[i])
+				return false;
+		}
+		return true;
+	};
+
+	switch (side)
+	{
+		case SOURCE:      return AddressMatches(tuple.srcAddr);
+		case DESTINATION: return AddressMatches(tuple.dstAddr);
+		case ANY_SIDE:    return AddressMatches(tuple.srcAddr) || AddressMatches(tuple.dstAddr);
+	}
+
+	return false;
+}
+
+ConntrackFilter::ConntrackFilter()
+: m_addressRules(),
+  m_ports(),
+  m_mark(0),
+  m_markMask(0),
+  m_zone(0),
+  m_hasIP4(false),
+  m_hasIP6(false),
+  m_hasTCP(false),
+  m_hasUDP(false),
+  m_hasMark(false),
+  m_hasZone(false)
+{
+}
+
+/**
+ * @brief Adds comma-separated filter terms.
+ * Supported terms are ip4, ip6, tcp, udp, src=ADDR[/PREFIX], dst=ADDR[/PREFIX], host=ADDR[/PREFIX], port=PORT,
+ * mark=MARK[/MASK] and zone=ZONE. Address terms can be negated with '!'. Terms of the same kind are
+ * OR-ed and terms of different kinds are AND-ed.
+ * @param spec The filter specification.
+ */
+void ConntrackFilter::parse(const KString & spec)
+{
+	const std::string specString = spec;
+
+	size_t begin = 0;
+	while (begin <= specString.length())
+	{
+		size_t end = specString.find(',', begin);
+		if (end == std::string::npos)
+		{
+			end = specString.length();
+		}
+
+		parseTerm(specString.substr(begin, end - begin));
+
+		begin = end + 1;
+	}
+}
+
+void ConntrackFilter::parseTerm(const std::string & term)
+{
+	const bool isNegative = (!term.empty() && term[0] == '!');
+	const size_t nameBegin = (isNegative) ? 1 : 0;
+	const size_t separatorPos = term.find('=');
+
+	if (separatorPos == std::string::npos)
+	{
+		const std::string name = term.substr(nameBegin);
+
+		if (isNegative)
+		{
+			ThrowInvalidTerm(term);
+		}
+		else if (name == "ip4")
+		{
+			m_hasIP4 = true;
+		}
+		else if (name == "ip6")
+		{
+			m_hasIP6 = true;
+		}
+		else if (name == "tcp")
+		{
+			m_hasTCP = true;
+		}
+		else if (name == "udp")
+		{
+			m_hasUDP = true;
+		}
+		else
+		{
+			ThrowInvalidTerm(term);
+		}
+
+		return;
+	}
+
+	const std::string name = term.substr(nameBegin, separatorPos - nameBegin);
+	const std::string value = term.substr(separatorPos + 1);
+
+	if (name == "src")
+	{
+		parseAddressRule(term, value, SOURCE, isNegative);
+	}
+	else if (name == "dst")
+	{
+		parseAddressRule(term, value, DESTINATION, isNegative);
+	}
+	else if (name == "host")
+	{
+		parseAddressRule(term, value, ANY_SIDE, isNegative);
+	}
+	else if (isNegative)
+	{
+		ThrowInvalidTerm(term);
+	}
+	else if (name == "port")
+	{
+		unsigned long port;
+		if (!Util::StringToUInt(value, port) || port > 0xFFFF)
+		{
+			ThrowInvalidTerm(term);
+		}
+
+		m_ports.push_back(port);
+	}
+	else if (name == "mark")
+	{
+		const size_t maskPos = value.find('/');
+
+		unsigned long mark;
+		unsigned long mask = 0xFFFFFFFF;
+		if (!ParseNumber(value.substr(0, maskPos), 0xFFFFFFFF, mark))
+		{
+			ThrowInvalidTerm(term);
+		}
+
+		if (maskPos != std::string::npos && !ParseNumber(value.substr(maskPos + 1), 0xFFFFFFFF, mask))
+		{
+			ThrowInvalidTerm(term);
+		}
+
+		m_mark = mark & mask;
+		m_markMask = mask;
+		m_hasMark = true;
+	}
+	else if (name == "zone")
+	{
+		unsigned long zone;
+		if (!Util::StringToUInt(value, zone) || zone > 0xFFFF)
+		{
+			ThrowInvalidTerm(term);
+		}
+
+		m_zone = zone;
+		m_hasZone = true;
+	}
+	else
+	{
+		ThrowInvalidTerm(term);
+	}
+}
+
+void ConntrackFilter::parseAddressRule(const std::string & term, const std::string & value, ESide side, bool isNegative)
+{
+	AddressRule rule = {};
+	rule.side = side;
+	rule.isNegative = isNegative;
+
+	const size_t prefixPos = value.find('/');
+	const std::string address = value.substr(0, prefixPos);
+
+	unsigned long maxPrefix;
+	if (inet_pton(AF_INET, address.c_str(), rule.addr) == 1)
+	{
+		rule.l3proto = AF_INET;
+		maxPrefix = 32;
+	}
+	else if (inet_pton(AF_INET6, address.c_str(), rule.addr) == 1)
+	{
+		rule.l3proto = AF_INET6;
+		maxPrefix = 128;
+	}
+	else
+	{
+		ThrowInvalidTerm(term);
+		return;
+	}
+
+	unsigned long prefix = maxPrefix;
+	if (prefixPos != std::string::npos)
+	{
+		if (!Util::StringToUInt(value.substr(prefixPos + 1), prefix) || prefix > maxPrefix)
+		{
+			ThrowInvalidTerm(term);
+		}
+	}
+
+	for (int i = 0; i < 4; i++)
+	{
+		const long bits = static_cast<long>(prefix) - (i * 32);
+
+		uint32_t mask = 0;
+		if (bits >= 32)
+		{
+			mask = 0xFFFFFFFF;
+		}
+		else if (bits > 0)
+		{
+			mask = ~(0xFFFFFFFF >> bits);
+		}
+
+		rule.mask[i] = htonl(mask);
+		rule.addr[i] &= rule.mask[i];
+	}
+
+	m_addressRules.push_back(rule);
+}
+
+/**
+ * @brief Creates filter for dumps using libnetfilter_conntrack.
+ * @param addressFamily Address family of the dump or AF_UNSPEC.
+ * @return New filter that must be destroyed by the caller or null if the dump does not need to be filtered.
+ */
+nfct_filter_dump *ConntrackFilter::createDumpFilter(uint8_t addressFamily) const
+{
+	if (!m_hasMark && addressFamily == AF_UNSPEC)
+	{
+		return nullptr;
+	}
+
+	nfct_filter_dump *pDumpFilter = nfct_filter_dump_create();
+	if (!pDumpFilter)
+	{
+		throw Exception("Unable to create conntrack dump filter", "Collector_Netfilter");
+	}
+
+	if (m_hasMark)
+	{
+		nfct_filter_dump_mark mark;
+		mark.val = m_mark;
+		mark.mask = m_markMask;
+		nfct_filter_dump_set_attr(pDumpFilter, NFCT_FILTER_DUMP_MARK, &mark);
+	}
+
+	nfct_filter_dump_set_attr_u8(pDumpFilter, NFCT_FILTER_DUMP_L3NUM, addressFamily);
+
+	return pDumpFilter;
+}
+
+void ConntrackFilter::addAddressRulesTo(nfct_filter *filter, ESide side, uint8_t l3proto) const
+{
+	const bool isIP4 = (l3proto == AF_INET);
+
+	nfct_filter_attr attr;
+	if (side == SOURCE)
+	{
+		attr = (isIP4) ? NFCT_FILTER_SRC_IPV4 : NFCT_FILTER_SRC_IPV6;
+	}
+	else
+	{
+		attr = (isIP4) ? NFCT_FILTER_DST_IPV4 : NFCT_FILTER_DST_IPV6;
+	}
+
+	bool hasPositive = false;
+	bool hasNegative = false;
+	for (const AddressRule & rule : m_addressRules)
+	{
+		if (rule.side == side && rule.l3proto == l3proto)
+		{
+			if (rule.isNegative)
+				hasNegative = true;
+			else
+				hasPositive = true;
+		}
+	}
+
+	// kernel filter has only one logic per attribute, so mixed rules are left to userspace
+	if (hasPositive == hasNegative)
+	{
+		return;
+	}
+
+	for (const AddressRule & rule : m_addressRules)
+	{
+		if (rule.side != side || rule.l3proto != l3proto)
+		{
+			continue;
+		}
+
+		// kernel filter uses host byte order
+		if (isIP4)
+		{
+			nfct_filter_ipv4 value;
+			value.addr = ntohl(rule.addr[0]);
+			value.mask = ntohl(rule.mask[0]);
+			nfct_filter_add_attr(filter, attr, &value);
+		}
+		else
+		{
+			nfct_filter_ipv6 value;
+			for (int i = 0; i < 4; i++)
+			{
+				value.addr[i] = ntohl(rule.addr[i]);
+				value.mask[i] = ntohl(rule.mask[i]);
+			}
+			nfct_filter_add_attr(filter, attr, &value);
+		}
+	}
+
+	nfct_filter_set_logic(filter, attr, (hasNegative) ? NFCT_FILTER_LOGIC_NEGATIVE : NFCT_FILTER_LOGIC_POSITIVE);
+}
+
+/**
+ * @brief Installs BPF filter on conntrack event socket.
+ * Events of protocols not supported by conntop are always dropped in kernel.
+ * @param fd File descriptor of the event socket.
+ */
+void ConntrackFilter::attachToEventSocket(int fd) const
+{
+	nfct_filter *filter = nfct_filter_create();
+	if (!filter)
+	{
+		throw Exception("Unable to create conntrack event filter", "Collector_Netfilter");
+	}
+
+	if (m_hasTCP || !m_hasUDP)
+	{
+		nfct_filter_add_attr_u32(filter, NFCT_FILTER_L4PROTO, IPPROTO_TCP);
+	}
+
+	if (m_hasUDP || !m_hasTCP)
+	{
+		nfct_filter_add_attr_u32(filter, NFCT_FILTER_L4PROTO, IPPROTO_UDP);
+	}
+
+	addAddressRulesTo(filter, SOURCE, AF_INET);
+	addAddressRulesTo(filter, SOURCE, AF_INET6);
+	addAddressRulesTo(filter, DESTINATION, AF_INET);
+	addAddressRulesTo(filter, DESTINATION, AF_INET6);
+
+	if (m_hasMark)
+	{
+		nfct_filter_dump_mark mark;
+		mark.val = m_mark;
+		mark.mask = m_markMask;
+		nfct_filter_add_attr(filter, NFCT_FILTER_MARK, &mark);
+	}
+
+	if (nfct_filter_attach(fd, filter) < 0)
+	{
+		gLog->warning("[Collector_Netfilter] Unable to attach conntrack event filter: %s", Util::ErrnoToString().c_str());
+	}
+	else
+	{
+		gLog->info("[Collector_Netfilter] Conntrack event filter attached");
+	}
+
+	nfct_filter_destroy(filter);
+}
+
+void ConntrackFilter::applyToDumpSocket(ConntrackDumpSocket & socket) const
+{
+	if (m_hasMark)
+	{
+		socket.setMarkFilter(m_mark, m_markMask);
+	}
+
+	if (m_hasZone)
+	{
+		socket.setZoneFilter(m_zone);
+	}
+}
+
+bool ConntrackFilter::matchesAddressRules(const ConntrackTuple & tuple) const
+{
+	bool hasPositive[3] = {};
+	bool matchesPositive[3] = {};
+
+	for (const AddressRule & rule : m_addressRules)
+	{
+		const bool isMatch = rule.matches(tuple);
+
+		if (rule.isNegative)
+		{
+			if (isMatch)
+			{
+				return false;
+			}
+		}
+		else
+		{
+			hasPositive[rule.side] = true;
+			if (isMatch)
+			{
+				matchesPositive[rule.side] = true;
+			}
+		}
+	}
+
+	for (int side = 0; side < 3; side++)
+	{
+		if (hasPositive[side] && !matchesPositive[side])
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * @brief Checks conntrack entry in userspace.
+ * @param record The entry.
+ * @return True, if the entry passes the filter, otherwise false.
+ */
+bool ConntrackFilter::matches(const ConntrackRecord & record) const
+{
+	const ConntrackTuple & tuple = record.tuple;
+
+	if (m_hasIP4 != m_hasIP6)
+	{
+		if (tuple.l3proto != ((m_hasIP4) ? AF_INET : AF_INET6))
+		{
+			return false;
+		}
+	}
+
+	if (m_hasTCP != m_hasUDP)
+	{
+		if (tuple.l4proto != ((m_hasTCP) ? IPPROTO_TCP : IPPROTO_UDP))
+		{
+			return false;
+		}
+	}
+
+	if (!m_addressRules.empty() && !matchesAddressRules(tuple))
+	{
+		return false;
+	}
+
+	if (!m_ports.empty())
+	{
+		bool isPortMatch = false;
+		for (uint16_t port : m_ports)
+		{
+			if (tuple.srcPort == port || tuple.dstPort == port)
+			{
+				isPortMatch = true;
+				break;
+			}
+		}
+
+		if (!isPortMatch)
+		{
+			return false;
+		}
+	}
+
+	if (m_hasMark && (record.mark & m_markMask) != m_mark)
+	{
+		return false;
+	}
+
+	if (m_hasZone && record.zone != m_zone)
+	{
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,95 @@
+/**
+ * @file
+ * @brief ConntrackFilter class.
+ */
+
+#pragma once
+
+#include <libnetfilter_conntrack/libnetfilter_conntrack.h>
+#include <string>
+#include <vector>
+
+#include "KString.hpp"
+#include "Collector_Common/ConntrackRecord.hpp"
+
+class ConntrackDumpSocket;
+
+/**
+ * @brief Filter of conntrack entries.
+ * As much as possible is done by kernel - BPF filter on the event socket and filtered dumps. Everything
+ * is checked once again in userspace, because not every kernel supports all the dump filter attributes.
+ */
+class ConntrackFilter
+{
+	enum ESide
+	{
+		SOURCE,
+		DESTINATION,
+		ANY_SIDE
+	};
+
+	struct AddressRule
+	{
+		uint32_t addr[4];  // network byte order
+		uint32_t mask[4];  // network byte order
+		uint8_t l3proto;
+		ESide side;
+		bool isNegative;
+
+		bool matches(const ConntrackTuple & tuple) const;
+	};
+
+	std::vector<AddressRule> m_addressRules;
+	std::vector<uint16_t> m_ports;
+	uint32_t m_mark;
+	uint32_t m_markMask;
+	uint16_t m_zone;
+	bool m_hasIP4;
+	bool m_hasIP6;
+	bool m_hasTCP;
+	bool m_hasUDP;
+	bool m_hasMark;
+	bool m_hasZone;
+
+	void parseTerm(const std::string & term);
+	void parseAddressRule(const std::string & term, const std::string & value, ESide side, bool isNegative);
+	bool matchesAddressRules(const ConntrackTuple & tuple) const;
+	void addAddressRulesTo(nfct_filter *filter, ESide side, uint8_t l3proto) const;
+
+public:
+	ConntrackFilter();
+
+	void parse(const KString & spec);
+
+	void attachToEventSocket(int fd) const;
+	void applyToDumpSocket(ConntrackDumpSocket & socket) const;
+	nfct_filter_dump *createDumpFilter(uint8_t addressFamily) const;
+
+	bool matches(const ConntrackRecord & record) const;
+
+	bool isEmpty() const
+	{
+		return m_addressRules.empty()
+		    && m_ports.empty()
+		    && !m_hasIP4
+		    && !m_hasIP6
+		    && !m_hasTCP
+		    && !m_hasUDP
+		    && !m_hasMark
+		    && !m_hasZone;
+	}
+
+	/**
+	 * @return AF_INET, AF_INET6 or AF_UNSPEC if both of them are accepted.
+	 */
+	uint8_t getAddressFamily() const
+	{
+		if (m_hasIP4 == m_hasIP6)
+		{
+			return AF_UNSPEC;
+		}
+
+		return (m_hasIP4) ? AF_INET : AF_INET6;
+	}
+
+};
@@ -0,0 +1,479 @@
+/**
+ * @file
+ * @brief Implementation of ConntrackDumpSocket class.
+ */
+
+#include <sys/socket.h>
+#include <unistd.h>
+#include <endian.h>
+#include <arpa/inet.h>
+#include <linux/netlink.h>
+#include <linux/netfilter/nfnetlink.h>
+#include <linux/netfilter/nfnetlink_conntrack.h>
+#include <cerrno>
+#include <cstring>
+
+#include "ConntrackNetlink.hpp"
+#include "Log.hpp"
+#include "Exception.hpp"
+#include "Util.hpp"
+
+static constexpr size_t BUFFER_SIZE = 65536;
+
+/**
+ * @brief Iterator over netlink attributes in a buffer.
+ */
+class AttrIterator
+{
+	const char *m_pos;
+	size_t m_remaining;
+
+public:
+	AttrIterator(const void *data, size_t length)
+	: m_pos(static_cast<const char*>(data)),
+	  m_remaining(length)
+	{
+	}
+
+	const nlattr *next()
+	{
+		if (m_remaining < NLA_HDRLEN)
+		{
+			return nullptr;
+		}
+
+		const nlattr *attr = reinterpret_cast<const nlattr*>(m_pos);
+		if (attr->nla_len < NLA_HDRLEN || attr->nla_len > m_remaining)
+		{
+			return nullptr;
+		}
+
+		const size_t alignedLength = NLA_ALIGN(attr->nla_len);
+		if (alignedLength >= m_remaining)
+		{
+			m_remaining = 0;
+		}
+		else
+		{
+			m_pos += alignedLength;
+			m_remaining -= alignedLength;
+		}
+
+		return attr;
+	}
+};
+
+static int GetAttrType(const nlattr *attr)
+{
+	return attr->nla_type & NLA_TYPE_MASK;
+}
+
+static const void *GetAttrData(const nlattr *attr)
+{
+	return reinterpret_cast<const char*>(attr) + NLA_HDRLEN;
+}
+
+static size_t GetAttrLength(const nlattr *attr)
+{
+	return attr->nla_len - NLA_HDRLEN;
+}
+
+static AttrIterator GetNestedAttrs(const nlattr *attr)
+{
+	return AttrIterator(GetAttrData(attr), GetAttrLength(attr));
+}
+
+template<class T>
+static bool ReadAttr(const nlattr *attr, T & result)
+{
+	if (GetAttrLength(attr) < sizeof (T))
+	{
+		return false;
+	}
+
+	// attribute payload is aligned only to 4 bytes
+	std::memcpy(&result, GetAttrData(attr), sizeof (T));
+
+	return true;
+}
+
+static void ParseTupleIP(const nlattr *tupleAttr, ConntrackTuple & tuple)
+{
+	AttrIterator it = GetNestedAttrs(tupleAttr);
+	while (const nlattr *attr = it.next())
+	{
+		switch (GetAttrType(attr))
+		{
+			case CTA_IP_V4_SRC:
+			{
+				ReadAttr(attr, tuple.srcAddr[0]);
+				break;
+			}
+			case CTA_IP_V4_DST:
+			{
+				ReadAttr(attr, tuple.dstAddr[0]);
+				break;
+			}
+			case CTA_IP_V6_SRC:
+			{
+				ReadAttr(attr, tuple.srcAddr);
+				break;
+			}
+			case CTA_IP_V6_DST:
+			{
+				ReadAttr(attr, tuple.dstAddr);
+				break;
+			}
+		}
+	}
+}
+
+static void ParseTupleProto(const nlattr *tupleAttr, ConntrackTuple & tuple)
+{
+	AttrIterator it = GetNestedAttrs(tupleAttr);
+	while (const nlattr *attr = it.next())
+	{
+		switch (GetAttrType(attr))
+		{
+			case CTA_PROTO_NUM:
+			{
+				ReadAttr(attr, tuple.l4proto);
+				break;
+			}
+			case CTA_PROTO_SRC_PORT:
+			{
+				uint16_t port;
+				if (ReadAttr(attr, port))
+				{
+					tuple.srcPort = ntohs(port);
+				}
+				break;
+			}
+			case CTA_PROTO_DST_PORT:
+			{
+				uint16_t port;
+				if (ReadAttr(attr, port))
+				{
+					tuple.dstPort = ntohs(port);
+				}
+				break;
+			}
+		}
+	}
+}
+
+static void ParseTuple(const nlattr *tupleAttr, ConntrackTuple & tuple)
+{
+	AttrIterator it = GetNestedAttrs(tupleAttr);
+	while (const nlattr *attr = it.next())
+	{
+		switch (GetAttrType(attr))
+		{
+			case CTA_TUPLE_IP:
+			{
+				ParseTupleIP(attr, tuple);
+				break;
+			}
+			case CTA_TUPLE_PROTO:
+			{
+				ParseTupleProto(attr, tuple);
+				break;
+			}
+		}
+	}
+}
+
+static void ParseProtoInfo(const nlattr *protoInfoAttr, ConntrackRecord & record)
+{
+	AttrIterator it = GetNestedAttrs(protoInfoAttr);
+	while (const nlattr *attr = it.next())
+	{
+		if (GetAttrType(attr) != CTA_PROTOINFO_TCP)
+		{
+			continue;
+		}
+
+		AttrIterator tcpIt = GetNestedAttrs(attr);
+		while (const nlattr *tcpAttr = tcpIt.next())
+		{
+			if (GetAttrType(tcpAttr) == CTA_PROTOINFO_TCP_STATE && ReadAttr(tcpAttr, record.tcpState))
+			{
+				record.hasTCPState = true;
+			}
+		}
+	}
+}
+
+static void ParseCounters(const nlattr *countersAttr, uint64_t & packets, uint64_t & bytes)
+{
+	AttrIterator it = GetNestedAttrs(countersAttr);
+	while (const nlattr *attr = it.next())
+	{
+		uint64_t value;
+
+		switch (GetAttrType(attr))
+		{
+			case CTA_COUNTERS_PACKETS:
+			{
+				if (ReadAttr(attr, value))
+				{
+					packets = be64toh(value);
+				}
+				break;
+			}
+			case CTA_COUNTERS_BYTES:
+			{
+				if (ReadAttr(attr, value))
+				{
+					bytes = be64toh(value);
+				}
+				break;
+			}
+		}
+	}
+}
+
+/**
+ * @brief Parses one conntrack entry message.
+ * @param nlh The message. Its type must be IPCTNL_MSG_CT_NEW.
+ * @param record Receives the entry. Missing attributes are zero.
+ */
+void ConntrackDumpSocket::ParseEntry(const nlmsghdr *nlh, ConntrackRecord & record)
+{
+	const nfgenmsg *nfmsg = static_cast<const nfgenmsg*>(NLMSG_DATA(nlh));
+	const size_t headerLength = NLMSG_LENGTH(NLMSG_ALIGN(sizeof (nfgenmsg)));
+
+	std::memset(&record, 0, sizeof record);
+	record.tuple.l3proto = nfmsg->nfgen_family;
+
+	if (nlh->nlmsg_len < headerLength)
+	{
+		return;
+	}
+
+	AttrIterator it(reinterpret_cast<const char*>(nlh) + headerLength, nlh->nlmsg_len - headerLength);
+	while (const nlattr *attr = it.next())
+	{
+		switch (GetAttrType(attr))
+		{
+			case CTA_TUPLE_ORIG:
+			{
+				ParseTuple(attr, record.tuple);
+				break;
+			}
+			case CTA_PROTOINFO:
+			{
+				ParseProtoInfo(attr, record);
+				break;
+			}
+			case CTA_COUNTERS_ORIG:
+			{
+				ParseCounters(attr, record.txPackets, record.txBytes);
+				break;
+			}
+			case CTA_COUNTERS_REPLY:
+			{
+				ParseCounters(attr, record.rxPackets, record.rxBytes);
+				break;
+			}
+			case CTA_MARK:
+			{
+				uint32_t mark;
+				if (ReadAttr(attr, mark))
+				{
+					record.mark = ntohl(mark);
+				}
+				break;
+			}
+			case CTA_ZONE:
+			{
+				uint16_t zone;
+				if (ReadAttr(attr, zone))
+				{
+					record.zone = ntohs(zone);
+				}
+				break;
+			}
+		}
+	}
+}
+
+ConntrackDumpSocket::ConntrackDumpSocket()
+: m_fd(-1),
+  m_sequence(0),
+  m_mark(0),
+  m_markMask(0),
+  m_zone(0),
+  m_hasMarkFilter(false),
+  m_hasZoneFilter(false),
+  m_buffer(std::make_unique<char[]>(BUFFER_SIZE))
+{
+	m_fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_NETFILTER);
+	if (m_fd < 0)
+	{
+		std::string errMsg = "Unable to open ctnetlink dump socket: ";
+		errMsg += Util::ErrnoToString();
+		throw Exception(std::move(errMsg), "Collector_Netfilter");
+	}
+
+	sockaddr_nl addr = {};
+	addr.nl_family = AF_NETLINK;
+
+	if (bind(m_fd, reinterpret_cast<sockaddr*>(&addr), sizeof addr) < 0)
+	{
+		std::string errMsg = "Unable to bind ctnetlink dump socket: ";
+		errMsg += Util::ErrnoToString();
+		close(m_fd);
+		throw Exception(std::move(errMsg), "Collector_Netfilter");
+	}
+
+	gLog->info("[Collector_Netfilter] Created ctnetlink dump socket on %d", m_fd);
+}
+
+ConntrackDumpSocket::~ConntrackDumpSocket()
+{
+	close(m_fd);
+
+	gLog->info("[Collector_Netfilter] Closed ctnetlink dump socket on %d", m_fd);
+}
+
+/**
+ * @brief Dumps conntrack table.
+ * @param addressFamily AF_INET, AF_INET6 or AF_UNSPEC for both of them.
+ * @param callback Function called for each conntrack entry.
+ * @param param Parameter passed to the callback.
+ * @return Number of dumped entries.
+ */
+unsigned long ConntrackDumpSocket::dump(int addressFamily, Callback callback, void *param)
+{
+	struct
+	{
+		nlmsghdr nlh;
+		nfgenmsg nfmsg;
+		char attrs[3 * NLA_ALIGN(NLA_HDRLEN + sizeof (uint32_t))];
+	} request = {};
+
+	m_sequence++;
+
+	request.nlh.nlmsg_len = NLMSG_LENGTH(sizeof (nfgenmsg));
+	request.nlh.nlmsg_type = (NFNL_SUBSYS_CTNETLINK << 8) | IPCTNL_MSG_CT_GET;
+	request.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+	request.nlh.nlmsg_seq = m_sequence;
+	request.nfmsg.nfgen_family = addressFamily;
+	request.nfmsg.version = NFNETLINK_V0;
+
+	auto AddAttr = [&request](int type, const void *data, size_t length) -> void
+	{
+		nlattr *attr = reinterpret_cast<nlattr*>(reinterpret_cast<char*>(&request) + NLMSG_ALIGN(request.nlh.nlmsg_len));
+		attr->nla_type = type;
+		attr->nla_len = NLA_HDRLEN + length;
+		std::memcpy(reinterpret_cast<char*>(attr) + NLA_HDRLEN, data, length);
+		request.nlh.nlmsg_len = NLMSG_ALIGN(request.nlh.nlmsg_len) + NLA_ALIGN(attr->nla_len);
+	};
+
+	// filter attributes in network byte order
+	if (m_hasMarkFilter)
+	{
+		const uint32_t mark = htonl(m_mark);
+		const uint32_t mask = htonl(m_markMask);
+		AddAttr(CTA_MARK, &mark, sizeof mark);
+		AddAttr(CTA_MARK_MASK, &mask, sizeof mask);
+	}
+
+	if (m_hasZoneFilter)
+	{
+		const uint16_t zone = htons(m_zone);
+		AddAttr(CTA_ZONE, &zone, sizeof zone);
+	}
+
+	sockaddr_nl kernelAddr = {};
+	kernelAddr.nl_family = AF_NETLINK;
+
+	if (sendto(m_fd, &request, request.nlh.nlmsg_len, 0, reinterpret_cast<sockaddr*>(&kernelAddr), sizeof kernelAddr) < 0)
+	{
+		std::string errMsg = "Unable to send ctnetlink dump request: ";
+		errMsg += Util::ErrnoToString();
+		throw Exception(std::move(errMsg), "Collector_Netfilter");
+	}
+
+	unsigned long count = 0;
+
+	while (receive(callback, param, count));
+
+	return count;
+}
+
+bool ConntrackDumpSocket::receive(Callback callback, void *param, unsigned long & count)
+{
+	ssize_t length;
+	do
+	{
+		// real length of truncated datagram is returned
+		length = recv(m_fd, m_buffer.get(), BUFFER_SIZE, MSG_TRUNC);
+	}
+	while (length < 0 && errno == EINTR);
+
+	if (length < 0)
+	{
+		std::string errMsg = "Unable to receive ctnetlink dump: ";
+		errMsg += Util::ErrnoToString();
+		throw Exception(std::move(errMsg), "Collector_Netfilter");
+	}
+
+	if (static_cast<size_t>(length) > BUFFER_SIZE)
+	{
+		// the rest of the datagram is lost, so the dump would be incomplete
+		std::string errMsg = "ctnetlink dump message is larger than receive buffer (";
+		errMsg += std::to_string(length);
+		errMsg += " > ";
+		errMsg += std::to_string(BUFFER_SIZE);
+		errMsg += " bytes)";
+		throw Exception(std::move(errMsg), "Collector_Netfilter");
+	}
+
+	ConntrackRecord record;
+
+	int remaining = length;
+	for (nlmsghdr *nlh = reinterpret_cast<nlmsghdr*>(m_buffer.get());
+	     NLMSG_OK(nlh, remaining);
+	     nlh = NLMSG_NEXT(nlh, remaining))
+	{
+		if (nlh->nlmsg_seq != m_sequence)
+		{
+			continue;
+		}
+
+		switch (nlh->nlmsg_type)
+		{
+			case NLMSG_DONE:
+			{
+				return false;
+			}
+			case NLMSG_ERROR:
+			{
+				const nlmsgerr *err = static_cast<const nlmsgerr*>(NLMSG_DATA(nlh));
+				if (err->error == 0)
+				{
+					return false;  // acknowledgement
+				}
+
+				std::string errMsg = "ctnetlink dump failed: ";
+				errMsg += Util::ErrnoToString(-err->error);
+				throw Exception(std::move(errMsg), "Collector_Netfilter");
+			}
+			case (NFNL_SUBSYS_CTNETLINK << 8) | IPCTNL_MSG_CT_NEW:
+			{
+				ParseEntry(nlh, record);
+				callback(record, param);
+				count++;
+				break;
+			}
+			default:
+			{
+				break;
+			}
+		}
+	}
+
+	return true;
+}
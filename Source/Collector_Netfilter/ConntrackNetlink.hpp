@@ -0,0 +1,71 @@
+/**
+ * @file
+ * @brief ConntrackDumpSocket class.
+ */
+
+#pragma once
+
+#include <memory>
+
+#include "Collector_Common/ConntrackRecord.hpp"
+
+struct nlmsghdr;
+
+/**
+ * @brief Raw ctnetlink socket for conntrack table dumps.
+ * Messages are parsed directly in the receive buffer without libnetfilter_conntrack.
+ */
+class ConntrackDumpSocket
+{
+public:
+	using Callback = void (*)(const ConntrackRecord & record, void *param);
+
+private:
+	int m_fd;
+	uint32_t m_sequence;
+	uint32_t m_mark;
+	uint32_t m_markMask;
+	uint16_t m_zone;
+	bool m_hasMarkFilter;
+	bool m_hasZoneFilter;
+	std::unique_ptr<char[]> m_buffer;
+
+	bool receive(Callback callback, void *param, unsigned long & count);
+
+public:
+	ConntrackDumpSocket();
+	~ConntrackDumpSocket();
+
+	// no copy
+	ConntrackDumpSocket(const ConntrackDumpSocket &) = delete;
+	ConntrackDumpSocket & operator=(const ConntrackDumpSocket &) = delete;
+
+	unsigned long dump(int addressFamily, Callback callback, void *param);
+
+	static void ParseEntry(const nlmsghdr *nlh, ConntrackRecord & record);
+
+	/**
+	 * @brief Makes kernel dump only entries with (entry mark & mask) == mark.
+	 */
+	void setMarkFilter(uint32_t mark, uint32_t mask)
+	{
+		m_mark = mark;
+		m_markMask = mask;
+		m_hasMarkFilter = true;
+	}
+
+	/**
+	 * @brief Makes kernel dump only entries in the zone.
+	 * This is ignored by older kernels.
+	 */
+	void setZoneFilter(uint16_t zone)
+	{
+		m_zone = zone;
+		m_hasZoneFilter = true;
+	}
+
+	int getFD() const
+	{
+		return m_fd;
+	}
+};
@@ -0,0 +1,348 @@
+/**
+ * @file
+ * @brief Implementation of replay collector.
+ */
+
+#include <chrono>
+
+#include "CCollector.hpp"
+#include "Collector_Common/Capture.hpp"
+#include "Collector_Common/ConntrackTable.hpp"
+#include "Address.hpp"
+#include "Port.hpp"
+#include "CmdLine.hpp"
+#include "Log.hpp"
+#include "Exception.hpp"
+#include "Platform.hpp"
+#include "Util.hpp"
+
+static ConnectionTraffic GetTraffic(const CaptureEntry & entry)
+{
+	ConnectionTraffic traffic;
+	traffic.rxPackets = entry.rxPackets;
+	traffic.txPackets = entry.txPackets;
+	traffic.rxBytes = entry.rxBytes;
+	traffic.txBytes = entry.txBytes;
+
+	return traffic;
+}
+
+class CCollector_Replay::Impl
+{
+	CaptureReader m_reader;
+	CaptureEntry m_entry;
+	ConntrackTable m_table;
+	IConnectionUpdateCallback *m_callback;
+	unsigned int m_speed;  // 0 means maximum speed
+	uint64_t m_replayTime;
+	uint64_t m_lastDumpTime;
+	unsigned long m_entryCount;
+	bool m_hasEntry;
+	bool m_isStarted;
+	bool m_isFinished;
+	bool m_isPaused;
+
+	static unsigned int GetSpeed()
+	{
+		CmdLineArg *speedArg = gCmdLine->getArg("replay-speed");
+		if (!speedArg)
+		{
+			return 1;
+		}
+
+		const KString value = speedArg->getValue();
+		if (value == "max")
+		{
+			return 0;
+		}
+
+		unsigned long speed;
+		if (!Util::StringToUInt(value, speed) || speed < 1 || speed > 1000000)
+		{
+			std::string errMsg = "Invalid value '";
+			errMsg += value;
+			errMsg += "' of '--replay-speed'";
+			throw Exception(std::move(errMsg), "Collector_Replay");
+		}
+
+		return speed;
+	}
+
+	void addConnection(const ConntrackTuple & tuple, const ConnectionTraffic & traffic, int state)
+	{
+		AddressData *srcAddress, *dstAddress;
+		PortData *srcPort, *dstPort;
+		if (ExtractAddressPort(&srcAddress, &srcPort, &dstAddress, &dstPort, tuple, m_callback, true))
+		{
+			m_callback->add(Connection(*srcAddress, *srcPort, *dstAddress, *dstPort), traffic, state);
+		}
+	}
+
+	void updateConnection(uint32_t row, int updateFlags)
+	{
+		AddressData *srcAddress, *dstAddress;
+		PortData *srcPort, *dstPort;
+		if (ExtractAddressPort(&srcAddress, &srcPort, &dstAddress, &dstPort, m_table.getTuple(row), m_callback, false))
+		{
+			ConnectionData *pData = m_callback->find(Connection(*srcAddress, *srcPort, *dstAddress, *dstPort));
+			if (pData)
+			{
+				pData->getTraffic() = m_table.getTraffic(row);
+				pData->setState(m_table.getState(row));
+				m_callback->update(*pData, updateFlags);
+			}
+		}
+	}
+
+	void removeConnection(const ConntrackTuple & tuple)
+	{
+		AddressData *srcAddress, *dstAddress;
+		PortData *srcPort, *dstPort;
+		if (ExtractAddressPort(&srcAddress, &srcPort, &dstAddress, &dstPort, tuple, m_callback, false))
+		{
+			m_callback->remove(Connection(*srcAddress, *srcPort, *dstAddress, *dstPort));
+		}
+	}
+
+	void handleDumpEntry(const CaptureEntry & entry)
+	{
+		const uint32_t row = m_table.find(entry.tuple);
+
+		if (row == ConntrackTable::NO_ROW)
+		{
+			const ConnectionTraffic traffic = GetTraffic(entry);
+
+			m_table.add(entry.tuple, traffic, entry.state);
+			addConnection(entry.tuple, traffic, entry.state);
+
+			return;
+		}
+
+		m_table.mark(row);
+
+		int updateFlags = 0;
+
+		if (m_table.getState(row) != entry.state)
+		{
+			m_table.setState(row, entry.state);
+			updateFlags |= EConnectionUpdateFlags::PROTO_STATE;
+		}
+
+		// traffic changes of all dumped entries are computed at once at the end of the dump
+		m_table.setDumpedCounters(row, entry.rxPackets, entry.txPackets, entry.rxBytes, entry.txBytes, updateFlags);
+	}
+
+	void handleEntry(const CaptureEntry & entry)
+	{
+		switch (entry.type)
+		{
+			case CaptureEntry::DUMP_BEGIN:
+			{
+				m_table.beginGeneration();
+				break;
+			}
+			case CaptureEntry::DUMP_ENTRY:
+			{
+				handleDumpEntry(entry);
+				break;
+			}
+			case CaptureEntry::DUMP_END:
+			{
+				// speed is per second of the recorded time
+				const double seconds = (entry.timestamp - m_lastDumpTime) / 1000.0;
+
+				m_table.commitCounters(seconds, [this](uint32_t row, int updateFlags) -> void
+				{
+					updateConnection(row, updateFlags);
+				});
+
+				// entries missing in the dump are gone even if their DESTROY events were not captured
+				m_table.sweep([this](const ConntrackTuple & tuple) -> void
+				{
+					removeConnection(tuple);
+				});
+
+				m_lastDumpTime = entry.timestamp;
+				break;
+			}
+			case CaptureEntry::EVENT_NEW:
+			{
+				const ConnectionTraffic traffic = GetTraffic(entry);
+
+				if (m_table.add(entry.tuple, traffic, entry.state).second)
+				{
+					addConnection(entry.tuple, traffic, entry.state);
+				}
+				break;
+			}
+			case CaptureEntry::EVENT_UPDATE:
+			{
+				const uint32_t row = m_table.find(entry.tuple);
+				if (row != ConntrackTable::NO_ROW && m_table.getState(row) != entry.state)
+				{
+					m_table.setState(row, entry.state);
+					updateConnection(row, EConnectionUpdateFlags::PROTO_STATE);
+				}
+				break;
+			}
+			case CaptureEntry::EVENT_DESTROY:
+			{
+				if (m_table.remove(entry.tuple))
+				{
+					removeConnection(entry.tuple);
+				}
+				break;
+			}
+		}
+
+		m_entryCount++;
+	}
+
+	/**
+	 * @brief Replays all records up to the given time.
+	 * @param time Time in the capture or UINT64_MAX to replay everything.
+	 */
+	void replay(uint64_t time)
+	{
+		while (!m_isFinished)
+		{
+			if (!m_hasEntry)
+			{
+				m_hasEntry = m_reader.read(m_entry);
+
+				if (!m_hasEntry)
+				{
+					m_isFinished = true;
+					gLog->info("[Collector_Replay] Replay finished, %lu records", m_entryCount);
+					break;
+				}
+			}
+
+			if (m_entry.timestamp > time)
+			{
+				break;
+			}
+
+			handleEntry(m_entry);
+			m_hasEntry = false;
+		}
+	}
+
+public:
+	Impl()
+	: m_reader(gCmdLine->getArg("replay")->getValue()),
+	  m_entry(),
+	  m_table(),
+	  m_callback(),
+	  m_speed(GetSpeed()),
+	  m_replayTime(0),
+	  m_lastDumpTime(0),
+	  m_entryCount(0),
+	  m_hasEntry(false),
+	  m_isStarted(false),
+	  m_isFinished(false),
+	  m_isPaused()
+	{
+		if (m_speed > 0)
+		{
+			gLog->info("[Collector_Replay] Replaying capture at %ux speed", m_speed);
+		}
+		else
+		{
+			gLog->info("[Collector_Replay] Replaying capture at maximum speed");
+		}
+	}
+
+	void init(IConnectionUpdateCallback *callback)
+	{
+		m_callback = callback;
+	}
+
+	void onUpdate()
+	{
+		if (!m_callback || m_isPaused || m_isFinished)
+		{
+			return;
+		}
+
+		ConnectionUpdateBatch updateBatch(m_callback);
+
+		if (m_speed == 0)
+		{
+			// everything at once to measure throughput of the whole pipeline
+			const auto startTime = std::chrono::steady_clock::now();
+
+			replay(UINT64_MAX);
+
+			updateBatch.commit();
+
+			const std::chrono::duration<double> duration = std::chrono::steady_clock::now() - startTime;
+			const double recordsPerSecond = (duration.count() > 0) ? m_entryCount / duration.count() : 0;
+
+			gLog->info("[Collector_Replay] Replayed in %.3f ms (%.0f records/s)",
+			           duration.count() * 1000, recordsPerSecond);
+
+			return;
+		}
+
+		if (!m_isStarted)
+		{
+			// the first update replays the first dump
+			m_isStarted = true;
+			m_hasEntry = m_reader.read(m_entry);
+			m_replayTime = (m_hasEntry) ? m_entry.timestamp : 0;
+		}
+		else
+		{
+			m_replayTime += static_cast<uint64_t>(gPlatform->getUpdateInterval()) * m_speed;
+		}
+
+		replay(m_replayTime);
+
+		updateBatch.commit();
+	}
+
+	bool isPaused() const
+	{
+		return m_isPaused;
+	}
+
+	void setPaused(bool paused)
+	{
+		m_isPaused = paused;
+	}
+};
+
+CCollector_Replay::CCollector_Replay()
+: m_impl(std::make_unique<Impl>())
+{
+}
+
+CCollector_Replay::~CCollector_Replay()
+{
+}
+
+KString CCollector_Replay::getName() const
+{
+	return "Replay";
+}
+
+void CCollector_Replay::init(IConnectionUpdateCallback *callback)
+{
+	m_impl->init(callback);
+}
+
+void CCollector_Replay::onUpdate()
+{
+	m_impl->onUpdate();
+}
+
+bool CCollector_Replay::isPaused() const
+{
+	return m_impl->isPaused();
+}
+
+void CCollector_Replay::setPaused(bool paused)
+{
+	m_impl->setPaused(paused);
+}
@@ -0,0 +1,33 @@
+/**
+ * @file
+ * @brief Replay collector.
+ */
+
+#pragma once
+
+#include <memory>
+
+#include "ICollector.hpp"
+
+/**
+ * @brief Collector that replays conntrack capture file.
+ * Capture files are created by Netfilter collector with '--record' option.
+ */
+class CCollector_Replay : public ICollector
+{
+	class Impl;
+	std::unique_ptr<Impl> m_impl;
+
+public:
+	CCollector_Replay();
+	~CCollector_Replay();
+
+	KString getName() const override;
+
+	void init(IConnectionUpdateCallback *callback) override;
+
+	void onUpdate() override;
+
+	bool isPaused() const override;
+	void setPaused(bool paused) override;
+};
@@ -0,0 +1,574 @@
+/**
+ * @file
+ * @brief Implementation of synthetic collector.
+ */
+
+#include <arpa/inet.h>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "CCollector.hpp"
+#include "Connection.hpp"
+#include "Address.hpp"
+#include "Port.hpp"
+#include "CmdLine.hpp"
+#include "Log.hpp"
+#include "Exception.hpp"
+#include "Platform.hpp"
+#include "Util.hpp"
+
+namespace
+{
+	/**
+	 * @brief Pseudo-random number generator (xorshift64*).
+	 * Standard library distributions are implementation-defined, so the numbers are generated here to get
+	 * the same connections everywhere for the same seed.
+	 */
+	class Random
+	{
+		uint64_t m_state;
+
+	public:
+		Random(uint64_t seed)
+		: m_state((seed) ? seed : 0x9E3779B97F4A7C15)
+		{
+		}
+
+		uint64_t next()
+		{
+			m_state ^= m_state >> 12;
+			m_state ^= m_state << 25;
+			m_state ^= m_state >> 27;
+			return m_state * 0x2545F4914F6CDD1D;
+		}
+
+		/**
+		 * @return Random number in range [0, limit).
+		 */
+		uint64_t nextBelow(uint64_t limit)
+		{
+			return (limit > 0) ? next() % limit : 0;
+		}
+
+		/**
+		 * @return Random number in range (0, 1].
+		 */
+		double nextUnit()
+		{
+			return ((next() >> 11) + 1) * (1.0 / 9007199254740992.0);
+		}
+
+		/**
+		 * @return True with the given probability in percent.
+		 */
+		bool nextPercent(unsigned long percent)
+		{
+			return nextBelow(100) < percent;
+		}
+	};
+
+	enum struct ETrafficDistribution
+	{
+		UNIFORM,
+		PARETO
+	};
+
+	struct SyntheticConfig
+	{
+		unsigned long connectionCount = 10000;
+		unsigned long churn = 100;         // new connections per second
+		unsigned long ip6Percent = 20;
+		unsigned long tcpPercent = 80;
+		unsigned long meanSpeed = 10000;   // bytes per second
+		unsigned long seed = 1;
+		ETrafficDistribution distribution = ETrafficDistribution::PARETO;
+
+		void parse(const KString & spec);
+		void parseTerm(const std::string & term);
+	};
+
+	/**
+	 * @brief Generated connection.
+	 * Addresses are in network byte order.
+	 */
+	struct SyntheticConnection
+	{
+		uint32_t srcAddr[4];
+		uint32_t dstAddr[4];
+		uint16_t srcPort;
+		uint16_t dstPort;
+		bool isIP6;
+		bool isTCP;
+		int state;
+		unsigned int closingUpdates;  // remaining updates until the connection is removed, 0 if not closing
+		uint64_t rxRate;  // bytes per second
+		uint64_t txRate;  // bytes per second
+		ConnectionTraffic traffic;
+	};
+}
+
+static void ThrowInvalidTerm(const std::string & term)
+{
+	std::string errMsg = "Invalid value '";
+	errMsg += term;
+	errMsg += "' in '--synthetic'";
+	throw Exception(std::move(errMsg), "Collector_Synthetic");
+}
+
+/**
+ * @brief Adds comma-separated options.
+ * Supported options are connections=N, churn=N, ip6=PERCENT, tcp=PERCENT, speed=BYTES,
+ * traffic=uniform|pareto and seed=N.
+ * @param spec The options.
+ */
+void SyntheticConfig::parse(const KString & spec)
+{
+	const std::string specString = spec;
+
+	size_t begin = 0;
+	while (begin <= specString.length())
+	{
+		size_t end = specString.find(',', begin);
+		if (end == std::string::npos)
+		{
+			end = specString.length();
+		}
+
+		parseTerm(specString.substr(begin, end - begin));
+
+		begin = end + 1;
+	}
+}
+
+void SyntheticConfig::parseTerm(const std::string & term)
+{
+	if (term.empty())
+	{
+		return;
+	}
+
+	const size_t separatorPos = term.find('=');
+	if (separatorPos == std::string::npos)
+	{
+		ThrowInvalidTerm(term);
+	}
+
+	const std::string name = term.substr(0, separatorPos);
+	const std::string value = term.substr(separatorPos + 1);
+
+	if (name == "traffic")
+	{
+		if (value == "uniform")
+		{
+			distribution = ETrafficDistribution::UNIFORM;
+		}
+		else if (value == "pareto")
+		{
+			distribution = ETrafficDistribution::PARETO;
+		}
+		else
+		{
+			ThrowInvalidTerm(term);
+		}
+
+		return;
+	}
+
+	unsigned long number;
+	if (!Util::StringToUInt(value, number))
+	{
+		ThrowInvalidTerm(term);
+	}
+
+	if (name == "connections")
+	{
+		connectionCount = number;
+	}
+	else if (name == "churn")
+	{
+		churn = number;
+	}
+	else if (name == "ip6" && number <= 100)
+	{
+		ip6Percent = number;
+	}
+	else if (name == "tcp" && number <= 100)
+	{
+		tcpPercent = number;
+	}
+	else if (name == "speed")
+	{
+		meanSpeed = number;
+	}
+	else if (name == "seed")
+	{
+		seed = number;
+	}
+	else
+	{
+		ThrowInvalidTerm(term);
+	}
+}
+
+class CCollector_Synthetic::Impl
+{
+	//! Average packet size used to derive number of packets from number of bytes.
+	static constexpr uint64_t PACKET_SIZE = 1000;
+
+	//! Number of distinct local and remote hosts.
+	static constexpr uint32_t LOCAL_HOST_COUNT = 256;
+	static constexpr uint32_t REMOTE_HOST_COUNT = 65536;
+
+	SyntheticConfig m_config;
+	Random m_random;
+	std::vector<SyntheticConnection> m_connections;
+	IConnectionUpdateCallback *m_callback;
+	unsigned int m_interval;  // milliseconds
+	uint64_t m_churnRemainder;
+	bool m_isPaused;
+
+	void generateAddress(uint32_t *address, bool isIP6, bool isLocal)
+	{
+		const uint32_t host = (isLocal) ? m_random.nextBelow(LOCAL_HOST_COUNT)
+		                                : m_random.nextBelow(REMOTE_HOST_COUNT);
+
+		if (isIP6)
+		{
+			// fd00::/8 for local hosts and 2001:db8::/32 for remote hosts
+			address[0] = htonl((isLocal) ? 0xFD000000 : 0x20010DB8);
+			address[1] = 0;
+			address[2] = 0;
+			address[3] = htonl(host + 1);
+		}
+		else
+		{
+			// 10.0.0.0/8 for local hosts and 100.64.0.0/10 for remote hosts
+			address[0] = htonl(((isLocal) ? 0x0A000000 : 0x64400000) + host + 1);
+			address[1] = 0;
+			address[2] = 0;
+			address[3] = 0;
+		}
+	}
+
+	uint64_t generateRate()
+	{
+		const double mean = m_config.meanSpeed;
+
+		switch (m_config.distribution)
+		{
+			case ETrafficDistribution::UNIFORM:
+			{
+				return m_random.nextBelow(2 * m_config.meanSpeed + 1);
+			}
+			case ETrafficDistribution::PARETO:
+			{
+				// few connections transfer most of the data (80/20 rule)
+				const double alpha = 1.16;
+				const double minimum = mean * (alpha - 1) / alpha;
+				const double rate = minimum / std::pow(m_random.nextUnit(), 1 / alpha);
+				return (rate < 1e15) ? static_cast<uint64_t>(rate) : 1000000000000000;
+			}
+		}
+
+		return m_config.meanSpeed;
+	}
+
+	SyntheticConnection generateConnection()
+	{
+		SyntheticConnection c = {};
+
+		c.isIP6 = m_random.nextPercent(m_config.ip6Percent);
+		c.isTCP = m_random.nextPercent(m_config.tcpPercent);
+
+		generateAddress(c.srcAddr, c.isIP6, true);
+		generateAddress(c.dstAddr, c.isIP6, false);
+
+		static const uint16_t SERVICE_PORTS[] = { 443, 80, 53, 22, 993, 25, 123, 8080 };
+
+		c.srcPort = 32768 + m_random.nextBelow(28232);
+		c.dstPort = SERVICE_PORTS[m_random.nextBelow(sizeof SERVICE_PORTS / sizeof SERVICE_PORTS[0])];
+
+		c.state = (c.isTCP) ? static_cast<int>(TCP::SYN_SENT) : static_cast<int>(UDP::UNKNOWN);
+		c.closingUpdates = 0;
+
+		c.rxRate = generateRate();
+		c.txRate = c.rxRate * (5 + m_random.nextBelow(96)) / 100;  // uploads are usually smaller
+
+		return c;
+	}
+
+	bool getConnection(const SyntheticConnection & c, bool add, AddressData **pSrcAddress, PortData **pSrcPort,
+	                   AddressData **pDstAddress, PortData **pDstPort)
+	{
+		if (c.isIP6)
+		{
+			*pSrcAddress = m_callback->getAddress(Address::CreateIP6(c.srcAddr), add);
+			*pDstAddress = m_callback->getAddress(Address::CreateIP6(c.dstAddr), add);
+		}
+		else
+		{
+			*pSrcAddress = m_callback->getAddress(Address::CreateIP4(c.srcAddr[0]), add);
+			*pDstAddress = m_callback->getAddress(Address::CreateIP4(c.dstAddr[0]), add);
+		}
+
+		const EPortType portType = (c.isTCP) ? EPortType::TCP : EPortType::UDP;
+
+		*pSrcPort = m_callback->getPort(Port(portType, c.srcPort), add);
+		*pDstPort = m_callback->getPort(Port(portType, c.dstPort), add);
+
+		return *pSrcAddress && *pDstAddress && *pSrcPort && *pDstPort;
+	}
+
+	void addConnection(const SyntheticConnection & c)
+	{
+		AddressData *srcAddress, *dstAddress;
+		PortData *srcPort, *dstPort;
+		if (getConnection(c, true, &srcAddress, &srcPort, &dstAddress, &dstPort))
+		{
+			m_callback->add(Connection(*srcAddress, *srcPort, *dstAddress, *dstPort), c.traffic, c.state);
+		}
+	}
+
+	void removeConnection(const SyntheticConnection & c)
+	{
+		AddressData *srcAddress, *dstAddress;
+		PortData *srcPort, *dstPort;
+		if (getConnection(c, false, &srcAddress, &srcPort, &dstAddress, &dstPort))
+		{
+			m_callback->remove(Connection(*srcAddress, *srcPort, *dstAddress, *dstPort));
+		}
+	}
+
+	void updateConnection(SyntheticConnection & c)
+	{
+		int updateFlags = 0;
+
+		// TCP state transitions
+		if (c.isTCP)
+		{
+			int state = c.state;
+
+			if (c.closingUpdates > 0)
+			{
+				state = (c.closingUpdates > 1) ? TCP::FIN_WAIT : TCP::TIME_WAIT;
+			}
+			else if (state == TCP::SYN_SENT)
+			{
+				state = TCP::ESTABLISHED;
+			}
+
+			if (state != c.state)
+			{
+				c.state = state;
+				updateFlags |= EConnectionUpdateFlags::PROTO_STATE;
+			}
+		}
+
+		// closing connections do not transfer any data
+		uint64_t rxBytes = 0;
+		uint64_t txBytes = 0;
+		if (c.closingUpdates == 0)
+		{
+			// +-50 % jitter
+			const uint64_t rxRate = c.rxRate * m_interval / 1000;
+			const uint64_t txRate = c.txRate * m_interval / 1000;
+			rxBytes = rxRate / 2 + m_random.nextBelow(rxRate + 1);
+			txBytes = txRate / 2 + m_random.nextBelow(txRate + 1);
+		}
+
+		ConnectionTraffic & traffic = c.traffic;
+
+		if (rxBytes > 0)
+		{
+			traffic.rxBytes += rxBytes;
+			traffic.rxPackets += rxBytes / PACKET_SIZE + 1;
+			updateFlags |= EConnectionUpdateFlags::RX_BYTES | EConnectionUpdateFlags::RX_PACKETS;
+		}
+
+		if (txBytes > 0)
+		{
+			traffic.txBytes += txBytes;
+			traffic.txPackets += txBytes / PACKET_SIZE + 1;
+			updateFlags |= EConnectionUpdateFlags::TX_BYTES | EConnectionUpdateFlags::TX_PACKETS;
+		}
+
+		const uint64_t rxSpeed = rxBytes * 1000 / m_interval;
+		if (traffic.rxSpeed != rxSpeed)
+		{
+			traffic.rxSpeed = rxSpeed;
+			updateFlags |= EConnectionUpdateFlags::RX_SPEED;
+		}
+
+		const uint64_t txSpeed = txBytes * 1000 / m_interval;
+		if (traffic.txSpeed != txSpeed)
+		{
+			traffic.txSpeed = txSpeed;
+			updateFlags |= EConnectionUpdateFlags::TX_SPEED;
+		}
+
+		if (updateFlags)
+		{
+			AddressData *srcAddress, *dstAddress;
+			PortData *srcPort, *dstPort;
+			if (getConnection(c, false, &srcAddress, &srcPort, &dstAddress, &dstPort))
+			{
+				ConnectionData *pData = m_callback->find(Connection(*srcAddress, *srcPort, *dstAddress, *dstPort));
+				if (pData)
+				{
+					pData->getTraffic() = traffic;
+					pData->setState(c.state);
+					m_callback->update(*pData, updateFlags);
+				}
+			}
+		}
+	}
+
+	void startClosing()
+	{
+		// churn is per second
+		m_churnRemainder += static_cast<uint64_t>(m_config.churn) * m_interval;
+		const uint64_t closeCount = m_churnRemainder / 1000;
+		m_churnRemainder %= 1000;
+
+		// random connections are closed
+		for (uint64_t i = 0; i < closeCount && !m_connections.empty(); i++)
+		{
+			SyntheticConnection & c = m_connections[m_random.nextBelow(m_connections.size())];
+			if (c.closingUpdates == 0)
+			{
+				// TCP connections go through FIN_WAIT and TIME_WAIT states before removal
+				c.closingUpdates = (c.isTCP) ? 3 : 1;
+			}
+		}
+	}
+
+public:
+	Impl()
+	: m_config(),
+	  m_random(0),
+	  m_connections(),
+	  m_callback(),
+	  m_interval(1000),
+	  m_churnRemainder(0),
+	  m_isPaused()
+	{
+		if (CmdLineArg *syntheticArg = gCmdLine->getArg("synthetic"))
+		{
+			for (const KString & value : syntheticArg->getAllValues())
+			{
+				m_config.parse(value);
+			}
+		}
+
+		m_random = Random(m_config.seed);
+		m_connections.reserve(m_config.connectionCount);
+
+		gLog->info("[Collector_Synthetic] %lu connections, churn %lu, IPv6 %lu%%, TCP %lu%%, speed %lu (%s), seed %lu",
+		           m_config.connectionCount, m_config.churn, m_config.ip6Percent, m_config.tcpPercent,
+		           m_config.meanSpeed,
+		           (m_config.distribution == ETrafficDistribution::PARETO) ? "pareto" : "uniform",
+		           m_config.seed);
+	}
+
+	void init(IConnectionUpdateCallback *callback)
+	{
+		m_callback = callback;
+	}
+
+	void onUpdate()
+	{
+		if (!m_callback || m_isPaused)
+		{
+			return;
+		}
+
+		ConnectionUpdateBatch updateBatch(m_callback);
+
+		m_interval = gPlatform->getUpdateInterval();
+
+		// advance existing connections and remove closed ones
+		size_t i = 0;
+		while (i < m_connections.size())
+		{
+			SyntheticConnection & c = m_connections[i];
+
+			if (c.closingUpdates == 1)
+			{
+				removeConnection(c);
+
+				c = m_connections.back();
+				m_connections.pop_back();
+				continue;
+			}
+
+			if (c.closingUpdates > 1)
+			{
+				c.closingUpdates--;
+			}
+
+			updateConnection(c);
+			i++;
+		}
+
+		startClosing();
+
+		// replace removed connections
+		if (m_connections.size() < m_config.connectionCount)
+		{
+			m_callback->reserve(m_config.connectionCount - m_connections.size());
+		}
+
+		while (m_connections.size() < m_config.connectionCount)
+		{
+			m_connections.push_back(generateConnection());
+			addConnection(m_connections.back());
+		}
+
+		updateBatch.commit();
+	}
+
+	bool isPaused() const
+	{
+		return m_isPaused;
+	}
+
+	void setPaused(bool paused)
+	{
+		m_isPaused = paused;
+	}
+};
+
+CCollector_Synthetic::CCollector_Synthetic()
+: m_impl(std::make_unique<Impl>())
+{
+}
+
+CCollector_Synthetic::~CCollector_Synthetic()
+{
+}
+
+KString CCollector_Synthetic::getName() const
+{
+	return "Synthetic";
+}
+
+void CCollector_Synthetic::init(IConnectionUpdateCallback *callback)
+{
+	m_impl->init(callback);
+}
+
+void CCollector_Synthetic::onUpdate()
+{
+	m_impl->onUpdate();
+}
+
+bool CCollector_Synthetic::isPaused() const
+{
+	return m_impl->isPaused();
+}
+
+void CCollector_Synthetic::setPaused(bool paused)
+{
+	m_impl->setPaused(paused);
+}
@@ -0,0 +1,34 @@
+/**
+ * @file
+ * @brief Synthetic collector.
+ */
+
+#pragma once
+
+#include <memory>
+
+#include "ICollector.hpp"
+
+/**
+ * @brief Collector that generates artificial connections.
+ * It is intended for benchmarking and profiling of the rest of the application. All generated data are
+ * deterministic and depend only on the options and the seed.
+ */
+class CCollector_Synthetic : public ICollector
+{
+	class Impl;
+	std::unique_ptr<Impl> m_impl;
+
+public:
+	CCollector_Synthetic();
+	~CCollector_Synthetic();
+
+	KString getName() const override;
+
+	void init(IConnectionUpdateCallback *callback) override;
+
+	void onUpdate() override;
+
+	bool isPaused() const override;
+	void setPaused(bool paused) override;
+};
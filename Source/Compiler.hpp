@@ -31,6 +31,9 @@
 
   #define COMPILER_CONSTEXPR_STRLEN(x) __builtin_strlen(x)
 
+  // number of trailing zero bits in non-zero 64-bit integer
+  #define COMPILER_CTZ64(x) __builtin_ctzll(x)
+
   #define COMPILER_PRINTF_ARGS_CHECK(...) __attribute__((format(printf,__VA_ARGS__)))
 
 #elif defined(_MSC_VER)  // MSVC or ICC on Windows
@@ -60,6 +63,8 @@
 
   /* COMPILER_CONSTEXPR_STRLEN(x) */
 
+  /* COMPILER_CTZ64(x) */
+
   #define COMPILER_PRINTF_ARGS_CHECK(...)
 
 #else  // unknown compiler
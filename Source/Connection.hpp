@@ -555,6 +555,9 @@ struct IConnectionUpdateCallback;
  */
 class ConnectionData
 {
+	// only hot data are here, so the whole object fits into one cache line
+	// everything else, such as type name or ports, is obtained from the connection
+
 	//! Data belongs to this connection.
 	const Connection *m_pConnection;
 
@@ -563,11 +566,6 @@ class ConnectionData
 	//! Current connection state.
 	int m_state;
 
-	//! True, if the connection has ports, otherwise false.
-	bool m_hasPorts;
-	//! Connection type name.
-	KString m_typeName;
-
 public:
 	/**
 	 * @brief Constructor.
@@ -577,9 +575,7 @@ public:
 	ConnectionData(const Connection & connection)
 	: m_pConnection(&connection),
 	  m_traffic(),
-	  m_state(0),
-	  m_hasPorts(connection.hasPorts()),
-	  m_typeName(connection.getTypeName())
+	  m_state(0)
 	{
 	}
 
@@ -593,9 +589,7 @@ public:
 	ConnectionData(const Connection & connection, const ConnectionTraffic & traffic, int state = 0)
 	: m_pConnection(&connection),
 	  m_traffic(traffic),
-	  m_state(state),
-	  m_hasPorts(connection.hasPorts()),
-	  m_typeName(connection.getTypeName())
+	  m_state(state)
 	{
 	}
 
@@ -614,7 +608,7 @@ public:
 	 */
 	KString getTypeName() const
 	{
-		return m_typeName;
+		return m_pConnection->getTypeName();
 	}
 
 	/**
@@ -632,7 +626,7 @@ public:
 	 */
 	bool hasPorts() const
 	{
-		return m_hasPorts;
+		return m_pConnection->hasPorts();
 	}
 
 	/**
@@ -806,6 +800,8 @@ public:
 	static bool Deserialize(const rapidjson::Value & document, IConnectionUpdateCallback *callback);
 };
 
+static_assert(sizeof (ConnectionData) <= 64, "ConnectionData must fit into one cache line");
+
 /**
  * @brief Connection update callback interface.
  * This class is used by collector to add, remove, and update connections in the connection list. It is also used during
@@ -813,7 +809,7 @@ public:
  */
 struct IConnectionUpdateCallback
 {
-	virtual AddressData *getAddress(const IAddress & address, bool add = false) = 0;
+	virtual AddressData *getAddress(const Address & address, bool add = false) = 0;
 
 	virtual PortData *getPort(const Port & port, bool add = false) = 0;
 
@@ -828,6 +824,67 @@ struct IConnectionUpdateCallback
 	virtual void remove(const Connection & connection) = 0;
 
 	virtual void clear() = 0;
+
+	/**
+	 * @brief Announces that a number of connections is going to be added.
+	 * It is only a hint that allows the callback to prepare for a large batch, such as the initial load.
+	 */
+	virtual void reserve(size_t connectionCount) = 0;
+
+	/**
+	 * @brief Starts a batch of changes.
+	 * All changes made before the matching endUpdate call belong to one update, so the callback may process them at
+	 * once. Batches are not nested.
+	 */
+	virtual void beginUpdate() = 0;
+
+	/**
+	 * @brief Ends a batch of changes.
+	 */
+	virtual void endUpdate() = 0;
+
+	/**
+	 * @brief Ends a batch of changes that was interrupted by an exception.
+	 * Processing of the changes is left to the next batch, so this function must not throw.
+	 */
+	virtual void cancelUpdate() noexcept = 0;
+};
+
+/**
+ * @brief Batch of connection changes.
+ * The batch has to be ended by commit. If it is destroyed without commit, for example by an exception, it is only
+ * cancelled, because processing of the changes might throw another exception.
+ */
+class ConnectionUpdateBatch
+{
+	IConnectionUpdateCallback *m_callback;
+	bool m_isCommitted;
+
+public:
+	explicit ConnectionUpdateBatch(IConnectionUpdateCallback *callback)
+	: m_callback(callback),
+	  m_isCommitted(false)
+	{
+		m_callback->beginUpdate();
+	}
+
+	~ConnectionUpdateBatch()
+	{
+		if (!m_isCommitted)
+		{
+			m_callback->cancelUpdate();
+		}
+	}
+
+	void commit()
+	{
+		m_callback->endUpdate();
+		m_isCommitted = true;
+	}
+
+	// no copy
+	ConnectionUpdateBatch(const ConnectionUpdateBatch &) = delete;
+	ConnectionUpdateBatch & operator=(const ConnectionUpdateBatch &) = delete;
 };
 
 inline bool operator==(const Connection & a, const Connection & b)
@@ -0,0 +1,724 @@
+/**
+ * @file
+ * @brief Implementation of ConnectionIndex class.
+ */
+
+#include <algorithm>
+#include <iterator>  // std::back_inserter
+#include <thread>
+
+#include "ConnectionIndex.hpp"
+#include "Thread.hpp"
+
+//! Minimum number of connections sorted by each thread when all connections are sorted at once.
+static const size_t PARALLEL_SORT_MIN_SIZE = 65536;
+static const unsigned int MAX_SORT_THREADS = 8;
+
+/**
+ * @brief Returns number of threads used to sort a number of connections at once.
+ */
+static unsigned int GetSortThreadCount(size_t connectionCount)
+{
+	// zero if unknown
+	size_t count = std::thread::hardware_concurrency();
+
+	count = std::min<size_t>(count, MAX_SORT_THREADS);
+	count = std::min<size_t>(count, connectionCount / PARALLEL_SORT_MIN_SIZE);
+
+	return (count > 1) ? count : 1;
+}
+
+/**
+ * @brief Calls a function with each index from zero to count at the same time.
+ * The first index is processed by the calling thread.
+ */
+template<class Function>
+static void RunParallel(unsigned int count, const Function & function)
+{
+	std::vector<Thread> threads;
+	threads.reserve(count);
+
+	for (unsigned int i = 1; i < count; i++)
+	{
+		threads.emplace_back("Sort", [&function, i]() -> void
+		{
+			function(i);
+		});
+	}
+
+	function(0);
+
+	for (Thread & thread : threads)
+	{
+		thread.join();
+	}
+}
+
+ConnectionIndex::ConnectionIndex(const Order & order)
+: m_nodes(1, Node{ Key{ 0, 0 }, nullptr, NIL, NIL, NIL, 0, 0, false, false }),
+  m_freeNodes(),
+  m_changedNodes(),
+  m_nodeMap(),
+  m_root(NIL),
+  m_random(0x9E3779B9),
+  m_order(order)
+{
+}
+
+uint32_t ConnectionIndex::allocateNode(const ConnectionData *pConnection)
+{
+	uint32_t node;
+	if (!m_freeNodes.empty())
+	{
+		node = m_freeNodes.back();
+		m_freeNodes.pop_back();
+	}
+	else
+	{
+		node = m_nodes.size();
+		m_nodes.emplace_back();
+	}
+
+	m_nodes[node] = Node{ Key{ 0, 0 }, pConnection, NIL, NIL, NIL, 1, nextPriority(), false, false };
+
+	return node;
+}
+
+void ConnectionIndex::replaceChild(uint32_t parent, uint32_t oldChild, uint32_t newChild)
+{
+	if (parent == NIL)
+	{
+		m_root = newChild;
+	}
+	else if (m_nodes[parent].left == oldChild)
+	{
+		m_nodes[parent].left = newChild;
+	}
+	else
+	{
+		m_nodes[parent].right = newChild;
+	}
+}
+
+/**
+ * @brief Rotates node above its parent.
+ * The order of nodes is not changed.
+ */
+void ConnectionIndex::rotateUp(uint32_t node)
+{
+	const uint32_t parent = m_nodes[node].parent;
+	const uint32_t grandparent = m_nodes[parent].parent;
+
+	uint32_t moved;
+	if (m_nodes[parent].left == node)
+	{
+		moved = m_nodes[node].right;
+		m_nodes[parent].left = moved;
+		m_nodes[node].right = parent;
+	}
+	else
+	{
+		moved = m_nodes[node].left;
+		m_nodes[parent].right = moved;
+		m_nodes[node].left = parent;
+	}
+
+	if (moved != NIL)
+	{
+		m_nodes[moved].parent = parent;
+	}
+
+	m_nodes[parent].parent = node;
+	m_nodes[node].parent = grandparent;
+	replaceChild(grandparent, parent, node);
+
+	updateSize(parent);
+	updateSize(node);
+}
+
+void ConnectionIndex::insertNode(uint32_t node)
+{
+	m_nodes[node].isLinked = true;
+
+	if (m_root == NIL)
+	{
+		m_root = node;
+		return;
+	}
+
+	uint32_t current = m_root;
+	for (;;)
+	{
+		m_nodes[current].size++;
+
+		uint32_t & child = (isLess(node, current)) ? m_nodes[current].left : m_nodes[current].right;
+		if (child == NIL)
+		{
+			child = node;
+			break;
+		}
+
+		current = child;
+	}
+
+	m_nodes[node].parent = current;
+
+	while (m_nodes[node].parent != NIL && m_nodes[node].priority > m_nodes[m_nodes[node].parent].priority)
+	{
+		rotateUp(node);
+	}
+}
+
+void ConnectionIndex::unlinkNode(uint32_t node)
+{
+	// rotate the node down until it is a leaf
+	for (;;)
+	{
+		const uint32_t left = m_nodes[node].left;
+		const uint32_t right = m_nodes[node].right;
+
+		if (left == NIL && right == NIL)
+		{
+			break;
+		}
+
+		if (left == NIL)
+		{
+			rotateUp(right);
+		}
+		else if (right == NIL)
+		{
+			rotateUp(left);
+		}
+		else
+		{
+			rotateUp((m_nodes[left].priority > m_nodes[right].priority) ? left : right);
+		}
+	}
+
+	const uint32_t parent = m_nodes[node].parent;
+
+	replaceChild(parent, node, NIL);
+
+	for (uint32_t ancestor = parent; ancestor != NIL; ancestor = m_nodes[ancestor].parent)
+	{
+		m_nodes[ancestor].size--;
+	}
+
+	m_nodes[node].parent = NIL;
+	m_nodes[node].size = 1;
+	m_nodes[node].isLinked = false;
+}
+
+/**
+ * @brief Stable LSD radix sort of entries by their keys.
+ * Histograms of all key bytes are computed at once and bytes that are the same in all keys are skipped, so
+ * small counters or addresses from the same range need only a few passes.
+ */
+void ConnectionIndex::RadixSort(std::vector<SortEntry> & entries)
+{
+	std::vector<size_t> counts(KEY_SIZE * 256);
+
+	for (const SortEntry & entry : entries)
+	{
+		for (unsigned int i = 0; i < KEY_SIZE; i++)
+		{
+			counts[i * 256 + GetKeyByte(entry.key, i)]++;
+		}
+	}
+
+	std::vector<SortEntry> buffer(entries.size());
+
+	for (unsigned int i = 0; i < KEY_SIZE; i++)
+	{
+		size_t *byteCounts = &counts[i * 256];
+
+		if (byteCounts[GetKeyByte(entries.front().key, i)] == entries.size())
+		{
+			continue;
+		}
+
+		size_t offset = 0;
+		for (unsigned int value = 0; value < 256; value++)
+		{
+			const size_t count = byteCounts[value];
+			byteCounts[value] = offset;
+			offset += count;
+		}
+
+		for (const SortEntry & entry : entries)
+		{
+			buffer[byteCounts[GetKeyByte(entry.key, i)]++] = entry;
+		}
+
+		entries.swap(buffer);
+	}
+}
+
+/**
+ * @brief Sorts nodes by their keys.
+ * Nodes with equal keys are sorted by the compare function if there is any. Otherwise, they keep their order.
+ */
+void ConnectionIndex::sortNodes(uint32_t *nodes, size_t count) const
+{
+	// keys are copied next to the nodes, so the sort does not access the nodes
+	std::vector<SortEntry> entries;
+	entries.reserve(count);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		entries.push_back(SortEntry{ m_nodes[nodes[i]].key, nodes[i] });
+	}
+
+	if (!m_order.compareFunc && entries.size() >= RADIX_SORT_MIN_SIZE)
+	{
+		RadixSort(entries);
+	}
+	else
+	{
+		std::stable_sort(entries.begin(), entries.end(),
+			[this](const SortEntry & a, const SortEntry & b) -> bool
+			{
+				return isLess(a.node, b.node);
+			}
+		);
+	}
+
+	for (size_t i = 0; i < entries.size(); i++)
+	{
+		nodes[i] = entries[i].node;
+	}
+}
+
+/**
+ * @brief Computes keys of nodes and sorts them using multiple threads.
+ * Each thread sorts one part of the nodes and then the parts are merged in pairs. Parts are merged in their
+ * original order, so the result is the same as if all nodes were sorted at once.
+ */
+void ConnectionIndex::sortNodesParallel(std::vector<uint32_t> & nodes, unsigned int threadCount)
+{
+	std::vector<size_t> bounds(threadCount + 1);
+	for (unsigned int i = 0; i <= threadCount; i++)
+	{
+		bounds[i] = nodes.size() * i / threadCount;
+	}
+
+	// each node is modified only by one thread and the node pool is not resized in the meantime
+	RunParallel(threadCount, [this, &nodes, &bounds](unsigned int part) -> void
+	{
+		for (size_t i = bounds[part]; i < bounds[part + 1]; i++)
+		{
+			Node & n = m_nodes[nodes[i]];
+			n.key = getKey(*n.pConnection);
+		}
+
+		sortNodes(&nodes[bounds[part]], bounds[part + 1] - bounds[part]);
+	});
+
+	std::vector<uint32_t> buffer(nodes.size());
+
+	for (unsigned int width = 1; width < threadCount; width *= 2)
+	{
+		const unsigned int mergeCount = (threadCount + 2 * width - 1) / (2 * width);
+
+		RunParallel(mergeCount, [this, &nodes, &bounds, &buffer, width, threadCount](unsigned int merge) -> void
+		{
+			const unsigned int first = merge * 2 * width;
+			const size_t begin = bounds[first];
+			const size_t middle = bounds[std::min(first + width, threadCount)];
+			const size_t end = bounds[std::min(first + 2 * width, threadCount)];
+
+			std::merge(nodes.begin() + begin, nodes.begin() + middle, nodes.begin() + middle, nodes.begin() + end,
+			           buffer.begin() + begin,
+				[this](uint32_t a, uint32_t b) -> bool
+				{
+					return isLess(a, b);
+				}
+			);
+		});
+
+		nodes.swap(buffer);
+	}
+}
+
+/**
+ * @brief Links sorted nodes into a new tree.
+ * Nodes with random priorities are linked into a treap in linear time. The right spine of the tree is kept on the
+ * stack and subtree of each node removed from it is complete.
+ */
+void ConnectionIndex::buildTree(const std::vector<uint32_t> & sortedNodes)
+{
+	std::vector<uint32_t> stack;
+
+	for (uint32_t node : sortedNodes)
+	{
+		Node & n = m_nodes[node];
+		n.parent = NIL;
+		n.right = NIL;
+		n.isLinked = true;
+
+		uint32_t last = NIL;
+		while (!stack.empty() && m_nodes[stack.back()].priority < n.priority)
+		{
+			last = stack.back();
+			stack.pop_back();
+			updateSize(last);
+		}
+
+		n.left = last;
+		if (last != NIL)
+		{
+			m_nodes[last].parent = node;
+		}
+
+		if (!stack.empty())
+		{
+			m_nodes[stack.back()].right = node;
+			n.parent = stack.back();
+		}
+
+		stack.push_back(node);
+	}
+
+	for (auto it = stack.rbegin(); it != stack.rend(); ++it)
+	{
+		updateSize(*it);
+	}
+
+	m_root = (stack.empty()) ? NIL : stack.front();
+}
+
+/**
+ * @brief Rebuilds the whole tree with changed nodes at their new positions.
+ * Unchanged nodes are still sorted, so only the changed ones are sorted and then merged with them.
+ */
+void ConnectionIndex::rebuildTree(const std::vector<uint32_t> & changedNodes)
+{
+	if (changedNodes.size() * 2 >= m_nodeMap.size())
+	{
+		// most nodes are changed, so it is faster to sort all nodes than to find the unchanged ones in the tree
+		std::vector<uint32_t> sortedNodes;
+		sortedNodes.reserve(m_nodeMap.size());
+
+		for (uint32_t node = 1; node < m_nodes.size(); node++)
+		{
+			if (m_nodes[node].pConnection)
+			{
+				sortedNodes.push_back(node);
+			}
+		}
+
+		sortNodes(sortedNodes);
+		buildTree(sortedNodes);
+
+		return;
+	}
+
+	std::vector<uint32_t> unchangedNodes;
+	unchangedNodes.reserve(m_nodeMap.size() - changedNodes.size());
+
+	for (uint32_t node = getFirstNode(); node != NIL; node = getNextNode(node))
+	{
+		if (!m_nodes[node].isChanged)
+		{
+			unchangedNodes.push_back(node);
+		}
+	}
+
+	std::vector<uint32_t> sortedChangedNodes(changedNodes);
+	sortNodes(sortedChangedNodes);
+
+	std::vector<uint32_t> sortedNodes;
+	sortedNodes.reserve(unchangedNodes.size() + sortedChangedNodes.size());
+
+	// unchanged nodes go first if equal
+	std::merge(unchangedNodes.begin(), unchangedNodes.end(), sortedChangedNodes.begin(), sortedChangedNodes.end(),
+	           std::back_inserter(sortedNodes),
+		[this](uint32_t a, uint32_t b) -> bool
+		{
+			return isLess(a, b);
+		}
+	);
+
+	buildTree(sortedNodes);
+}
+
+/**
+ * @brief Checks if a linked node is still between its neighbours.
+ */
+bool ConnectionIndex::isInOrder(uint32_t node) const
+{
+	const uint32_t prev = getPrevNode(node);
+	const uint32_t next = getNextNode(node);
+
+	return (prev == NIL || !isLess(node, prev)) && (next == NIL || !isLess(next, node));
+}
+
+uint32_t ConnectionIndex::getFirstNode() const
+{
+	uint32_t node = m_root;
+	if (node != NIL)
+	{
+		while (m_nodes[node].left != NIL)
+		{
+			node = m_nodes[node].left;
+		}
+	}
+
+	return node;
+}
+
+uint32_t ConnectionIndex::getPrevNode(uint32_t node) const
+{
+	if (m_nodes[node].left != NIL)
+	{
+		node = m_nodes[node].left;
+		while (m_nodes[node].right != NIL)
+		{
+			node = m_nodes[node].right;
+		}
+
+		return node;
+	}
+
+	uint32_t parent = m_nodes[node].parent;
+	while (parent != NIL && m_nodes[parent].left == node)
+	{
+		node = parent;
+		parent = m_nodes[node].parent;
+	}
+
+	return parent;
+}
+
+uint32_t ConnectionIndex::getNextNode(uint32_t node) const
+{
+	if (m_nodes[node].right != NIL)
+	{
+		node = m_nodes[node].right;
+		while (m_nodes[node].left != NIL)
+		{
+			node = m_nodes[node].left;
+		}
+
+		return node;
+	}
+
+	uint32_t parent = m_nodes[node].parent;
+	while (parent != NIL && m_nodes[parent].right == node)
+	{
+		node = parent;
+		parent = m_nodes[node].parent;
+	}
+
+	return parent;
+}
+
+uint32_t ConnectionIndex::getNodeAt(size_t position) const
+{
+	if (position >= size())
+	{
+		return NIL;
+	}
+
+	uint32_t node = m_root;
+	for (;;)
+	{
+		const size_t leftSize = m_nodes[m_nodes[node].left].size;
+
+		if (position < leftSize)
+		{
+			node = m_nodes[node].left;
+		}
+		else if (position == leftSize)
+		{
+			return node;
+		}
+		else
+		{
+			position -= leftSize + 1;
+			node = m_nodes[node].right;
+		}
+	}
+}
+
+void ConnectionIndex::insert(const ConnectionData *pConnection)
+{
+	const uint32_t node = allocateNode(pConnection);
+
+	m_nodeMap.emplace(pConnection, node);
+
+	m_nodes[node].isChanged = true;
+	m_changedNodes.push_back(node);
+}
+
+void ConnectionIndex::erase(const void *pConnection)
+{
+	const ConnectionData *pKey = static_cast<const ConnectionData*>(pConnection);
+
+	auto pEntry = m_nodeMap.find(pKey);
+	if (!pEntry)
+	{
+		return;
+	}
+
+	const uint32_t node = pEntry->second;
+
+	if (m_nodes[node].isLinked)
+	{
+		unlinkNode(node);
+	}
+
+	m_nodeMap.erase(pKey);
+
+	m_nodes[node].pConnection = nullptr;
+
+	// changed node is freed by commitChanges, so it cannot be in the list of changed nodes twice
+	if (!m_nodes[node].isChanged)
+	{
+		m_freeNodes.push_back(node);
+	}
+}
+
+void ConnectionIndex::setChanged(const ConnectionData *pConnection)
+{
+	auto pEntry = m_nodeMap.find(pConnection);
+	if (!pEntry)
+	{
+		return;
+	}
+
+	Node & n = m_nodes[pEntry->second];
+
+	if (!n.isChanged)
+	{
+		n.isChanged = true;
+		m_changedNodes.push_back(pEntry->second);
+	}
+}
+
+bool ConnectionIndex::commitChanges()
+{
+	if (m_changedNodes.empty())
+	{
+		return false;
+	}
+
+	// free removed nodes and update keys of the others
+	m_changedNodes.erase(std::remove_if(m_changedNodes.begin(), m_changedNodes.end(),
+		[this](uint32_t node) -> bool
+		{
+			Node & n = m_nodes[node];
+			if (n.pConnection)
+			{
+				n.key = getKey(*n.pConnection);
+				return false;
+			}
+
+			n.isChanged = false;
+			m_freeNodes.push_back(node);
+
+			return true;
+		}
+	), m_changedNodes.end());
+
+	if (m_changedNodes.empty())
+	{
+		return false;
+	}
+
+	bool isOrderChanged = true;
+
+	if (m_changedNodes.size() == 1 && m_nodes[m_changedNodes[0]].isLinked && isInOrder(m_changedNodes[0]))
+	{
+		// all other nodes are sorted, so a single node can be checked with its neighbours
+		isOrderChanged = false;
+	}
+	else if (m_changedNodes.size() * REBUILD_RATIO < m_nodeMap.size())
+	{
+		// unlinking does not compare nodes, so all changed nodes are removed first and then inserted into sorted tree
+		for (uint32_t node : m_changedNodes)
+		{
+			if (m_nodes[node].isLinked)
+			{
+				unlinkNode(node);
+			}
+		}
+
+		for (uint32_t node : m_changedNodes)
+		{
+			insertNode(node);
+		}
+	}
+	else
+	{
+		rebuildTree(m_changedNodes);
+	}
+
+	for (uint32_t node : m_changedNodes)
+	{
+		m_nodes[node].isChanged = false;
+	}
+
+	m_changedNodes.clear();
+
+	return isOrderChanged;
+}
+
+void ConnectionIndex::assign(const std::vector<const ConnectionData*> & connections, const Order & order,
+                             unsigned int threadCount)
+{
+	clear();
+
+	m_order = order;
+
+	reserve(connections.size());
+
+	std::vector<uint32_t> sortedNodes;
+	sortedNodes.reserve(connections.size());
+
+	for (const ConnectionData *pConnection : connections)
+	{
+		const uint32_t node = allocateNode(pConnection);
+
+		m_nodeMap.emplace(pConnection, node);
+
+		sortedNodes.push_back(node);
+	}
+
+	if (threadCount == 0)
+	{
+		threadCount = GetSortThreadCount(sortedNodes.size());
+	}
+
+	if (threadCount > 1 && sortedNodes.size() >= threadCount)
+	{
+		sortNodesParallel(sortedNodes, threadCount);
+	}
+	else
+	{
+		for (uint32_t node : sortedNodes)
+		{
+			m_nodes[node].key = getKey(*m_nodes[node].pConnection);
+		}
+
+		sortNodes(sortedNodes);
+	}
+
+	buildTree(sortedNodes);
+}
+
+void ConnectionIndex::clear()
+{
+	m_nodes.resize(1);
+	m_freeNodes.clear();
+	m_changedNodes.clear();
+	m_nodeMap.clear();
+	m_root = NIL;
+}
+
+void ConnectionIndex::reserve(size_t count)
+{
+	m_nodes.reserve(count + 1);
+	m_nodeMap.reserve(count);
+}
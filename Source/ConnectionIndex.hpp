@@ -0,0 +1,257 @@
+/**
+ * @file
+ * @brief ConnectionIndex class.
+ */
+
+#pragma once
+
+#include <vector>
+
+#include "Connection.hpp"
+#include "StableHashMap.hpp"
+
+/**
+ * @brief Sorted index of all connections with order statistics.
+ * Connections are kept in a treap where each node knows size of its subtree, so a connection at any position can be
+ * found in O(log n). Each connection has its own node, which is found by a hash map, so a connection can be removed
+ * without comparing it with other connections. This is required because the order is defined by connection data and
+ * they are already changed when the index is notified.
+ * Changed connections are only marked and moved to their new positions later at once. Each one is either moved in
+ * O(log n) or, if there are many of them, the whole tree is rebuilt in linear time by merging them with the rest.
+ * Each node keeps a fixed-width key of its connection, so most comparisons do not access connection data at all and
+ * large number of connections can be sorted by radix sort.
+ */
+class ConnectionIndex
+{
+public:
+	/**
+	 * @brief Binary sort key.
+	 * Keys are compared as unsigned 128-bit integers.
+	 */
+	struct Key
+	{
+		uint64_t high;
+		uint64_t low;
+	};
+
+	//! Returns key of a connection.
+	using KeyFunction = Key (*)(const ConnectionData & connection);
+	//! Returns true if the first connection should be before the second one.
+	using CompareFunction = bool (*)(const ConnectionData & a, const ConnectionData & b);
+
+	/**
+	 * @brief Order of connections.
+	 */
+	struct Order
+	{
+		KeyFunction keyFunc;
+		//! Orders connections with equal keys or null if such connections are equal.
+		CompareFunction compareFunc;
+		//! Reverses the order.
+		bool isDescending;
+	};
+
+private:
+	static constexpr uint32_t NIL = 0;
+	//! The tree is rebuilt if at least one of this many connections was changed.
+	static constexpr size_t REBUILD_RATIO = 12;
+	//! Smaller number of connections is sorted by comparisons.
+	static constexpr size_t RADIX_SORT_MIN_SIZE = 1024;
+
+	struct Node
+	{
+		Key key;  //!< Already reversed if the order is descending.
+		const ConnectionData *pConnection;
+		uint32_t parent;
+		uint32_t left;
+		uint32_t right;
+		uint32_t size;  //!< Number of nodes in the subtree.
+		uint32_t priority;
+		bool isLinked;   //!< The node is in the tree.
+		bool isChanged;  //!< The node is waiting for commitChanges.
+	};
+
+	//! The first node is a sentinel with zero size, so NIL can be used like any other node.
+	std::vector<Node> m_nodes;
+	std::vector<uint32_t> m_freeNodes;
+	//! Also contains removed nodes, which are freed only by commitChanges.
+	std::vector<uint32_t> m_changedNodes;
+	StableHashMap<const ConnectionData*, uint32_t> m_nodeMap;
+	uint32_t m_root;
+	uint32_t m_random;
+	Order m_order;
+
+	uint32_t nextPriority()
+	{
+		// xorshift32
+		m_random ^= m_random << 13;
+		m_random ^= m_random >> 17;
+		m_random ^= m_random << 5;
+
+		return m_random;
+	}
+
+	struct SortEntry
+	{
+		Key key;
+		uint32_t node;
+	};
+
+	static constexpr unsigned int KEY_SIZE = 16;
+
+	static uint8_t GetKeyByte(const Key & key, unsigned int index)
+	{
+		return (index < 8) ? key.low >> (index * 8) : key.high >> ((index - 8) * 8);
+	}
+
+	static void RadixSort(std::vector<SortEntry> & entries);
+
+	static bool IsKeyLess(const Key & a, const Key & b)
+	{
+		return (a.high != b.high) ? a.high < b.high : a.low < b.low;
+	}
+
+	static bool IsKeyEqual(const Key & a, const Key & b)
+	{
+		return a.high == b.high && a.low == b.low;
+	}
+
+	Key getKey(const ConnectionData & connection) const
+	{
+		const Key key = m_order.keyFunc(connection);
+
+		return (m_order.isDescending) ? Key{ ~key.high, ~key.low } : key;
+	}
+
+	bool isLess(uint32_t a, uint32_t b) const
+	{
+		const Node & aNode = m_nodes[a];
+		const Node & bNode = m_nodes[b];
+
+		if (!IsKeyEqual(aNode.key, bNode.key))
+		{
+			return IsKeyLess(aNode.key, bNode.key);
+		}
+
+		if (!m_order.compareFunc)
+		{
+			return false;
+		}
+
+		return (m_order.isDescending) ? m_order.compareFunc(*bNode.pConnection, *aNode.pConnection)
+		                              : m_order.compareFunc(*aNode.pConnection, *bNode.pConnection);
+	}
+
+	void updateSize(uint32_t node)
+	{
+		Node & n = m_nodes[node];
+		n.size = m_nodes[n.left].size + m_nodes[n.right].size + 1;
+	}
+
+	uint32_t allocateNode(const ConnectionData *pConnection);
+	void replaceChild(uint32_t parent, uint32_t oldChild, uint32_t newChild);
+	void rotateUp(uint32_t node);
+	void insertNode(uint32_t node);
+	void unlinkNode(uint32_t node);
+	void sortNodes(uint32_t *nodes, size_t count) const;
+
+	void sortNodes(std::vector<uint32_t> & nodes) const
+	{
+		sortNodes(nodes.data(), nodes.size());
+	}
+
+	void sortNodesParallel(std::vector<uint32_t> & nodes, unsigned int threadCount);
+	void buildTree(const std::vector<uint32_t> & sortedNodes);
+	void rebuildTree(const std::vector<uint32_t> & changedNodes);
+	bool isInOrder(uint32_t node) const;
+	uint32_t getFirstNode() const;
+	uint32_t getPrevNode(uint32_t node) const;
+	uint32_t getNextNode(uint32_t node) const;
+	uint32_t getNodeAt(size_t position) const;
+
+public:
+	explicit ConnectionIndex(const Order & order);
+
+	/**
+	 * @brief Adds a connection.
+	 * It is placed by the next commitChanges after all connections that compare equal, so a large number of new
+	 * connections is sorted at once.
+	 */
+	void insert(const ConnectionData *pConnection);
+
+	/**
+	 * @brief Removes a connection.
+	 * The connection is never dereferenced, so it may be already destroyed.
+	 */
+	void erase(const void *pConnection);
+
+	/**
+	 * @brief Marks a connection as changed in a way that may affect its key.
+	 * Until commitChanges is called, connections are not moved.
+	 */
+	void setChanged(const ConnectionData *pConnection);
+
+	/**
+	 * @brief Updates keys of all changed connections and moves them to their new positions.
+	 * @return True if order of connections may have changed, otherwise false.
+	 */
+	bool commitChanges();
+
+	/**
+	 * @brief Replaces all connections and sorts them in a new order.
+	 * This is faster than adding connections one by one. Connections that compare equal keep their order. Large
+	 * number of connections is split between multiple threads, which compute keys and sort their parts.
+	 * @param threadCount Number of threads or zero to choose it by number of connections and CPUs.
+	 */
+	void assign(const std::vector<const ConnectionData*> & connections, const Order & order,
+	            unsigned int threadCount = 0);
+
+	void clear();
+
+	/**
+	 * @brief Prepares the index for a number of connections.
+	 */
+	void reserve(size_t count);
+
+	/**
+	 * @brief Returns connections in a range of positions.
+	 * @param position Position of the first connection.
+	 * @param count Maximum number of connections.
+	 * @param callback Function called with each connection in order.
+	 */
+	template<class Callback>
+	void forEach(size_t position, size_t count, Callback callback) const
+	{
+		for (uint32_t node = getNodeAt(position); node != NIL && count > 0; node = getNextNode(node), count--)
+		{
+			callback(m_nodes[node].pConnection);
+		}
+	}
+
+	//! Connections waiting for commitChanges are not counted.
+	size_t size() const
+	{
+		return m_nodes[m_root].size;
+	}
+
+	bool empty() const
+	{
+		return m_root == NIL;
+	}
+
+	const Order & getOrder() const
+	{
+		return m_order;
+	}
+
+	/**
+	 * @brief Returns number of bytes allocated by the index.
+	 */
+	size_t getMemoryUsage() const
+	{
+		return m_nodes.capacity() * sizeof (Node)
+		     + m_freeNodes.capacity() * sizeof (uint32_t)
+		     + m_changedNodes.capacity() * sizeof (uint32_t)
+		     + m_nodeMap.getMemoryUsage();
+	}
+};
@@ -4,14 +4,84 @@
  */
 
 #include <algorithm>
+#include <cstring>
 
 #include "ConnectionList.hpp"
 #include "App.hpp"
+#include "Compiler.hpp"  // COMPILER_CTZ64
 #include "IUI.hpp"
 
+using SortKey = ConnectionIndex::Key;
+
+/**
+ * @brief Counts trailing zero bits.
+ * @param value Non-zero value.
+ */
+static unsigned int CountTrailingZeros(uint64_t value)
+{
+#ifdef COMPILER_CTZ64
+	return COMPILER_CTZ64(value);
+#else
+	unsigned int count = 0;
+	while ((value & 1) == 0)
+	{
+		value >>= 1;
+		count++;
+	}
+	return count;
+#endif
+}
+
+static uint64_t ReadBigEndian64(const uint8_t *bytes)
+{
+	uint64_t value = 0;
+	for (unsigned int i = 0; i < 8; i++)
+	{
+		value = (value << 8) | bytes[i];
+	}
+
+	return value;
+}
+
+/**
+ * @brief Makes key of a signed value.
+ * The sign bit is flipped, so negative values are before positive ones.
+ */
+static uint64_t GetSignedKey(int64_t value)
+{
+	return static_cast<uint64_t>(value) ^ (static_cast<uint64_t>(1) << 63);
+}
+
+/**
+ * @brief Makes key of an address.
+ * The key is the whole raw address, so addresses are sorted numerically. IPv4 addresses are sorted as IPv4-mapped
+ * IPv6 addresses.
+ */
+static SortKey GetAddressKey(const AddressData & address)
+{
+	const uint8_t *bytes = reinterpret_cast<const uint8_t*>(address.getAddress().getRawAddr());
+
+	return SortKey{ ReadBigEndian64(bytes), ReadBigEndian64(bytes + 8) };
+}
+
+/**
+ * @brief Makes key of a string.
+ * The key is the first 16 bytes of the string padded with zeros, so strings with equal keys have to be compared.
+ */
+static SortKey GetStringKey(const std::string & string)
+{
+	uint8_t bytes[16] = {};
+	std::memcpy(bytes, string.data(), std::min<size_t>(string.length(), sizeof bytes));
+
+	return SortKey{ ReadBigEndian64(bytes), ReadBigEndian64(bytes + 8) };
+}
+
 ConnectionList::ConnectionList()
 : m_storage(),
-  m_list(),
+  m_index(GetSortOrder(EConnectionSortMode::NONE, false)),
+  m_rows(),
+  m_dirtyRows(),
+  m_dirtyRowsBegin(0),
   m_targetSize(0),
   m_scrollOffset(0),
   m_cursorPos(0),
@@ -21,52 +91,33 @@ ConnectionList::ConnectionList()
   m_connectionDetailUpdateFlags(0),
   m_sortMode(EConnectionSortMode::NONE),
   m_isSortAscending(false),
+  m_sortUpdateFlags(GetSortUpdateFlags(EConnectionSortMode::NONE)),
   m_isRefreshRequired(true),
-  m_compareFunc(nullptr)
+  m_isBatchUpdate(false),
+  m_isViewUpdatePending(false)
 {
-	updateCompareFunc();
 }
 
-AddressData *ConnectionList::getAddress(const IAddress & address, bool add)
+AddressData *ConnectionList::getAddress(const Address & address, bool add)
 {
 	bool isNew = false;
 	AddressData *pData = nullptr;
 
-	switch (address.getType())
+	if (add)
 	{
-		case EAddressType::IP4:
-		{
-			if (add)
-			{
-				auto result = m_storage.addIP4Address(static_cast<const AddressIP4&>(address));
-				pData = result.first;
-				isNew = result.second;
-			}
-			else
-			{
-				pData = m_storage.getIP4Address(static_cast<const AddressIP4&>(address));
-			}
-			break;
-		}
-		case EAddressType::IP6:
-		{
-			if (add)
-			{
-				auto result = m_storage.addIP6Address(static_cast<const AddressIP6&>(address));
-				pData = result.first;
-				isNew = result.second;
-			}
-			else
-			{
-				pData = m_storage.getIP6Address(static_cast<const AddressIP6&>(address));
-			}
-			break;
-		}
+		auto result = m_storage.addAddress(address);
+		pData = result.first;
+		isNew = result.second;
+	}
+	else
+	{
+		pData = m_storage.getAddress(address);
 	}
 
 	if (isNew)
 	{
 		m_dataTotalCount++;
+		m_storage.acquireAddress(*pData);  // released when resolved
 		gApp->getResolver()->resolveAddress(*pData, ResolverCallbackAddress, this);
 	}
 
@@ -92,6 +143,7 @@ PortData *ConnectionList::getPort(const Port & port, bool add)
 	if (isNew)
 	{
 		m_dataTotalCount++;
+		m_storage.acquirePort(*pData);  // released when resolved
 		gApp->getResolver()->resolvePort(*pData, ResolverCallbackPort, this);
 	}
 
@@ -136,92 +188,28 @@ void ConnectionList::update(const ConnectionData & data, int updateFlags)
 		m_connectionDetailUpdateFlags = updateFlags;
 	}
 
-	if (m_list.empty())
-	{
-		return;
-	}
-
-	unsigned int i = 0;
-	for (; i < m_list.size(); i++)
+	if (updateFlags & m_sortUpdateFlags)
 	{
-		if (m_list[i].pConnection == &data)
-		{
-			// check if the updated connection is in visible part of the list
-			if (i >= getListBeginIndex())
-			{
-				m_list[i].isRefreshRequired = true;
-				m_list[i].updateFlags |= updateFlags;
-				m_isRefreshRequired = true;
-			}
+		m_index.setChanged(&data);
 
-			break;
-		}
+		updateView();
 	}
 
-	if (i < m_list.size())
+	for (unsigned int row = 0; row < m_rows.size(); row++)
 	{
-		const Item & item = m_list[i];
-
-		bool isSortRequired = false;
-		bool isFillRequired = false;
-
-		// check if the updated connection is not the first
-		if (i > 0)
-		{
-			// compare with previous connection in the list
-			if (m_compareFunc(item, m_list[i-1]))
-			{
-				isSortRequired = true;
-			}
-		}
-
-		// check if the updated connection is not the last
-		if ((i+1) < m_list.size())
-		{
-			// compare with next connection in the list
-			if (m_compareFunc(m_list[i+1], item))
-			{
-				isSortRequired = true;
-			}
-
-			// compare with the last connection in the list
-			if (m_compareFunc(m_list.back(), item))
-			{
-				// maybe the updated connection shouldn't be in the list anymore
-				isFillRequired = true;
-			}
-		}
-		else if (!isSortRequired)
+		if (m_rows[row].pConnection == &data)
 		{
-			// the connection is already at the end of the list, so maybe it shouldn't be there anymore
-			isFillRequired = true;
-		}
-
-		if (isSortRequired)
-		{
-			sort();
-		}
+			m_rows[row].updateFlags |= updateFlags;
+			setRefreshRequired(row);
 
-		if (isFillRequired)
-		{
-			fill();
-		}
-	}
-	else
-	{
-		Item item(&data);
-
-		// the updated connection is not in the list but maybe it should be there now
-		if (m_compareFunc(item, m_list.back()))
-		{
-			insertItem(item);
+			break;
 		}
 	}
 }
 
 void ConnectionList::remove(const Connection & connection)
 {
-	void *pData = m_storage.removeConnection(connection);
+	const void *pData = m_storage.removeConnection(connection);
 	if (pData)
 	{
 		handleRemovedConnection(pData);
@@ -230,8 +218,10 @@ void ConnectionList::remove(const Connection & connection)
 
 void ConnectionList::clear()
 {
-	m_list.clear();
+	m_rows.clear();
+	m_index.clear();
 	m_storage.clearConnections();
+	clearDirtyRows();
 
 	m_cursorPos = 0;
 
@@ -241,6 +231,50 @@ void ConnectionList::clear()
 	m_isRefreshRequired = true;
 }
 
+void ConnectionList::reserve(size_t connectionCount)
+{
+	const size_t totalCount = m_storage.getConnectionCount() + connectionCount;
+
+	m_storage.reserveConnections(totalCount);
+	m_index.reserve(totalCount);
+}
+
+void ConnectionList::beginUpdate()
+{
+	m_isBatchUpdate = true;
+}
+
+void ConnectionList::endUpdate()
+{
+	m_isBatchUpdate = false;
+
+	if (m_isViewUpdatePending)
+	{
+		updateView();
+	}
+}
+
+void ConnectionList::cancelUpdate() noexcept
+{
+	m_isBatchUpdate = false;
+
+	// rows of connections removed during the batch are dropped without any allocation
+	auto isRemoved = [](const Item & item) -> bool { return item.pConnection == nullptr; };
+
+	const auto rowsEnd = std::remove_if(m_rows.begin(), m_rows.end(), isRemoved);
+	if (rowsEnd != m_rows.end())
+	{
+		m_rows.erase(rowsEnd, m_rows.end());
+		m_isViewUpdatePending = true;
+	}
+
+	// the visible rows are rebuilt from the index by the next update or by getNextUpdate
+	if (m_isViewUpdatePending)
+	{
+		m_isRefreshRequired = true;
+	}
+}
+
 void ConnectionList::addressDataUpdated(const AddressData & address)
 {
 	if (m_connectionDetail)
@@ -256,9 +290,26 @@ void ConnectionList::addressDataUpdated(const AddressData & address)
 		}
 	}
 
-	if (m_list.empty())
+	for (unsigned int row = 0; row < m_rows.size(); row++)
 	{
-		return;
+		Item & item = m_rows[row];
+
+		if (!item.pConnection)
+		{
+			continue;  // removed during the current batch
+		}
+
+		if (&item.pConnection->getSrcAddr() == &address)
+		{
+			item.updateFlags |= EConnectionUpdateFlags::SRC_ADDRESS;
+			setRefreshRequired(row);
+		}
+
+		if (&item.pConnection->getDstAddr() == &address)
+		{
+			item.updateFlags |= EConnectionUpdateFlags::DST_ADDRESS;
+			setRefreshRequired(row);
+		}
 	}
 
 	bool mayAffectOrder = false;
@@ -280,68 +331,19 @@ void ConnectionList::addressDataUpdated(const AddressData & address)
 		}
 	}
 
-	bool contains = false;
 	if (mayAffectOrder)
 	{
-		const auto visibleBeginIt = getListBeginIt();
-		for (auto it = m_list.begin(); it != visibleBeginIt; ++it)
-		{
-			if (&it->pConnection->getSrcAddr() == &address || &it->pConnection->getDstAddr() == &address)
-			{
-				contains = true;
-			}
-		}
-	}
-
-	bool isVisible = false;
-	for (auto it = getListBeginIt(); it != m_list.end(); ++it)
-	{
-		if (&it->pConnection->getSrcAddr() == &address)
-		{
-			isVisible = true;
-			it->updateFlags |= EConnectionUpdateFlags::SRC_ADDRESS;
-			it->isRefreshRequired = true;
-		}
-
-		if (&it->pConnection->getDstAddr() == &address)
-		{
-			isVisible = true;
-			it->updateFlags |= EConnectionUpdateFlags::DST_ADDRESS;
-			it->isRefreshRequired = true;
-		}
-	}
-
-	if (isVisible)
-	{
-		contains = true;
-		m_isRefreshRequired = true;
-	}
+		bool isChanged = false;
 
-	if (mayAffectOrder)
-	{
-		if (contains)
+		m_storage.forEachConnection(address, [this, &isChanged](const ConnectionData & connection) -> void
 		{
-			sort();
-		}
-
-		Item item(nullptr);
+			m_index.setChanged(&connection);
+			isChanged = true;
+		});
 
-		for (auto storageIt = m_storage.begin(); storageIt != m_storage.end(); ++storageIt)
+		if (isChanged)
 		{
-			const ConnectionData *pConnection = &storageIt->second;
-
-			if (&pConnection->getSrcAddr() == &address || &pConnection->getDstAddr() == &address)
-			{
-				item.pConnection = pConnection;
-
-				if (m_compareFunc(item, m_list.back()))
-				{
-					if (!containsItem(item))
-					{
-						insertItem(item);
-					}
-				}
-			}
+			updateView();
 		}
 	}
 }
@@ -361,9 +363,26 @@ void ConnectionList::portDataUpdated(const PortData & port)
 		}
 	}
 
-	if (m_list.empty())
+	for (unsigned int row = 0; row < m_rows.size(); row++)
 	{
-		return;
+		Item & item = m_rows[row];
+
+		if (!item.pConnection || !item.pConnection->hasPorts())
+		{
+			continue;
+		}
+
+		if (&item.pConnection->getSrcPort() == &port)
+		{
+			item.updateFlags |= EConnectionUpdateFlags::SRC_PORT;
+			setRefreshRequired(row);
+		}
+
+		if (&item.pConnection->getDstPort() == &port)
+		{
+			item.updateFlags |= EConnectionUpdateFlags::DST_PORT;
+			setRefreshRequired(row);
+		}
 	}
 
 	bool mayAffectOrder = false;
@@ -381,106 +400,60 @@ void ConnectionList::portDataUpdated(const PortData & port)
 		}
 	}
 
-	bool contains = false;
 	if (mayAffectOrder)
 	{
-		auto visibleBeginIt = getListBeginIt();
-		for (auto it = m_list.begin(); it != visibleBeginIt; ++it)
-		{
-			if (!it->pConnection->hasPorts())
-			{
-				continue;
-			}
+		bool isChanged = false;
 
-			if (&it->pConnection->getSrcPort() == &port || &it->pConnection->getDstPort() == &port)
-			{
-				contains = true;
-			}
-		}
-	}
-
-	bool isVisible = false;
-	for (auto it = getListBeginIt(); it != m_list.end(); ++it)
-	{
-		if (!it->pConnection->hasPorts())
-		{
-			continue;
-		}
-
-		if (&it->pConnection->getSrcPort() == &port)
+		m_storage.forEachConnection(port, [this, &isChanged](const ConnectionData & connection) -> void
 		{
-			isVisible = true;
-			it->updateFlags |= EConnectionUpdateFlags::SRC_PORT;
-			it->isRefreshRequired = true;
-		}
+			m_index.setChanged(&connection);
+			isChanged = true;
+		});
 
-		if (&it->pConnection->getDstPort() == &port)
+		if (isChanged)
 		{
-			isVisible = true;
-			it->updateFlags |= EConnectionUpdateFlags::DST_PORT;
-			it->isRefreshRequired = true;
+			updateView();
 		}
 	}
+}
 
-	if (isVisible)
+ConnectionListUpdate ConnectionList::getNextUpdate()
+{
+	if (m_isViewUpdatePending && !m_isBatchUpdate)
 	{
-		contains = true;
-		m_isRefreshRequired = true;
+		// some batch was cancelled
+		updateView();
 	}
 
-	if (mayAffectOrder)
+	if (m_isRefreshRequired)
 	{
-		if (contains)
-		{
-			sort();
-		}
+		const unsigned int visibleSize = getSize();
 
-		Item item(nullptr);
-
-		for (auto storageIt = m_storage.begin(); storageIt != m_storage.end(); ++storageIt)
+		// rows before m_dirtyRowsBegin are already refreshed, so each call continues where the previous one ended
+		for (; m_dirtyRowsBegin < m_dirtyRows.size(); m_dirtyRowsBegin++)
 		{
-			const ConnectionData *pConnection = &storageIt->second;
+			uint64_t & word = m_dirtyRows[m_dirtyRowsBegin];
 
-			if (!pConnection->hasPorts())
+			while (word)
 			{
-				continue;
-			}
+				const unsigned int row = m_dirtyRowsBegin * 64 + CountTrailingZeros(word);
 
-			if (&pConnection->getSrcPort() == &port || &pConnection->getDstPort() == &port)
-			{
-				item.pConnection = pConnection;
+				word &= word - 1;  // clear the lowest set bit
 
-				if (m_compareFunc(item, m_list.back()))
+				// the row may not exist anymore if the list was shrunk, and the connection may be removed during
+				// the current batch, in which case the row is refreshed again at the end of the batch
+				if (row < visibleSize && m_rows[row].pConnection)
 				{
-					if (!containsItem(item))
-					{
-						insertItem(item);
-					}
-				}
-			}
-		}
-	}
-}
+					Item & item = m_rows[row];
 
-ConnectionListUpdate ConnectionList::getNextUpdate()
-{
-	if (m_isRefreshRequired)
-	{
-		unsigned int currentRow = 0;
-		for (auto it = getListBeginIt(); it != m_list.end(); ++it)
-		{
-			if (it->isRefreshRequired)
-			{
-				const bool isCursor = (currentRow == m_cursorPos);
-				const int updateFlags = it->updateFlags;
+					const bool isCursor = (row == m_cursorPos);
+					const int updateFlags = item.updateFlags;
 
-				it->isRefreshRequired = false;
-				it->updateFlags = 0;
+					item.updateFlags = 0;
 
-				return ConnectionListUpdate(it->pConnection, updateFlags, currentRow, isCursor);
+					return ConnectionListUpdate(item.pConnection, updateFlags, row, isCursor);
+				}
 			}
-
-			currentRow++;
 		}
 
 		// all items in the list are refreshed
@@ -492,10 +465,10 @@ ConnectionListUpdate ConnectionList::getNextUpdate()
 
 void ConnectionList::invalidateAllVisible()
 {
-	for (auto it = getListBeginIt(); it != m_list.end(); ++it)
+	for (unsigned int row = 0; row < m_rows.size(); row++)
 	{
-		it->isRefreshRequired = true;
-		it->updateFlags = -1;
+		m_rows[row].updateFlags = -1;
+		setRefreshRequired(row);
 	}
 
 	m_isRefreshRequired = true;
@@ -503,15 +476,10 @@ void ConnectionList::invalidateAllVisible()
 
 void ConnectionList::invalidateCursor()
 {
-	auto it = getListBeginIt();
-	if (it != m_list.end())
+	if (m_cursorPos < m_rows.size())
 	{
-		it += m_cursorPos;
-
-		it->isRefreshRequired = true;
-		it->updateFlags = -1;
-
-		m_isRefreshRequired = true;
+		m_rows[m_cursorPos].updateFlags = -1;
+		setRefreshRequired(m_cursorPos);
 	}
 }
 
@@ -543,7 +511,7 @@ void ConnectionList::moveCursor(int amount)
 	{
 		const unsigned int maxPos = getCursorMaxPos();
 		const int maxAmount = maxPos - m_cursorPos;
-		if (amount > maxAmount && m_storage.getConnectionCount() > m_list.size())
+		if (amount > maxAmount && m_index.size() > m_scrollOffset + m_rows.size())
 		{
 			m_cursorPos = maxPos;
 
@@ -579,17 +547,13 @@ void ConnectionList::doScroll(int amount)
 		{
 			m_scrollOffset -= amount;
 
-			for (int diff = getSize() - m_targetSize; diff > 0; diff--)
-			{
-				m_list.pop_back();
-			}
-
 			invalidateAllVisible();
+			updateView();
 		}
 	}
 	else if (amount > 0)
 	{
-		const int maxAmount = m_storage.getConnectionCount() - m_list.size();
+		const int maxAmount = m_index.size() - (m_scrollOffset + m_rows.size());
 		if (amount > maxAmount)
 		{
 			amount = maxAmount;
@@ -600,19 +564,16 @@ void ConnectionList::doScroll(int amount)
 			m_scrollOffset += amount;
 
 			invalidateAllVisible();
-
-			fill();
+			updateView();
 		}
 	}
 }
 
 void ConnectionList::initConnectionDetail()
 {
-	auto it = getListBeginIt();
-	if (it != m_list.end())
+	if (m_cursorPos < m_rows.size())
 	{
-		it += m_cursorPos;
-		m_connectionDetail = it->pConnection;
+		m_connectionDetail = m_rows[m_cursorPos].pConnection;
 	}
 	else
 	{
@@ -633,27 +594,7 @@ void ConnectionList::setTargetSize(unsigned int size)
 	{
 		m_targetSize = size;
 
-		const unsigned int currentSize = getSize();
-		if (currentSize > m_targetSize)
-		{
-			for (unsigned int diff = currentSize - m_targetSize; diff > 0; diff--)
-			{
-				m_list.pop_back();
-			}
-
-			m_isRefreshRequired = true;
-		}
-		else if (currentSize < m_targetSize)
-		{
-			fill();
-		}
-
-		const unsigned int maxCursorPos = getCursorMaxPos();
-		if (m_cursorPos > maxCursorPos)
-		{
-			m_cursorPos = maxCursorPos;
-			invalidateCursor();
-		}
+		updateView();
 	}
 }
 
@@ -663,105 +604,77 @@ void ConnectionList::setSortMode(EConnectionSortMode sortMode, bool isAscending)
 	{
 		m_sortMode = sortMode;
 		m_isSortAscending = isAscending;
+		m_sortUpdateFlags = GetSortUpdateFlags(m_sortMode);
 
-		updateCompareFunc();
+		std::vector<const ConnectionData*> connections;
+		connections.reserve(m_storage.getConnectionCount());
 
-		m_list.clear();
-		fill();
+		for (auto storageIt = m_storage.begin(); storageIt != m_storage.end(); ++storageIt)
+		{
+			connections.push_back(&storageIt->second);
+		}
 
-		m_isRefreshRequired = true;
+		m_index.assign(connections, GetSortOrder(m_sortMode, m_isSortAscending));
+
+		invalidateAllVisible();
+		updateView();
 	}
 }
 
-void ConnectionList::fill()
+void ConnectionList::updateView()
 {
-	if (m_targetSize <= getSize() || m_storage.getConnectionCount() <= m_list.size())
+	if (m_isBatchUpdate)
 	{
+		// the visible rows are updated only once at the end of the batch
+		m_isViewUpdatePending = true;
 		return;
 	}
 
-	Item item(nullptr);
+	m_isViewUpdatePending = false;
 
-	if (m_list.empty())
-	{
-		// there must be at least one connection in the storage (see the above checks)
-		item.pConnection = &m_storage.begin()->second;
+	m_index.commitChanges();
 
-		m_list.push_back(item);
-	}
+	unsigned int row = 0;
 
-	for (auto storageIt = m_storage.begin(); storageIt != m_storage.end(); ++storageIt)
+	m_index.forEach(m_scrollOffset, m_targetSize, [this, &row](const ConnectionData *pConnection) -> void
 	{
-		item.pConnection = &storageIt->second;
-
-		if (m_compareFunc(item, m_list.back()))
+		if (row == m_rows.size())
 		{
-			if (!containsItem(item))
-			{
-				insertItem(item);
-			}
+			m_rows.emplace_back(pConnection);
+			setRefreshRequired(row);
 		}
-		else if (getSize() < m_targetSize)
+		else if (m_rows[row].pConnection != pConnection)
 		{
-			if (!containsItem(item))
-			{
-				m_list.push_back(item);
-			}
+			m_rows[row] = Item(pConnection);
+			setRefreshRequired(row);
 		}
-	}
-
-	m_isRefreshRequired = true;
-}
-
-void ConnectionList::sort()
-{
-	std::sort(m_list.begin(), m_list.end(), m_compareFunc);
-
-	invalidateAllVisible();
-}
 
-void ConnectionList::insertItem(const Item & item)
-{
-	auto it = m_list.insert(std::upper_bound(m_list.begin(), m_list.end(), item, m_compareFunc), item);
-
-	unsigned int index = std::distance(m_list.begin(), it);
+		row++;
+	});
 
-	if (getSize() > m_targetSize)
+	if (row < m_rows.size())
 	{
-		m_list.pop_back();
-	}
+		m_rows.erase(m_rows.begin() + row, m_rows.end());
 
-	const unsigned int visibleBeginIndex = getListBeginIndex();
-	if (index < visibleBeginIndex)
-	{
-		index = visibleBeginIndex;
+		m_isRefreshRequired = true;
 	}
 
-	for (; index < m_list.size(); ++index)
+	const unsigned int maxCursorPos = getCursorMaxPos();
+	if (m_cursorPos > maxCursorPos)
 	{
-		m_list[index].isRefreshRequired = true;
-		m_list[index].updateFlags = -1;
+		m_cursorPos = maxCursorPos;
+		invalidateCursor();
 	}
-
-	m_isRefreshRequired = true;
 }
 
 void ConnectionList::handleNewConnection(const ConnectionData & connection)
 {
-	Item item(&connection);
+	m_index.insert(&connection);
 
-	if (!m_list.empty() && m_compareFunc(item, m_list.back()))
-	{
-		insertItem(item);
-	}
-	else if (getSize() < m_targetSize)
-	{
-		m_list.push_back(item);
-		m_isRefreshRequired = true;
-	}
+	updateView();
 }
 
-void ConnectionList::handleRemovedConnection(void *pConnection)
+void ConnectionList::handleRemovedConnection(const void *pConnection)
 {
 	if (m_connectionDetail == pConnection)
 	{
@@ -769,585 +682,322 @@ void ConnectionList::handleRemovedConnection(void *pConnection)
 		m_connectionDetailUpdateFlags = -1;
 	}
 
-	auto it = m_list.begin();
-	while (it != m_list.end())
+	m_index.erase(pConnection);
+
+	// the storage may reuse the same memory for a new connection before the visible rows are updated
+	for (Item & item : m_rows)
 	{
-		if (pConnection == it->pConnection)
+		if (item.pConnection == pConnection)
 		{
-			it = m_list.erase(it);
-
+			item.pConnection = nullptr;
 			break;
 		}
-		else
-		{
-			++it;
-		}
-	}
-
-	const auto visibleBeginIt = getListBeginIt();
-	if (it < visibleBeginIt)
-	{
-		it = visibleBeginIt;
 	}
 
-	// invalidate all visible connections after the removed connection
-	for (; it != m_list.end(); ++it)
-	{
-		it->isRefreshRequired = true;
-		it->updateFlags = -1;
-	}
-
-	fill();
-
-	const unsigned int maxCursorPos = getCursorMaxPos();
-	if (m_cursorPos > maxCursorPos)
-	{
-		m_cursorPos = maxCursorPos;
-		invalidateCursor();
-	}
-
-	m_isRefreshRequired = true;
+	updateView();
 }
 
-void ConnectionList::updateCompareFunc()
+ConnectionIndex::Order ConnectionList::GetSortOrder(EConnectionSortMode sortMode, bool isAscending)
 {
-	switch (m_sortMode)
+	ConnectionIndex::Order order = {};
+	order.isDescending = !isAscending;
+
+	switch (sortMode)
 	{
 		case EConnectionSortMode::NONE:
 		{
-			m_compareFunc = [](const Item &, const Item &) -> bool
+			order.keyFunc = [](const ConnectionData &) -> SortKey
 			{
-				return false;
+				return SortKey{ 0, 0 };
 			};
 			break;
 		}
 		case EConnectionSortMode::PROTO:
 		{
-			if (m_isSortAscending)
+			order.keyFunc = [](const ConnectionData & connection) -> SortKey
 			{
-				m_compareFunc = [](const Item & a, const Item & b) -> bool
-				{
-					const EConnectionType aProto = a.pConnection->getType();
-					const EConnectionType bProto = b.pConnection->getType();
-
-					return aProto < bProto;
-				};
-			}
-			else
-			{
-				m_compareFunc = [](const Item & a, const Item & b) -> bool
-				{
-					const EConnectionType aProto = a.pConnection->getType();
-					const EConnectionType bProto = b.pConnection->getType();
-
-					return bProto < aProto;
-				};
-			}
+				return SortKey{ 0, static_cast<uint64_t>(connection.getType()) };
+			};
 			break;
 		}
 		case EConnectionSortMode::PROTO_STATE:
 		{
-			if (m_isSortAscending)
+			order.keyFunc = [](const ConnectionData & connection) -> SortKey
 			{
-				m_compareFunc = [](const Item & a, const Item & b) -> bool
-				{
-					const EConnectionType aProto = a.pConnection->getType();
-					const EConnectionType bProto = b.pConnection->getType();
-
-					if (Connection::IsProtoEqual(aProto, bProto))
-					{
-						return a.pConnection->getState() < b.pConnection->getState();
-					}
-					else
-					{
-						return aProto < bProto;
-					}
-				};
-			}
-			else
-			{
-				m_compareFunc = [](const Item & a, const Item & b) -> bool
-				{
-					const EConnectionType aProto = a.pConnection->getType();
-					const EConnectionType bProto = b.pConnection->getType();
-
-					if (Connection::IsProtoEqual(aProto, bProto))
-					{
-						return b.pConnection->getState() < a.pConnection->getState();
-					}
-					else
-					{
-						return bProto < aProto;
-					}
-				};
-			}
+				// the same states of IPv4 and IPv6 connections are equal
+				const EConnectionType type = connection.getType();
+				const bool isTCP = (type == EConnectionType::TCP4 || type == EConnectionType::TCP6);
+
+				return SortKey{ isTCP, GetSignedKey(connection.getState()) };
+			};
 			break;
 		}
 		case EConnectionSortMode::SRC_ADDRESS:
 		{
-			if (m_isSortAscending)
+			order.keyFunc = [](const ConnectionData & connection) -> SortKey
 			{
-				m_compareFunc = [](const Item & a, const Item & b) -> bool
-				{
-					const AddressData & aAddr = a.pConnection->getSrcAddr();
-					const AddressData & bAddr = b.pConnection->getSrcAddr();
-
-					if (aAddr.getAddressType() == bAddr.getAddressType())
-					{
-						return aAddr.getNumericString() < bAddr.getNumericString();
-					}
-					else
-					{
-						return aAddr.getAddressType() < bAddr.getAddressType();
-					}
-				};
-			}
-			else
-			{
-				m_compareFunc = [](const Item & a, const Item & b) -> bool
-				{
-					const AddressData & aAddr = a.pConnection->getSrcAddr();
-					const AddressData & bAddr = b.pConnection->getSrcAddr();
-
-					if (aAddr.getAddressType() == bAddr.getAddressType())
-					{
-						return bAddr.getNumericString() < aAddr.getNumericString();
-					}
-					else
-					{
-						return bAddr.getAddressType() < aAddr.getAddressType();
-					}
-				};
-			}
+				return GetAddressKey(connection.getSrcAddr());
+			};
 			break;
 		}
 		case EConnectionSortMode::DST_ADDRESS:
 		{
-			if (m_isSortAscending)
-			{
-				m_compareFunc = [](const Item & a, const Item & b) -> bool
-				{
-					const AddressData & aAddr = a.pConnection->getDstAddr();
-					const AddressData & bAddr = b.pConnection->getDstAddr();
-
-					if (aAddr.getAddressType() == bAddr.getAddressType())
-					{
-						return aAddr.getNumericString() < bAddr.getNumericString();
-					}
-					else
-					{
-						return aAddr.getAddressType() < bAddr.getAddressType();
-					}
-				};
-			}
-			else
+			order.keyFunc = [](const ConnectionData & connection) -> SortKey
 			{
-				m_compareFunc = [](const Item & a, const Item & b) -> bool
-				{
-					const AddressData & aAddr = a.pConnection->getDstAddr();
-					const AddressData & bAddr = b.pConnection->getDstAddr();
-
-					if (aAddr.getAddressType() == bAddr.getAddressType())
-					{
-						return bAddr.getNumericString() < aAddr.getNumericString();
-					}
-					else
-					{
-						return bAddr.getAddressType() < aAddr.getAddressType();
-					}
-				};
-			}
+				return GetAddressKey(connection.getDstAddr());
+			};
 			break;
 		}
 		case EConnectionSortMode::SRC_HOSTNAME:
 		{
-			if (m_isSortAscending)
+			order.keyFunc = [](const ConnectionData & connection) -> SortKey
 			{
-				m_compareFunc = [](const Item & a, const Item & b) -> bool
-				{
-					const AddressData & aAddr = a.pConnection->getSrcAddr();
-					const AddressData & bAddr = b.pConnection->getSrcAddr();
-
-					return aAddr.getHostnameString() < bAddr.getHostnameString();
-				};
-			}
-			else
+				return GetStringKey(connection.getSrcAddr().getHostnameString());
+			};
+			order.compareFunc = [](const ConnectionData & a, const ConnectionData & b) -> bool
 			{
-				m_compareFunc = [](const Item & a, const Item & b) -> bool
-				{
-					const AddressData & aAddr = a.pConnection->getSrcAddr();
-					const AddressData & bAddr = b.pConnection->getSrcAddr();
-
-					return bAddr.getHostnameString() < aAddr.getHostnameString();
-				};
-			}
+				return a.getSrcAddr().getHostnameString() < b.getSrcAddr().getHostnameString();
+			};
 			break;
 		}
 		case EConnectionSortMode::DST_HOSTNAME:
 		{
-			if (m_isSortAscending)
+			order.keyFunc = [](const ConnectionData & connection) -> SortKey
 			{
-				m_compareFunc = [](const Item & a, const Item & b) -> bool
-				{
-					const AddressData & aAddr = a.pConnection->getDstAddr();
-					const AddressData & bAddr = b.pConnection->getDstAddr();
-
-					return aAddr.getHostnameString() < bAddr.getHostnameString();
-				};
-			}
-			else
+				return GetStringKey(connection.getDstAddr().getHostnameString());
+			};
+			order.compareFunc = [](const ConnectionData & a, const ConnectionData & b) -> bool
 			{
-				m_compareFunc = [](const Item & a, const Item & b) -> bool
-				{
-					const AddressData & aAddr = a.pConnection->getDstAddr();
-					const AddressData & bAddr = b.pConnection->getDstAddr();
-
-					return bAddr.getHostnameString() < aAddr.getHostnameString();
-				};
-			}
+				return a.getDstAddr().getHostnameString() < b.getDstAddr().getHostnameString();
+			};
 			break;
 		}
 		case EConnectionSortMode::SRC_ASN:
 		{
-			if (m_isSortAscending)
+			order.keyFunc = [](const ConnectionData & connection) -> SortKey
 			{
-				m_compareFunc = [](const Item & a, const Item & b) -> bool
-				{
-					const AddressData & aAddr = a.pConnection->getSrcAddr();
-					const AddressData & bAddr = b.pConnection->getSrcAddr();
-
-					return aAddr.getASN() < bAddr.getASN();
-				};
-			}
-			else
-			{
-				m_compareFunc = [](const Item & a, const Item & b) -> bool
-				{
-					const AddressData & aAddr = a.pConnection->getSrcAddr();
-					const AddressData & bAddr = b.pConnection->getSrcAddr();
-
-					return bAddr.getASN() < aAddr.getASN();
-				};
-			}
+				return SortKey{ 0, connection.getSrcAddr().getASN().getNumber() };
+			};
 			break;
 		}
 		case EConnectionSortMode::DST_ASN:
 		{
-			if (m_isSortAscending)
+			order.keyFunc = [](const ConnectionData & connection) -> SortKey
 			{
-				m_compareFunc = [](const Item & a, const Item & b) -> bool
-				{
-					const AddressData & aAddr = a.pConnection->getDstAddr();
-					const AddressData & bAddr = b.pConnection->getDstAddr();
-
-					return aAddr.getASN() < bAddr.getASN();
-				};
-			}
-			else
-			{
-				m_compareFunc = [](const Item & a, const Item & b) -> bool
-				{
-					const AddressData & aAddr = a.pConnection->getDstAddr();
-					const AddressData & bAddr = b.pConnection->getDstAddr();
-
-					return bAddr.getASN() < aAddr.getASN();
-				};
-			}
+				return SortKey{ 0, connection.getDstAddr().getASN().getNumber() };
+			};
 			break;
 		}
 		case EConnectionSortMode::SRC_COUNTRY:
 		{
-			if (m_isSortAscending)
+			order.keyFunc = [](const ConnectionData & connection) -> SortKey
 			{
-				m_compareFunc = [](const Item & a, const Item & b) -> bool
-				{
-					const AddressData & aAddr = a.pConnection->getSrcAddr();
-					const AddressData & bAddr = b.pConnection->getSrcAddr();
-
-					return aAddr.getCountry() < bAddr.getCountry();
-				};
-			}
-			else
-			{
-				m_compareFunc = [](const Item & a, const Item & b) -> bool
-				{
-					const AddressData & aAddr = a.pConnection->getSrcAddr();
-					const AddressData & bAddr = b.pConnection->getSrcAddr();
-
-					return bAddr.getCountry() < aAddr.getCountry();
-				};
-			}
+				return SortKey{ 0, static_cast<uint64_t>(connection.getSrcAddr().getCountry().getCode()) };
+			};
 			break;
 		}
 		case EConnectionSortMode::DST_COUNTRY:
 		{
-			if (m_isSortAscending)
+			order.keyFunc = [](const ConnectionData & connection) -> SortKey
 			{
-				m_compareFunc = [](const Item & a, const Item & b) -> bool
-				{
-					const AddressData & aAddr = a.pConnection->getDstAddr();
-					const AddressData & bAddr = b.pConnection->getDstAddr();
-
-					return aAddr.getCountry() < bAddr.getCountry();
-				};
-			}
-			else
-			{
-				m_compareFunc = [](const Item & a, const Item & b) -> bool
-				{
-					const AddressData & aAddr = a.pConnection->getDstAddr();
-					const AddressData & bAddr = b.pConnection->getDstAddr();
-
-					return bAddr.getCountry() < aAddr.getCountry();
-				};
-			}
+				return SortKey{ 0, static_cast<uint64_t>(connection.getDstAddr().getCountry().getCode()) };
+			};
 			break;
 		}
 		case EConnectionSortMode::SRC_PORT:
 		{
-			if (m_isSortAscending)
+			order.keyFunc = [](const ConnectionData & connection) -> SortKey
 			{
-				m_compareFunc = [](const Item & a, const Item & b) -> bool
+				// connections without ports are first
+				if (!connection.hasPorts())
 				{
-					if (!a.pConnection->hasPorts() || !b.pConnection->hasPorts())
-					{
-						return false;
-					}
-
-					const PortData & aPort = a.pConnection->getSrcPort();
-					const PortData & bPort = b.pConnection->getSrcPort();
-
-					return aPort.getPortNumber() < bPort.getPortNumber();
-				};
-			}
-			else
-			{
-				m_compareFunc = [](const Item & a, const Item & b) -> bool
-				{
-					if (!a.pConnection->hasPorts() || !b.pConnection->hasPorts())
-					{
-						return false;
-					}
-
-					const PortData & aPort = a.pConnection->getSrcPort();
-					const PortData & bPort = b.pConnection->getSrcPort();
+					return SortKey{ 0, 0 };
+				}
 
-					return bPort.getPortNumber() < aPort.getPortNumber();
-				};
-			}
+				return SortKey{ 1, connection.getSrcPort().getPortNumber() };
+			};
 			break;
 		}
 		case EConnectionSortMode::DST_PORT:
 		{
-			if (m_isSortAscending)
-			{
-				m_compareFunc = [](const Item & a, const Item & b) -> bool
-				{
-					if (!a.pConnection->hasPorts() || !b.pConnection->hasPorts())
-					{
-						return false;
-					}
-
-					const PortData & aPort = a.pConnection->getDstPort();
-					const PortData & bPort = b.pConnection->getDstPort();
-
-					return aPort.getPortNumber() < bPort.getPortNumber();
-				};
-			}
-			else
+			order.keyFunc = [](const ConnectionData & connection) -> SortKey
 			{
-				m_compareFunc = [](const Item & a, const Item & b) -> bool
+				// connections without ports are first
+				if (!connection.hasPorts())
 				{
-					if (!a.pConnection->hasPorts() || !b.pConnection->hasPorts())
-					{
-						return false;
-					}
-
-					const PortData & aPort = a.pConnection->getDstPort();
-					const PortData & bPort = b.pConnection->getDstPort();
+					return SortKey{ 0, 0 };
+				}
 
-					return bPort.getPortNumber() < aPort.getPortNumber();
-				};
-			}
+				return SortKey{ 1, connection.getDstPort().getPortNumber() };
+			};
 			break;
 		}
 		case EConnectionSortMode::SRC_SERVICE:
 		{
-			if (m_isSortAscending)
+			order.keyFunc = [](const ConnectionData & connection) -> SortKey
 			{
-				m_compareFunc = [](const Item & a, const Item & b) -> bool
+				if (!connection.hasPorts())
 				{
-					if (!a.pConnection->hasPorts() || !b.pConnection->hasPorts())
-					{
-						return false;
-					}
-
-					const PortData & aPort = a.pConnection->getSrcPort();
-					const PortData & bPort = b.pConnection->getSrcPort();
+					return SortKey{ 0, 0 };
+				}
 
-					return aPort.getServiceString() < bPort.getServiceString();
-				};
-			}
-			else
+				return GetStringKey(connection.getSrcPort().getServiceString());
+			};
+			order.compareFunc = [](const ConnectionData & a, const ConnectionData & b) -> bool
 			{
-				m_compareFunc = [](const Item & a, const Item & b) -> bool
+				// connections without ports are first
+				if (!a.hasPorts() || !b.hasPorts())
 				{
-					if (!a.pConnection->hasPorts() || !b.pConnection->hasPorts())
-					{
-						return false;
-					}
-
-					const PortData & aPort = a.pConnection->getSrcPort();
-					const PortData & bPort = b.pConnection->getSrcPort();
+					return !a.hasPorts() && b.hasPorts();
+				}
 
-					return bPort.getServiceString() < aPort.getServiceString();
-				};
-			}
+				return a.getSrcPort().getServiceString() < b.getSrcPort().getServiceString();
+			};
 			break;
 		}
 		case EConnectionSortMode::DST_SERVICE:
 		{
-			if (m_isSortAscending)
+			order.keyFunc = [](const ConnectionData & connection) -> SortKey
 			{
-				m_compareFunc = [](const Item & a, const Item & b) -> bool
+				if (!connection.hasPorts())
 				{
-					if (!a.pConnection->hasPorts() || !b.pConnection->hasPorts())
-					{
-						return false;
-					}
-
-					const PortData & aPort = a.pConnection->getDstPort();
-					const PortData & bPort = b.pConnection->getDstPort();
+					return SortKey{ 0, 0 };
+				}
 
-					return aPort.getServiceString() < bPort.getServiceString();
-				};
-			}
-			else
+				return GetStringKey(connection.getDstPort().getServiceString());
+			};
+			order.compareFunc = [](const ConnectionData & a, const ConnectionData & b) -> bool
 			{
-				m_compareFunc = [](const Item & a, const Item & b) -> bool
+				// connections without ports are first
+				if (!a.hasPorts() || !b.hasPorts())
 				{
-					if (!a.pConnection->hasPorts() || !b.pConnection->hasPorts())
-					{
-						return false;
-					}
-
-					const PortData & aPort = a.pConnection->getDstPort();
-					const PortData & bPort = b.pConnection->getDstPort();
+					return !a.hasPorts() && b.hasPorts();
+				}
 
-					return bPort.getServiceString() < aPort.getServiceString();
-				};
-			}
+				return a.getDstPort().getServiceString() < b.getDstPort().getServiceString();
+			};
 			break;
 		}
 		case EConnectionSortMode::RX_PACKETS:
 		{
-			if (m_isSortAscending)
+			order.keyFunc = [](const ConnectionData & connection) -> SortKey
 			{
-				m_compareFunc = [](const Item & a, const Item & b) -> bool
-				{
-					return a.pConnection->getRXPackets() < b.pConnection->getRXPackets();
-				};
-			}
-			else
-			{
-				m_compareFunc = [](const Item & a, const Item & b) -> bool
-				{
-					return b.pConnection->getRXPackets() < a.pConnection->getRXPackets();
-				};
-			}
+				return SortKey{ 0, connection.getRXPackets() };
+			};
 			break;
 		}
 		case EConnectionSortMode::TX_PACKETS:
 		{
-			if (m_isSortAscending)
+			order.keyFunc = [](const ConnectionData & connection) -> SortKey
 			{
-				m_compareFunc = [](const Item & a, const Item & b) -> bool
-				{
-					return a.pConnection->getTXPackets() < b.pConnection->getTXPackets();
-				};
-			}
-			else
-			{
-				m_compareFunc = [](const Item & a, const Item & b) -> bool
-				{
-					return b.pConnection->getTXPackets() < a.pConnection->getTXPackets();
-				};
-			}
+				return SortKey{ 0, connection.getTXPackets() };
+			};
 			break;
 		}
 		case EConnectionSortMode::RX_BYTES:
 		{
-			if (m_isSortAscending)
+			order.keyFunc = [](const ConnectionData & connection) -> SortKey
 			{
-				m_compareFunc = [](const Item & a, const Item & b) -> bool
-				{
-					return a.pConnection->getRXBytes() < b.pConnection->getRXBytes();
-				};
-			}
-			else
-			{
-				m_compareFunc = [](const Item & a, const Item & b) -> bool
-				{
-					return b.pConnection->getRXBytes() < a.pConnection->getRXBytes();
-				};
-			}
+				return SortKey{ 0, connection.getRXBytes() };
+			};
 			break;
 		}
 		case EConnectionSortMode::TX_BYTES:
 		{
-			if (m_isSortAscending)
-			{
-				m_compareFunc = [](const Item & a, const Item & b) -> bool
-				{
-					return a.pConnection->getTXBytes() < b.pConnection->getTXBytes();
-				};
-			}
-			else
+			order.keyFunc = [](const ConnectionData & connection) -> SortKey
 			{
-				m_compareFunc = [](const Item & a, const Item & b) -> bool
-				{
-					return b.pConnection->getTXBytes() < a.pConnection->getTXBytes();
-				};
-			}
+				return SortKey{ 0, connection.getTXBytes() };
+			};
 			break;
 		}
 		case EConnectionSortMode::RX_SPEED:
 		{
-			if (m_isSortAscending)
+			order.keyFunc = [](const ConnectionData & connection) -> SortKey
 			{
-				m_compareFunc = [](const Item & a, const Item & b) -> bool
-				{
-					return a.pConnection->getRXSpeed() < b.pConnection->getRXSpeed();
-				};
-			}
-			else
-			{
-				m_compareFunc = [](const Item & a, const Item & b) -> bool
-				{
-					return b.pConnection->getRXSpeed() < a.pConnection->getRXSpeed();
-				};
-			}
+				return SortKey{ 0, connection.getRXSpeed() };
+			};
 			break;
 		}
 		case EConnectionSortMode::TX_SPEED:
 		{
-			if (m_isSortAscending)
-			{
-				m_compareFunc = [](const Item & a, const Item & b) -> bool
-				{
-					return a.pConnection->getTXSpeed() < b.pConnection->getTXSpeed();
-				};
-			}
-			else
+			order.keyFunc = [](const ConnectionData & connection) -> SortKey
 			{
-				m_compareFunc = [](const Item & a, const Item & b) -> bool
-				{
-					return b.pConnection->getTXSpeed() < a.pConnection->getTXSpeed();
-				};
-			}
+				return SortKey{ 0, connection.getTXSpeed() };
+			};
 			break;
 		}
 	}
+
+	return order;
+}
+
+int ConnectionList::GetSortUpdateFlags(EConnectionSortMode sortMode)
+{
+	switch (sortMode)
+	{
+		case EConnectionSortMode::NONE:
+		{
+			return 0;
+		}
+		case EConnectionSortMode::PROTO:
+		{
+			return EConnectionUpdateFlags::PROTO;
+		}
+		case EConnectionSortMode::PROTO_STATE:
+		{
+			return EConnectionUpdateFlags::PROTO | EConnectionUpdateFlags::PROTO_STATE;
+		}
+		case EConnectionSortMode::SRC_ADDRESS:
+		case EConnectionSortMode::SRC_HOSTNAME:
+		case EConnectionSortMode::SRC_ASN:
+		case EConnectionSortMode::SRC_COUNTRY:
+		{
+			return EConnectionUpdateFlags::SRC_ADDRESS;
+		}
+		case EConnectionSortMode::DST_ADDRESS:
+		case EConnectionSortMode::DST_HOSTNAME:
+		case EConnectionSortMode::DST_ASN:
+		case EConnectionSortMode::DST_COUNTRY:
+		{
+			return EConnectionUpdateFlags::DST_ADDRESS;
+		}
+		case EConnectionSortMode::SRC_PORT:
+		case EConnectionSortMode::SRC_SERVICE:
+		{
+			return EConnectionUpdateFlags::SRC_PORT;
+		}
+		case EConnectionSortMode::DST_PORT:
+		case EConnectionSortMode::DST_SERVICE:
+		{
+			return EConnectionUpdateFlags::DST_PORT;
+		}
+		case EConnectionSortMode::RX_PACKETS:
+		{
+			return EConnectionUpdateFlags::RX_PACKETS;
+		}
+		case EConnectionSortMode::TX_PACKETS:
+		{
+			return EConnectionUpdateFlags::TX_PACKETS;
+		}
+		case EConnectionSortMode::RX_BYTES:
+		{
+			return EConnectionUpdateFlags::RX_BYTES;
+		}
+		case EConnectionSortMode::TX_BYTES:
+		{
+			return EConnectionUpdateFlags::TX_BYTES;
+		}
+		case EConnectionSortMode::RX_SPEED:
+		{
+			return EConnectionUpdateFlags::RX_SPEED;
+		}
+		case EConnectionSortMode::TX_SPEED:
+		{
+			return EConnectionUpdateFlags::TX_SPEED;
+		}
+	}
+
+	return -1;
 }
 
 void ConnectionList::ResolverCallbackAddress(AddressData & address, ResolvedAddress & resolved, void *param)
@@ -1360,6 +1010,7 @@ void ConnectionList::ResolverCallbackAddress(AddressData & address, ResolvedAddr
 
 	self->m_dataResolvedCount++;
 	self->addressDataUpdated(address);
+	self->m_storage.releaseAddress(address);
 
 	gApp->getUI()->refreshConnectionList();
 }
@@ -1372,6 +1023,7 @@ void ConnectionList::ResolverCallbackPort(PortData & port, ResolvedPort & resolv
 
 	self->m_dataResolvedCount++;
 	self->portDataUpdated(port);
+	self->m_storage.releasePort(port);
 
 	gApp->getUI()->refreshConnectionList();
 }
@@ -5,8 +5,9 @@
 
 #pragma once
 
-#include <deque>
+#include <vector>
 
+#include "ConnectionIndex.hpp"
 #include "ConnectionStorage.hpp"
 #include "Resolver.hpp"
 
@@ -66,20 +67,23 @@ class ConnectionList final : public IConnectionUpdateCallback
 	{
 		const ConnectionData *pConnection;
 		int updateFlags;
-		bool isRefreshRequired;
 
 		Item(const ConnectionData *pData, int dataUpdateFlags = -1)
 		: pConnection(pData),
-		  updateFlags(dataUpdateFlags),
-		  isRefreshRequired(true)
+		  updateFlags(dataUpdateFlags)
 		{
 		}
 	};
 
-	using CompareFunction = bool (*)(const Item & a, const Item & b);  // operator<
-
 	ConnectionStorage m_storage;
-	std::deque<Item> m_list;
+	//! All connections in the current order.
+	ConnectionIndex m_index;
+	//! Visible part of the index starting at m_scrollOffset.
+	std::vector<Item> m_rows;
+	//! One bit for each visible row that needs to be redrawn.
+	std::vector<uint64_t> m_dirtyRows;
+	//! Index of the first word in m_dirtyRows that may have some bit set.
+	unsigned int m_dirtyRowsBegin;
 	unsigned int m_targetSize;
 	unsigned int m_scrollOffset;
 	unsigned int m_cursorPos;
@@ -89,8 +93,13 @@ class ConnectionList final : public IConnectionUpdateCallback
 	int m_connectionDetailUpdateFlags;
 	EConnectionSortMode m_sortMode;
 	bool m_isSortAscending;
+	//! Updates with these flags may change position of a connection.
+	int m_sortUpdateFlags;
 	bool m_isRefreshRequired;
-	CompareFunction m_compareFunc;
+	//! True between beginUpdate and endUpdate.
+	bool m_isBatchUpdate;
+	//! Visible rows have to be updated from the index at the end of the current batch or after a cancelled one.
+	bool m_isViewUpdatePending;
 
 	unsigned int getCursorMaxPos() const
 	{
@@ -98,32 +107,44 @@ class ConnectionList final : public IConnectionUpdateCallback
 		return (visibleSize > 0) ? visibleSize-1 : 0;
 	}
 
-	unsigned int getListBeginIndex() const
+	/**
+	 * @brief Marks visible row as requiring refresh.
+	 * @param row Index of the row in the visible part of the list.
+	 */
+	void setRefreshRequired(unsigned int row)
 	{
-		return (m_list.size() > m_scrollOffset) ? m_scrollOffset : 0;
-	}
+		const unsigned int wordIndex = row / 64;
 
-	std::deque<Item>::iterator getListBeginIt()
-	{
-		return (m_list.size() > m_scrollOffset) ? m_list.begin() + m_scrollOffset : m_list.end();
-	}
+		if (wordIndex >= m_dirtyRows.size())
+		{
+			m_dirtyRows.resize(wordIndex + 1);
+		}
 
-	bool containsItem(const Item & item) const
-	{
-		for (const Item & listItem : m_list)
+		m_dirtyRows[wordIndex] |= static_cast<uint64_t>(1) << (row % 64);
+
+		if (wordIndex < m_dirtyRowsBegin)
 		{
-			if (listItem.pConnection == item.pConnection)
-				return true;
+			m_dirtyRowsBegin = wordIndex;
 		}
-		return false;
+
+		m_isRefreshRequired = true;
 	}
 
-	void fill();
-	void sort();
-	void insertItem(const Item & item);
+	void clearDirtyRows()
+	{
+		m_dirtyRows.clear();
+		m_dirtyRowsBegin = 0;
+	}
+
+	/**
+	 * @brief Replaces visible rows with connections at their positions in the index.
+	 * Only rows with a different connection are refreshed.
+	 */
+	void updateView();
 	void handleNewConnection(const ConnectionData & connection);
-	void handleRemovedConnection(void *pConnection);
-	void updateCompareFunc();
+	void handleRemovedConnection(const void *pConnection);
+
+	static int GetSortUpdateFlags(EConnectionSortMode sortMode);
 
 	static void ResolverCallbackAddress(AddressData & address, ResolvedAddress & resolved, void *param);
 	static void ResolverCallbackPort(PortData & port, ResolvedPort & resolved, void *param);
@@ -133,7 +154,7 @@ public:
 
 	// IConnectionUpdateCallback
 
-	AddressData *getAddress(const IAddress & address, bool add = false) override;
+	AddressData *getAddress(const Address & address, bool add = false) override;
 	PortData *getPort(const Port & port, bool add = false) override;
 	ConnectionData *find(const Connection & connection) override;
 	ConnectionData *add(const Connection & connection) override;
@@ -141,6 +162,10 @@ public:
 	void update(const ConnectionData & data, int updateFlags) override;
 	void remove(const Connection & connection) override;
 	void clear() override;
+	void reserve(size_t connectionCount) override;
+	void beginUpdate() override;
+	void endUpdate() override;
+	void cancelUpdate() noexcept override;
 
 	void addressDataUpdated(const AddressData & address);
 	void portDataUpdated(const PortData & port);
@@ -155,6 +180,8 @@ public:
 	void setTargetSize(unsigned int size);
 	void setSortMode(EConnectionSortMode sortMode, bool isAscending = false);
 
+	static ConnectionIndex::Order GetSortOrder(EConnectionSortMode sortMode, bool isAscending);
+
 	bool isRefreshRequired() const
 	{
 		return m_isRefreshRequired;
@@ -177,7 +204,7 @@ public:
 
 	unsigned int getSize() const
 	{
-		return (m_list.size() > m_scrollOffset) ? m_list.size() - m_scrollOffset : 0;
+		return m_rows.size();
 	}
 
 	unsigned int getTargetSize() const
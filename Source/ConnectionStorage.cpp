@@ -0,0 +1,196 @@
+/**
+ * @file
+ * @brief Implementation of ConnectionStorage class.
+ */
+
+#include <algorithm>
+
+#include "ConnectionStorage.hpp"
+#include "CmdLine.hpp"
+#include "Exception.hpp"
+#include "Util.hpp"
+
+static const unsigned long DEFAULT_GRACE_PERIOD = 60;  // seconds
+static const unsigned long MAX_GRACE_PERIOD = 86400;
+
+/**
+ * @brief Reclaims data whose grace period is over.
+ * @param deadline Data released before this time are reclaimed if they are still unused.
+ */
+template<class MapType, class QueueType>
+static void ReclaimReleased(MapType & map, QueueType & queue, std::chrono::steady_clock::time_point deadline)
+{
+	while (!queue.empty() && queue.front().time <= deadline)
+	{
+		const auto & released = queue.front();
+		const auto pEntry = map.get(released.handle);
+
+		// data used again during the grace period have another record if they were released again
+		if (pEntry && pEntry->second.getRefCount() == 0
+		  && pEntry->second.getReleaseCount() == released.releaseCount)
+		{
+			map.erase(released.handle);
+		}
+
+		queue.pop_front();
+	}
+}
+
+ConnectionStorage::ConnectionStorage()
+: m_connectionMap(),
+  m_addressMap(),
+  m_portMap(),
+  m_releasedAddresses(),
+  m_releasedPorts(),
+#ifndef CONNTOP_DEDICATED
+  m_addressConnections(),
+  m_portConnections(),
+#endif
+  m_gracePeriod(GetGracePeriod())
+{
+}
+
+ConnectionStorage::Clock::duration ConnectionStorage::GetGracePeriod()
+{
+	unsigned long seconds = DEFAULT_GRACE_PERIOD;
+
+	CmdLineArg *gracePeriodArg = gCmdLine->getArg("data-grace-period");
+	if (gracePeriodArg)
+	{
+		const KString value = gracePeriodArg->getValue();
+
+		if (!Util::StringToUInt(value, seconds) || seconds > MAX_GRACE_PERIOD)
+		{
+			std::string errMsg = "Invalid value '";
+			errMsg += value;
+			errMsg += "' of '--data-grace-period'";
+			throw Exception(std::move(errMsg), "ConnectionStorage");
+		}
+	}
+
+	return std::chrono::seconds(seconds);
+}
+
+void ConnectionStorage::releaseAddress(AddressData & data, Clock::time_point now)
+{
+	if (data.releaseRef() > 0)
+	{
+		return;
+	}
+
+#ifndef CONNTOP_DEDICATED
+	// no connection uses the data anymore
+	m_addressConnections.erase(&data);
+#endif
+
+	auto handle = m_addressMap.getHandle(data.getAddress());
+	m_releasedAddresses.push_back({ now, handle, data.getReleaseCount() });
+}
+
+void ConnectionStorage::releasePort(PortData & data, Clock::time_point now)
+{
+	if (data.releaseRef() > 0)
+	{
+		return;
+	}
+
+#ifndef CONNTOP_DEDICATED
+	m_portConnections.erase(&data);
+#endif
+
+	auto handle = m_portMap.getHandle(data.getPort());
+	m_releasedPorts.push_back({ now, handle, data.getReleaseCount() });
+}
+
+void ConnectionStorage::releaseConnection(const Connection & connection, Clock::time_point now)
+{
+	releaseAddress(const_cast<AddressData&>(connection.getSrcAddr()), now);
+	releaseAddress(const_cast<AddressData&>(connection.getDstAddr()), now);
+
+	if (connection.hasPorts())
+	{
+		releasePort(const_cast<PortData&>(connection.getSrcPort()), now);
+		releasePort(const_cast<PortData&>(connection.getDstPort()), now);
+	}
+}
+
+void ConnectionStorage::sweep(Clock::time_point now)
+{
+	const Clock::time_point deadline = now - m_gracePeriod;
+
+	ReclaimReleased(m_addressMap, m_releasedAddresses, deadline);
+	ReclaimReleased(m_portMap, m_releasedPorts, deadline);
+}
+
+#ifndef CONNTOP_DEDICATED
+void ConnectionStorage::indexConnection(const Connection & connection)
+{
+	const ConnectionHandle handle = m_connectionMap.getHandle(connection);
+
+	// connections between the same addresses or ports are added only once
+	addToIndex(m_addressConnections, connection.getSrcAddr(), handle);
+	if (&connection.getDstAddr() != &connection.getSrcAddr())
+	{
+		addToIndex(m_addressConnections, connection.getDstAddr(), handle);
+	}
+
+	if (connection.hasPorts())
+	{
+		addToIndex(m_portConnections, connection.getSrcPort(), handle);
+		if (&connection.getDstPort() != &connection.getSrcPort())
+		{
+			addToIndex(m_portConnections, connection.getDstPort(), handle);
+		}
+	}
+}
+
+void ConnectionStorage::pruneConnections(ConnectionHandleList & connections) const
+{
+	auto IsRemoved = [this](const ConnectionHandle & handle) -> bool
+	{
+		return !m_connectionMap.isValid(handle);
+	};
+
+	connections.erase(std::remove_if(connections.begin(), connections.end(), IsRemoved), connections.end());
+}
+#endif
+
+void ConnectionStorage::clearConnections()
+{
+	const Clock::time_point now = Clock::now();
+
+	for (const auto & entry : m_connectionMap)
+	{
+		releaseConnection(entry.first, now);
+	}
+
+	m_connectionMap.clear();
+#ifndef CONNTOP_DEDICATED
+	m_addressConnections.clear();
+	m_portConnections.clear();
+#endif
+
+	sweep(now);
+}
+
+size_t ConnectionStorage::getConnectionMemoryUsage() const
+{
+	size_t result = m_connectionMap.getMemoryUsage();
+
+#ifndef CONNTOP_DEDICATED
+	result += m_addressConnections.getMemoryUsage();
+	result += m_portConnections.getMemoryUsage();
+
+	for (const auto & entry : m_addressConnections)
+	{
+		result += entry.second.capacity() * sizeof (ConnectionHandle);
+	}
+
+	for (const auto & entry : m_portConnections)
+	{
+		result += entry.second.capacity() * sizeof (ConnectionHandle);
+	}
+#endif
+
+	return result;
+}
@@ -5,57 +5,135 @@
 
 #pragma once
 
-#include <unordered_map>
+#include <chrono>
+#include <deque>
+#include <vector>
 
 #include "Connection.hpp"
 #include "Address.hpp"
 #include "Port.hpp"
+#include "StableHashMap.hpp"
 
+/**
+ * @brief Storage of connections, addresses and ports.
+ * All data are kept in stable hash maps, so references to them stay valid until they are removed.
+ * Address and port data are reference counted. Unused data are kept for a grace period, so resolved information
+ * can be reused by new connections, and then they are reclaimed.
+ * Each address and port data also know connections that use them, so changes of resolved information can be applied
+ * without going through all connections.
+ */
 class ConnectionStorage
 {
 public:
-	using ConnectionMapType = std::unordered_map<Connection, ConnectionData>;
-	using AddressIP4MapType = std::unordered_map<AddressIP4, AddressData>;
-	using AddressIP6MapType = std::unordered_map<AddressIP6, AddressData>;
-	using PortMapType = std::unordered_map<Port, PortData>;
+	using ConnectionMapType = StableHashMap<Connection, ConnectionData>;
+	using AddressMapType = StableHashMap<Address, AddressData>;
+	using PortMapType = StableHashMap<Port, PortData>;
+	using ConnectionHandle = ConnectionMapType::Handle;
 
 private:
+	using Clock = std::chrono::steady_clock;
+
+	template<class MapType>
+	struct ReleasedData
+	{
+		Clock::time_point time;
+		typename MapType::Handle handle;
+		unsigned int releaseCount;
+	};
+
 	ConnectionMapType m_connectionMap;
-	AddressIP4MapType m_addressIP4Map;
-	AddressIP6MapType m_addressIP6Map;
+	AddressMapType m_addressMap;
 	PortMapType m_portMap;
+	std::deque<ReleasedData<AddressMapType>> m_releasedAddresses;
+	std::deque<ReleasedData<PortMapType>> m_releasedPorts;
+#ifndef CONNTOP_DEDICATED
+	using ConnectionHandleList = std::vector<ConnectionHandle>;
 
-public:
-	ConnectionStorage()
-	: m_connectionMap(),
-	  m_addressIP4Map(),
-	  m_addressIP6Map(),
-	  m_portMap()
+	//! Connections using each address or port data. Handles of removed connections are dropped lazily.
+	StableHashMap<const AddressData*, ConnectionHandleList> m_addressConnections;
+	StableHashMap<const PortData*, ConnectionHandleList> m_portConnections;
+#endif
+	Clock::duration m_gracePeriod;
+
+	static Clock::duration GetGracePeriod();
+
+	void releaseAddress(AddressData & data, Clock::time_point now);
+	void releasePort(PortData & data, Clock::time_point now);
+	void releaseConnection(const Connection & connection, Clock::time_point now);
+	void sweep(Clock::time_point now);
+#ifndef CONNTOP_DEDICATED
+	void indexConnection(const Connection & connection);
+
+	template<class DataType, class IndexType>
+	void addToIndex(IndexType & index, const DataType & data, const ConnectionHandle & handle)
 	{
+		ConnectionHandleList & connections = index.emplace(&data).first->second;
+
+		// the list can contain at most one live handle per reference to the data
+		if (connections.size() >= 2 * data.getRefCount() + 8)
+		{
+			pruneConnections(connections);
+		}
+
+		connections.push_back(handle);
 	}
 
-	std::pair<AddressData*, bool> addIP4Address(const AddressIP4 & address)
+	void pruneConnections(ConnectionHandleList & connections) const;
+
+	template<class DataType, class IndexType, class Callback>
+	void forEachIndexed(IndexType & index, const DataType & data, Callback & callback)
 	{
-		auto result = m_addressIP4Map.emplace(address, address);
-		auto it = result.first;
-		bool isNew = result.second;
-		AddressData *pData = &it->second;
-		if (isNew)
+		auto pEntry = index.find(&data);
+		if (!pEntry)
 		{
-			pData->setAddress(it->first);
+			return;
 		}
-		return { pData, isNew };
+
+		ConnectionHandleList & connections = pEntry->second;
+
+		// removed connections are dropped on the way
+		size_t count = 0;
+		for (size_t i = 0; i < connections.size(); i++)
+		{
+			auto pConnection = m_connectionMap.get(connections[i]);
+			if (pConnection)
+			{
+				connections[count++] = connections[i];
+				callback(pConnection->second);
+			}
+		}
+
+		connections.resize(count);
 	}
+#endif
 
-	std::pair<AddressData*, bool> addIP6Address(const AddressIP6 & address)
+	void acquireConnection(const Connection & connection)
 	{
-		auto result = m_addressIP6Map.emplace(address, address);
+		// the storage owns all address and port data
+		const_cast<AddressData&>(connection.getSrcAddr()).addRef();
+		const_cast<AddressData&>(connection.getDstAddr()).addRef();
+
+		if (connection.hasPorts())
+		{
+			const_cast<PortData&>(connection.getSrcPort()).addRef();
+			const_cast<PortData&>(connection.getDstPort()).addRef();
+		}
+	}
+
+public:
+	ConnectionStorage();
+
+	std::pair<AddressData*, bool> addAddress(const Address & address)
+	{
+		auto result = m_addressMap.emplace(address, address);
 		auto it = result.first;
 		bool isNew = result.second;
 		AddressData *pData = &it->second;
 		if (isNew)
 		{
 			pData->setAddress(it->first);
+			// data that are never used are reclaimed too
+			m_releasedAddresses.push_back({ Clock::now(), m_addressMap.getHandle(address), 0 });
 		}
 		return { pData, isNew };
 	}
@@ -69,6 +147,8 @@ public:
 		if (isNew)
 		{
 			pData->setPort(it->first);
+			// data that are never used are reclaimed too
+			m_releasedPorts.push_back({ Clock::now(), m_portMap.getHandle(port), 0 });
 		}
 		return { pData, isNew };
 	}
@@ -76,56 +156,129 @@ public:
 	template<class... Args>
 	std::pair<ConnectionData*, bool> addConnection(const Connection & c, Args &&... args)
 	{
-		auto result = m_connectionMap.emplace(c, ConnectionData(c, std::forward<Args>(args)...));
+		auto result = m_connectionMap.emplace(c, c, std::forward<Args>(args)...);
 		auto it = result.first;
 		bool isNew = result.second;
 		ConnectionData *pData = &it->second;
 		if (isNew)
 		{
 			pData->setConnection(it->first);
+			acquireConnection(it->first);
+#ifndef CONNTOP_DEDICATED
+			indexConnection(it->first);
+#endif
 		}
 		return { pData, isNew };
 	}
 
-	void *removeConnection(const Connection & connection)
+	const void *removeConnection(const Connection & connection)
 	{
-		void *pData = nullptr;
-		auto it = m_connectionMap.find(connection);
-		if (it != m_connectionMap.end())
+		// the connection may refer to the removed key
+		const Connection removed = connection;
+
+		const void *pData = m_connectionMap.erase(removed);
+		if (pData)
 		{
-			pData = &it->second;
-			m_connectionMap.erase(it);
+			const Clock::time_point now = Clock::now();
+			releaseConnection(removed, now);
+			sweep(now);
 		}
 		return pData;
 	}
 
-	void clearConnections()
+	void clearConnections();
+
+	/**
+	 * @brief Prepares the storage for a number of connections, so they can be added without rehashing.
+	 */
+	void reserveConnections(size_t count)
 	{
-		m_connectionMap.clear();
+		m_connectionMap.reserve(count);
 	}
 
-	ConnectionData *getConnection(const Connection & connection)
+	/**
+	 * @brief Prevents address data from being reclaimed, for example while they are being resolved.
+	 */
+	void acquireAddress(AddressData & data)
+	{
+		data.addRef();
+	}
+
+	void releaseAddress(AddressData & data)
 	{
-		auto it = m_connectionMap.find(connection);
-		return (it != m_connectionMap.end()) ? &it->second : nullptr;
+		const Clock::time_point now = Clock::now();
+		releaseAddress(data, now);
+		sweep(now);
 	}
 
-	AddressData *getIP4Address(const AddressIP4 & address)
+	/**
+	 * @brief Prevents port data from being reclaimed, for example while they are being resolved.
+	 */
+	void acquirePort(PortData & data)
 	{
-		auto it = m_addressIP4Map.find(address);
-		return (it != m_addressIP4Map.end()) ? &it->second : nullptr;
+		data.addRef();
 	}
 
-	AddressData *getIP6Address(const AddressIP6 & address)
+	void releasePort(PortData & data)
+	{
+		const Clock::time_point now = Clock::now();
+		releasePort(data, now);
+		sweep(now);
+	}
+
+	ConnectionData *getConnection(const Connection & connection)
 	{
-		auto it = m_addressIP6Map.find(address);
-		return (it != m_addressIP6Map.end()) ? &it->second : nullptr;
+		auto pEntry = m_connectionMap.find(connection);
+		return (pEntry) ? &pEntry->second : nullptr;
+	}
+
+	AddressData *getAddress(const Address & address)
+	{
+		auto pEntry = m_addressMap.find(address);
+		return (pEntry) ? &pEntry->second : nullptr;
 	}
 
 	PortData *getPort(const Port & port)
 	{
-		auto it = m_portMap.find(port);
-		return (it != m_portMap.end()) ? &it->second : nullptr;
+		auto pEntry = m_portMap.find(port);
+		return (pEntry) ? &pEntry->second : nullptr;
+	}
+
+#ifndef CONNTOP_DEDICATED
+	/**
+	 * @brief Calls a function with each connection that uses the address data.
+	 * The function must not add or remove connections.
+	 */
+	template<class Callback>
+	void forEachConnection(const AddressData & data, Callback callback)
+	{
+		forEachIndexed(m_addressConnections, data, callback);
+	}
+
+	/**
+	 * @brief Calls a function with each connection that uses the port data.
+	 * The function must not add or remove connections.
+	 */
+	template<class Callback>
+	void forEachConnection(const PortData & data, Callback callback)
+	{
+		forEachIndexed(m_portConnections, data, callback);
+	}
+#endif
+
+	ConnectionHandle getConnectionHandle(const Connection & connection) const
+	{
+		return m_connectionMap.getHandle(connection);
+	}
+
+	/**
+	 * @brief Resolves connection handle without hashing.
+	 * @return Pointer to the connection data or null if the connection was removed in the meantime.
+	 */
+	ConnectionData *getConnection(const ConnectionHandle & handle)
+	{
+		auto pEntry = m_connectionMap.get(handle);
+		return (pEntry) ? &pEntry->second : nullptr;
 	}
 
 	ConnectionMapType::iterator begin()
@@ -158,14 +311,9 @@ public:
 		return m_connectionMap.cend();
 	}
 
-	std::pair<AddressIP4MapType::iterator, AddressIP4MapType::iterator> getIP4AddressIterators()
-	{
-		return { m_addressIP4Map.begin(), m_addressIP4Map.end() };
-	}
-
-	std::pair<AddressIP6MapType::iterator, AddressIP6MapType::iterator> getIP6AddressIterators()
+	std::pair<AddressMapType::iterator, AddressMapType::iterator> getAddressIterators()
 	{
-		return { m_addressIP6Map.begin(), m_addressIP6Map.end() };
+		return { m_addressMap.begin(), m_addressMap.end() };
 	}
 
 	std::pair<PortMapType::iterator, PortMapType::iterator> getPortIterators()
@@ -178,18 +326,30 @@ public:
 		return m_connectionMap.size();
 	}
 
-	size_t getIP4AddressCount() const
+	size_t getAddressCount() const
 	{
-		return m_addressIP4Map.size();
+		return m_addressMap.size();
 	}
 
-	size_t getIP6AddressCount() const
+	size_t getPortCount() const
 	{
-		return m_addressIP6Map.size();
+		return m_portMap.size();
 	}
 
-	size_t getPortCount() const
+	/**
+	 * @brief Returns how long unused address and port data are kept.
+	 */
+	std::chrono::steady_clock::duration getGracePeriod() const
 	{
-		return m_portMap.size();
+		return m_gracePeriod;
 	}
+
+	/**
+	 * @brief Returns number of bytes used by connections including all hash map overhead.
+	 * Address and port data are not included.
+	 */
+	size_t getConnectionMemoryUsage() const;
 };
+
+// memory used by each tracked connection, not counting its bucket in the hash map index
+static_assert(sizeof (ConnectionStorage::ConnectionMapType::Entry) <= 104, "Connection entry is too large");
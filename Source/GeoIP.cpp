@@ -181,6 +181,14 @@ public:
 		return (m_hasDB_ASN) ? m_dbASN.filename : nullptr;
 	}
 
+	uint64_t getDBVersion() const
+	{
+		const uint64_t countryBuildTime = (m_hasDB_Country) ? m_dbCountry.metadata.build_epoch : 0;
+		const uint64_t asnBuildTime = (m_hasDB_ASN) ? m_dbASN.metadata.build_epoch : 0;
+
+		return (countryBuildTime << 32) ^ asnBuildTime;
+	}
+
 	MMDB_s *getDB_Country()
 	{
 		return (m_hasDB_Country) ? &m_dbCountry : nullptr;
@@ -221,6 +229,11 @@ KString GeoIP::getDBFileName_ASN() const
 	return m_impl->getDBFileName_ASN();
 }
 
+uint64_t GeoIP::getDBVersion() const
+{
+	return m_impl->getDBVersion();
+}
+
 Country GeoIP::queryCountry(const AddressIP4 & address)
 {
 	MMDB_s *pDatabase = m_impl->getDB_Country();
@@ -41,43 +41,25 @@ public:
 	KString getDBFileName_Country() const;
 	KString getDBFileName_ASN() const;
 
+	/**
+	 * @brief Returns value that changes whenever any loaded database is replaced by another build.
+	 * @return Build times of both databases or zero if no database is loaded.
+	 */
+	uint64_t getDBVersion() const;
+
 	Country queryCountry(const AddressIP4 & address);
 	Country queryCountry(const AddressIP6 & address);
 
-	Country queryCountry(const IAddress & address)
+	Country queryCountry(const Address & address)
 	{
-		switch (address.getType())
-		{
-			case EAddressType::IP4:
-			{
-				return queryCountry(static_cast<const AddressIP4&>(address));
-			}
-			case EAddressType::IP6:
-			{
-				return queryCountry(static_cast<const AddressIP6&>(address));
-			}
-		}
-
-		return Country();
+		return (address.isIP4()) ? queryCountry(address.toIP4()) : queryCountry(address.toIP6());
 	}
 
 	ASN queryASN(const AddressIP4 & address);
 	ASN queryASN(const AddressIP6 & address);
 
-	ASN queryASN(const IAddress & address)
+	ASN queryASN(const Address & address)
 	{
-		switch (address.getType())
-		{
-			case EAddressType::IP4:
-			{
-				return queryASN(static_cast<const AddressIP4&>(address));
-			}
-			case EAddressType::IP6:
-			{
-				return queryASN(static_cast<const AddressIP6&>(address));
-			}
-		}
-
-		return ASN();
+		return (address.isIP4()) ? queryASN(address.toIP4()) : queryASN(address.toIP6());
 	}
 };
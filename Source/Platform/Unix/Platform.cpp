@@ -10,6 +10,7 @@
 #include <cerrno>
 #include <cstdio>  // std::sscanf
 #include <cstring>  // std::strchr
+#include <atomic>
 #include <fstream>
 #include <system_error>
 
@@ -19,6 +20,8 @@
 #include "App.hpp"
 #include "Log.hpp"
 #include "Util.hpp"
+#include "CmdLine.hpp"
+#include "Exception.hpp"
 #include "conntop_config.h"
 
 #ifdef CONNTOP_UI_CURSES
@@ -33,12 +36,80 @@ static void EmptySignalHandler(int)
 }
 #endif
 
+static unsigned int GetUpdateInterval()
+{
+	CmdLineArg *intervalArg = gCmdLine->getArg("interval");
+	if (!intervalArg)
+	{
+		return 1000;
+	}
+
+	const KString value = intervalArg->getValue();
+
+	unsigned long interval;
+	if (!Util::StringToUInt(value, interval)
+	  || interval < Platform::MIN_UPDATE_INTERVAL
+	  || interval > Platform::MAX_UPDATE_INTERVAL)
+	{
+		std::string errMsg = "Invalid value '";
+		errMsg += value;
+		errMsg += "' of '--interval'";
+		throw Exception(std::move(errMsg), "Platform");
+	}
+
+	return interval;
+}
+
 class Platform::Impl
 {
 	bool m_isRunning;
 	Thread m_signalThread;
 	sigset_t m_signalMask;
 	timer_t m_updateTimer;
+	std::atomic<unsigned int> m_updateInterval;
+	std::atomic<bool> m_isUpdatePending;
+	unsigned long m_coalescedTickCount;
+
+	void handleUpdateTimer()  // executed by signal thread
+	{
+		const int overrunCount = timer_getoverrun(m_updateTimer);
+		if (overrunCount > 0)
+		{
+			// timer expired multiple times before the signal was delivered
+			m_coalescedTickCount += overrunCount;
+		}
+
+		if (m_isUpdatePending.exchange(true))
+		{
+			// the previous update is still being processed, so this tick is merged with the next one
+			m_coalescedTickCount++;
+			return;
+		}
+
+		if (m_coalescedTickCount > 0)
+		{
+			gLog->debug("[Platform] Update is late, %lu update ticks coalesced", m_coalescedTickCount);
+			m_coalescedTickCount = 0;
+		}
+
+		gApp->getEventSystem()->dispatch<UpdateEvent>();
+	}
+
+	void armUpdateTimer()
+	{
+		const unsigned int interval = m_updateInterval;
+
+		itimerspec updateTimerSpec;
+		updateTimerSpec.it_interval.tv_sec  = interval / 1000;
+		updateTimerSpec.it_interval.tv_nsec = (interval % 1000) * 1000000L;
+		updateTimerSpec.it_value.tv_sec     = updateTimerSpec.it_interval.tv_sec;
+		updateTimerSpec.it_value.tv_nsec    = updateTimerSpec.it_interval.tv_nsec;
+
+		if (timer_settime(m_updateTimer, 0, &updateTimerSpec, nullptr) < 0)
+		{
+			throw std::system_error(errno, std::system_category(), "Unable to start update timer");
+		}
+	}
 
 	void signalLoop()  // executed by signal thread
 	{
@@ -64,7 +135,7 @@ class Platform::Impl
 				if (signal.si_pid == 0 && signal.si_value.sival_ptr == &m_updateTimer)
 				{
 					gLog->debug("[Platform] Signal: UPDATE_TIMER_SIGNAL");
-					gApp->getEventSystem()->dispatch<UpdateEvent>();
+					handleUpdateTimer();
 				}
 			}
 			else
@@ -126,7 +197,10 @@ public:
 	: m_isRunning(false),
 	  m_signalThread(),
 	  m_signalMask(),
-	  m_updateTimer()
+	  m_updateTimer(),
+	  m_updateInterval(1000),
+	  m_isUpdatePending(false),
+	  m_coalescedTickCount(0)
 	{
 		sigemptyset(&m_signalMask);
 
@@ -177,6 +251,8 @@ public:
 
 	void start()
 	{
+		m_updateInterval = GetUpdateInterval();
+
 		m_isRunning = true;
 
 		sigevent updateTimerEvent;
@@ -184,20 +260,17 @@ public:
 		updateTimerEvent.sigev_signo = UPDATE_TIMER_SIGNAL;
 		updateTimerEvent.sigev_value.sival_ptr = &m_updateTimer;
 
-		if (timer_create(CLOCK_REALTIME, &updateTimerEvent, &m_updateTimer) < 0)
+		// monotonic clock is not affected by changes of system time
+		if (timer_create(CLOCK_MONOTONIC, &updateTimerEvent, &m_updateTimer) < 0)
 		{
 			throw std::system_error(errno, std::system_category(), "Unable to create update timer");
 		}
 
-		itimerspec updateTimerSpec;
-		updateTimerSpec.it_interval.tv_sec  = 1;
-		updateTimerSpec.it_interval.tv_nsec = 0;
-		updateTimerSpec.it_value.tv_sec     = updateTimerSpec.it_interval.tv_sec;
-		updateTimerSpec.it_value.tv_nsec    = updateTimerSpec.it_interval.tv_nsec;
+		armUpdateTimer();
 
-		if (timer_settime(m_updateTimer, 0, &updateTimerSpec, nullptr) < 0)
+		if (m_updateInterval != 1000)
 		{
-			throw std::system_error(errno, std::system_category(), "Unable to start update timer");
+			gLog->info("[Platform] Update interval is %u ms", m_updateInterval.load());
 		}
 
 		auto SignalThreadFunction = [this]() -> void
@@ -219,6 +292,26 @@ public:
 		pthread_kill(m_signalThread.getNativeHandle(), SIGINT);
 		m_signalThread.join();
 	}
+
+	unsigned int getUpdateInterval() const
+	{
+		return m_updateInterval;
+	}
+
+	void setUpdateInterval(unsigned int milliseconds)
+	{
+		m_updateInterval = milliseconds;
+
+		if (m_isRunning)
+		{
+			armUpdateTimer();
+		}
+	}
+
+	void finishUpdate()
+	{
+		m_isUpdatePending = false;
+	}
 };
 
 Platform::Platform()
@@ -260,6 +353,32 @@ void Platform::stop()
 	}
 }
 
+/**
+ * @return Interval between update events in milliseconds.
+ */
+unsigned int Platform::getUpdateInterval() const
+{
+	return m_impl->getUpdateInterval();
+}
+
+/**
+ * @brief Changes interval between update events.
+ * @param milliseconds The interval. It must be between MIN_UPDATE_INTERVAL and MAX_UPDATE_INTERVAL.
+ */
+void Platform::setUpdateInterval(unsigned int milliseconds)
+{
+	m_impl->setUpdateInterval(milliseconds);
+}
+
+/**
+ * @brief Notifies the platform that the current update event was processed.
+ * No new update event is dispatched until then, so slow updates never create a backlog of stale updates.
+ */
+void Platform::finishUpdate()
+{
+	m_impl->finishUpdate();
+}
+
 std::string Platform::getCurrentHostName()
 {
 	char buffer[256];
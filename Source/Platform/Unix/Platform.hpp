@@ -87,6 +87,10 @@ class Platform
 	std::unique_ptr<Impl> m_impl;
 
 public:
+	//! Limits of update interval in milliseconds.
+	static constexpr unsigned int MIN_UPDATE_INTERVAL = 100;
+	static constexpr unsigned int MAX_UPDATE_INTERVAL = 10000;
+
 	Platform();
 	~Platform();
 
@@ -96,6 +100,11 @@ public:
 	void start();
 	void stop();
 
+	unsigned int getUpdateInterval() const;
+	void setUpdateInterval(unsigned int milliseconds);
+
+	void finishUpdate();
+
 	std::string getCurrentHostName();
 
 	UnixTime getCurrentUnixTime();
@@ -91,9 +91,9 @@ void PollHandle::remove(int fd)
 	}
 }
 
-void PollHandle::wait()
+void PollHandle::wait(int timeout)
 {
-	int status = poll(m_descriptors.data(), m_descriptors.size(), -1);
+	int status = poll(m_descriptors.data(), m_descriptors.size(), timeout);
 	if (status > 0)
 	{
 		m_eventIndex = 0;
@@ -75,7 +75,7 @@ public:
 	void reset(int fd, int flags);
 	void remove(int fd);
 
-	void wait();
+	void wait(int timeout = -1);
 
 	PollEvent getNextEvent();
 };
@@ -114,7 +114,7 @@ PortPack Resolver::PlatformResolveService(const KString & service, EPortType por
 	return pack;
 }
 
-std::string Resolver::PlatformResolveAddress(const IAddress & address)
+std::string Resolver::PlatformResolveAddress(const Address & address)
 {
 	sockaddr_storage addr{};
 	socklen_t size;
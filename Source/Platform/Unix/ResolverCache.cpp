@@ -0,0 +1,452 @@
+/**
+ * @file
+ * @brief Implementation of ResolverCache class for Unix platform.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdlib>  // std::getenv
+#include <cstring>
+#include <ctime>
+#include <vector>
+#include <unordered_map>
+
+#include "ResolverCache.hpp"
+#include "GeoIP.hpp"
+#include "App.hpp"
+#include "Log.hpp"
+#include "CmdLine.hpp"
+#include "Util.hpp"
+
+static const char CACHE_MAGIC[8] = { 'C', 'O', 'N', 'N', 'T', 'O', 'P', 'R' };
+//! Must be changed whenever the file format changes.
+static const uint32_t CACHE_FORMAT_VERSION = 1;
+
+//! Magic, format version, padding and GeoIP databases version.
+static const size_t HEADER_SIZE = 8 + 4 + 4 + 8;
+//! Address, expiration time, ASN, country code, hostname length and AS organization name length.
+static const size_t RECORD_SIZE = 16 + 8 + 4 + 2 + 1 + 2;
+
+//! Hostnames are never kept longer than a week, whatever their TTL is.
+static const unsigned int MAX_TTL = 7 * 24 * 60 * 60;
+//! Added records are written when there is this many bytes of them or after FLUSH_INTERVAL seconds.
+static const size_t FLUSH_SIZE = 64 * 1024;
+static const time_t FLUSH_INTERVAL = 10;
+//! The file is rewritten when it contains this many more records than there are valid addresses.
+static const size_t MAX_STALE_RECORD_COUNT = 4096;
+
+template<class T>
+static void AppendValue(std::vector<uint8_t> & buffer, const T & value)
+{
+	const uint8_t *bytes = reinterpret_cast<const uint8_t*>(&value);
+	buffer.insert(buffer.end(), bytes, bytes + sizeof value);
+}
+
+template<class T>
+static T ReadValue(const uint8_t *data)
+{
+	T value;
+	std::memcpy(&value, data, sizeof value);
+	return value;
+}
+
+static bool WriteAll(int fd, const std::vector<uint8_t> & buffer)
+{
+	size_t offset = 0;
+	while (offset < buffer.size())
+	{
+		const ssize_t length = write(fd, buffer.data() + offset, buffer.size() - offset);
+		if (length < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+
+			return false;
+		}
+
+		offset += length;
+	}
+
+	return true;
+}
+
+static std::string GetDefaultCachePath()
+{
+	std::string path;
+
+	if (const char *cacheDir = std::getenv("XDG_CACHE_HOME"))
+	{
+		path = cacheDir;
+	}
+	else if (const char *homeDir = std::getenv("HOME"))
+	{
+		path = homeDir;
+		path += "/.cache";
+	}
+	else
+	{
+		return path;
+	}
+
+	mkdir(path.c_str(), 0700);
+
+	path += "/conntop";
+
+	mkdir(path.c_str(), 0700);
+
+	path += "/resolver.cache";
+
+	return path;
+}
+
+class ResolverCache::Impl
+{
+	struct Entry
+	{
+		ResolvedAddress resolved;
+		//! Unix time when the hostname expires.
+		int64_t expireTime;
+	};
+
+	std::string m_path;
+	int m_fd;
+	std::unordered_map<Address, Entry> m_entries;
+	//! Records not written to the file yet.
+	std::vector<uint8_t> m_writeBuffer;
+	time_t m_lastFlushTime;
+	uint64_t m_geoIPVersion;
+
+	static void AppendRecord(std::vector<uint8_t> & buffer, const Address & address, const Entry & entry)
+	{
+		const ResolvedAddress & resolved = entry.resolved;
+		const std::string & hostname = resolved.hostname;
+		const std::string & orgName = resolved.asn.getOrgName();
+
+		const uint8_t hostnameLength = (hostname.length() > UINT8_MAX) ? UINT8_MAX : hostname.length();
+		const uint16_t orgNameLength = (orgName.length() > UINT16_MAX) ? UINT16_MAX : orgName.length();
+
+		const KString countryCode = (resolved.country.isUnknown()) ? "ZZ" : resolved.country.getCodeString();
+
+		AppendValue(buffer, address.getRawAddr());
+		AppendValue(buffer, entry.expireTime);
+		AppendValue(buffer, resolved.asn.getNumber());
+		buffer.insert(buffer.end(), countryCode.c_str(), countryCode.c_str() + 2);
+		AppendValue(buffer, hostnameLength);
+		AppendValue(buffer, orgNameLength);
+		buffer.insert(buffer.end(), hostname.begin(), hostname.begin() + hostnameLength);
+		buffer.insert(buffer.end(), orgName.begin(), orgName.begin() + orgNameLength);
+	}
+
+	/**
+	 * @brief Reads all records from the cache file.
+	 * @return False if the file has to be rewritten, otherwise true.
+	 */
+	bool load()
+	{
+		struct stat fileStat;
+		if (fstat(m_fd, &fileStat) < 0 || fileStat.st_size == 0)
+		{
+			return false;
+		}
+
+		const size_t fileSize = fileStat.st_size;
+
+		void *pMapping = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, m_fd, 0);
+		if (pMapping == MAP_FAILED)
+		{
+			gLog->warning("[ResolverCache] Unable to map '%s': %s", m_path.c_str(), Util::ErrnoToString().c_str());
+			return false;
+		}
+
+		const uint8_t *data = static_cast<const uint8_t*>(pMapping);
+
+		if (fileSize < HEADER_SIZE || std::memcmp(data, CACHE_MAGIC, sizeof CACHE_MAGIC) != 0
+		  || ReadValue<uint32_t>(data + 8) != CACHE_FORMAT_VERSION)
+		{
+			munmap(pMapping, fileSize);
+			gLog->notice("[ResolverCache] Ignoring invalid cache file '%s'", m_path.c_str());
+			return false;
+		}
+
+		const bool isGeoIPChanged = ReadValue<uint64_t>(data + 16) != m_geoIPVersion;
+
+		const int64_t now = std::time(nullptr);
+		size_t recordCount = 0;
+		size_t offset = HEADER_SIZE;
+
+		while (offset + RECORD_SIZE <= fileSize)
+		{
+			const uint8_t *record = data + offset;
+
+			const uint8_t hostnameLength = record[30];
+			const uint16_t orgNameLength = ReadValue<uint16_t>(record + 31);
+
+			const size_t recordLength = RECORD_SIZE + hostnameLength + orgNameLength;
+			if (offset + recordLength > fileSize)
+			{
+				break;  // incomplete record at the end
+			}
+
+			const char *hostname = reinterpret_cast<const char*>(record + RECORD_SIZE);
+			const char *orgName = hostname + hostnameLength;
+
+			Address::RawAddr rawAddress;
+			std::memcpy(rawAddress, record, sizeof rawAddress);
+
+			const Address address = Address::CreateIP6(rawAddress);
+			const int64_t expireTime = ReadValue<int64_t>(record + 16);
+
+			// later records replace earlier ones
+			if (expireTime > now)
+			{
+				Entry & entry = m_entries[address];
+				entry.expireTime = expireTime;
+				entry.resolved.hostname.assign(hostname, hostnameLength);
+
+				if (!isGeoIPChanged)
+				{
+					const uint32_t asnNumber = ReadValue<uint32_t>(record + 24);
+					const KString countryCode(reinterpret_cast<const char*>(record + 28), 2);
+
+					entry.resolved.asn = (asnNumber != 0) ? ASN(asnNumber, std::string(orgName, orgNameLength)) : ASN();
+					entry.resolved.country = Country::ParseCodeString(countryCode);
+				}
+			}
+			else
+			{
+				m_entries.erase(address);
+			}
+
+			offset += recordLength;
+			recordCount++;
+		}
+
+		munmap(pMapping, fileSize);
+
+		gLog->info("[ResolverCache] Loaded %zu addresses from '%s'", m_entries.size(), m_path.c_str());
+
+		if (isGeoIPChanged)
+		{
+			gLog->info("[ResolverCache] GeoIP databases changed");
+			refreshGeoIP();
+			return false;
+		}
+
+		return offset == fileSize && recordCount <= m_entries.size() + MAX_STALE_RECORD_COUNT;
+	}
+
+	void refreshGeoIP()
+	{
+		for (auto & pair : m_entries)
+		{
+			const Address & address = pair.first;
+			ResolvedAddress & resolved = pair.second.resolved;
+
+			if (gApp->hasGeoIP())
+			{
+				resolved.country = gApp->getGeoIP()->queryCountry(address);
+				resolved.asn = gApp->getGeoIP()->queryASN(address);
+			}
+			else
+			{
+				resolved.country = Country();
+				resolved.asn = ASN();
+			}
+		}
+	}
+
+	/**
+	 * @brief Replaces the cache file with a new one that contains only valid addresses.
+	 */
+	void rewrite()
+	{
+		std::vector<uint8_t> buffer;
+		buffer.reserve(HEADER_SIZE + m_entries.size() * (RECORD_SIZE + 32));
+
+		buffer.insert(buffer.end(), CACHE_MAGIC, CACHE_MAGIC + sizeof CACHE_MAGIC);
+		AppendValue(buffer, CACHE_FORMAT_VERSION);
+		AppendValue(buffer, static_cast<uint32_t>(0));
+		AppendValue(buffer, m_geoIPVersion);
+
+		for (const auto & pair : m_entries)
+		{
+			AppendRecord(buffer, pair.first, pair.second);
+		}
+
+		const std::string tempPath = m_path + ".tmp";
+
+		const int fd = open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0600);
+		if (fd < 0 || !WriteAll(fd, buffer) || rename(tempPath.c_str(), m_path.c_str()) < 0)
+		{
+			gLog->warning("[ResolverCache] Unable to write '%s': %s",
+			  tempPath.c_str(),
+			  Util::ErrnoToString().c_str()
+			);
+
+			if (fd >= 0)
+			{
+				close(fd);
+				unlink(tempPath.c_str());
+			}
+
+			closeFile();
+			return;
+		}
+
+		close(m_fd);
+		m_fd = fd;
+
+		gLog->debug("[ResolverCache] Rewritten '%s' with %zu addresses", m_path.c_str(), m_entries.size());
+	}
+
+	void closeFile()
+	{
+		if (m_fd >= 0)
+		{
+			close(m_fd);
+			m_fd = -1;
+		}
+	}
+
+public:
+	Impl()
+	: m_path(),
+	  m_fd(-1),
+	  m_entries(),
+	  m_writeBuffer(),
+	  m_lastFlushTime(std::time(nullptr)),
+	  m_geoIPVersion((gApp->hasGeoIP()) ? gApp->getGeoIP()->getDBVersion() : 0)
+	{
+		CmdLineArg *pathArg = gCmdLine->getArg("resolver-cache");
+		m_path = (pathArg) ? std::string(pathArg->getValue().c_str()) : GetDefaultCachePath();
+
+		if (m_path.empty())
+		{
+			gLog->warning("[ResolverCache] Unable to find cache directory");
+			return;
+		}
+
+		m_fd = open(m_path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+		if (m_fd < 0)
+		{
+			gLog->warning("[ResolverCache] Unable to open '%s': %s", m_path.c_str(), Util::ErrnoToString().c_str());
+			return;
+		}
+
+		if (!load())
+		{
+			rewrite();
+		}
+	}
+
+	~Impl()
+	{
+		flush();
+		closeFile();
+	}
+
+	bool isOpen() const
+	{
+		return m_fd >= 0;
+	}
+
+	bool find(const Address & address, ResolvedAddress & result) const
+	{
+		auto it = m_entries.find(address);
+		if (it == m_entries.end() || it->second.expireTime <= std::time(nullptr))
+		{
+			return false;
+		}
+
+		result = it->second.resolved;
+
+		return true;
+	}
+
+	void add(const Address & address, const ResolvedAddress & resolved, unsigned int ttl)
+	{
+		if (m_fd < 0)
+		{
+			return;
+		}
+
+		const time_t now = std::time(nullptr);
+
+		Entry & entry = m_entries[address];
+		entry.resolved = resolved;
+		entry.expireTime = now + ((ttl > MAX_TTL) ? MAX_TTL : ttl);
+
+		AppendRecord(m_writeBuffer, address, entry);
+
+		if (m_writeBuffer.size() >= FLUSH_SIZE || now - m_lastFlushTime >= FLUSH_INTERVAL)
+		{
+			flush();
+		}
+	}
+
+	void onUpdate()
+	{
+		if (!m_writeBuffer.empty() && std::time(nullptr) - m_lastFlushTime >= FLUSH_INTERVAL)
+		{
+			flush();
+		}
+	}
+
+	void flush()
+	{
+		m_lastFlushTime = std::time(nullptr);
+
+		if (m_fd < 0 || m_writeBuffer.empty())
+		{
+			return;
+		}
+
+		if (!WriteAll(m_fd, m_writeBuffer))
+		{
+			gLog->warning("[ResolverCache] Unable to write '%s': %s", m_path.c_str(), Util::ErrnoToString().c_str());
+			closeFile();
+		}
+
+		m_writeBuffer.clear();
+	}
+};
+
+ResolverCache::ResolverCache()
+: m_impl(std::make_unique<Impl>())
+{
+}
+
+ResolverCache::~ResolverCache()
+{
+}
+
+bool ResolverCache::isOpen() const
+{
+	return m_impl->isOpen();
+}
+
+bool ResolverCache::find(const Address & address, ResolvedAddress & result) const
+{
+	return m_impl->find(address, result);
+}
+
+void ResolverCache::add(const Address & address, const ResolvedAddress & resolved, unsigned int ttl)
+{
+	m_impl->add(address, resolved, ttl);
+}
+
+void ResolverCache::onUpdate()
+{
+	m_impl->onUpdate();
+}
+
+void ResolverCache::flush()
+{
+	m_impl->flush();
+}
@@ -0,0 +1,56 @@
+/**
+ * @file
+ * @brief ResolverCache class for Unix platform.
+ */
+
+#pragma once
+
+#include <memory>
+
+#include "Address.hpp"
+#include "Resolver.hpp"
+
+/**
+ * @brief Persistent cache of resolved addresses.
+ * The cache file is memory-mapped and read when the cache is opened. New results are appended to it and the whole file
+ * is rewritten only when it contains too many expired records or GeoIP databases have changed.
+ */
+class ResolverCache
+{
+	class Impl;
+	std::unique_ptr<Impl> m_impl;
+
+public:
+	ResolverCache();
+	~ResolverCache();
+
+	bool isOpen() const;
+
+	/**
+	 * @brief Finds address that has not expired yet.
+	 * @param address The address.
+	 * @param result Output resolved data.
+	 * @return True if the address was found, otherwise false.
+	 */
+	bool find(const Address & address, ResolvedAddress & result) const;
+
+	/**
+	 * @brief Adds resolved address.
+	 * Empty hostname is cached too, so addresses without hostname are not resolved again.
+	 * @param address The address.
+	 * @param resolved Resolved data.
+	 * @param ttl Number of seconds the hostname is valid.
+	 */
+	void add(const Address & address, const ResolvedAddress & resolved, unsigned int ttl);
+
+	/**
+	 * @brief Writes added addresses to the cache file if they have been waiting for too long.
+	 * It should be called periodically, so the addresses are not lost when resolving stops.
+	 */
+	void onUpdate();
+
+	/**
+	 * @brief Writes all added addresses to the cache file.
+	 */
+	void flush();
+};
@@ -0,0 +1,1221 @@
+/**
+ * @file
+ * @brief Implementation of ReverseDNS class for Unix platform.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <deque>
+#include <random>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+
+#include "ReverseDNS.hpp"
+#include "PollHandle.hpp"
+#include "PollSystem.hpp"  // EPollFlags
+#include "SelfPipe.hpp"
+#include "Thread.hpp"
+#include "Log.hpp"
+#include "Util.hpp"
+
+#include "readerwriterqueue/readerwriterqueue.h"
+
+static const char *RESOLV_CONF_FILE = "/etc/resolv.conf";
+static const char *HOSTS_FILE = "/etc/hosts";
+
+// the same defaults and limits as in glibc resolver
+static const size_t MAX_NAMESERVERS = 3;
+static const unsigned long DEFAULT_TIMEOUT = 5;  // seconds
+static const unsigned long MAX_TIMEOUT = 30;
+static const unsigned long DEFAULT_ATTEMPTS = 2;
+static const unsigned long MAX_ATTEMPTS = 5;
+
+static const uint16_t DNS_PORT = 53;
+//! Maximum number of queries waiting for response. Other lookups are started when some query finishes.
+static const size_t MAX_ACTIVE_QUERIES = 512;
+static const size_t UDP_BUFFER_SIZE = 4096;
+static const unsigned int MAX_CNAME_CHAIN = 8;
+
+static const size_t HEADER_SIZE = 12;
+static const size_t MAX_NAME_LENGTH = 255;
+static const uint16_t TYPE_CNAME = 5;
+static const uint16_t TYPE_SOA = 6;
+static const uint16_t TYPE_PTR = 12;
+static const uint16_t CLASS_IN = 1;
+static const uint16_t FLAG_RESPONSE = 0x8000;
+static const uint16_t FLAG_TRUNCATED = 0x0200;
+static const uint16_t FLAG_RECURSION_DESIRED = 0x0100;
+static const unsigned int RCODE_NOERROR = 0;
+static const unsigned int RCODE_NXDOMAIN = 3;
+
+static uint16_t Read16(const uint8_t *data)
+{
+	return (data[0] << 8) | data[1];
+}
+
+static uint32_t Read32(const uint8_t *data)
+{
+	return (static_cast<uint32_t>(Read16(data)) << 16) | Read16(data + 2);
+}
+
+static void Append16(std::vector<uint8_t> & buffer, uint16_t value)
+{
+	buffer.push_back(value >> 8);
+	buffer.push_back(value & 0xFF);
+}
+
+static char ToLowerASCII(char ch)
+{
+	return (ch >= 'A' && ch <= 'Z') ? ch + ('a' - 'A') : ch;
+}
+
+static bool IsNameEqual(const std::string & a, const std::string & b)
+{
+	if (a.length() != b.length())
+	{
+		return false;
+	}
+
+	for (size_t i = 0; i < a.length(); i++)
+	{
+		if (ToLowerASCII(a[i]) != ToLowerASCII(b[i]))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static bool IsPrintableName(const std::string & name)
+{
+	for (char ch : name)
+	{
+		const unsigned char value = ch;
+		if (value < 0x21 || value > 0x7E)
+		{
+			return false;
+		}
+	}
+
+	return !name.empty();
+}
+
+static bool ParseAddress(const std::string & string, Address & result)
+{
+	in_addr addr4;
+	if (inet_pton(AF_INET, string.c_str(), &addr4) > 0)
+	{
+		result = Address::CreateIP4(addr4.s_addr);
+		return true;
+	}
+
+	in6_addr addr6;
+	if (inet_pton(AF_INET6, string.c_str(), &addr6) > 0)
+	{
+		result = Address::CreateIP6(addr6.s6_addr32);
+		return true;
+	}
+
+	return false;
+}
+
+/**
+ * @brief Creates name used in PTR query of an address.
+ * @param address The address.
+ * @return For example "4.3.2.1.in-addr.arpa" for address 1.2.3.4.
+ */
+static std::string BuildQueryName(const Address & address)
+{
+	uint8_t bytes[16];
+	address.copyRawTo(bytes);
+
+	std::string name;
+
+	if (address.isIP4())
+	{
+		for (int i = 3; i >= 0; i--)
+		{
+			name += std::to_string(bytes[i]);
+			name += '.';
+		}
+
+		name += "in-addr.arpa";
+	}
+	else
+	{
+		const char *digits = "0123456789abcdef";
+
+		for (int i = 15; i >= 0; i--)
+		{
+			name += digits[bytes[i] & 0xF];
+			name += '.';
+			name += digits[bytes[i] >> 4];
+			name += '.';
+		}
+
+		name += "ip6.arpa";
+	}
+
+	return name;
+}
+
+static std::vector<uint8_t> BuildQueryMessage(uint16_t id, const std::string & name)
+{
+	std::vector<uint8_t> message;
+	message.reserve(HEADER_SIZE + name.length() + 6);
+
+	Append16(message, id);
+	Append16(message, FLAG_RECURSION_DESIRED);
+	Append16(message, 1);  // question count
+	Append16(message, 0);
+	Append16(message, 0);
+	Append16(message, 0);
+
+	size_t labelBegin = 0;
+	while (labelBegin < name.length())
+	{
+		size_t labelEnd = name.find('.', labelBegin);
+		if (labelEnd == std::string::npos)
+		{
+			labelEnd = name.length();
+		}
+
+		message.push_back(labelEnd - labelBegin);
+		message.insert(message.end(), name.begin() + labelBegin, name.begin() + labelEnd);
+
+		labelBegin = labelEnd + 1;
+	}
+
+	message.push_back(0);
+
+	Append16(message, TYPE_PTR);
+	Append16(message, CLASS_IN);
+
+	return message;
+}
+
+/**
+ * @brief Reads possibly compressed domain name from DNS message.
+ * @param message The message.
+ * @param length Length of the message.
+ * @param offset Position of the name. It is moved right behind the name.
+ * @param name Output name without the trailing dot.
+ * @return False if the name is malformed, otherwise true.
+ */
+static bool ReadName(const uint8_t *message, size_t length, size_t & offset, std::string & name)
+{
+	name.clear();
+
+	size_t pos = offset;
+	unsigned int jumpCount = 0;
+
+	while (pos < length)
+	{
+		const uint8_t labelLength = message[pos];
+
+		if ((labelLength & 0xC0) == 0xC0)
+		{
+			// compression pointer
+			if (pos + 1 >= length || ++jumpCount > 64)
+			{
+				return false;
+			}
+
+			if (jumpCount == 1)
+			{
+				offset = pos + 2;
+			}
+
+			pos = ((labelLength & 0x3F) << 8) | message[pos + 1];
+		}
+		else if (labelLength & 0xC0)
+		{
+			return false;  // unsupported label type
+		}
+		else if (labelLength == 0)
+		{
+			if (jumpCount == 0)
+			{
+				offset = pos + 1;
+			}
+
+			return true;
+		}
+		else
+		{
+			if (pos + 1 + labelLength > length)
+			{
+				return false;
+			}
+
+			if (!name.empty())
+			{
+				name += '.';
+			}
+
+			name.append(reinterpret_cast<const char*>(message + pos + 1), labelLength);
+
+			if (name.length() > MAX_NAME_LENGTH)
+			{
+				return false;
+			}
+
+			pos += 1 + labelLength;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * @brief Finds PTR record in answer section of DNS message.
+ * CNAME records are followed, so classless reverse delegation works.
+ * @param message The message.
+ * @param length Length of the message.
+ * @param offset Position of the first answer.
+ * @param answerCount Number of answers.
+ * @param queryName Name from the question.
+ * @param ttl Output TTL of the hostname, which is the lowest TTL of all used records.
+ * @return Hostname or empty string if there is no PTR record.
+ */
+static std::string FindPTR(const uint8_t *message, size_t length, size_t offset, unsigned int answerCount,
+                           const std::string & queryName, uint32_t & ttl)
+{
+	std::string owner = queryName;
+	ttl = UINT32_MAX;
+
+	for (unsigned int chain = 0; chain < MAX_CNAME_CHAIN; chain++)
+	{
+		size_t pos = offset;
+		bool isOwnerChanged = false;
+
+		for (unsigned int i = 0; i < answerCount; i++)
+		{
+			std::string name;
+			if (!ReadName(message, length, pos, name) || pos + 10 > length)
+			{
+				return std::string();
+			}
+
+			const uint16_t type = Read16(message + pos);
+			const uint16_t dataClass = Read16(message + pos + 2);
+			const uint32_t recordTTL = Read32(message + pos + 4);
+			const uint16_t dataLength = Read16(message + pos + 8);
+
+			size_t dataPos = pos + 10;
+			pos = dataPos + dataLength;
+
+			if (pos > length)
+			{
+				return std::string();
+			}
+
+			if (dataClass != CLASS_IN || !IsNameEqual(name, owner))
+			{
+				continue;
+			}
+
+			std::string target;
+
+			if (type == TYPE_PTR || type == TYPE_CNAME)
+			{
+				ttl = std::min(ttl, recordTTL);
+			}
+
+			if (type == TYPE_PTR)
+			{
+				return (ReadName(message, length, dataPos, target)) ? target : std::string();
+			}
+			else if (type == TYPE_CNAME && ReadName(message, length, dataPos, target))
+			{
+				owner = std::move(target);
+				isOwnerChanged = true;
+			}
+		}
+
+		if (!isOwnerChanged)
+		{
+			break;
+		}
+	}
+
+	return std::string();
+}
+
+/**
+ * @brief Finds how long a negative response may be cached.
+ * It is the lower of SOA record TTL and SOA minimum field from authority section (RFC 2308).
+ * @param message The message.
+ * @param length Length of the message.
+ * @param offset Position of the first answer.
+ * @param answerCount Number of answers.
+ * @param authorityCount Number of records in authority section.
+ * @return TTL in seconds or zero if there is no SOA record.
+ */
+static uint32_t FindNegativeTTL(const uint8_t *message, size_t length, size_t offset, unsigned int answerCount,
+                                unsigned int authorityCount)
+{
+	for (unsigned int i = 0; i < answerCount + authorityCount; i++)
+	{
+		std::string name;
+		if (!ReadName(message, length, offset, name) || offset + 10 > length)
+		{
+			return 0;
+		}
+
+		const uint16_t type = Read16(message + offset);
+		const uint32_t recordTTL = Read32(message + offset + 4);
+		const uint16_t dataLength = Read16(message + offset + 8);
+
+		offset += 10 + dataLength;
+
+		if (offset > length)
+		{
+			return 0;
+		}
+
+		if (i >= answerCount && type == TYPE_SOA && dataLength >= 22)
+		{
+			// the minimum field is the last one
+			const uint32_t minimum = Read32(message + offset - 4);
+
+			return std::min(recordTTL, minimum);
+		}
+	}
+
+	return 0;
+}
+
+class ReverseDNS::Impl
+{
+	using Clock = std::chrono::steady_clock;
+
+	struct Nameserver
+	{
+		std::string name;
+		sockaddr_storage address;
+		socklen_t addressLength;
+		int udpFD;
+	};
+
+	struct Lookup
+	{
+		Address address;
+		void *param;
+
+		Lookup(const Address & lookupAddress = Address(), void *lookupParam = nullptr)
+		: address(lookupAddress),
+		  param(lookupParam)
+		{
+		}
+	};
+
+	struct Query
+	{
+		Address address;
+		void *param;
+		std::string name;
+		std::vector<uint8_t> message;
+		Clock::time_point deadline;
+		//! Number of times the query was sent over UDP.
+		unsigned int sendCount;
+		//! TCP connection used after truncated UDP response.
+		int tcpFD;
+		bool isTCPSending;
+		//! Query being sent or response being received over TCP, both with 2-byte length prefix.
+		std::vector<uint8_t> tcpBuffer;
+		size_t tcpOffset;
+
+		Query(const Lookup & lookup)
+		: address(lookup.address),
+		  param(lookup.param),
+		  name(),
+		  message(),
+		  deadline(),
+		  sendCount(0),
+		  tcpFD(-1),
+		  isTCPSending(false),
+		  tcpBuffer(),
+		  tcpOffset(0)
+		{
+		}
+	};
+
+	ReverseDNS::Callback m_callback;
+	ReverseDNS::Config m_config;
+	std::vector<Nameserver> m_nameservers;
+	//! Addresses from /etc/hosts.
+	std::unordered_map<Address, std::string> m_hosts;
+	Clock::duration m_timeout;
+	//! Number of times each query is sent before it fails.
+	unsigned int m_maxSendCount;
+	moodycamel::ReaderWriterQueue<Lookup> m_lookupQueue;
+	SelfPipe m_pipe;
+	std::atomic<bool> m_isWakePending;
+	std::atomic<bool> m_isRunning;
+	Thread m_thread;
+
+	// used only by reverse DNS thread
+
+	PollHandle m_pollHandle;
+	std::unordered_map<uint16_t, Query> m_queries;
+	std::unordered_map<int, uint16_t> m_tcpQueries;
+	//! Query deadlines in ascending order. Entries of finished or resent queries are skipped.
+	std::deque<std::pair<Clock::time_point, uint16_t>> m_timeouts;
+	std::deque<Lookup> m_waitingLookups;
+	std::mt19937 m_random;
+
+	void loadResolvConf()
+	{
+		unsigned long timeout = DEFAULT_TIMEOUT;
+		unsigned long attempts = DEFAULT_ATTEMPTS;
+		std::vector<std::string> nameservers;
+
+		std::ifstream file(m_config.resolvConfFile);
+		std::string line;
+		while (std::getline(file, line))
+		{
+			std::istringstream stream(line);
+			std::string keyword;
+			stream >> keyword;
+
+			if (keyword == "nameserver")
+			{
+				std::string value;
+				if (stream >> value && nameservers.size() < MAX_NAMESERVERS)
+				{
+					nameservers.emplace_back(std::move(value));
+				}
+			}
+			else if (keyword == "options")
+			{
+				std::string option;
+				while (stream >> option)
+				{
+					unsigned long value;
+
+					if (option.compare(0, 8, "timeout:") == 0 && Util::StringToUInt(option.substr(8), value))
+					{
+						timeout = (value > MAX_TIMEOUT) ? MAX_TIMEOUT : (value < 1) ? 1 : value;
+					}
+					else if (option.compare(0, 9, "attempts:") == 0 && Util::StringToUInt(option.substr(9), value))
+					{
+						attempts = (value > MAX_ATTEMPTS) ? MAX_ATTEMPTS : (value < 1) ? 1 : value;
+					}
+				}
+			}
+		}
+
+		if (nameservers.empty())
+		{
+			// the same default as in glibc resolver
+			nameservers.emplace_back("127.0.0.1");
+		}
+
+		for (const std::string & nameserver : nameservers)
+		{
+			addNameserver(nameserver);
+		}
+
+		m_timeout = std::chrono::seconds(timeout);
+		m_maxSendCount = attempts * m_nameservers.size();
+
+		gLog->info("[ReverseDNS] Timeout %lu seconds, %lu attempts", timeout, attempts);
+	}
+
+	void addNameserver(const std::string & value)
+	{
+		Nameserver nameserver;
+		nameserver.name = value;
+		nameserver.address = sockaddr_storage{};
+
+		const size_t scopePos = value.find('%');
+		const std::string addressString = value.substr(0, scopePos);
+
+		sockaddr_in *pAddr4 = reinterpret_cast<sockaddr_in*>(&nameserver.address);
+		sockaddr_in6 *pAddr6 = reinterpret_cast<sockaddr_in6*>(&nameserver.address);
+
+		if (inet_pton(AF_INET, addressString.c_str(), &pAddr4->sin_addr) > 0)
+		{
+			pAddr4->sin_family = AF_INET;
+			pAddr4->sin_port = htons(m_config.nameserverPort);
+			nameserver.addressLength = sizeof (sockaddr_in);
+		}
+		else if (inet_pton(AF_INET6, addressString.c_str(), &pAddr6->sin6_addr) > 0)
+		{
+			pAddr6->sin6_family = AF_INET6;
+			pAddr6->sin6_port = htons(m_config.nameserverPort);
+			nameserver.addressLength = sizeof (sockaddr_in6);
+
+			if (scopePos != std::string::npos)
+			{
+				pAddr6->sin6_scope_id = if_nametoindex(value.c_str() + scopePos + 1);
+			}
+		}
+		else
+		{
+			gLog->warning("[ReverseDNS] Invalid nameserver '%s' in %s",
+			  value.c_str(),
+			  m_config.resolvConfFile.c_str()
+			);
+			return;
+		}
+
+		const sockaddr *pAddr = reinterpret_cast<const sockaddr*>(&nameserver.address);
+
+		nameserver.udpFD = socket(pAddr->sa_family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if (nameserver.udpFD < 0 || connect(nameserver.udpFD, pAddr, nameserver.addressLength) < 0)
+		{
+			gLog->warning("[ReverseDNS] Unable to use nameserver %s: %s",
+			  value.c_str(),
+			  Util::ErrnoToString().c_str()
+			);
+
+			if (nameserver.udpFD >= 0)
+			{
+				close(nameserver.udpFD);
+			}
+
+			return;
+		}
+
+		gLog->info("[ReverseDNS] Using nameserver %s", value.c_str());
+
+		m_nameservers.emplace_back(std::move(nameserver));
+	}
+
+	void loadHosts()
+	{
+		std::ifstream file(m_config.hostsFile);
+		std::string line;
+		while (std::getline(file, line))
+		{
+			std::istringstream stream(line.substr(0, line.find('#')));
+			std::string addressString;
+			std::string hostname;
+
+			Address address;
+			if (stream >> addressString >> hostname && ParseAddress(addressString, address))
+			{
+				// the first hostname of an address is used
+				m_hosts.emplace(address, std::move(hostname));
+			}
+		}
+
+		gLog->debug("[ReverseDNS] Loaded %zu addresses from %s", m_hosts.size(), m_config.hostsFile.c_str());
+	}
+
+	void wakeThread()
+	{
+		const char *something = "A";
+		m_pipe.writeData(something, 1);
+	}
+
+	void resolverLoop()  // executed by reverse DNS thread
+	{
+		const int pipeFD = m_pipe.getReadFD();
+		m_pollHandle.add(pipeFD, EPollFlags::INPUT);
+
+		for (const Nameserver & nameserver : m_nameservers)
+		{
+			m_pollHandle.add(nameserver.udpFD, EPollFlags::INPUT);
+		}
+
+		while (m_isRunning)
+		{
+			m_pollHandle.wait(getPollTimeout());
+
+			PollEvent event = m_pollHandle.getNextEvent();
+			while (!event.isEmpty())
+			{
+				const int fd = event.getDescriptor();
+
+				if (fd == pipeFD)
+				{
+					m_pipe.clear();
+					m_pollHandle.reset(pipeFD, EPollFlags::INPUT);
+					m_isWakePending = false;
+
+					Lookup lookup;
+					while (m_lookupQueue.try_dequeue(lookup))
+					{
+						startLookup(lookup);
+					}
+				}
+				else if (m_tcpQueries.count(fd) > 0)
+				{
+					handleTCP(fd);
+				}
+				else
+				{
+					for (size_t i = 0; i < m_nameservers.size(); i++)
+					{
+						if (m_nameservers[i].udpFD == fd)
+						{
+							receiveUDP(i);
+							m_pollHandle.reset(fd, EPollFlags::INPUT);
+							break;
+						}
+					}
+				}
+
+				event = m_pollHandle.getNextEvent();
+			}
+
+			handleTimeouts();
+		}
+	}
+
+	int getPollTimeout() const
+	{
+		if (m_timeouts.empty())
+		{
+			return -1;
+		}
+
+		const Clock::duration remaining = m_timeouts.front().first - Clock::now();
+		if (remaining <= Clock::duration::zero())
+		{
+			return 0;
+		}
+
+		return std::chrono::duration_cast<std::chrono::milliseconds>(remaining).count() + 1;
+	}
+
+	void startLookup(const Lookup & lookup)
+	{
+		auto it = m_hosts.find(lookup.address);
+		if (it != m_hosts.end())
+		{
+			std::string hostname = it->second;
+			m_callback(hostname, 0, lookup.param);
+		}
+		else if (m_queries.size() >= MAX_ACTIVE_QUERIES)
+		{
+			m_waitingLookups.push_back(lookup);
+		}
+		else
+		{
+			startQuery(lookup);
+		}
+	}
+
+	void startQuery(const Lookup & lookup)
+	{
+		uint16_t id;
+		do
+		{
+			id = static_cast<uint16_t>(m_random());
+		}
+		while (m_queries.count(id) > 0);
+
+		Query & query = m_queries.emplace(id, Query(lookup)).first->second;
+		query.name = BuildQueryName(lookup.address);
+		query.message = BuildQueryMessage(id, query.name);
+
+		sendQuery(id, query);
+	}
+
+	void startWaitingLookups()
+	{
+		while (!m_waitingLookups.empty() && m_queries.size() < MAX_ACTIVE_QUERIES)
+		{
+			const Lookup lookup = m_waitingLookups.front();
+			m_waitingLookups.pop_front();
+
+			startQuery(lookup);
+		}
+	}
+
+	void sendQuery(uint16_t id, Query & query)
+	{
+		// each attempt uses the next nameserver
+		const Nameserver & nameserver = m_nameservers[query.sendCount % m_nameservers.size()];
+		query.sendCount++;
+
+		if (send(nameserver.udpFD, query.message.data(), query.message.size(), 0) < 0)
+		{
+			// the query is sent again after timeout
+			gLog->debug("[ReverseDNS] Unable to send query to %s: %s",
+			  nameserver.name.c_str(),
+			  Util::ErrnoToString().c_str()
+			);
+		}
+
+		setDeadline(id, query);
+	}
+
+	void setDeadline(uint16_t id, Query & query)
+	{
+		query.deadline = Clock::now() + m_timeout;
+		m_timeouts.emplace_back(query.deadline, id);
+	}
+
+	void handleTimeouts()
+	{
+		const Clock::time_point now = Clock::now();
+
+		while (!m_timeouts.empty() && m_timeouts.front().first <= now)
+		{
+			const Clock::time_point deadline = m_timeouts.front().first;
+			const uint16_t id = m_timeouts.front().second;
+			m_timeouts.pop_front();
+
+			auto it = m_queries.find(id);
+			if (it == m_queries.end() || it->second.deadline != deadline)
+			{
+				continue;
+			}
+
+			Query & query = it->second;
+
+			if (query.tcpFD < 0 && query.sendCount < m_maxSendCount)
+			{
+				sendQuery(id, query);
+			}
+			else
+			{
+				failQuery(id, "Timed out");
+			}
+		}
+	}
+
+	void receiveUDP(size_t nameserverIndex)
+	{
+		const int fd = m_nameservers[nameserverIndex].udpFD;
+
+		uint8_t buffer[UDP_BUFFER_SIZE];
+
+		while (true)
+		{
+			const ssize_t length = recv(fd, buffer, sizeof buffer, 0);
+			if (length < 0)
+			{
+				if (errno == ECONNREFUSED)
+				{
+					// ICMP error of some previous query, which is sent again after timeout
+					continue;
+				}
+
+				if (errno != EAGAIN && errno != EWOULDBLOCK)
+				{
+					gLog->debug("[ReverseDNS] Unable to receive response from %s: %s",
+					  m_nameservers[nameserverIndex].name.c_str(),
+					  Util::ErrnoToString().c_str()
+					);
+				}
+
+				break;
+			}
+
+			handleResponse(buffer, length, nameserverIndex, false);
+		}
+	}
+
+	/**
+	 * @brief Processes response message.
+	 * @return False if the message does not belong to any query, otherwise true.
+	 */
+	bool handleResponse(const uint8_t *message, size_t length, size_t nameserverIndex, bool isTCP)
+	{
+		if (length < HEADER_SIZE)
+		{
+			return false;
+		}
+
+		const uint16_t id = Read16(message);
+
+		auto it = m_queries.find(id);
+		if (it == m_queries.end())
+		{
+			return false;
+		}
+
+		Query & query = it->second;
+
+		const uint16_t flags = Read16(message + 2);
+		const unsigned int opcode = (flags >> 11) & 0xF;
+		const unsigned int rcode = flags & 0xF;
+
+		if (!(flags & FLAG_RESPONSE) || opcode != 0 || Read16(message + 4) != 1)
+		{
+			return false;
+		}
+
+		size_t offset = HEADER_SIZE;
+		std::string name;
+
+		if (!ReadName(message, length, offset, name) || offset + 4 > length || !IsNameEqual(name, query.name)
+		  || Read16(message + offset) != TYPE_PTR || Read16(message + offset + 2) != CLASS_IN)
+		{
+			// possibly spoofed response
+			return false;
+		}
+
+		offset += 4;
+
+		const unsigned int answerCount = Read16(message + 6);
+		const unsigned int authorityCount = Read16(message + 8);
+
+		if (query.tcpFD >= 0 && !isTCP)
+		{
+			// late response to some UDP query
+			return false;
+		}
+
+		if ((flags & FLAG_TRUNCATED) && !isTCP)
+		{
+			startTCP(id, query, nameserverIndex);
+			return true;
+		}
+
+		switch (rcode)
+		{
+			case RCODE_NOERROR:
+			{
+				uint32_t ttl;
+				std::string hostname = FindPTR(message, length, offset, answerCount, query.name, ttl);
+
+				if (hostname.empty())
+				{
+					failQuery(id, "No PTR record", FindNegativeTTL(message, length, offset, answerCount, authorityCount));
+				}
+				else if (!IsPrintableName(hostname))
+				{
+					failQuery(id, "Invalid hostname", ttl);
+				}
+				else
+				{
+					finishQuery(id, hostname, ttl);
+				}
+
+				break;
+			}
+			case RCODE_NXDOMAIN:
+			{
+				failQuery(id, "Name does not exist", FindNegativeTTL(message, length, offset, answerCount, authorityCount));
+				break;
+			}
+			default:
+			{
+				if (!isTCP && query.sendCount < m_maxSendCount)
+				{
+					sendQuery(id, query);
+				}
+				else
+				{
+					failQuery(id, "Server failure");
+				}
+
+				break;
+			}
+		}
+
+		return true;
+	}
+
+	void startTCP(uint16_t id, Query & query, size_t nameserverIndex)
+	{
+		const Nameserver & nameserver = m_nameservers[nameserverIndex];
+		const sockaddr *pAddr = reinterpret_cast<const sockaddr*>(&nameserver.address);
+
+		const int fd = socket(pAddr->sa_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if (fd < 0)
+		{
+			failQuery(id, Util::ErrnoToString().c_str());
+			return;
+		}
+
+		if (connect(fd, pAddr, nameserver.addressLength) < 0 && errno != EINPROGRESS)
+		{
+			const std::string errorString = Util::ErrnoToString();
+			close(fd);
+			failQuery(id, errorString.c_str());
+			return;
+		}
+
+		query.tcpFD = fd;
+		query.isTCPSending = true;
+		query.tcpBuffer.clear();
+		Append16(query.tcpBuffer, query.message.size());
+		query.tcpBuffer.insert(query.tcpBuffer.end(), query.message.begin(), query.message.end());
+		query.tcpOffset = 0;
+
+		m_tcpQueries.emplace(fd, id);
+		m_pollHandle.add(fd, EPollFlags::OUTPUT);
+
+		setDeadline(id, query);
+
+		gLog->debug("[ReverseDNS] Response of %s is truncated, using TCP", query.name.c_str());
+	}
+
+	void handleTCP(int fd)
+	{
+		const uint16_t id = m_tcpQueries[fd];
+		Query & query = m_queries.at(id);
+
+		uint8_t *buffer = query.tcpBuffer.data();
+		const size_t remainingLength = query.tcpBuffer.size() - query.tcpOffset;
+
+		const ssize_t length = (query.isTCPSending)
+		  ? send(fd, buffer + query.tcpOffset, remainingLength, MSG_NOSIGNAL)
+		  : recv(fd, buffer + query.tcpOffset, remainingLength, 0);
+
+		if (length < 0)
+		{
+			if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+			{
+				m_pollHandle.reset(fd, (query.isTCPSending) ? EPollFlags::OUTPUT : EPollFlags::INPUT);
+			}
+			else
+			{
+				failQuery(id, Util::ErrnoToString().c_str());
+			}
+
+			return;
+		}
+
+		if (length == 0 && !query.isTCPSending)
+		{
+			failQuery(id, "Connection closed by nameserver");
+			return;
+		}
+
+		query.tcpOffset += length;
+
+		if (query.isTCPSending)
+		{
+			if (query.tcpOffset == query.tcpBuffer.size())
+			{
+				// receive length of the response
+				query.isTCPSending = false;
+				query.tcpBuffer.assign(2, 0);
+				query.tcpOffset = 0;
+				m_pollHandle.reset(fd, EPollFlags::INPUT);
+			}
+			else
+			{
+				m_pollHandle.reset(fd, EPollFlags::OUTPUT);
+			}
+
+			return;
+		}
+
+		if (query.tcpBuffer.size() == 2 && query.tcpOffset == 2)
+		{
+			const size_t messageLength = Read16(buffer);
+			if (messageLength < HEADER_SIZE)
+			{
+				failQuery(id, "Invalid response");
+				return;
+			}
+
+			query.tcpBuffer.resize(2 + messageLength);
+		}
+
+		if (query.tcpOffset < query.tcpBuffer.size())
+		{
+			m_pollHandle.reset(fd, EPollFlags::INPUT);
+			return;
+		}
+
+		const uint8_t *message = query.tcpBuffer.data() + 2;
+		const size_t messageLength = query.tcpBuffer.size() - 2;
+
+		if (Read16(message) != id || !handleResponse(message, messageLength, 0, true))
+		{
+			failQuery(id, "Invalid response");
+		}
+	}
+
+	void closeTCP(Query & query)
+	{
+		if (query.tcpFD >= 0)
+		{
+			m_pollHandle.remove(query.tcpFD);
+			m_tcpQueries.erase(query.tcpFD);
+			close(query.tcpFD);
+			query.tcpFD = -1;
+		}
+	}
+
+	void failQuery(uint16_t id, const char *reason, unsigned int ttl = 0)
+	{
+		const Address & address = m_queries.at(id).address;
+
+		if (gLog->isMsgEnabled(Log::NOTICE))
+		{
+			gLog->notice("[ReverseDNS] Hostname of %s address %s cannot be resolved: %s",
+			  address.getTypeName().c_str(),
+			  AddressString(address).get().c_str(),
+			  reason
+			);
+		}
+
+		std::string hostname;
+		finishQuery(id, hostname, ttl);
+	}
+
+	void finishQuery(uint16_t id, std::string & hostname, unsigned int ttl)
+	{
+		auto it = m_queries.find(id);
+
+		void *param = it->second.param;
+		closeTCP(it->second);
+		m_queries.erase(it);
+
+		m_callback(hostname, ttl, param);
+
+		startWaitingLookups();
+	}
+
+public:
+	Impl(const ReverseDNS::Callback & callback, const ReverseDNS::Config & config)
+	: m_callback(callback),
+	  m_config(config),
+	  m_nameservers(),
+	  m_hosts(),
+	  m_timeout(),
+	  m_maxSendCount(),
+	  m_lookupQueue(),
+	  m_pipe(),
+	  m_isWakePending(),
+	  m_isRunning(),
+	  m_thread(),
+	  m_pollHandle(),
+	  m_queries(),
+	  m_tcpQueries(),
+	  m_timeouts(),
+	  m_waitingLookups(),
+	  m_random(std::random_device()())
+	{
+		loadResolvConf();
+
+		if (m_nameservers.empty())
+		{
+			gLog->warning("[ReverseDNS] No usable nameserver");
+			return;
+		}
+
+		loadHosts();
+
+		m_isRunning = true;
+
+		auto ReverseDNSThreadFunction = [this]() -> void
+		{
+			resolverLoop();
+		};
+
+		// start reverse DNS thread
+		m_thread = Thread("ReverseDNS", ReverseDNSThreadFunction);
+	}
+
+	~Impl()
+	{
+		stop();
+
+		for (const Nameserver & nameserver : m_nameservers)
+		{
+			close(nameserver.udpFD);
+		}
+	}
+
+	bool isAvailable() const
+	{
+		return !m_nameservers.empty();
+	}
+
+	void resolve(const Address & address, void *param)
+	{
+		m_lookupQueue.emplace(address, param);
+
+		if (!m_isWakePending.exchange(true))
+		{
+			wakeThread();
+		}
+	}
+
+	std::vector<void*> stop()
+	{
+		if (m_thread.isJoinable())
+		{
+			m_isRunning = false;
+
+			// stop reverse DNS thread
+			wakeThread();
+			m_thread.join();
+		}
+
+		std::vector<void*> params;
+
+		for (auto & pair : m_queries)
+		{
+			closeTCP(pair.second);
+			params.push_back(pair.second.param);
+		}
+
+		for (const Lookup & lookup : m_waitingLookups)
+		{
+			params.push_back(lookup.param);
+		}
+
+		Lookup lookup;
+		while (m_lookupQueue.try_dequeue(lookup))
+		{
+			params.push_back(lookup.param);
+		}
+
+		m_queries.clear();
+		m_timeouts.clear();
+		m_waitingLookups.clear();
+
+		return params;
+	}
+};
+
+ReverseDNS::Config::Config()
+: resolvConfFile(RESOLV_CONF_FILE),
+  hostsFile(HOSTS_FILE),
+  nameserverPort(DNS_PORT)
+{
+}
+
+ReverseDNS::ReverseDNS(const Callback & callback)
+: ReverseDNS(callback, Config())
+{
+}
+
+ReverseDNS::ReverseDNS(const Callback & callback, const Config & config)
+: m_impl(std::make_unique<Impl>(callback, config))
+{
+}
+
+ReverseDNS::~ReverseDNS()
+{
+}
+
+bool ReverseDNS::isAvailable() const
+{
+	return m_impl->isAvailable();
+}
+
+void ReverseDNS::resolve(const Address & address, void *param)
+{
+	m_impl->resolve(address, param);
+}
+
+std::vector<void*> ReverseDNS::stop()
+{
+	return m_impl->stop();
+}
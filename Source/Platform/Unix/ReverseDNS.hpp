@@ -0,0 +1,72 @@
+/**
+ * @file
+ * @brief ReverseDNS class for Unix platform.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <cstdint>
+
+#include "Address.hpp"
+
+/**
+ * @brief Asynchronous resolver of address hostnames.
+ * PTR queries are sent directly to nameservers from /etc/resolv.conf, so one thread can wait for hundreds of them
+ * at once. Addresses listed in /etc/hosts are resolved without any query.
+ */
+class ReverseDNS
+{
+public:
+	/**
+	 * @brief Executed by reverse DNS thread.
+	 * The hostname is empty if the address cannot be resolved. The second parameter is number of seconds the result
+	 * may be cached, which is zero if the result must not be cached.
+	 */
+	using Callback = std::function<void(std::string&, unsigned int, void*)>;
+
+	/**
+	 * @brief Where the resolver gets its configuration from.
+	 * The default is the system configuration. Tests use their own files and nameserver port.
+	 */
+	struct Config
+	{
+		std::string resolvConfFile;
+		std::string hostsFile;
+		//! Port of all nameservers.
+		uint16_t nameserverPort;
+
+		Config();
+	};
+
+private:
+	class Impl;
+	std::unique_ptr<Impl> m_impl;
+
+public:
+	ReverseDNS(const Callback & callback);
+	ReverseDNS(const Callback & callback, const Config & config);
+	~ReverseDNS();
+
+	/**
+	 * @brief Checks if any nameserver can be used.
+	 * @return False if no lookup can be done, otherwise true.
+	 */
+	bool isAvailable() const;
+
+	/**
+	 * @brief Starts lookup of address hostname.
+	 * @param address The address.
+	 * @param param Parameter passed to the callback.
+	 */
+	void resolve(const Address & address, void *param);
+
+	/**
+	 * @brief Stops reverse DNS thread.
+	 * @return Parameters of all unfinished lookups.
+	 */
+	std::vector<void*> stop();
+};
@@ -145,6 +145,10 @@ class PortData
 
 	//! Cached port number string.
 	std::string m_numeric;
+	//! Number of connections and pending requests using the data.
+	unsigned int m_refCount;
+	//! Number of times the data became unused.
+	unsigned int m_releaseCount;
 
 public:
 	/**
@@ -158,7 +162,9 @@ public:
 	  m_isServiceResolved(false),
 	  m_service(),
 #endif
-	  m_numeric(std::to_string(port.getNumber()))
+	  m_numeric(std::to_string(port.getNumber())),
+	  m_refCount(0),
+	  m_releaseCount(0)
 	{
 	}
 
@@ -263,6 +269,50 @@ public:
 	}
 #endif
 
+	/**
+	 * @brief Returns number of connections and pending requests using the data.
+	 * Unused data are reclaimed by ConnectionStorage after a grace period.
+	 * @return Reference count.
+	 */
+	unsigned int getRefCount() const
+	{
+		return m_refCount;
+	}
+
+	/**
+	 * @brief Returns number of times the data became unused.
+	 * It allows ConnectionStorage to detect that the data were used again during the grace period.
+	 * @return Release count.
+	 */
+	unsigned int getReleaseCount() const
+	{
+		return m_releaseCount;
+	}
+
+	/**
+	 * @brief Increments reference count.
+	 * This function should be used only in ConnectionStorage class.
+	 */
+	void addRef()
+	{
+		m_refCount++;
+	}
+
+	/**
+	 * @brief Decrements reference count.
+	 * This function should be used only in ConnectionStorage class.
+	 * @return New reference count.
+	 */
+	unsigned int releaseRef()
+	{
+		if (--m_refCount == 0)
+		{
+			m_releaseCount++;
+		}
+
+		return m_refCount;
+	}
+
 	/**
 	 * @brief Sets port to which the data belongs.
 	 * This function should be used only in ConnectionStorage class.
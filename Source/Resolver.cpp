@@ -3,15 +3,28 @@
  * @brief Implementation of Resolver class.
  */
 
+#include <string>
+#include <vector>
+#include <unordered_map>
+
 #include "Resolver.hpp"
+#include "ResolverCache.hpp"
+#include "ReverseDNS.hpp"
 #include "GeoIP.hpp"
 #include "App.hpp"
 #include "Log.hpp"
 #include "Thread.hpp"
 #include "Events.hpp"
 #include "CmdLine.hpp"
+#include "Exception.hpp"
+#include "Util.hpp"
+
+#include "concurrentqueue/blockingconcurrentqueue.h"
 
-#include "readerwriterqueue/readerwriterqueue.h"
+static const unsigned long DEFAULT_DNS_THREAD_COUNT = 4;
+static const unsigned long MAX_DNS_THREAD_COUNT = 64;
+//! System resolver does not provide TTL, so its hostnames are cached for this many seconds.
+static const unsigned int SYSTEM_RESOLVER_TTL = 3600;
 
 enum struct EResolverRequest
 {
@@ -26,6 +39,18 @@ struct IResolverRequest
 	virtual ~IResolverRequest() = default;
 
 	virtual EResolverRequest getType() const = 0;
+
+	/**
+	 * @brief Returns key identifying requested data.
+	 * Requests with the same key are resolved only once.
+	 */
+	virtual std::string getKey() const = 0;
+
+	/**
+	 * @brief Takes result of an identical request.
+	 * @param source Resolved request with the same key.
+	 */
+	virtual void copyResult(const IResolverRequest & source) = 0;
 };
 
 struct ResolverEvent
@@ -73,6 +98,37 @@ public:
 		return EResolverRequest::HOSTNAME;
 	}
 
+	std::string getKey() const override
+	{
+		return "H" + m_hostname;
+	}
+
+	void copyResult(const IResolverRequest & source) override
+	{
+		const AddressPack & pack = static_cast<const HostnameRequest&>(source).m_addressPack;
+
+		m_addressPack.clear();
+
+		for (size_t i = 0; i < pack.getSize(); i++)
+		{
+			const IAddress & address = pack[i];
+
+			switch (address.getType())
+			{
+				case EAddressType::IP4:
+				{
+					m_addressPack.add(static_cast<const AddressIP4&>(address));
+					break;
+				}
+				case EAddressType::IP6:
+				{
+					m_addressPack.add(static_cast<const AddressIP6&>(address));
+					break;
+				}
+			}
+		}
+	}
+
 	Resolver::CallbackHostname & getCallback()
 	{
 		return m_callback;
@@ -117,6 +173,16 @@ public:
 		return EResolverRequest::SERVICE;
 	}
 
+	std::string getKey() const override
+	{
+		return "S" + std::to_string(static_cast<int>(m_portType)) + ":" + m_service;
+	}
+
+	void copyResult(const IResolverRequest & source) override
+	{
+		m_portPack = static_cast<const ServiceRequest&>(source).m_portPack;
+	}
+
 	Resolver::CallbackService & getCallback()
 	{
 		return m_callback;
@@ -149,13 +215,16 @@ class AddressRequest : public IResolverRequest
 	Resolver::CallbackAddress m_callback;
 	void *m_callbackParam;
 	ResolvedAddress m_resolvedData;
+	//! Number of seconds the result may be cached. Zero if it must not be cached.
+	unsigned int m_hostnameTTL;
 
 public:
 	AddressRequest(AddressData & addressData, const Resolver::CallbackAddress & callback, void *param)
 	: m_pAddressData(&addressData),
 	  m_callback(callback),
 	  m_callbackParam(param),
-	  m_resolvedData()
+	  m_resolvedData(),
+	  m_hostnameTTL(0)
 	{
 	}
 
@@ -164,6 +233,16 @@ public:
 		return EResolverRequest::ADDRESS;
 	}
 
+	std::string getKey() const override
+	{
+		return "A" + AddressString(m_pAddressData->getAddress()).toString();
+	}
+
+	void copyResult(const IResolverRequest & source) override
+	{
+		m_resolvedData = static_cast<const AddressRequest&>(source).m_resolvedData;
+	}
+
 	Resolver::CallbackAddress & getCallback()
 	{
 		return m_callback;
@@ -183,6 +262,16 @@ public:
 	{
 		return m_resolvedData;
 	}
+
+	unsigned int getHostnameTTL() const
+	{
+		return m_hostnameTTL;
+	}
+
+	void setHostnameTTL(unsigned int ttl)
+	{
+		m_hostnameTTL = ttl;
+	}
 };
 
 class PortRequest : public IResolverRequest
@@ -206,6 +295,18 @@ public:
 		return EResolverRequest::PORT;
 	}
 
+	std::string getKey() const override
+	{
+		const Port & port = m_pPortData->getPort();
+
+		return "P" + std::to_string(static_cast<int>(port.getType())) + ":" + std::to_string(port.getNumber());
+	}
+
+	void copyResult(const IResolverRequest & source) override
+	{
+		m_resolvedData = static_cast<const PortRequest&>(source).m_resolvedData;
+	}
+
 	Resolver::CallbackPort & getCallback()
 	{
 		return m_callback;
@@ -227,24 +328,56 @@ public:
 	}
 };
 
+static unsigned long GetDNSThreadCount()
+{
+	unsigned long count = DEFAULT_DNS_THREAD_COUNT;
+
+	CmdLineArg *threadsArg = gCmdLine->getArg("resolver-threads");
+	if (threadsArg)
+	{
+		const KString value = threadsArg->getValue();
+
+		if (!Util::StringToUInt(value, count) || count == 0 || count > MAX_DNS_THREAD_COUNT)
+		{
+			std::string errMsg = "Invalid value '";
+			errMsg += value;
+			errMsg += "' of '--resolver-threads'";
+			throw Exception(std::move(errMsg), "Resolver");
+		}
+	}
+
+	return count;
+}
+
 class Resolver::Impl final : public IEventCallback<ResolverEvent>
 {
-	moodycamel::BlockingReaderWriterQueue<std::unique_ptr<IResolverRequest>> m_requestQueue;
-	Thread m_resolverThread;
-	bool m_isRunning;
+	using RequestQueue = moodycamel::BlockingConcurrentQueue<std::unique_ptr<IResolverRequest>>;
+
+	//! Requests that may wait for DNS server.
+	RequestQueue m_dnsQueue;
+	//! Requests resolved using only local data, such as GeoIP database and service names.
+	RequestQueue m_localQueue;
+	std::vector<Thread> m_dnsThreads;
+	Thread m_localThread;
+	//! Resolves address hostnames without blocking any thread. Null if the system resolver has to be used.
+	std::unique_ptr<ReverseDNS> m_pReverseDNS;
+	//! Resolved addresses from previous runs. Accessed only by the main thread.
+	std::unique_ptr<ResolverCache> m_pCache;
+	//! Requests waiting for an identical request that is being resolved. Accessed only by the main thread.
+	std::unordered_map<std::string, std::vector<std::unique_ptr<IResolverRequest>>> m_pendingRequests;
 	bool m_isAddressHostnameEnabled;
 	bool m_isPortServiceEnabled;
 
-	void resolverLoop()  // executed by resolver thread
+	void resolverLoop(RequestQueue & queue)  // executed by resolver threads
 	{
-		while (m_isRunning)
+		while (true)
 		{
 			std::unique_ptr<IResolverRequest> pRequest;
-			m_requestQueue.wait_dequeue(pRequest);
+			queue.wait_dequeue(pRequest);
 
 			if (!pRequest)
 			{
-				continue;
+				break;
 			}
 
 			switch (pRequest->getType())
@@ -319,14 +452,38 @@ class Resolver::Impl final : public IEventCallback<ResolverEvent>
 
 	void processAddress(AddressRequest & request)
 	{
-		const IAddress & address = request.getAddressData().getAddress();
+		const Address & address = request.getAddressData().getAddress();
 		ResolvedAddress & resolved = request.getResolvedData();
 
 		if (m_isAddressHostnameEnabled)
 		{
 			resolved.hostname = Resolver::PlatformResolveAddress(address);
+
+			// empty hostname may be caused by a temporary failure
+			request.setHostnameTTL((resolved.hostname.empty()) ? 0 : SYSTEM_RESOLVER_TTL);
 		}
 
+		completeAddress(request);
+	}
+
+	void processReverseDNS(std::string & hostname, unsigned int ttl, void *param)  // executed by reverse DNS thread
+	{
+		std::unique_ptr<IResolverRequest> pRequest(static_cast<IResolverRequest*>(param));
+		AddressRequest & request = static_cast<AddressRequest&>(*pRequest);
+
+		request.getResolvedData().hostname = std::move(hostname);
+		request.setHostnameTTL(ttl);
+
+		completeAddress(request);
+
+		gApp->getEventSystem()->dispatch<ResolverEvent>(std::move(pRequest));
+	}
+
+	void completeAddress(AddressRequest & request)
+	{
+		const Address & address = request.getAddressData().getAddress();
+		ResolvedAddress & resolved = request.getResolvedData();
+
 		if (gApp->hasGeoIP())
 		{
 			resolved.country = gApp->getGeoIP()->queryCountry(address);
@@ -337,7 +494,7 @@ class Resolver::Impl final : public IEventCallback<ResolverEvent>
 		{
 			gLog->info("[Resolver] Address resolved: %s %s --> '%s' | country: %s | %s %s",
 			  address.getTypeName().c_str(),
-			  request.getAddressData().getNumericString().c_str(),
+			  AddressString(address).get().c_str(),
 			  resolved.hostname.c_str(),
 			  resolved.country.getCodeString().c_str(),
 			  resolved.asn.getString().c_str(),
@@ -366,59 +523,30 @@ class Resolver::Impl final : public IEventCallback<ResolverEvent>
 		}
 	}
 
-public:
-	Impl()
-	: m_requestQueue(),
-	  m_resolverThread(),
-	  m_isRunning(),
-	  m_isAddressHostnameEnabled(true),
-	  m_isPortServiceEnabled(true)
+	bool isLocalRequest(const IResolverRequest & request) const
 	{
-		if (gCmdLine->hasArg("no-hostname"))
-		{
-			m_isAddressHostnameEnabled = false;
-			gLog->notice("[Resolver] Address hostname resolving disabled by command line");
-		}
-
-		if (gCmdLine->hasArg("no-servname"))
+		switch (request.getType())
 		{
-			m_isPortServiceEnabled = false;
-			gLog->notice("[Resolver] Port service name resolving disabled by command line");
+			case EResolverRequest::HOSTNAME:
+			{
+				return false;
+			}
+			case EResolverRequest::ADDRESS:
+			{
+				return !m_isAddressHostnameEnabled;
+			}
+			case EResolverRequest::SERVICE:
+			case EResolverRequest::PORT:
+			{
+				return true;
+			}
 		}
 
-		m_isRunning = true;
-
-		auto ResolverThreadFunction = [this]() -> void
-		{
-			resolverLoop();
-		};
-
-		// start resolver thread
-		m_resolverThread = Thread("Resolver", ResolverThreadFunction);
-
-		gApp->getEventSystem()->registerCallback<ResolverEvent>(this);
+		return false;
 	}
 
-	~Impl()
+	void invokeCallback(IResolverRequest & genericRequest)
 	{
-		m_isRunning = false;
-
-		gApp->getEventSystem()->removeCallback<ResolverEvent>(this);
-
-		// stop resolver thread
-		m_requestQueue.enqueue(nullptr);  // wake resolver thread
-		m_resolverThread.join();
-	}
-
-	void onEvent(const ResolverEvent & event) override
-	{
-		if (event.isEmpty())
-		{
-			return;
-		}
-
-		IResolverRequest & genericRequest = const_cast<IResolverRequest&>(event.getRequest());
-
 		switch (genericRequest.getType())
 		{
 			case EResolverRequest::HOSTNAME:
@@ -477,6 +605,160 @@ public:
 		}
 	}
 
+public:
+	Impl()
+	: m_dnsQueue(),
+	  m_localQueue(),
+	  m_dnsThreads(),
+	  m_localThread(),
+	  m_pReverseDNS(),
+	  m_pCache(),
+	  m_pendingRequests(),
+	  m_isAddressHostnameEnabled(true),
+	  m_isPortServiceEnabled(true)
+	{
+		if (gCmdLine->hasArg("no-hostname"))
+		{
+			m_isAddressHostnameEnabled = false;
+			gLog->notice("[Resolver] Address hostname resolving disabled by command line");
+		}
+
+		if (gCmdLine->hasArg("no-servname"))
+		{
+			m_isPortServiceEnabled = false;
+			gLog->notice("[Resolver] Port service name resolving disabled by command line");
+		}
+
+		if (m_isAddressHostnameEnabled)
+		{
+			auto ReverseDNSCallback = [this](std::string & hostname, unsigned int ttl, void *param) -> void
+			{
+				processReverseDNS(hostname, ttl, param);
+			};
+
+			m_pReverseDNS = std::make_unique<ReverseDNS>(ReverseDNSCallback);
+
+			if (!m_pReverseDNS->isAvailable())
+			{
+				m_pReverseDNS.reset();
+				gLog->notice("[Resolver] Using system resolver for address hostnames");
+			}
+
+			if (gCmdLine->hasArg("no-resolver-cache"))
+			{
+				gLog->notice("[Resolver] Cache of resolved addresses disabled by command line");
+			}
+			else
+			{
+				m_pCache = std::make_unique<ResolverCache>();
+
+				if (!m_pCache->isOpen())
+				{
+					m_pCache.reset();
+				}
+			}
+		}
+
+		const unsigned long dnsThreadCount = GetDNSThreadCount();
+
+		gLog->info("[Resolver] Using %lu DNS threads", dnsThreadCount);
+
+		auto DNSThreadFunction = [this]() -> void
+		{
+			resolverLoop(m_dnsQueue);
+		};
+
+		auto LocalThreadFunction = [this]() -> void
+		{
+			resolverLoop(m_localQueue);
+		};
+
+		// start resolver threads
+		for (unsigned long i = 0; i < dnsThreadCount; i++)
+		{
+			m_dnsThreads.emplace_back("Resolver", DNSThreadFunction);
+		}
+
+		m_localThread = Thread("ResolverLocal", LocalThreadFunction);
+
+		gApp->getEventSystem()->registerCallback<ResolverEvent>(this);
+	}
+
+	~Impl()
+	{
+		gApp->getEventSystem()->removeCallback<ResolverEvent>(this);
+
+		if (m_pReverseDNS)
+		{
+			// drop unfinished requests
+			for (void *param : m_pReverseDNS->stop())
+			{
+				delete static_cast<IResolverRequest*>(param);
+			}
+		}
+
+		// stop resolver threads
+		for (size_t i = 0; i < m_dnsThreads.size(); i++)
+		{
+			m_dnsQueue.enqueue(nullptr);  // wake one DNS thread
+		}
+
+		m_localQueue.enqueue(nullptr);  // wake local thread
+
+		for (Thread & thread : m_dnsThreads)
+		{
+			thread.join();
+		}
+
+		m_localThread.join();
+	}
+
+	void onEvent(const ResolverEvent & event) override
+	{
+		if (event.isEmpty())
+		{
+			return;
+		}
+
+		IResolverRequest & request = const_cast<IResolverRequest&>(event.getRequest());
+
+		if (m_pCache && request.getType() == EResolverRequest::ADDRESS)
+		{
+			AddressRequest & addressRequest = static_cast<AddressRequest&>(request);
+
+			if (addressRequest.getHostnameTTL() > 0)
+			{
+				m_pCache->add(
+				  addressRequest.getAddressData().getAddress(),
+				  addressRequest.getResolvedData(),
+				  addressRequest.getHostnameTTL()
+				);
+			}
+		}
+
+		std::vector<std::unique_ptr<IResolverRequest>> duplicates;
+
+		auto it = m_pendingRequests.find(request.getKey());
+		if (it != m_pendingRequests.end())
+		{
+			duplicates = std::move(it->second);
+			m_pendingRequests.erase(it);
+		}
+
+		// callbacks may take the result, so copy it first
+		for (std::unique_ptr<IResolverRequest> & pDuplicate : duplicates)
+		{
+			pDuplicate->copyResult(request);
+		}
+
+		invokeCallback(request);
+
+		for (std::unique_ptr<IResolverRequest> & pDuplicate : duplicates)
+		{
+			invokeCallback(*pDuplicate);
+		}
+	}
+
 	bool isAddressHostnameEnabled() const
 	{
 		return m_isAddressHostnameEnabled;
@@ -487,9 +769,48 @@ public:
 		return m_isPortServiceEnabled;
 	}
 
+	void onUpdate()
+	{
+		if (m_pCache)
+		{
+			m_pCache->onUpdate();
+		}
+	}
+
 	void pushRequest(std::unique_ptr<IResolverRequest> && request)
 	{
-		m_requestQueue.enqueue(std::move(request));
+		auto result = m_pendingRequests.emplace(request->getKey(), std::vector<std::unique_ptr<IResolverRequest>>());
+		if (!result.second)
+		{
+			// identical request is already being resolved
+			result.first->second.emplace_back(std::move(request));
+			return;
+		}
+
+		if (m_pCache && request->getType() == EResolverRequest::ADDRESS)
+		{
+			AddressRequest & addressRequest = static_cast<AddressRequest&>(*request);
+
+			if (m_pCache->find(addressRequest.getAddressData().getAddress(), addressRequest.getResolvedData()))
+			{
+				// the result is delivered later like any other result
+				gApp->getEventSystem()->dispatch<ResolverEvent>(std::move(request));
+				return;
+			}
+		}
+
+		if (m_pReverseDNS && request->getType() == EResolverRequest::ADDRESS)
+		{
+			const Address & address = static_cast<AddressRequest&>(*request).getAddressData().getAddress();
+
+			// the request is owned by reverse DNS until its callback is called
+			m_pReverseDNS->resolve(address, request.release());
+			return;
+		}
+
+		RequestQueue & queue = isLocalRequest(*request) ? m_localQueue : m_dnsQueue;
+
+		queue.enqueue(std::move(request));
 	}
 };
 
@@ -512,6 +833,11 @@ bool Resolver::isPortServiceEnabled() const
 	return m_impl->isPortServiceEnabled();
 }
 
+void Resolver::onUpdate()
+{
+	m_impl->onUpdate();
+}
+
 void Resolver::resolveHostname(std::string hostname, const CallbackHostname & callback, void *param)
 {
 	m_impl->pushRequest(std::make_unique<HostnameRequest>(std::move(hostname), callback, param));
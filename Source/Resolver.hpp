@@ -46,7 +46,7 @@ private:
 
 	static AddressPack PlatformResolveHostname(const KString & hostname);
 	static PortPack PlatformResolveService(const KString & service, EPortType portType);
-	static std::string PlatformResolveAddress(const IAddress & address);
+	static std::string PlatformResolveAddress(const Address & address);
 	static std::string PlatformResolvePort(const Port & port);
 
 public:
@@ -56,6 +56,8 @@ public:
 	bool isAddressHostnameEnabled() const;
 	bool isPortServiceEnabled() const;
 
+	void onUpdate();
+
 	void resolveHostname(std::string hostname, const CallbackHostname & callback, void *param);
 	void resolveService(std::string service, EPortType type, const CallbackService & callback, void *param);
 	void resolveAddress(AddressData & address, const CallbackAddress & callback, void *param);
@@ -0,0 +1,12 @@
+/**
+ * @file
+ * @brief ResolverCache class.
+ */
+
+#pragma once
+
+#include "conntop_config.h"
+
+#ifdef CONNTOP_PLATFORM_UNIX
+#include "Platform/Unix/ResolverCache.hpp"
+#endif
@@ -81,24 +81,9 @@ public:
 
 	// IConnectionUpdateCallback
 
-	AddressData *getAddress(const IAddress & address, bool add) override
+	AddressData *getAddress(const Address & address, bool add) override
 	{
-		switch (address.getType())
-		{
-			case EAddressType::IP4:
-			{
-				return (add) ?
-				  m_pStorage->addIP4Address(static_cast<const AddressIP4&>(address)).first :
-				  m_pStorage->getIP4Address(static_cast<const AddressIP4&>(address));
-			}
-			case EAddressType::IP6:
-			{
-				return (add) ?
-				  m_pStorage->addIP6Address(static_cast<const AddressIP6&>(address)).first :
-				  m_pStorage->getIP6Address(static_cast<const AddressIP6&>(address));
-			}
-		}
-		return nullptr;
+		return (add) ? m_pStorage->addAddress(address).first : m_pStorage->getAddress(address);
 	}
 
 	PortData *getPort(const Port & port, bool add) override
@@ -159,6 +144,23 @@ public:
 		m_pStorage->clearConnections();
 		setSerializationEnabled(false);
 	}
+
+	void reserve(size_t connectionCount) override
+	{
+		m_pStorage->reserveConnections(m_pStorage->getConnectionCount() + connectionCount);
+	}
+
+	void beginUpdate() override
+	{
+	}
+
+	void endUpdate() override
+	{
+	}
+
+	void cancelUpdate() noexcept override
+	{
+	}
 };
 
 class Server final : public IServerSessionCallback
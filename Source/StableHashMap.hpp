@@ -0,0 +1,591 @@
+/**
+ * @file
+ * @brief StableHashMap class.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <functional>  // std::hash
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Open-addressing hash map with stable entries.
+ * Entries are stored in fixed-size blocks of slots that are never moved, so pointers to keys and values stay valid
+ * until the entry is removed. Lookups probe only a flat index of (hash, slot) pairs using linear probing, and removal
+ * uses backward-shift deletion, so there are no tombstones. Slots of removed entries are reused. Each slot has
+ * a generation number, which allows handles to detect that their entry is gone. Generation numbers and usage flags
+ * are kept in a separate dense array, so slots contain nothing but entries.
+ * @tparam Key Key type. It must be copy-constructible and equality-comparable.
+ * @tparam Value Value type. It is constructed in place and never moved.
+ * @tparam Hash Hash function.
+ */
+template<class Key, class Value, class Hash = std::hash<Key>>
+class StableHashMap
+{
+public:
+	struct Entry
+	{
+		const Key first;
+		Value second;
+
+		template<class... Args>
+		Entry(const Key & key, Args &&... args)
+		: first(key),
+		  second(std::forward<Args>(args)...)
+		{
+		}
+	};
+
+	/**
+	 * @brief Generation-checked reference to an entry.
+	 */
+	struct Handle
+	{
+		uint32_t slot;
+		uint32_t generation;
+
+		Handle()
+		: slot(UINT32_MAX),
+		  generation(0)
+		{
+		}
+
+		Handle(uint32_t slot, uint32_t generation)
+		: slot(slot),
+		  generation(generation)
+		{
+		}
+	};
+
+private:
+	static constexpr unsigned int BLOCK_SHIFT = 12;
+	static constexpr uint32_t BLOCK_SIZE = 1U << BLOCK_SHIFT;
+	static constexpr uint32_t EMPTY = UINT32_MAX;
+	static constexpr size_t NPOS = SIZE_MAX;
+
+	struct Slot
+	{
+		alignas(Entry) unsigned char storage[sizeof (Entry)];
+
+		Entry *getEntry()
+		{
+			return std::launder(reinterpret_cast<Entry*>(storage));
+		}
+
+		const Entry *getEntry() const
+		{
+			return std::launder(reinterpret_cast<const Entry*>(storage));
+		}
+	};
+
+	struct SlotState
+	{
+		uint32_t generation;
+		bool isUsed;
+	};
+
+	struct Bucket
+	{
+		uint32_t hash;  // upper bits are the home position of the entry
+		uint32_t slot;
+	};
+
+	std::vector<std::unique_ptr<Slot[]>> m_blocks;
+	std::vector<SlotState> m_slotStates;
+	std::vector<uint32_t> m_freeSlots;
+	std::vector<Bucket> m_buckets;
+	uint32_t m_slotCount;  // high-water mark of used slots
+	size_t m_size;
+	unsigned int m_bucketShift;
+
+	static uint32_t GetHash(const Key & key)
+	{
+		// Fibonacci hashing spreads weak hashes such as identity hashes of IPv4 addresses
+		const uint64_t hash = static_cast<uint64_t>(Hash()(key)) * 0x9E3779B97F4A7C15;
+
+		return hash >> 32;
+	}
+
+	Slot & getSlot(uint32_t index)
+	{
+		return m_blocks[index >> BLOCK_SHIFT][index & (BLOCK_SIZE - 1)];
+	}
+
+	const Slot & getSlot(uint32_t index) const
+	{
+		return m_blocks[index >> BLOCK_SHIFT][index & (BLOCK_SIZE - 1)];
+	}
+
+	size_t getHomeBucket(uint32_t hash) const
+	{
+		return hash >> m_bucketShift;
+	}
+
+	size_t findBucket(const Key & key, uint32_t hash) const
+	{
+		if (m_size == 0)
+		{
+			return NPOS;
+		}
+
+		const size_t mask = m_buckets.size() - 1;
+
+		for (size_t i = getHomeBucket(hash);; i = (i + 1) & mask)
+		{
+			const Bucket & bucket = m_buckets[i];
+
+			if (bucket.slot == EMPTY)
+			{
+				return NPOS;
+			}
+
+			if (bucket.hash == hash && getSlot(bucket.slot).getEntry()->first == key)
+			{
+				return i;
+			}
+		}
+	}
+
+	void insertBucket(uint32_t hash, uint32_t slot)
+	{
+		const size_t mask = m_buckets.size() - 1;
+
+		size_t i = getHomeBucket(hash);
+		while (m_buckets[i].slot != EMPTY)
+		{
+			i = (i + 1) & mask;
+		}
+
+		m_buckets[i].hash = hash;
+		m_buckets[i].slot = slot;
+	}
+
+	void eraseBucket(size_t index)
+	{
+		const size_t mask = m_buckets.size() - 1;
+
+		size_t hole = index;
+		for (size_t i = (index + 1) & mask; m_buckets[i].slot != EMPTY; i = (i + 1) & mask)
+		{
+			const size_t home = getHomeBucket(m_buckets[i].hash);
+
+			// the entry can fill the hole only if the hole is not before its home position
+			if (((i - home) & mask) >= ((i - hole) & mask))
+			{
+				m_buckets[hole] = m_buckets[i];
+				hole = i;
+			}
+		}
+
+		m_buckets[hole].slot = EMPTY;
+	}
+
+	void rehash(size_t bucketCount)
+	{
+		unsigned int bits = 0;
+		while ((static_cast<size_t>(1) << bits) < bucketCount)
+		{
+			bits++;
+		}
+
+		std::vector<Bucket> oldBuckets(static_cast<size_t>(1) << bits, Bucket{ 0, EMPTY });
+		m_buckets.swap(oldBuckets);
+		m_bucketShift = 32 - bits;
+
+		// only the index is rebuilt, entries stay where they are
+		for (const Bucket & bucket : oldBuckets)
+		{
+			if (bucket.slot != EMPTY)
+			{
+				insertBucket(bucket.hash, bucket.slot);
+			}
+		}
+	}
+
+	uint32_t allocateSlot()
+	{
+		if (!m_freeSlots.empty())
+		{
+			const uint32_t index = m_freeSlots.back();
+			m_freeSlots.pop_back();
+			return index;
+		}
+
+		if ((m_slotCount >> BLOCK_SHIFT) >= m_blocks.size())
+		{
+			m_slotStates.resize((m_blocks.size() + 1) * BLOCK_SIZE);
+			m_blocks.emplace_back(std::make_unique<Slot[]>(BLOCK_SIZE));
+		}
+
+		return m_slotCount++;
+	}
+
+	void destroySlot(uint32_t index)
+	{
+		getSlot(index).getEntry()->~Entry();
+
+		SlotState & state = m_slotStates[index];
+		state.isUsed = false;
+		state.generation++;
+	}
+
+	void eraseAt(size_t bucket)
+	{
+		const uint32_t index = m_buckets[bucket].slot;
+
+		destroySlot(index);
+		eraseBucket(bucket);
+		m_freeSlots.push_back(index);
+		m_size--;
+	}
+
+	template<bool IsConst>
+	class IteratorBase
+	{
+		using MapType = typename std::conditional<IsConst, const StableHashMap, StableHashMap>::type;
+
+		MapType *m_pMap;
+		uint32_t m_index;
+
+		void skipUnused()
+		{
+			while (m_index < m_pMap->m_slotCount && !m_pMap->m_slotStates[m_index].isUsed)
+			{
+				m_index++;
+			}
+		}
+
+		friend class StableHashMap;
+		friend class IteratorBase<!IsConst>;
+
+	public:
+		using iterator_category = std::forward_iterator_tag;
+		using value_type = Entry;
+		using difference_type = std::ptrdiff_t;
+		using pointer = typename std::conditional<IsConst, const Entry*, Entry*>::type;
+		using reference = typename std::conditional<IsConst, const Entry&, Entry&>::type;
+
+		IteratorBase()
+		: m_pMap(),
+		  m_index(0)
+		{
+		}
+
+		IteratorBase(MapType *pMap, uint32_t index)
+		: m_pMap(pMap),
+		  m_index(index)
+		{
+			skipUnused();
+		}
+
+		// conversion from iterator to const_iterator
+		template<bool WasConst, class = typename std::enable_if<IsConst && !WasConst>::type>
+		IteratorBase(const IteratorBase<WasConst> & other)
+		: m_pMap(other.m_pMap),
+		  m_index(other.m_index)
+		{
+		}
+
+		reference operator*() const
+		{
+			return *m_pMap->getSlot(m_index).getEntry();
+		}
+
+		pointer operator->() const
+		{
+			return m_pMap->getSlot(m_index).getEntry();
+		}
+
+		IteratorBase & operator++()
+		{
+			m_index++;
+			skipUnused();
+			return *this;
+		}
+
+		IteratorBase operator++(int)
+		{
+			IteratorBase old = *this;
+			++(*this);
+			return old;
+		}
+
+		bool operator==(const IteratorBase & other) const
+		{
+			return m_index == other.m_index;
+		}
+
+		bool operator!=(const IteratorBase & other) const
+		{
+			return m_index != other.m_index;
+		}
+	};
+
+public:
+	using iterator = IteratorBase<false>;
+	using const_iterator = IteratorBase<true>;
+
+	StableHashMap()
+	: m_blocks(),
+	  m_slotStates(),
+	  m_freeSlots(),
+	  m_buckets(),
+	  m_slotCount(0),
+	  m_size(0),
+	  m_bucketShift(32)
+	{
+	}
+
+	StableHashMap(const StableHashMap &) = delete;
+	StableHashMap & operator=(const StableHashMap &) = delete;
+
+	~StableHashMap()
+	{
+		clear();
+	}
+
+	/**
+	 * @brief Adds a new entry if the key does not exist yet.
+	 * @param key The key.
+	 * @param args Arguments passed to constructor of the value.
+	 * @return Pointer to the entry with the key and true if the entry was added.
+	 */
+	template<class... Args>
+	std::pair<Entry*, bool> emplace(const Key & key, Args &&... args)
+	{
+		const uint32_t hash = GetHash(key);
+
+		const size_t bucket = findBucket(key, hash);
+		if (bucket != NPOS)
+		{
+			return { getSlot(m_buckets[bucket].slot).getEntry(), false };
+		}
+
+		// maximum load factor is 0.75
+		if ((m_size + 1) * 4 > m_buckets.size() * 3)
+		{
+			rehash((m_buckets.empty()) ? 16 : m_buckets.size() * 2);
+		}
+
+		const uint32_t index = allocateSlot();
+		Slot & slot = getSlot(index);
+
+		Entry *pEntry;
+		try
+		{
+			pEntry = new (slot.storage) Entry(key, std::forward<Args>(args)...);
+		}
+		catch (...)
+		{
+			m_freeSlots.push_back(index);
+			throw;
+		}
+
+		m_slotStates[index].isUsed = true;
+		insertBucket(hash, index);
+		m_size++;
+
+		return { pEntry, true };
+	}
+
+	/**
+	 * @brief Removes an entry.
+	 * @param key The key.
+	 * @return Address of the removed value or null if no such entry exists. It must not be dereferenced.
+	 */
+	const void *erase(const Key & key)
+	{
+		const size_t bucket = findBucket(key, GetHash(key));
+		if (bucket == NPOS)
+		{
+			return nullptr;
+		}
+
+		const void *pValue = &getSlot(m_buckets[bucket].slot).getEntry()->second;
+
+		eraseAt(bucket);
+
+		return pValue;
+	}
+
+	/**
+	 * @brief Removes an entry referenced by handle.
+	 * @param handle The handle.
+	 * @return False if the entry was already removed, otherwise true.
+	 */
+	bool erase(const Handle & handle)
+	{
+		const Entry *pEntry = get(handle);
+		if (!pEntry)
+		{
+			return false;
+		}
+
+		const size_t mask = m_buckets.size() - 1;
+
+		size_t bucket = getHomeBucket(GetHash(pEntry->first));
+		while (m_buckets[bucket].slot != handle.slot)
+		{
+			bucket = (bucket + 1) & mask;
+		}
+
+		eraseAt(bucket);
+
+		return true;
+	}
+
+	/**
+	 * @brief Removes all entries.
+	 * Allocated memory is kept for reuse. Handles to removed entries become invalid.
+	 */
+	void clear()
+	{
+		if (m_size > 0)
+		{
+			for (uint32_t i = 0; i < m_slotCount; i++)
+			{
+				if (m_slotStates[i].isUsed)
+				{
+					destroySlot(i);
+				}
+			}
+
+			for (Bucket & bucket : m_buckets)
+			{
+				bucket.slot = EMPTY;
+			}
+		}
+
+		m_freeSlots.clear();
+		m_slotCount = 0;
+		m_size = 0;
+	}
+
+	/**
+	 * @brief Prepares the map for a number of entries, so they can be added without rehashing.
+	 */
+	void reserve(size_t count)
+	{
+		if (count * 4 > m_buckets.size() * 3)
+		{
+			rehash(count * 4 / 3 + 1);
+		}
+
+		const size_t blockCount = (count + BLOCK_SIZE - 1) >> BLOCK_SHIFT;
+
+		m_blocks.reserve(blockCount);
+		m_slotStates.reserve(blockCount * BLOCK_SIZE);
+	}
+
+	Entry *find(const Key & key)
+	{
+		const size_t bucket = findBucket(key, GetHash(key));
+
+		return (bucket != NPOS) ? getSlot(m_buckets[bucket].slot).getEntry() : nullptr;
+	}
+
+	const Entry *find(const Key & key) const
+	{
+		const size_t bucket = findBucket(key, GetHash(key));
+
+		return (bucket != NPOS) ? getSlot(m_buckets[bucket].slot).getEntry() : nullptr;
+	}
+
+	Handle getHandle(const Key & key) const
+	{
+		const size_t bucket = findBucket(key, GetHash(key));
+		if (bucket == NPOS)
+		{
+			return Handle();
+		}
+
+		const uint32_t index = m_buckets[bucket].slot;
+
+		return Handle(index, m_slotStates[index].generation);
+	}
+
+	/**
+	 * @brief Resolves handle without hashing.
+	 * @return Pointer to the entry or null if the entry was removed in the meantime.
+	 */
+	Entry *get(const Handle & handle)
+	{
+		if (handle.slot >= m_slotCount)
+		{
+			return nullptr;
+		}
+
+		const SlotState & state = m_slotStates[handle.slot];
+
+		return (state.isUsed && state.generation == handle.generation) ? getSlot(handle.slot).getEntry() : nullptr;
+	}
+
+	const Entry *get(const Handle & handle) const
+	{
+		return const_cast<StableHashMap*>(this)->get(handle);
+	}
+
+	bool isValid(const Handle & handle) const
+	{
+		return get(handle) != nullptr;
+	}
+
+	iterator begin()
+	{
+		return iterator(this, 0);
+	}
+
+	iterator end()
+	{
+		return iterator(this, m_slotCount);
+	}
+
+	const_iterator begin() const
+	{
+		return const_iterator(this, 0);
+	}
+
+	const_iterator end() const
+	{
+		return const_iterator(this, m_slotCount);
+	}
+
+	const_iterator cbegin() const
+	{
+		return begin();
+	}
+
+	const_iterator cend() const
+	{
+		return end();
+	}
+
+	size_t size() const
+	{
+		return m_size;
+	}
+
+	bool empty() const
+	{
+		return m_size == 0;
+	}
+
+	/**
+	 * @brief Returns number of bytes allocated by the map.
+	 * Memory allocated by keys and values themselves is not included.
+	 */
+	size_t getMemoryUsage() const
+	{
+		return m_blocks.capacity() * sizeof (std::unique_ptr<Slot[]>)
+		     + m_blocks.size() * BLOCK_SIZE * sizeof (Slot)
+		     + m_slotStates.capacity() * sizeof (SlotState)
+		     + m_freeSlots.capacity() * sizeof (uint32_t)
+		     + m_buckets.capacity() * sizeof (Bucket);
+	}
+};
@@ -93,6 +93,42 @@ std::string Util::AddressPortToString(const IAddress & address, const Port & por
 	return AddressPortToString(address, port.getNumber());
 }
 
+/**
+ * @brief Converts decimal string to unsigned integer.
+ * @param string The string. It must contain only decimal digits.
+ * @param result Reference to variable that receives the number. It is not changed if the conversion fails.
+ * @return True, if the conversion succeeded, otherwise false.
+ */
+bool Util::StringToUInt(const KString & string, unsigned long & result)
+{
+	if (string.empty())
+	{
+		return false;
+	}
+
+	unsigned long value = 0;
+	for (size_t i = 0; i < string.length(); i++)
+	{
+		const char ch = string[i];
+		if (ch < '0' || ch > '9')
+		{
+			return false;
+		}
+
+		const unsigned long digit = ch - '0';
+		if (value > (static_cast<unsigned long>(-1) - digit) / 10)
+		{
+			return false;  // overflow
+		}
+
+		value = (value * 10) + digit;
+	}
+
+	result = value;
+
+	return true;
+}
+
 /**
  * @brief Dumps memory usage information to log.
  * @param always If true, always log message is used instead of info message.
@@ -9,6 +9,7 @@
 #include <string>
 
 #include "Types.hpp"
+#include "KString.hpp"
 #include "DateTime.hpp"
 
 class IAddress;
@@ -23,6 +24,8 @@ namespace Util
 
 	void LogMemoryUsage(bool always = false);
 
+	bool StringToUInt(const KString & string, unsigned long & result);
+
 	/**
 	 * @brief Obtains text description of error number (errno).
 	 * Implementation is platform-specific.
@@ -0,0 +1,244 @@
+/**
+ * @file
+ * @brief Test of capture files cut at every possible position.
+ * Capture of a killed application ends inside a record, which must end the replay instead of failing it. Invalid
+ * content of the file must still be reported.
+ */
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "Collector_Common/Capture.hpp"
+#include "Exception.hpp"
+#include "Thread.hpp"
+#include "Log.hpp"
+
+static std::string GetTempFileName(const char *name)
+{
+	const char *tempDir = std::getenv("TMPDIR");
+
+	return std::string((tempDir) ? tempDir : "/tmp") + "/conntop_test_" + name + "." + std::to_string(getpid());
+}
+
+static CaptureEntry CreateEntry(CaptureEntry::EType type, uint8_t l3proto, uint16_t srcPort)
+{
+	CaptureEntry entry = {};
+	entry.type = type;
+	entry.tuple.l3proto = l3proto;
+	entry.tuple.l4proto = IPPROTO_TCP;
+	entry.tuple.srcAddr[0] = 0x0100000A;
+	entry.tuple.dstAddr[0] = 0x08080808;
+	entry.tuple.srcAddr[3] = (l3proto == AF_INET6) ? 0x01000000 : 0;
+	entry.tuple.srcPort = srcPort;
+	entry.tuple.dstPort = 443;
+	entry.rxPackets = 1000;
+	entry.txPackets = 300;
+	entry.rxBytes = 1500000;
+	entry.txBytes = 20000;
+	entry.state = 3;
+
+	return entry;
+}
+
+static std::vector<CaptureEntry> WriteCapture(const std::string & fileName)
+{
+	const std::vector<CaptureEntry> entries = {
+		CreateEntry(CaptureEntry::DUMP_ENTRY, AF_INET, 40000),
+		CreateEntry(CaptureEntry::DUMP_ENTRY, AF_INET6, 40001),
+		CreateEntry(CaptureEntry::EVENT_NEW, AF_INET, 40002),
+		CreateEntry(CaptureEntry::EVENT_DESTROY, AF_INET6, 40001)
+	};
+
+	CaptureWriter writer(fileName);
+
+	std::string dumpEntries;
+	CaptureWriter::EncodeDumpEntry(dumpEntries, entries[0]);
+	CaptureWriter::EncodeDumpEntry(dumpEntries, entries[1]);
+
+	writer.writeDumpBegin();
+	writer.writeDumpEntries(dumpEntries);
+	writer.writeDumpEnd();
+	writer.writeEvent(entries[2]);
+	writer.writeEvent(entries[3]);
+
+	return {
+		CreateEntry(CaptureEntry::DUMP_BEGIN, 0, 0),
+		entries[0],
+		entries[1],
+		CreateEntry(CaptureEntry::DUMP_END, 0, 0),
+		entries[2],
+		entries[3]
+	};
+}
+
+static std::string ReadFile(const std::string & fileName)
+{
+	std::ifstream file(fileName, std::ios::binary);
+
+	return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+static void WriteFile(const std::string & fileName, const std::string & content)
+{
+	std::ofstream file(fileName, std::ios::binary | std::ios::trunc);
+	file << content;
+}
+
+static bool IsEqual(const CaptureEntry & a, const CaptureEntry & b)
+{
+	if (a.type != b.type)
+	{
+		return false;
+	}
+
+	if (a.type == CaptureEntry::DUMP_BEGIN || a.type == CaptureEntry::DUMP_END)
+	{
+		return true;
+	}
+
+	return a.tuple == b.tuple
+	    && a.rxPackets == b.rxPackets
+	    && a.txPackets == b.txPackets
+	    && a.rxBytes == b.rxBytes
+	    && a.txBytes == b.txBytes
+	    && a.state == b.state;
+}
+
+/**
+ * @brief Reads all records of a capture file.
+ * @return Number of records that are the same as the expected ones, or -1 if some record differs.
+ */
+static int ReadCapture(const std::string & fileName, const std::vector<CaptureEntry> & expected)
+{
+	CaptureReader reader(fileName);
+	CaptureEntry entry;
+	size_t count = 0;
+
+	while (reader.read(entry))
+	{
+		if (count >= expected.size() || !IsEqual(entry, expected[count]))
+		{
+			return -1;
+		}
+
+		count++;
+	}
+
+	return count;
+}
+
+static int RunTest()
+{
+	const std::string fileName = GetTempFileName("capture");
+	const std::vector<CaptureEntry> expected = WriteCapture(fileName);
+	const std::string content = ReadFile(fileName);
+
+	// the header is not part of any record
+	const size_t headerLength = 9;
+
+	int status = 0;
+	int previousCount = 0;
+	std::vector<size_t> recordEnds;
+
+	for (size_t length = headerLength; length <= content.length(); length++)
+	{
+		WriteFile(fileName, content.substr(0, length));
+
+		int count = -1;
+		try
+		{
+			count = ReadCapture(fileName, expected);
+		}
+		catch (const Exception &)
+		{
+		}
+
+		if (count < previousCount)
+		{
+			std::printf("FAIL: Capture cut after %zu bytes: %d records (expected at least %d)\n",
+			            length, count, previousCount);
+			status = 1;
+			break;
+		}
+
+		if (count > previousCount)
+		{
+			recordEnds.push_back(length);
+			previousCount = count;
+		}
+	}
+
+	const bool isComplete = static_cast<size_t>(previousCount) == expected.size();
+
+	std::printf("%s: Cut captures: %d of %zu records\n", (isComplete) ? "OK" : "FAIL", previousCount, expected.size());
+
+	if (!isComplete)
+	{
+		status = 1;
+	}
+
+	// the first dump entry follows DUMP_BEGIN record, invalid type and address family must be reported
+	if (recordEnds.size() >= 2)
+	{
+		const struct
+		{
+			const char *description;
+			size_t offset;
+			char value;
+		}
+		corruptions[] = {
+			{ "Unknown record type", recordEnds[0], 0x7F },
+			{ "Unknown address family", recordEnds[0] + 1, 5 }
+		};
+
+		for (const auto & corruption : corruptions)
+		{
+			std::string corrupted = content;
+			corrupted[corruption.offset] = corruption.value;
+			WriteFile(fileName, corrupted);
+
+			bool isReported = false;
+			try
+			{
+				ReadCapture(fileName, expected);
+			}
+			catch (const Exception &)
+			{
+				isReported = true;
+			}
+
+			std::printf("%s: %s is reported\n", (isReported) ? "OK" : "FAIL", corruption.description);
+
+			if (!isReported)
+			{
+				status = 1;
+			}
+		}
+	}
+
+	unlink(fileName.c_str());
+
+	return status;
+}
+
+int main()
+{
+	Thread::SetCurrentThreadName("Main");
+
+	// every cut capture logs a warning
+	Log log(Log::VERBOSITY_DISABLED, Log::COLORIZE_NEVER, Log::STYLE_SIMPLE);
+	gLog = &log;
+
+	const int status = RunTest();
+
+	gLog = nullptr;
+
+	return status;
+}
@@ -0,0 +1,119 @@
+/**
+ * @file
+ * @brief Test of memory used by each connection in the storage.
+ * Addresses and ports are shared by connections like on a busy NAT gateway. The number of connections is large
+ * enough, so lists of connections of each address and port do not dominate.
+ */
+
+#include <arpa/inet.h>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "ConnectionStorage.hpp"
+#include "CmdLine.hpp"
+#include "Thread.hpp"
+#include "Log.hpp"
+
+static const size_t CONNECTION_COUNT = 1000000;
+static const uint32_t LOCAL_ADDRESS_COUNT = 4096;
+static const uint32_t REMOTE_ADDRESS_COUNT = 65536;
+
+//! Maximum number of bytes used by each connection in the storage including all hash map overhead.
+static const double MAX_BYTES_PER_CONNECTION = 192;
+static const size_t MAX_CONNECTION_DATA_SIZE = 64;
+
+static void FillStorage(ConnectionStorage & storage)
+{
+	std::mt19937_64 random(42);
+
+	std::vector<AddressData*> localAddresses;
+	std::vector<AddressData*> remoteAddresses;
+
+	for (uint32_t i = 0; i < LOCAL_ADDRESS_COUNT; i++)
+	{
+		localAddresses.push_back(storage.addAddress(Address::CreateIP4(htonl(0x0A000000 | i))).first);
+	}
+
+	for (uint32_t i = 0; i < REMOTE_ADDRESS_COUNT; i++)
+	{
+		remoteAddresses.push_back(storage.addAddress(Address::CreateIP4(random())).first);
+	}
+
+	storage.reserveConnections(CONNECTION_COUNT);
+
+	for (size_t i = 0; i < CONNECTION_COUNT; i++)
+	{
+		const EPortType portType = (random() % 5 == 0) ? EPortType::UDP : EPortType::TCP;
+
+		// the pair of local address and port is unique
+		const AddressData *pSrcAddress = localAddresses[i % LOCAL_ADDRESS_COUNT];
+		const PortData *pSrcPort = storage.addPort(Port(portType, 1024 + i / LOCAL_ADDRESS_COUNT)).first;
+		const AddressData *pDstAddress = remoteAddresses[random() % REMOTE_ADDRESS_COUNT];
+		const PortData *pDstPort = storage.addPort(Port(portType, (random() % 2) ? 443 : 80)).first;
+
+		ConnectionTraffic traffic;
+		traffic.rxPackets = random() % 100000;
+		traffic.txPackets = random() % 100000;
+
+		storage.addConnection(Connection(*pSrcAddress, *pSrcPort, *pDstAddress, *pDstPort), traffic);
+	}
+}
+
+static int RunTest()
+{
+	int status = 0;
+
+	const bool isDataSizeOK = sizeof (ConnectionData) <= MAX_CONNECTION_DATA_SIZE;
+
+	std::printf("%s: ConnectionData has %zu bytes (budget %zu)\n",
+	  (isDataSizeOK) ? "OK" : "FAIL",
+	  sizeof (ConnectionData),
+	  MAX_CONNECTION_DATA_SIZE
+	);
+
+	if (!isDataSizeOK)
+	{
+		status = 1;
+	}
+
+	ConnectionStorage storage;
+	FillStorage(storage);
+
+	const size_t count = storage.getConnectionCount();
+	const double bytesPerConnection = static_cast<double>(storage.getConnectionMemoryUsage()) / count;
+	const bool isStorageOK = count == CONNECTION_COUNT && bytesPerConnection <= MAX_BYTES_PER_CONNECTION;
+
+	std::printf("%s: %zu connections use %.1f bytes each (budget %.0f)\n",
+	  (isStorageOK) ? "OK" : "FAIL",
+	  count,
+	  bytesPerConnection,
+	  MAX_BYTES_PER_CONNECTION
+	);
+
+	if (!isStorageOK)
+	{
+		status = 1;
+	}
+
+	return status;
+}
+
+int main(int argc, char *argv[])
+{
+	Thread::SetCurrentThreadName("Main");
+
+	// the storage reads its options from command line
+	CmdLine cmdLine(argc, argv);
+	gCmdLine = &cmdLine;
+
+	Log log(Log::VERBOSITY_LOW, Log::COLORIZE_NEVER, Log::STYLE_SIMPLE);
+	gLog = &log;
+
+	const int status = RunTest();
+
+	gLog = nullptr;
+	gCmdLine = nullptr;
+
+	return status;
+}
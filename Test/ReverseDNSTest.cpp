@@ -0,0 +1,640 @@
+/**
+ * @file
+ * @brief Test of ReverseDNS against stub nameserver.
+ *
+ * The stub nameserver listens on UDP and TCP at an ephemeral port of 127.0.0.1. Its response depends on the queried
+ * address, so every scenario is one lookup and all of them run at once.
+ */
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "ReverseDNS.hpp"
+#include "Address.hpp"
+#include "Thread.hpp"
+#include "Log.hpp"
+
+static const uint16_t TYPE_CNAME = 5;
+static const uint16_t TYPE_SOA = 6;
+static const uint16_t TYPE_PTR = 12;
+static const uint16_t CLASS_IN = 1;
+static const uint16_t FLAGS_RESPONSE = 0x8180;  // response, recursion desired and available
+static const uint16_t FLAG_TRUNCATED = 0x0200;
+static const uint16_t RCODE_NXDOMAIN = 3;
+
+// the resolver sends each query twice and waits one second for each response
+static const char *RESOLV_CONF = "nameserver 127.0.0.1\noptions timeout:1 attempts:2\n";
+static const char *HOSTS = "192.0.2.9 hosts.example.net\n";
+
+static const auto RESULT_TIMEOUT = std::chrono::seconds(10);
+
+struct Record
+{
+	std::string name;
+	uint16_t type;
+	uint32_t ttl;
+	std::vector<uint8_t> data;
+};
+
+static void Append16(std::vector<uint8_t> & message, uint16_t value)
+{
+	message.push_back(value >> 8);
+	message.push_back(value & 0xFF);
+}
+
+static void Append32(std::vector<uint8_t> & message, uint32_t value)
+{
+	Append16(message, value >> 16);
+	Append16(message, value & 0xFFFF);
+}
+
+static void AppendName(std::vector<uint8_t> & message, const std::string & name)
+{
+	size_t labelBegin = 0;
+	while (labelBegin < name.length())
+	{
+		size_t labelEnd = name.find('.', labelBegin);
+		if (labelEnd == std::string::npos)
+		{
+			labelEnd = name.length();
+		}
+
+		message.push_back(labelEnd - labelBegin);
+		message.insert(message.end(), name.begin() + labelBegin, name.begin() + labelEnd);
+
+		labelBegin = labelEnd + 1;
+	}
+
+	message.push_back(0);
+}
+
+static Record NameRecord(const std::string & name, uint16_t type, uint32_t ttl, const std::string & target)
+{
+	Record record{name, type, ttl, {}};
+	AppendName(record.data, target);
+
+	return record;
+}
+
+static Record SOARecord(const std::string & name, uint32_t ttl, uint32_t minimum)
+{
+	Record record{name, TYPE_SOA, ttl, {}};
+	AppendName(record.data, "ns.example.net");
+	AppendName(record.data, "hostmaster.example.net");
+	Append32(record.data, 1);     // serial
+	Append32(record.data, 3600);  // refresh
+	Append32(record.data, 600);   // retry
+	Append32(record.data, 86400); // expire
+	Append32(record.data, minimum);
+
+	return record;
+}
+
+static std::vector<uint8_t> BuildResponse(uint16_t id, uint16_t flags, const std::string & questionName,
+                                          const std::vector<Record> & answers,
+                                          const std::vector<Record> & authority = {})
+{
+	std::vector<uint8_t> message;
+
+	Append16(message, id);
+	Append16(message, flags);
+	Append16(message, 1);  // question count
+	Append16(message, answers.size());
+	Append16(message, authority.size());
+	Append16(message, 0);
+
+	AppendName(message, questionName);
+	Append16(message, TYPE_PTR);
+	Append16(message, CLASS_IN);
+
+	for (const std::vector<Record> *section : { &answers, &authority })
+	{
+		for (const Record & record : *section)
+		{
+			AppendName(message, record.name);
+			Append16(message, record.type);
+			Append16(message, CLASS_IN);
+			Append32(message, record.ttl);
+			Append16(message, record.data.size());
+			message.insert(message.end(), record.data.begin(), record.data.end());
+		}
+	}
+
+	return message;
+}
+
+/**
+ * @brief Reads ID and question name of a query.
+ * @return False if the query is malformed, otherwise true.
+ */
+static bool ParseQuery(const uint8_t *message, size_t length, uint16_t & id, std::string & name)
+{
+	if (length < 12)
+	{
+		return false;
+	}
+
+	id = (message[0] << 8) | message[1];
+	name.clear();
+
+	size_t pos = 12;
+	while (pos < length && message[pos] != 0)
+	{
+		const size_t labelLength = message[pos];
+		if (pos + 1 + labelLength > length)
+		{
+			return false;
+		}
+
+		if (!name.empty())
+		{
+			name += '.';
+		}
+
+		name.append(reinterpret_cast<const char*>(message + pos + 1), labelLength);
+		pos += 1 + labelLength;
+	}
+
+	return pos < length;
+}
+
+class StubNameserver
+{
+	int m_udpFD;
+	int m_tcpFD;
+	uint16_t m_port;
+	std::atomic<bool> m_isRunning;
+	Thread m_thread;
+
+	std::mutex m_mutex;
+	//! Number of queries received over UDP and TCP for each name.
+	std::map<std::string, unsigned int> m_udpQueryCounts;
+	std::map<std::string, unsigned int> m_tcpQueryCounts;
+
+	bool bindSockets()
+	{
+		sockaddr_in addr = {};
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+		socklen_t addrLength = sizeof addr;
+
+		if (bind(m_udpFD, reinterpret_cast<sockaddr*>(&addr), sizeof addr) < 0
+		  || getsockname(m_udpFD, reinterpret_cast<sockaddr*>(&addr), &addrLength) < 0)
+		{
+			return false;
+		}
+
+		// TCP uses the same port, which may be taken by someone else
+		if (bind(m_tcpFD, reinterpret_cast<sockaddr*>(&addr), sizeof addr) < 0 || listen(m_tcpFD, 8) < 0)
+		{
+			return false;
+		}
+
+		m_port = ntohs(addr.sin_port);
+
+		return true;
+	}
+
+	void closeSockets()
+	{
+		if (m_udpFD >= 0)
+		{
+			close(m_udpFD);
+			m_udpFD = -1;
+		}
+
+		if (m_tcpFD >= 0)
+		{
+			close(m_tcpFD);
+			m_tcpFD = -1;
+		}
+	}
+
+	static std::vector<std::vector<uint8_t>> BuildResponses(uint16_t id, const std::string & name,
+	                                                        unsigned int queryCount, bool isTCP)
+	{
+		if (name == "1.2.0.192.in-addr.arpa")
+		{
+			return { BuildResponse(id, FLAGS_RESPONSE, name, { NameRecord(name, TYPE_PTR, 300, "host.example.net") }) };
+		}
+		else if (name == "2.2.0.192.in-addr.arpa")
+		{
+			// negative TTL is the lower of SOA TTL and SOA minimum
+			const Record soa = SOARecord("2.0.192.in-addr.arpa", 3600, 120);
+
+			return { BuildResponse(id, FLAGS_RESPONSE | RCODE_NXDOMAIN, name, {}, { soa }) };
+		}
+		else if (name == "3.2.0.192.in-addr.arpa")
+		{
+			if (!isTCP)
+			{
+				return { BuildResponse(id, FLAGS_RESPONSE | FLAG_TRUNCATED, name, {}) };
+			}
+
+			return { BuildResponse(id, FLAGS_RESPONSE, name, { NameRecord(name, TYPE_PTR, 200, "tcp.example.net") }) };
+		}
+		else if (name == "4.2.0.192.in-addr.arpa")
+		{
+			// classless delegation with two CNAMEs in reverse order, the lowest TTL is used
+			const std::string alias1 = "4.0-25.2.0.192.in-addr.arpa";
+			const std::string alias2 = "4.hosts.0-25.2.0.192.in-addr.arpa";
+
+			return { BuildResponse(id, FLAGS_RESPONSE, name, {
+				NameRecord(alias2, TYPE_PTR, 400, "cname.example.net"),
+				NameRecord(alias1, TYPE_CNAME, 90, alias2),
+				NameRecord(name, TYPE_CNAME, 600, alias1)
+			}) };
+		}
+		else if (name == "5.2.0.192.in-addr.arpa")
+		{
+			if (queryCount == 1)
+			{
+				return {};  // lost query
+			}
+
+			return { BuildResponse(id, FLAGS_RESPONSE, name, { NameRecord(name, TYPE_PTR, 300, "retry.example.net") }) };
+		}
+		else if (name == "6.2.0.192.in-addr.arpa")
+		{
+			return {};  // dead nameserver
+		}
+		else if (name == "7.2.0.192.in-addr.arpa")
+		{
+			const std::string otherName = "8.2.0.192.in-addr.arpa";
+
+			// the first two responses must be ignored
+			return {
+				BuildResponse(id ^ 0x8000, FLAGS_RESPONSE, name, {
+					NameRecord(name, TYPE_PTR, 300, "wrong-id.example.net")
+				}),
+				BuildResponse(id, FLAGS_RESPONSE, otherName, {
+					NameRecord(otherName, TYPE_PTR, 300, "wrong-question.example.net")
+				}),
+				BuildResponse(id, FLAGS_RESPONSE, name, {
+					NameRecord(name, TYPE_PTR, 300, "valid.example.net")
+				})
+			};
+		}
+
+		return { BuildResponse(id, FLAGS_RESPONSE | RCODE_NXDOMAIN, name, {}) };
+	}
+
+	unsigned int countQuery(const std::string & name, bool isTCP)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		return ++((isTCP) ? m_tcpQueryCounts : m_udpQueryCounts)[name];
+	}
+
+	void handleUDP()
+	{
+		uint8_t buffer[512];
+		sockaddr_storage clientAddr;
+		socklen_t clientAddrLength = sizeof clientAddr;
+
+		const ssize_t length = recvfrom(m_udpFD, buffer, sizeof buffer, 0,
+		                                reinterpret_cast<sockaddr*>(&clientAddr), &clientAddrLength);
+
+		uint16_t id;
+		std::string name;
+
+		if (length < 0 || !ParseQuery(buffer, length, id, name))
+		{
+			return;
+		}
+
+		for (const std::vector<uint8_t> & response : BuildResponses(id, name, countQuery(name, false), false))
+		{
+			sendto(m_udpFD, response.data(), response.size(), 0,
+			       reinterpret_cast<const sockaddr*>(&clientAddr), clientAddrLength);
+		}
+	}
+
+	static bool ReceiveAll(int fd, uint8_t *buffer, size_t length)
+	{
+		while (length > 0)
+		{
+			const ssize_t received = recv(fd, buffer, length, 0);
+			if (received <= 0)
+			{
+				return false;
+			}
+
+			buffer += received;
+			length -= received;
+		}
+
+		return true;
+	}
+
+	void handleTCP()
+	{
+		const int fd = accept(m_tcpFD, nullptr, nullptr);
+		if (fd < 0)
+		{
+			return;
+		}
+
+		uint8_t buffer[514];
+		uint16_t id;
+		std::string name;
+
+		if (ReceiveAll(fd, buffer, 2))
+		{
+			const size_t length = (buffer[0] << 8) | buffer[1];
+
+			if (length <= sizeof buffer - 2 && ReceiveAll(fd, buffer + 2, length)
+			  && ParseQuery(buffer + 2, length, id, name))
+			{
+				for (const std::vector<uint8_t> & response : BuildResponses(id, name, countQuery(name, true), true))
+				{
+					std::vector<uint8_t> data;
+					Append16(data, response.size());
+					data.insert(data.end(), response.begin(), response.end());
+
+					send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+				}
+			}
+		}
+
+		close(fd);
+	}
+
+	void serverLoop()
+	{
+		pollfd fds[2] = {
+			{ m_udpFD, POLLIN, 0 },
+			{ m_tcpFD, POLLIN, 0 }
+		};
+
+		while (m_isRunning)
+		{
+			if (poll(fds, 2, 100) <= 0)
+			{
+				continue;
+			}
+
+			if (fds[0].revents & POLLIN)
+			{
+				handleUDP();
+			}
+
+			if (fds[1].revents & POLLIN)
+			{
+				handleTCP();
+			}
+		}
+	}
+
+public:
+	StubNameserver()
+	: m_udpFD(-1),
+	  m_tcpFD(-1),
+	  m_port(0),
+	  m_isRunning(),
+	  m_thread(),
+	  m_mutex(),
+	  m_udpQueryCounts(),
+	  m_tcpQueryCounts()
+	{
+	}
+
+	~StubNameserver()
+	{
+		stop();
+	}
+
+	bool start()
+	{
+		for (int attempt = 0; attempt < 16; attempt++)
+		{
+			closeSockets();
+
+			m_udpFD = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+			m_tcpFD = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+			if (m_udpFD >= 0 && m_tcpFD >= 0 && bindSockets())
+			{
+				m_isRunning = true;
+				m_thread = Thread("StubNameserver", [this]() -> void { serverLoop(); });
+
+				return true;
+			}
+		}
+
+		closeSockets();
+
+		return false;
+	}
+
+	void stop()
+	{
+		m_isRunning = false;
+		m_thread.join();
+		closeSockets();
+	}
+
+	uint16_t getPort() const
+	{
+		return m_port;
+	}
+
+	unsigned int getQueryCount(const std::string & name, bool isTCP)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		const std::map<std::string, unsigned int> & counts = (isTCP) ? m_tcpQueryCounts : m_udpQueryCounts;
+		auto it = counts.find(name);
+
+		return (it != counts.end()) ? it->second : 0;
+	}
+};
+
+struct Scenario
+{
+	const char *description;
+	const char *address;
+	const char *expectedHostname;
+	unsigned int expectedTTL;
+
+	bool isDone;
+	std::string hostname;
+	unsigned int ttl;
+};
+
+static std::string WriteTempFile(const char *name, const char *content)
+{
+	const char *tempDir = std::getenv("TMPDIR");
+	const std::string path = std::string((tempDir) ? tempDir : "/tmp") + "/conntop_test_" + name + "."
+	  + std::to_string(getpid());
+
+	std::ofstream file(path);
+	file << content;
+
+	return path;
+}
+
+static int RunTest()
+{
+	StubNameserver nameserver;
+	if (!nameserver.start())
+	{
+		std::fprintf(stderr, "FAIL: Unable to start stub nameserver\n");
+		return 1;
+	}
+
+	std::vector<Scenario> scenarios = {
+		{ "PTR answer",                 "192.0.2.1", "host.example.net",  300, false, "", 0 },
+		{ "NXDOMAIN with negative TTL", "192.0.2.2", "",                  120, false, "", 0 },
+		{ "Truncation and TCP",         "192.0.2.3", "tcp.example.net",   200, false, "", 0 },
+		{ "CNAME chain",                "192.0.2.4", "cname.example.net",  90, false, "", 0 },
+		{ "Retry after lost query",     "192.0.2.5", "retry.example.net", 300, false, "", 0 },
+		{ "Timeout",                    "192.0.2.6", "",                    0, false, "", 0 },
+		{ "ID and question mismatch",   "192.0.2.7", "valid.example.net", 300, false, "", 0 },
+		{ "Hosts file",                 "192.0.2.9", "hosts.example.net",   0, false, "", 0 }
+	};
+
+	std::mutex mutex;
+	std::condition_variable condition;
+	size_t doneCount = 0;
+
+	auto Callback = [&](std::string & hostname, unsigned int ttl, void *param) -> void
+	{
+		Scenario *pScenario = static_cast<Scenario*>(param);
+
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if (!pScenario->isDone)
+		{
+			pScenario->isDone = true;
+			pScenario->hostname = hostname;
+			pScenario->ttl = ttl;
+			doneCount++;
+		}
+
+		condition.notify_all();
+	};
+
+	ReverseDNS::Config config;
+	config.resolvConfFile = WriteTempFile("resolv.conf", RESOLV_CONF);
+	config.hostsFile = WriteTempFile("hosts", HOSTS);
+	config.nameserverPort = nameserver.getPort();
+
+	ReverseDNS reverseDNS(Callback, config);
+
+	unlink(config.resolvConfFile.c_str());
+	unlink(config.hostsFile.c_str());
+
+	if (!reverseDNS.isAvailable())
+	{
+		std::fprintf(stderr, "FAIL: Stub nameserver is not used\n");
+		return 1;
+	}
+
+	for (Scenario & scenario : scenarios)
+	{
+		reverseDNS.resolve(Address(AddressIP4::CreateFromString(scenario.address)), &scenario);
+	}
+
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		condition.wait_for(lock, RESULT_TIMEOUT, [&]() { return doneCount == scenarios.size(); });
+	}
+
+	reverseDNS.stop();
+	nameserver.stop();
+
+	int status = 0;
+
+	for (const Scenario & scenario : scenarios)
+	{
+		const bool isOK = scenario.isDone && scenario.hostname == scenario.expectedHostname
+		  && scenario.ttl == scenario.expectedTTL;
+
+		if (!scenario.isDone)
+		{
+			std::printf("FAIL: %s: no result\n", scenario.description);
+		}
+		else
+		{
+			std::printf("%s: %s: '%s' TTL %u (expected '%s' TTL %u)\n",
+			  (isOK) ? "OK" : "FAIL",
+			  scenario.description,
+			  scenario.hostname.c_str(),
+			  scenario.ttl,
+			  scenario.expectedHostname,
+			  scenario.expectedTTL
+			);
+		}
+
+		if (!isOK)
+		{
+			status = 1;
+		}
+	}
+
+	struct
+	{
+		const char *description;
+		const char *name;
+		bool isTCP;
+		unsigned int expectedCount;
+	}
+	const queryCounts[] = {
+		{ "Truncation and TCP UDP queries", "3.2.0.192.in-addr.arpa", false, 1 },
+		{ "Truncation and TCP TCP queries", "3.2.0.192.in-addr.arpa", true,  1 },
+		{ "Retry after lost query queries", "5.2.0.192.in-addr.arpa", false, 2 },
+		{ "Timeout queries",                "6.2.0.192.in-addr.arpa", false, 2 },
+		{ "Hosts file queries",             "9.2.0.192.in-addr.arpa", false, 0 }
+	};
+
+	for (const auto & expected : queryCounts)
+	{
+		const unsigned int count = nameserver.getQueryCount(expected.name, expected.isTCP);
+		const bool isOK = count == expected.expectedCount;
+
+		std::printf("%s: %s: %u (expected %u)\n",
+		  (isOK) ? "OK" : "FAIL",
+		  expected.description,
+		  count,
+		  expected.expectedCount
+		);
+
+		if (!isOK)
+		{
+			status = 1;
+		}
+	}
+
+	return status;
+}
+
+int main()
+{
+	Thread::SetCurrentThreadName("Main");
+
+	Log log(Log::VERBOSITY_NORMAL, Log::COLORIZE_NEVER, Log::STYLE_SIMPLE);
+	gLog = &log;
+
+	const int status = RunTest();
+
+	gLog = nullptr;
+
+	return status;
+}